@@ -29,16 +29,21 @@ std::unique_ptr<Pass> createInnerSerializationPass();
 std::unique_ptr<Pass> createSerializationPass();
 std::unique_ptr<Pass> replaceAffineCFGPass();
 std::unique_ptr<Pass> createOpenMPOptPass();
+std::unique_ptr<Pass> createSCFToOpenMPPass();
+std::unique_ptr<Pass> createOpenMPSchedulePass(bool remarks = false);
+std::unique_ptr<Pass> createOpenMPFirstTouchPass();
 std::unique_ptr<Pass> createCanonicalizeForPass();
 std::unique_ptr<Pass> createRaiseSCFToAffinePass();
 std::unique_ptr<Pass> createCPUifyPass(StringRef method = "");
 std::unique_ptr<Pass> createBarrierRemovalContinuation();
 std::unique_ptr<Pass> detectReductionPass();
+std::unique_ptr<Pass> createAffineParallelReductionPass(bool fastMath = false);
 std::unique_ptr<Pass> createRemoveTrivialUsePass();
 std::unique_ptr<Pass> createParallelLowerPass(
     bool wrapParallelOps = false,
     PolygeistGPUStructureMode gpuKernelStructureMode = PGSM_Discard);
-std::unique_ptr<Pass> createConvertCudaRTtoCPUPass();
+std::unique_ptr<Pass>
+createConvertCudaRTtoCPUPass(bool useRuntimeAllocator = false);
 std::unique_ptr<Pass> createConvertCudaRTtoGPUPass();
 std::unique_ptr<Pass> createConvertCudaRTtoHipRTPass();
 std::unique_ptr<Pass> createFixGPUFuncPass();
@@ -56,7 +61,16 @@ createConvertParallelToGPUPass2(bool emitGPUKernelLaunchBounds = true);
 std::unique_ptr<Pass> createMergeGPUModulesPass();
 std::unique_ptr<Pass> createConvertToOpaquePtrPass();
 std::unique_ptr<Pass> createLowerAlternativesPass();
+/// Writes what besides the IR decides the output of the alternatives
+/// lowering to \p os: environment overrides, the working directory the ids
+/// are derived from and, in pgo_opt mode, the merged profile. Tools caching
+/// their outputs add this to the cache key.
+void writeAlternativesCacheKey(llvm::raw_ostream &os);
 std::unique_ptr<Pass> createCollectKernelStatisticsPass();
+std::unique_ptr<Pass> createFixedPointPass();
+std::unique_ptr<Pass>
+createFixedPointPass(SmallVector<std::unique_ptr<Pass>> passes,
+                     unsigned maxIterations = 10);
 std::unique_ptr<Pass> createPolygeistCanonicalizePass();
 std::unique_ptr<Pass>
 createPolygeistCanonicalizePass(const GreedyRewriteConfig &config,
@@ -127,6 +141,14 @@ namespace LLVM {
 class LLVMDialect;
 }
 
+namespace ROCDL {
+class ROCDLDialect;
+}
+
+namespace async {
+class AsyncDialect;
+}
+
 #define GEN_PASS_REGISTRATION
 #include "polygeist/Passes/Passes.h.inc"
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
+#include "mlir/Dialect/OpenMP/OpenMPDialect.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/IntegerSet.h"
 
@@ -141,3 +143,39 @@ static inline bool hasElse(mlir::scf::IfOp op) {
 static inline bool hasElse(mlir::affine::AffineIfOp op) {
   return op.getElseRegion().getBlocks().size() > 0;
 }
+
+/// Returns the number of iterations from \p lb to \p ub, including \p ub
+/// with \p inclusive, or std::nullopt unless the bounds are constants and the
+/// step a positive constant.
+static inline std::optional<int64_t> getConstantTripCount(mlir::Value lb,
+                                                          mlir::Value ub,
+                                                          mlir::Value step,
+                                                          bool inclusive) {
+  auto lbCst = mlir::getConstantIntValue(lb);
+  auto ubCst = mlir::getConstantIntValue(ub);
+  auto stepCst = mlir::getConstantIntValue(step);
+  if (!lbCst || !ubCst || !stepCst || *stepCst <= 0)
+    return std::nullopt;
+  int64_t end = *ubCst + (inclusive ? 1 : 0);
+  if (end <= *lbCst)
+    return 0;
+  return (end - *lbCst + *stepCst - 1) / *stepCst;
+}
+static inline std::optional<int64_t>
+getConstantTripCount(mlir::scf::ForOp op) {
+  return getConstantTripCount(op.getLowerBound(), op.getUpperBound(),
+                              op.getStep(), /*inclusive*/ false);
+}
+/// Returns the number of iterations of all dimensions of \p op together.
+static inline std::optional<int64_t>
+getConstantTripCount(mlir::omp::WsLoopOp op) {
+  int64_t tripCount = 1;
+  for (auto [lb, ub, step] :
+       llvm::zip(op.getLowerBound(), op.getUpperBound(), op.getStep())) {
+    auto trip = getConstantTripCount(lb, ub, step, op.getInclusive());
+    if (!trip)
+      return std::nullopt;
+    tripCount *= *trip;
+  }
+  return tripCount;
+}
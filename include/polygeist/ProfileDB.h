@@ -0,0 +1,366 @@
+//===- ProfileDB.h - Profiles of kernel alternatives ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The profile of the alternatives of kernels, which the PGO runtime writes and
+// LowerAlternatives reads. All runs of all kernels go to a single file that
+// starts with a header followed by fixed-size records sorted by kernel, size
+// class and alternative, so that the records of a kernel are found by binary
+// search directly in the mapped file. The names of the kernels follow the
+// records, for tools only.
+//
+// Every record keeps the count, mean and variance of the timings as well as a
+// histogram with logarithmic bins, from which quantiles such as the median
+// are estimated. All of them can be merged exactly, so the profiles of
+// several runs or machines can be combined.
+//
+// This header only uses the standard library, as the runtime includes it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef POLYGEIST_PROFILEDB_H
+#define POLYGEIST_PROFILEDB_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace mlir {
+namespace polygeist {
+namespace pgo {
+
+constexpr char kProfileMagic[8] = {'P', 'G', 'O', 'P', 'R', 'O', 'F', '\0'};
+constexpr uint32_t kProfileVersion = 1;
+constexpr const char *kProfileFileName = "profile.db";
+
+/// Bins per doubling of the time, which bounds the error of the estimated
+/// quantiles to about 4%.
+constexpr unsigned kBinsPerOctave = 8;
+/// Covers 1ns up to about three days.
+constexpr unsigned kNumBins = 48 * kBinsPerOctave;
+
+struct ProfileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t numRecords;
+  /// Where the names of the kernels start, after the records.
+  uint64_t namesOffset;
+  uint64_t numNames;
+};
+
+/// The timings of one alternative of a kernel for inputs of one size class.
+struct ProfileRecord {
+  uint64_t kernel;
+  uint32_t sizeClass;
+  uint32_t alternative;
+  uint64_t count;
+  /// The mean, minimum and maximum time in seconds.
+  double mean;
+  double min;
+  double max;
+  /// The sum of the squared differences from the mean.
+  double m2;
+  uint32_t bins[kNumBins];
+};
+
+/// Returns the id a kernel has in profiles and in the runtime, given the
+/// xxHash64 \p nameHash of its polygeist.altop.id. 0 marks free entries in
+/// the runtime, so it is never an id. The hash is computed by the callers, as
+/// this header does not depend on LLVM.
+inline uint64_t getKernelId(uint64_t nameHash) {
+  return nameHash ? nameHash : 1;
+}
+
+/// Returns the size class of a problem of \p size, floor(log2(size)) + 1,
+/// with class 0 for kernels whose size is not known.
+inline uint32_t getSizeClass(uint64_t size) {
+  uint32_t sizeClass = 0;
+  for (; size; size >>= 1)
+    sizeClass++;
+  return sizeClass;
+}
+
+inline unsigned getBin(double seconds) {
+  double nanos = seconds * 1e9;
+  if (!(nanos > 1))
+    return 0;
+  return std::min<unsigned>(std::log2(nanos) * kBinsPerOctave, kNumBins - 1);
+}
+
+inline ProfileRecord createRecord(uint64_t kernel, uint32_t sizeClass,
+                                  uint32_t alternative) {
+  ProfileRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kernel = kernel;
+  record.sizeClass = sizeClass;
+  record.alternative = alternative;
+  return record;
+}
+
+inline void addSample(ProfileRecord &record, double seconds) {
+  record.min = record.count ? std::min(record.min, seconds) : seconds;
+  record.max = record.count ? std::max(record.max, seconds) : seconds;
+  record.count++;
+  double delta = seconds - record.mean;
+  record.mean += delta / record.count;
+  record.m2 += delta * (seconds - record.mean);
+  record.bins[getBin(seconds)]++;
+}
+
+inline void mergeRecords(ProfileRecord &into, const ProfileRecord &from) {
+  if (!from.count)
+    return;
+  if (!into.count) {
+    uint64_t kernel = into.kernel;
+    uint32_t sizeClass = into.sizeClass, alternative = into.alternative;
+    into = from;
+    into.kernel = kernel;
+    into.sizeClass = sizeClass;
+    into.alternative = alternative;
+    return;
+  }
+  double count = into.count + from.count;
+  double delta = from.mean - into.mean;
+  into.mean += delta * from.count / count;
+  into.m2 += from.m2 + delta * delta * into.count * from.count / count;
+  into.min = std::min(into.min, from.min);
+  into.max = std::max(into.max, from.max);
+  into.count += from.count;
+  for (unsigned i = 0; i < kNumBins; i++)
+    into.bins[i] += from.bins[i];
+}
+
+inline double getVariance(const ProfileRecord &record) {
+  return record.count > 1 ? record.m2 / (record.count - 1) : 0;
+}
+
+/// Estimates the \p q quantile of the timings, interpolating within the bin
+/// that holds it.
+inline double getQuantile(const ProfileRecord &record, double q) {
+  if (!record.count)
+    return 0;
+  double rank = q * record.count, seen = 0;
+  for (unsigned i = 0; i < kNumBins; i++) {
+    if (!record.bins[i] || seen + record.bins[i] < rank) {
+      seen += record.bins[i];
+      continue;
+    }
+    double fraction = (rank - seen) / record.bins[i];
+    double value = std::exp2((i + fraction) / kBinsPerOctave) * 1e-9;
+    return std::min(std::max(value, record.min), record.max);
+  }
+  return record.max;
+}
+
+inline double getMedian(const ProfileRecord &record) {
+  return getQuantile(record, 0.5);
+}
+
+/// Returns the standard error of the median, from the spread of the middle
+/// half of the timings, which outliers do not inflate.
+inline double getMedianError(const ProfileRecord &record) {
+  if (!record.count)
+    return INFINITY;
+  double sigma =
+      (getQuantile(record, 0.75) - getQuantile(record, 0.25)) / 1.349;
+  if (!(sigma > 0))
+    sigma = std::sqrt(getVariance(record));
+  return 1.2533 * sigma / std::sqrt((double)record.count);
+}
+
+/// Returns z such that a standard normal variable is below z with
+/// probability \p confidence.
+inline double getZScore(double confidence) {
+  double lo = -10, hi = 10;
+  for (int i = 0; i < 100; i++) {
+    double mid = (lo + hi) / 2;
+    if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < confidence)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/// Picks an alternative from \p records, the timings of every alternative
+/// indexed by alternative. The alternative with the lowest median wins only
+/// if it is faster than every other one with \p confidence. Otherwise the
+/// first of the alternatives that are about as fast is picked, so that noise
+/// does not change the choice from one profile to the next. Alternatives with
+/// fewer than \p minSamples timings are only considered when no alternative
+/// has as many. Returns -1 when there are no timings at all.
+inline int selectAlternative(const std::vector<ProfileRecord> &records,
+                             double confidence, uint64_t minSamples) {
+  uint64_t required = std::max<uint64_t>(minSamples, 1);
+  if (std::none_of(records.begin(), records.end(),
+                   [&](const ProfileRecord &r) { return r.count >= required; }))
+    required = 1;
+
+  int best = -1;
+  for (int i = 0, e = records.size(); i < e; i++)
+    if (records[i].count >= required &&
+        (best < 0 || getMedian(records[i]) < getMedian(records[best])))
+      best = i;
+  if (best < 0)
+    return -1;
+
+  double z = getZScore(confidence);
+  double bestError = getMedianError(records[best]);
+  for (int i = 0; i < best; i++) {
+    if (records[i].count < required)
+      continue;
+    double error = std::sqrt(bestError * bestError +
+                             std::pow(getMedianError(records[i]), 2));
+    if (getMedian(records[i]) - getMedian(records[best]) <= z * error)
+      return i;
+  }
+  return best;
+}
+
+/// A profile in memory, such as a mapped file, which is used in place.
+class ProfileView {
+public:
+  /// Returns whether \p data holds a valid profile.
+  bool init(const char *data, size_t size) {
+    if (size < sizeof(ProfileHeader))
+      return false;
+    auto *header = reinterpret_cast<const ProfileHeader *>(data);
+    if (memcmp(header->magic, kProfileMagic, sizeof(kProfileMagic)) ||
+        header->version != kProfileVersion ||
+        header->recordSize != sizeof(ProfileRecord) ||
+        header->numRecords > (size - sizeof(ProfileHeader)) /
+                                 sizeof(ProfileRecord) ||
+        header->namesOffset < sizeof(ProfileHeader) +
+                                  header->numRecords * sizeof(ProfileRecord) ||
+        header->namesOffset > size)
+      return false;
+    this->header = header;
+    this->data = data;
+    this->size = size;
+    records = reinterpret_cast<const ProfileRecord *>(header + 1);
+    return true;
+  }
+
+  const ProfileRecord *begin() const { return records; }
+  const ProfileRecord *end() const { return records + header->numRecords; }
+
+  /// Returns the records of \p kernel.
+  std::pair<const ProfileRecord *, const ProfileRecord *>
+  lookup(uint64_t kernel) const {
+    auto less = [](const ProfileRecord &r, uint64_t k) { return r.kernel < k; };
+    auto greater = [](uint64_t k, const ProfileRecord &r) {
+      return k < r.kernel;
+    };
+    return {std::lower_bound(begin(), end(), kernel, less),
+            std::upper_bound(begin(), end(), kernel, greater)};
+  }
+
+  /// Returns the names of the kernels by id.
+  std::map<uint64_t, std::string> getNames() const {
+    std::map<uint64_t, std::string> names;
+    size_t offset = header->namesOffset;
+    for (uint64_t i = 0; i < header->numNames; i++) {
+      uint64_t kernel;
+      uint32_t length;
+      if (offset + sizeof(kernel) + sizeof(length) > size)
+        break;
+      memcpy(&kernel, data + offset, sizeof(kernel));
+      memcpy(&length, data + offset + sizeof(kernel), sizeof(length));
+      offset += sizeof(kernel) + sizeof(length);
+      if (offset + length > size)
+        break;
+      names[kernel] = std::string(data + offset, length);
+      offset += length;
+    }
+    return names;
+  }
+
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+  const ProfileHeader *header = nullptr;
+  const ProfileRecord *records = nullptr;
+};
+
+/// A profile that is being built, from timings or other profiles.
+class ProfileDB {
+public:
+  void addSample(uint64_t kernel, uint32_t sizeClass, uint32_t alternative,
+                 double seconds) {
+    pgo::addSample(getRecord(kernel, sizeClass, alternative), seconds);
+  }
+
+  void setName(uint64_t kernel, const std::string &name) {
+    names[kernel] = name;
+  }
+
+  void merge(const ProfileView &view) {
+    for (const ProfileRecord &record : view)
+      mergeRecords(getRecord(record.kernel, record.sizeClass,
+                             record.alternative),
+                   record);
+    for (auto &name : view.getNames())
+      names.insert(name);
+  }
+
+  bool empty() const { return records.empty(); }
+
+  /// Returns the file contents of the profile.
+  std::string serialize() const {
+    ProfileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kProfileMagic, sizeof(kProfileMagic));
+    header.version = kProfileVersion;
+    header.recordSize = sizeof(ProfileRecord);
+    header.numRecords = records.size();
+    header.namesOffset =
+        sizeof(ProfileHeader) + records.size() * sizeof(ProfileRecord);
+    header.numNames = names.size();
+
+    std::string result(reinterpret_cast<const char *>(&header),
+                       sizeof(header));
+    for (auto &pair : records)
+      result.append(reinterpret_cast<const char *>(&pair.second),
+                    sizeof(ProfileRecord));
+    for (auto &pair : names) {
+      uint32_t length = pair.second.size();
+      result.append(reinterpret_cast<const char *>(&pair.first),
+                    sizeof(pair.first));
+      result.append(reinterpret_cast<const char *>(&length), sizeof(length));
+      result.append(pair.second);
+    }
+    return result;
+  }
+
+private:
+  ProfileRecord &getRecord(uint64_t kernel, uint32_t sizeClass,
+                           uint32_t alternative) {
+    auto key = std::make_tuple(kernel, sizeClass, alternative);
+    auto it = records.find(key);
+    if (it == records.end())
+      it = records
+               .emplace(key, createRecord(kernel, sizeClass, alternative))
+               .first;
+    return it->second;
+  }
+
+  std::map<std::tuple<uint64_t, uint32_t, uint32_t>, ProfileRecord> records;
+  std::map<uint64_t, std::string> names;
+};
+
+} // namespace pgo
+} // namespace polygeist
+} // namespace mlir
+
+#endif // POLYGEIST_PROFILEDB_H
@@ -0,0 +1,15 @@
+//===- CpuPGORuntimeWrappers.cpp - Profiling of kernels on the CPU --------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Implements the profiling hooks of the alternatives of kernels lowered to the
+// CPU. Unlike the rest of the CPU runtime they need the C++ standard library,
+// so cgeist only links them into programs that call them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PGORuntime.h"
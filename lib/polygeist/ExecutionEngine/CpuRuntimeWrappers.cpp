@@ -0,0 +1,157 @@
+//===- CpuRuntimeWrappers.cpp - Runtime for kernels lowered to the CPU ----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Implements the runtime functions that code generated for kernels lowered to
+// the CPU calls, such as the allocator that replaces cudaMalloc, without
+// depending on a GPU runtime. This is linked into C programs, so it must not
+// depend on the C++ standard library either. The profiling hooks of kernel
+// alternatives, which do, are in CpuPGORuntimeWrappers.cpp.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifdef _WIN32
+#define MLIR_CPU_WRAPPERS_EXPORT __declspec(dllexport) __attribute__((weak))
+#else
+#define MLIR_CPU_WRAPPERS_EXPORT __attribute__((weak))
+#endif // _WIN32
+
+// A kernel on the CPU is done once it returns.
+extern "C" MLIR_CPU_WRAPPERS_EXPORT int32_t mgpurtDeviceSynchronizeErr(void) {
+  return 0;
+}
+
+namespace {
+/// A caching allocator for the memory that CUDA code allocates with
+/// cudaMalloc. Such code often allocates and frees scratch buffers in every
+/// iteration of its main loop, which on the CPU costs a system call and a page
+/// fault for every page of large buffers each time. Instead, sizes are rounded
+/// up to one of four size classes per doubling, and freed blocks are kept on
+/// the free list of their class until a block of the same class is requested
+/// again. Memory is never returned to the operating system.
+///
+/// Blocks are aligned to cache lines. Large blocks are mapped separately, and
+/// are backed by transparent huge pages if POLYGEIST_CPU_HUGE_PAGES_ENV_VAR is
+/// set in the environment.
+class CpuAllocator {
+public:
+  static constexpr uint64_t kAlignment = 64;
+  static constexpr uint64_t kHugePageSize = 2 << 20;
+  static constexpr unsigned kClassesPerOctave = 4;
+  /// Up to 2^48 bytes.
+  static constexpr unsigned kNumClasses = 42 * kClassesPerOctave + 1;
+
+  static CpuAllocator &get() {
+    // Never destroyed, as memory may still be freed while other globals are
+    // destroyed. Statics with dynamic initialization would need the guards
+    // of the C++ runtime.
+    alignas(CpuAllocator) static char storage[sizeof(CpuAllocator)];
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, [] { new (storage) CpuAllocator(); });
+    return *reinterpret_cast<CpuAllocator *>(storage);
+  }
+
+  void *allocate(uint64_t size) {
+    uint64_t classSize;
+    unsigned sizeClass = getSizeClass(size, classSize);
+    if (sizeClass >= kNumClasses)
+      return nullptr;
+
+    FreeList &list = lists[sizeClass];
+    pthread_mutex_lock(&list.mutex);
+    Header *header = list.head;
+    if (header)
+      list.head = header->next;
+    pthread_mutex_unlock(&list.mutex);
+    if (header)
+      return header + 1;
+
+    uint64_t bytes = sizeof(Header) + classSize;
+    void *memory;
+    if (bytes >= kHugePageSize) {
+      memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED)
+        return nullptr;
+#ifdef MADV_HUGEPAGE
+      if (hugePages)
+        madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+    } else if (posix_memalign(&memory, kAlignment, bytes)) {
+      return nullptr;
+    }
+    header = static_cast<Header *>(memory);
+    header->sizeClass = sizeClass;
+    return header + 1;
+  }
+
+  void deallocate(void *ptr) {
+    if (!ptr)
+      return;
+    Header *header = static_cast<Header *>(ptr) - 1;
+    FreeList &list = lists[header->sizeClass];
+    pthread_mutex_lock(&list.mutex);
+    header->next = list.head;
+    list.head = header;
+    pthread_mutex_unlock(&list.mutex);
+  }
+
+  /// Returns the size class of a block of \p size bytes, and the bytes such a
+  /// block holds in \p classSize. Sizes above 2^48 bytes return kNumClasses
+  /// and leave \p classSize unset.
+  static unsigned getSizeClass(uint64_t size, uint64_t &classSize) {
+    if (size <= kAlignment) {
+      classSize = kAlignment;
+      return 0;
+    }
+    if (size > (1ull << 48))
+      return kNumClasses;
+    // size - 1 is in [2^log, 2^(log+1)), which the classes split in four steps
+    // of 2^(log-2).
+    unsigned log = 63 - __builtin_clzll(size - 1);
+    unsigned shift = log - 2;
+    uint64_t steps = ((size - 1) >> shift) + 1;
+    classSize = steps << shift;
+    return (log - 6) * kClassesPerOctave + (steps - 4);
+  }
+
+private:
+  /// Precedes every block, so that the memory after it stays aligned.
+  struct alignas(kAlignment) Header {
+    Header *next;
+    unsigned sizeClass;
+  };
+
+  struct FreeList {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    Header *head = nullptr;
+  };
+
+  CpuAllocator() {
+    const char *env = getenv(POLYGEIST_CPU_HUGE_PAGES_ENV_VAR);
+    hugePages = env && *env && *env != '0';
+  }
+
+  FreeList lists[kNumClasses];
+  bool hugePages;
+};
+} // namespace
+
+extern "C" MLIR_CPU_WRAPPERS_EXPORT void *mgpurtCpuMalloc(uint64_t size) {
+  return CpuAllocator::get().allocate(size);
+}
+
+extern "C" MLIR_CPU_WRAPPERS_EXPORT void mgpurtCpuFree(void *ptr) {
+  CpuAllocator::get().deallocate(ptr);
+}
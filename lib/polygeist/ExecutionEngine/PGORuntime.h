@@ -4,16 +4,35 @@
 // PGO functions which should know whether the code in the alternatives op is
 // GPU code - we can add an attrib to the alternatives op for that
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
+#include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "polygeist/ProfileDB.h"
+
 extern "C" int32_t mgpurtDeviceSynchronizeErr(void);
 
 #ifdef _WIN32
@@ -22,134 +41,445 @@ extern "C" int32_t mgpurtDeviceSynchronizeErr(void);
 #define MLIR_PGO_WRAPPERS_EXPORT __attribute__((weak))
 #endif // _WIN32
 
-class PGOState {
+/// Nanoseconds since an arbitrary point. CLOCK_MONOTONIC_RAW is not slewed
+/// while NTP adjusts the system time, which would skew short kernels.
+static inline uint64_t pgoNow() {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Waits a little in a spin loop that has run \p spins times so far. The
+/// first iterations only tell the core that it is spinning, later ones give
+/// the processor to other threads, which the one being waited for may need.
+static inline void pgoSpinWait(unsigned spins) {
+  if (spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+    return;
+  }
+  std::this_thread::yield();
+}
+
+/// Picks the alternative of every kernel while the program runs, instead of
+/// running the whole program once per alternative. Every kernel explores its
+/// alternatives during its first invocations, times them and then keeps the
+/// fastest one. Enabled by setting POLYGEIST_PGO_POLICY_ENV_VAR to
+///
+///   round-robin[:<runs>]   run every alternative <runs> times in turn, 3 by
+///                          default,
+///   bandit[:<runs>]        spend <runs> invocations per alternative, 20 by
+///                          default, mostly on the ones that were fast so far
+///                          while still trying the others as long as their
+///                          timings are uncertain.
+///
+/// With POLYGEIST_PGO_PERSIST_ENV_VAR set, the choices are saved at exit and
+/// kernels that have a saved choice use it right away in the next run.
+class PGOAdaptive {
 public:
-  enum Type { Start, End };
-  struct State {
-    struct timespec start_clock;
-  };
+  enum class Policy { RoundRobin, Bandit };
 
-  struct Logger {
-    std::map<std::string, std::vector<double>> timings;
-    ~Logger() { PGOState::writeResults(); }
+  struct Site {
+    std::mutex mutex;
+    std::vector<unsigned> runs;
+    std::vector<double> totals;
+    unsigned invocations = 0;
+    /// Set once exploring is over, after which the site is only read.
+    std::atomic<int> chosen{-1};
   };
 
-  inline static int alternative;
-  inline static std::string dirname;
-  inline thread_local static std::mutex mutex;
-  inline thread_local static std::map<std::string, State *> states;
-  inline static Logger logger;
+  bool isEnabled() const { return enabled; }
 
-  const char *kernelId_c;
-  int totalAlternatives;
+  /// Reads the policy from the environment, and the saved choices from
+  /// \p dirname.
+  void init(const std::string &dirname) {
+    const char *p = getenv(POLYGEIST_PGO_POLICY_ENV_VAR);
+    if (!p)
+      return;
+    std::string spec = p;
+    std::string name = spec.substr(0, spec.find(':'));
+    if (name == "round-robin") {
+      policy = Policy::RoundRobin;
+      budget = 3;
+    } else if (name == "bandit") {
+      policy = Policy::Bandit;
+      budget = 20;
+    } else {
+      std::cerr << "Unknown " << POLYGEIST_PGO_POLICY_ENV_VAR << " " << spec
+                << ", expected round-robin[:<runs>] or bandit[:<runs>]"
+                << std::endl;
+      exit(1);
+    }
+    if (spec.find(':') != std::string::npos)
+      budget = std::max(1, atoi(spec.c_str() + spec.find(':') + 1));
+    enabled = true;
 
-  std::string getKernelId() {
-    std::string kernelId = kernelId_c;
-    for (char &c : kernelId)
-      if (c == '/')
-        c = '+';
-    return kernelId;
+    this->dirname = dirname;
+    const char *e = getenv(POLYGEIST_PGO_PERSIST_ENV_VAR);
+    persist = e && strcmp(e, "0") != 0;
+    if (persist) {
+      std::ifstream ifile(getChoicesFile());
+      std::string kernelName;
+      int alternative;
+      while (ifile >> kernelName >> alternative)
+        saved[kernelName] = alternative;
+    }
   }
 
-  PGOState(const char *kernelId_c, int totalAlternatives)
-      : totalAlternatives(totalAlternatives) {
-    this->kernelId_c = kernelId_c;
+  /// Creates the site of a kernel when it is first seen.
+  Site *createSite(const std::string &kernelName, int totalAlternatives) {
+    auto site = std::make_unique<Site>();
+    site->runs.assign(totalAlternatives, 0);
+    site->totals.assign(totalAlternatives, 0);
+    std::unique_lock<std::mutex> lock(sitesMutex);
+    auto it = saved.find(kernelName);
+    if (it != saved.end() && it->second < totalAlternatives)
+      site->chosen = it->second;
+    sites.emplace_back(kernelName, std::move(site));
+    return sites.back().second.get();
   }
-  void end() {
-    struct timespec end_clock;
-    mgpurtDeviceSynchronizeErr();
-    clock_gettime(CLOCK_MONOTONIC, &end_clock);
 
-    auto kernelId = getKernelId();
-    std::unique_lock<std::mutex> lock(mutex);
-    if (states.count(kernelId) == 0) {
-      std::cerr << "No kernel with id " << kernelId << "running" << std::endl;
-      exit(1);
+  int choose(Site &site) {
+    int alternative = site.chosen.load(std::memory_order_acquire);
+    if (alternative >= 0)
+      return alternative;
+    std::unique_lock<std::mutex> lock(site.mutex);
+    alternative = site.chosen.load(std::memory_order_relaxed);
+    if (alternative < 0)
+      alternative = policy == Policy::RoundRobin ? exploreRoundRobin(site)
+                                                 : exploreBandit(site);
+    site.invocations++;
+    return alternative;
+  }
+
+  void record(Site &site, int alternative, double elapsed) {
+    if (site.chosen.load(std::memory_order_acquire) >= 0)
+      return;
+    std::unique_lock<std::mutex> lock(site.mutex);
+    if (site.chosen.load(std::memory_order_relaxed) >= 0 ||
+        alternative >= (int)site.runs.size())
+      return;
+    site.runs[alternative]++;
+    site.totals[alternative] += elapsed;
+    if (site.invocations >= budget * site.runs.size() &&
+        std::all_of(site.runs.begin(), site.runs.end(),
+                    [](unsigned runs) { return runs > 0; }))
+      site.chosen.store(getFastest(site), std::memory_order_release);
+  }
+
+  ~PGOAdaptive() {
+    if (!persist)
+      return;
+    std::ofstream ofile(getChoicesFile(), std::ios::out | std::ios::trunc);
+    for (auto &pair : sites) {
+      Site &site = *pair.second;
+      int alternative = site.chosen;
+      if (alternative < 0 && site.invocations)
+        alternative = getFastest(site);
+      if (alternative >= 0)
+        ofile << pair.first << " " << alternative << "\n";
     }
-    State *state = states[kernelId];
-    struct timespec tmp_clock {
-      end_clock.tv_sec - state->start_clock.tv_sec,
-          end_clock.tv_nsec - state->start_clock.tv_nsec
-    };
-    double elapsed =
-        (tmp_clock.tv_sec + ((double)tmp_clock.tv_nsec) * .000000001);
+  }
 
-    if (states.count(kernelId) == 0)
-      logger.timings[kernelId] = {};
-    logger.timings[kernelId].push_back(elapsed);
+private:
+  std::string getChoicesFile() const {
+    return dirname + "/adaptive.choices";
+  }
 
-    delete state;
-    states.erase(states.find(kernelId));
+  static double getMean(const Site &site, int alternative) {
+    return site.totals[alternative] / site.runs[alternative];
   }
 
-  void start() {
-    auto kernelId = getKernelId();
-    std::unique_lock<std::mutex> lock(mutex);
-    State *state = new State();
-    if (states.count(kernelId) == 1) {
-      std::cerr << "Two kernels with id " << kernelId
-                << "running at the same time" << std::endl;
-      exit(1);
+  static int getFastest(const Site &site) {
+    int best = -1;
+    for (int i = 0, e = site.runs.size(); i < e; i++)
+      if (site.runs[i] &&
+          (best < 0 || getMean(site, i) < getMean(site, best)))
+        best = i;
+    return best;
+  }
+
+  int exploreRoundRobin(Site &site) {
+    return site.invocations % site.runs.size();
+  }
+
+  /// Picks the alternative with the lowest optimistic estimate of its time,
+  /// its mean relative to the fastest one so far minus a bonus that shrinks
+  /// as it runs more often (UCB1).
+  int exploreBandit(Site &site) {
+    int numAlternatives = site.runs.size();
+    for (int i = 0; i < numAlternatives; i++)
+      if (!site.runs[i])
+        return i;
+    double fastest = getMean(site, getFastest(site));
+    unsigned total =
+        std::accumulate(site.runs.begin(), site.runs.end(), 0u);
+    int best = 0;
+    double bestBound = INFINITY;
+    for (int i = 0; i < numAlternatives; i++) {
+      double bound = getMean(site, i) / fastest -
+                     std::sqrt(2 * std::log((double)total) / site.runs[i]);
+      if (bound < bestBound) {
+        bestBound = bound;
+        best = i;
+      }
     }
-    states[kernelId] = state;
-    // Start timing
-    mgpurtDeviceSynchronizeErr();
-    clock_gettime(CLOCK_MONOTONIC, &state->start_clock);
-  }
-
-  static void writeResults() {
-    // Only write to file if we are profiling a valid alternative
-    for (auto &pair : logger.timings) {
-      auto &kernelId = std::get<0>(pair);
-      auto &timings = std::get<1>(pair);
-      auto elapsed = std::accumulate(timings.begin(), timings.end(), 0.0f);
-      // TODO error handling
-      std::ofstream ofile;
-      ofile.open(std::string(dirname) + "/" + kernelId,
-                 std::ios::out | std::ios::app);
-      ofile << alternative << " " << elapsed << std::endl;
-      ofile.close();
+    return best;
+  }
+
+  bool enabled = false;
+  bool persist = false;
+  Policy policy = Policy::RoundRobin;
+  unsigned budget = 0;
+  std::string dirname;
+  std::map<std::string, int> saved;
+  std::mutex sitesMutex;
+  std::vector<std::pair<std::string, std::unique_ptr<Site>>> sites;
+};
+
+/// Times the alternatives of kernels. Kernels are identified by a 64-bit id
+/// the compiler derives from their location, and looked up in a fixed table
+/// without locking. Every thread appends its timings to its own buffer, which
+/// are merged into the profile database when the program exits, so that
+/// timing a kernel neither allocates nor synchronizes with other threads, and
+/// the same kernel may run on several threads at once.
+class PGOProfiler {
+public:
+  /// The size of the kernel table. A program that runs more distinct kernels
+  /// with alternatives prints an error and exits when the first kernel that
+  /// does not fit is seen, since its timings could not be recorded.
+  static constexpr unsigned kMaxKernels = 1 << 12;
+
+  struct Kernel {
+    /// The id of the kernel, or 0 while the entry is free.
+    std::atomic<uint64_t> id{0};
+    /// Set once the fields below are initialized.
+    std::atomic<bool> ready{false};
+    const char *name = nullptr;
+    int totalAlternatives = 0;
+    PGOAdaptive::Site *site = nullptr;
+  };
+
+  struct Sample {
+    uint32_t kernel;
+    uint16_t alternative;
+    uint16_t sizeClass;
+    uint64_t elapsed;
+  };
+
+  /// The samples of one thread. Only the owning thread appends, and it
+  /// publishes every sample through the size of its chunk, so that the
+  /// buffers can be read at exit while other threads keep running.
+  struct Buffer {
+    static constexpr size_t kChunkSize = 4096;
+    struct Chunk {
+      Sample samples[kChunkSize];
+      std::atomic<size_t> size{0};
+      std::atomic<Chunk *> next{nullptr};
+    };
+    Chunk head;
+    Chunk *tail = &head;
+    Buffer *next = nullptr;
+
+    void append(const Sample &sample) {
+      size_t size = tail->size.load(std::memory_order_relaxed);
+      if (size == kChunkSize) {
+        Chunk *chunk = new Chunk();
+        tail->next.store(chunk, std::memory_order_release);
+        tail = chunk;
+        size = 0;
+      }
+      tail->samples[size] = sample;
+      tail->size.store(size + 1, std::memory_order_release);
     }
+  };
+
+  static PGOProfiler &get() {
+    static PGOProfiler profiler;
+    return profiler;
   }
 
-  int getAlternative() {
-    static int init = [&] {
-      if (char *i = getenv(POLYGEIST_PGO_ALTERNATIVE_ENV_VAR)) {
-        this->alternative = atoi(i);
-      } else {
-        std::cerr << POLYGEIST_PGO_ALTERNATIVE_ENV_VAR << " not defined"
-                  << std::endl;
-        exit(1);
+  /// Returns the entry of the kernel \p id, which is created with \p name
+  /// and \p totalAlternatives when the kernel is first seen. Exits the
+  /// program when the table is full, see kMaxKernels.
+  Kernel &getKernel(uint64_t id, const char *name = nullptr,
+                    int totalAlternatives = 0) {
+    for (unsigned i = id % kMaxKernels, n = 0; n < kMaxKernels;
+         i = (i + 1) % kMaxKernels, n++) {
+      Kernel &kernel = kernels[i];
+      uint64_t found = kernel.id.load(std::memory_order_acquire);
+      if (found == 0 && name &&
+          kernel.id.compare_exchange_strong(found, id,
+                                            std::memory_order_acq_rel)) {
+        kernel.name = name;
+        kernel.totalAlternatives = totalAlternatives;
+        if (adaptive.isEnabled())
+          kernel.site = adaptive.createSite(getFileName(name),
+                                            totalAlternatives);
+        kernel.ready.store(true, std::memory_order_release);
+        return kernel;
       }
-      if (char *d = getenv(POLYGEIST_PGO_DATA_DIR_ENV_VAR)) {
-        this->dirname = d;
-      } else {
-        this->dirname = POLYGEIST_PGO_DEFAULT_DATA_DIR;
+      if (found == id) {
+        // Another thread may still be creating the entry, which takes a
+        // lock when adaptive policies are enabled.
+        for (unsigned spins = 0;
+             !kernel.ready.load(std::memory_order_acquire); spins++)
+          pgoSpinWait(spins);
+        return kernel;
       }
-      std::filesystem::create_directories(dirname);
+      if (found == 0)
+        break;
+    }
+    if (name)
+      std::cerr << "More than " << kMaxKernels
+                << " profiled kernels, cannot profile " << name << std::endl;
+    else
+      std::cerr << "No kernel with id " << id << " running" << std::endl;
+    exit(1);
+  }
+
+  int getAlternative(Kernel &kernel) {
+    if (kernel.site)
+      return adaptive.choose(*kernel.site);
+    return alternative % kernel.totalAlternatives;
+  }
 
-      return 0;
-    }();
-    return alternative % totalAlternatives;
+  uint64_t start() {
+    mgpurtDeviceSynchronizeErr();
+    return pgoNow();
+  }
+
+  void end(uint64_t id, int alternative, uint64_t start, uint64_t size) {
+    mgpurtDeviceSynchronizeErr();
+    uint64_t elapsed = pgoNow() - start;
+
+    Kernel &kernel = getKernel(id);
+    getBuffer().append({(uint32_t)(&kernel - kernels), (uint16_t)alternative,
+                        (uint16_t)mlir::polygeist::pgo::getSizeClass(size),
+                        elapsed});
+    if (kernel.site)
+      adaptive.record(*kernel.site, alternative, elapsed * 1e-9);
+  }
+
+  ~PGOProfiler() { writeResults(); }
+
+private:
+  PGOProfiler() {
+    if (char *d = getenv(POLYGEIST_PGO_DATA_DIR_ENV_VAR)) {
+      dirname = d;
+    } else {
+      dirname = POLYGEIST_PGO_DEFAULT_DATA_DIR;
+    }
+    std::filesystem::create_directories(dirname);
+    adaptive.init(dirname);
+    if (adaptive.isEnabled())
+      return;
+    if (char *i = getenv(POLYGEIST_PGO_ALTERNATIVE_ENV_VAR)) {
+      alternative = atoi(i);
+    } else {
+      std::cerr << POLYGEIST_PGO_ALTERNATIVE_ENV_VAR << " not defined"
+                << std::endl;
+      exit(1);
+    }
+  }
+
+  static std::string getFileName(const char *name) {
+    std::string fileName = name;
+    for (char &c : fileName)
+      if (c == '/')
+        c = '+';
+    return fileName;
+  }
+
+  /// Returns the buffer of this thread. Threads may still be running when
+  /// the results are written, so the buffers are never freed.
+  Buffer &getBuffer() {
+    thread_local Buffer *buffer = nullptr;
+    if (!buffer) {
+      buffer = new Buffer();
+      buffer->next = buffers.load(std::memory_order_relaxed);
+      while (!buffers.compare_exchange_weak(buffer->next, buffer,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed))
+        ;
+    }
+    return *buffer;
+  }
+
+  /// Merges the timings of this run into the profile database. Runs that
+  /// end at the same time take turns through a lock file, and every run
+  /// replaces the database at once, so readers never see a partial one.
+  void writeResults() {
+    mlir::polygeist::pgo::ProfileDB db;
+    for (Buffer *buffer = buffers.load(std::memory_order_acquire); buffer;
+         buffer = buffer->next)
+      for (Buffer::Chunk *chunk = &buffer->head; chunk;
+           chunk = chunk->next.load(std::memory_order_acquire))
+        for (size_t i = 0, e = chunk->size.load(std::memory_order_acquire);
+             i < e; i++) {
+          const Sample &sample = chunk->samples[i];
+          const Kernel &kernel = kernels[sample.kernel];
+          db.addSample(kernel.id, sample.sizeClass, sample.alternative,
+                       sample.elapsed * 1e-9);
+          db.setName(kernel.id, getFileName(kernel.name));
+        }
+    if (db.empty())
+      return;
+
+    std::string path = dirname + "/" + mlir::polygeist::pgo::kProfileFileName;
+    int lock = open((path + ".lock").c_str(), O_CREAT | O_RDWR, 0644);
+    if (lock < 0 || flock(lock, LOCK_EX)) {
+      std::cerr << "Could not lock " << path << std::endl;
+      return;
+    }
+    {
+      std::ifstream ifile(path, std::ios::in | std::ios::binary);
+      std::string contents((std::istreambuf_iterator<char>(ifile)),
+                           std::istreambuf_iterator<char>());
+      mlir::polygeist::pgo::ProfileView view;
+      if (view.init(contents.data(), contents.size()))
+        db.merge(view);
+      else if (!contents.empty())
+        std::cerr << "Replacing invalid profile " << path << std::endl;
+    }
+    std::string tmpPath = path + "." + std::to_string(getpid());
+    {
+      std::ofstream ofile(tmpPath,
+                          std::ios::out | std::ios::trunc | std::ios::binary);
+      ofile << db.serialize();
+    }
+    if (rename(tmpPath.c_str(), path.c_str()))
+      std::cerr << "Could not write " << path << std::endl;
+    flock(lock, LOCK_UN);
+    close(lock);
   }
 
-  ~PGOState() {}
+  int alternative = 0;
+  std::string dirname;
+  PGOAdaptive adaptive;
+  Kernel kernels[kMaxKernels];
+  std::atomic<Buffer *> buffers{nullptr};
 };
 
-extern "C" MLIR_PGO_WRAPPERS_EXPORT int32_t
-mgpurtPGOGetAlternative(const char *kernelID, int totalAlternatives) {
-  PGOState pgoState(kernelID, totalAlternatives);
-  return pgoState.getAlternative();
+extern "C" MLIR_PGO_WRAPPERS_EXPORT int32_t mgpurtPGOGetAlternative(
+    uint64_t kernelId, const char *kernelName, int32_t totalAlternatives) {
+  PGOProfiler &profiler = PGOProfiler::get();
+  return profiler.getAlternative(
+      profiler.getKernel(kernelId, kernelName, totalAlternatives));
 }
 
-extern "C" MLIR_PGO_WRAPPERS_EXPORT void mgpurtPGOStart(const char *kernelID,
-                                                        int totalAlternatives) {
-  PGOState pgoState(kernelID, totalAlternatives);
-  pgoState.start();
+extern "C" MLIR_PGO_WRAPPERS_EXPORT uint64_t mgpurtPGOStart() {
+  return PGOProfiler::get().start();
 }
 
-extern "C" MLIR_PGO_WRAPPERS_EXPORT void mgpurtPGOEnd(const char *kernelID,
-                                                      int totalAlternatives) {
-  PGOState pgoState(kernelID, totalAlternatives);
-  pgoState.end();
+extern "C" MLIR_PGO_WRAPPERS_EXPORT void mgpurtPGOEnd(uint64_t kernelId,
+                                                      int32_t alternative,
+                                                      uint64_t start,
+                                                      uint64_t size) {
+  PGOProfiler::get().end(kernelId, alternative, start, size);
 }
@@ -1,13 +1,18 @@
 #include "PassDetails.h"
 
+#include "mlir/Dialect/Affine/Analysis/AffineAnalysis.h"
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/Affine/Passes.h"
+#include "mlir/Dialect/Affine/Utils.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/IR/Dominance.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "polygeist/Passes/Passes.h"
 #include "llvm/Support/Debug.h"
 
+#define DEBUG_TYPE "affine-reduction"
+
 using namespace mlir;
 using namespace polygeist;
 using namespace mlir::affine;
@@ -16,6 +21,12 @@ namespace {
 struct AffineReductionPass : public AffineReductionBase<AffineReductionPass> {
   void runOnOperation() override;
 };
+
+struct AffineParallelReductionPass
+    : public AffineParallelReductionBase<AffineParallelReductionPass> {
+  AffineParallelReductionPass(bool fastMath) { this->fastMath = fastMath; }
+  void runOnOperation() override;
+};
 } // end namespace.
 
 namespace {
@@ -266,10 +277,55 @@ void AffineReductionPass::runOnOperation() {
   (void)applyPatternsAndFoldGreedily(getOperation(), std::move(rpl), config);
 }
 
+/// Returns true if the partial results of \p reduction may be combined in
+/// any order. Floating-point sums and products are only reassociated when
+/// their combiner or \p fastMath allows it.
+static bool isReassociable(affine::AffineForOp forOp,
+                           const LoopReduction &reduction, bool fastMath) {
+  if (reduction.kind != arith::AtomicRMWKind::addf &&
+      reduction.kind != arith::AtomicRMWKind::mulf)
+    return true;
+  if (fastMath)
+    return true;
+  Value combined =
+      forOp.getBody()->getTerminator()->getOperand(reduction.iterArgPosition);
+  auto fmf = combined.getDefiningOp<arith::ArithFastMathInterface>();
+  return fmf && arith::bitEnumContainsAll(fmf.getFastMathFlagsAttr().getValue(),
+                                          arith::FastMathFlags::reassoc);
+}
+
+void AffineParallelReductionPass::runOnOperation() {
+  // Inner loops come first, so that the loops around them may be
+  // parallelized as well.
+  SmallVector<affine::AffineForOp> loops;
+  getOperation()->walk([&](affine::AffineForOp forOp) {
+    if (forOp.getNumIterOperands())
+      loops.push_back(forOp);
+  });
+
+  for (affine::AffineForOp forOp : loops) {
+    SmallVector<LoopReduction> reductions;
+    if (!isLoopParallel(forOp, &reductions) ||
+        reductions.size() != forOp.getNumIterOperands())
+      continue;
+    if (!llvm::all_of(reductions, [&](const LoopReduction &reduction) {
+          return isReassociable(forOp, reduction, fastMath);
+        })) {
+      LLVM_DEBUG(llvm::dbgs() << "not reassociable: " << forOp << "\n");
+      continue;
+    }
+    if (succeeded(affineParallelize(forOp, reductions)))
+      numParallelized++;
+  }
+}
+
 namespace mlir {
 namespace polygeist {
 std::unique_ptr<Pass> detectReductionPass() {
   return std::make_unique<AffineReductionPass>();
 }
+std::unique_ptr<Pass> createAffineParallelReductionPass(bool fastMath) {
+  return std::make_unique<AffineParallelReductionPass>(fastMath);
+}
 } // namespace polygeist
 } // namespace mlir
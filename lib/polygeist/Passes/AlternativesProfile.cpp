@@ -0,0 +1,251 @@
+//===- AlternativesProfile.cpp - Use profiles of alternatives ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "AlternativesProfile.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/GPU/IR/GPUDialect.h"
+#include "mlir/Dialect/OpenMP/OpenMPDialect.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/IR/IRMapping.h"
+#include "mlir/IR/Matchers.h"
+#include "polygeist/ProfileDB.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <map>
+
+using namespace mlir;
+using namespace polygeist;
+
+static llvm::cl::opt<double> PGOConfidence(
+    "polygeist-pgo-confidence", llvm::cl::init(0.95),
+    llvm::cl::desc("Confidence the profile must give that an alternative is "
+                   "faster before it is picked over an earlier one"));
+
+static llvm::cl::opt<unsigned> PGOMinSamples(
+    "polygeist-pgo-min-samples", llvm::cl::init(5),
+    llvm::cl::desc("Timings an alternative needs in the profile before it is "
+                   "compared with the others"));
+
+uint64_t mlir::polygeist::getAlternativesKernelId(AlternativesOp altOp) {
+  return pgo::getKernelId(llvm::xxHash64(
+      altOp->getAttrOfType<StringAttr>("polygeist.altop.id").getValue()));
+}
+
+namespace {
+/// A parallel dimension, which runs (ub - lb) / step iterations, or only ub
+/// for a dimension of a kernel launch.
+struct Dimension {
+  Value lb, ub, step;
+};
+} // namespace
+
+static void getDimensions(Operation *op, SmallVectorImpl<Dimension> &dims) {
+  if (auto loop = dyn_cast<scf::ParallelOp>(op)) {
+    for (auto [lb, ub, step] : llvm::zip(
+             loop.getLowerBound(), loop.getUpperBound(), loop.getStep()))
+      dims.push_back({lb, ub, step});
+  } else if (auto loop = dyn_cast<omp::WsLoopOp>(op)) {
+    for (auto [lb, ub, step] : llvm::zip(
+             loop.getLowerBound(), loop.getUpperBound(), loop.getStep()))
+      dims.push_back({lb, ub, step});
+  } else if (auto launch = dyn_cast<gpu::LaunchFuncOp>(op)) {
+    gpu::KernelDim3 grid = launch.getGridSizeOperandValues();
+    gpu::KernelDim3 block = launch.getBlockSizeOperandValues();
+    for (Value dim : {grid.x, grid.y, grid.z, block.x, block.y, block.z})
+      dims.push_back({nullptr, dim, nullptr});
+  }
+}
+
+Value mlir::polygeist::createAlternativesProblemSize(AlternativesOp altOp,
+                                                     OpBuilder &builder) {
+  SmallVector<Dimension> dims;
+  altOp->getRegion(0).walk<WalkOrder::PreOrder>([&](Operation *op) {
+    getDimensions(op, dims);
+    return dims.empty() ? WalkResult::advance() : WalkResult::interrupt();
+  });
+  if (dims.empty())
+    return nullptr;
+
+  // Constants are recreated in front of the op, other values must be defined
+  // there already.
+  auto isAvailable = [&](Value val) {
+    if (!val)
+      return true;
+    Type type = val.getType();
+    if (!type.isIndex() &&
+        !(type.isa<IntegerType>() && type.getIntOrFloatBitWidth() <= 64))
+      return false;
+    return !altOp->isAncestor(val.getParentBlock()->getParentOp()) ||
+           matchPattern(val, m_Constant());
+  };
+  if (!llvm::all_of(dims, [&](const Dimension &dim) {
+        return isAvailable(dim.lb) && isAvailable(dim.ub) &&
+               isAvailable(dim.step);
+      }))
+    return nullptr;
+
+  Location loc = altOp.getLoc();
+  Type i64 = builder.getI64Type();
+  auto materialize = [&](Value val) -> Value {
+    if (altOp->isAncestor(val.getParentBlock()->getParentOp()))
+      val = builder.clone(*val.getDefiningOp())
+                ->getResult(val.cast<OpResult>().getResultNumber());
+    if (val.getType().isIndex())
+      return builder.create<arith::IndexCastOp>(loc, i64, val);
+    if (val.getType() != i64)
+      return builder.create<arith::ExtUIOp>(loc, i64, val);
+    return val;
+  };
+
+  Value zero = builder.create<arith::ConstantIntOp>(loc, 0, 64);
+  Value one = builder.create<arith::ConstantIntOp>(loc, 1, 64);
+  Value size = one;
+  for (const Dimension &dim : dims) {
+    Value trip = materialize(dim.ub);
+    if (dim.lb) {
+      Value step = materialize(dim.step);
+      trip = builder.create<arith::SubIOp>(loc, trip, materialize(dim.lb));
+      trip = builder.create<arith::AddIOp>(
+          loc, trip, builder.create<arith::SubIOp>(loc, step, one));
+      trip = builder.create<arith::DivSIOp>(loc, trip, step);
+      trip = builder.create<arith::MaxSIOp>(loc, trip, zero);
+    }
+    size = builder.create<arith::MulIOp>(loc, size, trip);
+  }
+  return size;
+}
+
+std::string mlir::polygeist::getPGODataDir() {
+  if (char *d = getenv(POLYGEIST_PGO_DATA_DIR_ENV_VAR))
+    return d;
+  return POLYGEIST_PGO_DEFAULT_DATA_DIR;
+}
+
+/// Replaces \p altOp by a copy of its alternative \p alternative, in front of
+/// the insertion point of \p rewriter.
+static void cloneAlternative(AlternativesOp altOp, int alternative,
+                             PatternRewriter &rewriter) {
+  IRMapping mapping;
+  Block &block = altOp->getRegion(alternative).front();
+  for (Operation &op : block.without_terminator())
+    rewriter.clone(op, mapping);
+}
+
+LogicalResult
+mlir::polygeist::lowerAlternativesFromProfile(AlternativesOp altOp,
+                                              PatternRewriter &rewriter) {
+  StringRef locStr =
+      altOp->getAttrOfType<StringAttr>("polygeist.altop.id").getValue();
+  auto descs = altOp->getAttrOfType<ArrayAttr>("alternatives.descs");
+  unsigned numAlternatives = altOp->getNumRegions();
+
+  auto pick = [&](int alternative) {
+    Block *block = &altOp->getRegion(alternative).front();
+    rewriter.eraseOp(block->getTerminator());
+    rewriter.inlineBlockBefore(block, altOp);
+    rewriter.eraseOp(altOp);
+    return success();
+  };
+
+  std::string path = getPGODataDir() + "/" + pgo::kProfileFileName;
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText*/ false,
+                                            /*RequiresNullTerminator*/ false);
+  pgo::ProfileView view;
+  if (!buffer ||
+      !view.init((*buffer)->getBufferStart(), (*buffer)->getBufferSize())) {
+    llvm::errs() << "No valid profile in " << path << ", picking 0,"
+                 << descs[0] << " for " << locStr << "\n";
+    return pick(0);
+  }
+
+  // The timings of every alternative, per size class and over all sizes.
+  uint64_t kernel = getAlternativesKernelId(altOp);
+  std::map<uint32_t, std::vector<pgo::ProfileRecord>> bySize;
+  std::vector<pgo::ProfileRecord> overall;
+  for (unsigned i = 0; i < numAlternatives; i++)
+    overall.push_back(pgo::createRecord(kernel, 0, i));
+  auto range = view.lookup(kernel);
+  for (const pgo::ProfileRecord *record = range.first; record != range.second;
+       record++) {
+    if (record->alternative >= numAlternatives)
+      continue;
+    std::vector<pgo::ProfileRecord> &records = bySize[record->sizeClass];
+    if (records.empty())
+      for (unsigned i = 0; i < numAlternatives; i++)
+        records.push_back(pgo::createRecord(kernel, record->sizeClass, i));
+    pgo::mergeRecords(records[record->alternative], *record);
+    pgo::mergeRecords(overall[record->alternative], *record);
+  }
+
+  for (unsigned i = 0; i < numAlternatives; i++) {
+    const pgo::ProfileRecord &record = overall[i];
+    if (!record.count) {
+      llvm::errs() << "No data for alternative " << i << "," << descs[i]
+                   << " of " << locStr << "\n";
+      continue;
+    }
+    llvm::errs() << "Alternative " << i << "," << descs[i] << " has median "
+                 << pgo::getMedian(record) << ", mean " << record.mean
+                 << " and standard deviation "
+                 << std::sqrt(pgo::getVariance(record)) << " over "
+                 << record.count << " runs\n";
+  }
+
+  int best = pgo::selectAlternative(overall, PGOConfidence, PGOMinSamples);
+  if (best < 0)
+    best = 0;
+
+  // The choice for every size class that was profiled, merging neighbouring
+  // classes with the same choice. Class c holds the sizes below 2^c.
+  SmallVector<std::pair<uint32_t, int>> choices;
+  for (auto &pair : bySize) {
+    int choice =
+        pgo::selectAlternative(pair.second, PGOConfidence, PGOMinSamples);
+    if (!pair.first || choice < 0)
+      continue;
+    if (!choices.empty() && choices.back().second == choice)
+      choices.back().first = pair.first;
+    else
+      choices.push_back({pair.first, choice});
+  }
+
+  Value size;
+  if (choices.size() > 1) {
+    rewriter.setInsertionPoint(altOp);
+    size = createAlternativesProblemSize(altOp, rewriter);
+  }
+  if (!size) {
+    llvm::errs() << "Picking " << best << "," << descs[best] << "\n";
+    return pick(best);
+  }
+
+  Location loc = altOp.getLoc();
+  for (auto [sizeClass, choice] : ArrayRef(choices).drop_back()) {
+    if (sizeClass >= 64)
+      break;
+    llvm::errs() << "Picking " << choice << "," << descs[choice]
+                 << " for sizes below " << (1ull << sizeClass) << "\n";
+    Value bound = rewriter.create<arith::ConstantIntOp>(
+        loc, (int64_t)(1ull << sizeClass), 64);
+    Value cond = rewriter.create<arith::CmpIOp>(
+        loc, arith::CmpIPredicate::ult, size, bound);
+    auto ifOp = rewriter.create<scf::IfOp>(loc, cond, /*withElseRegion*/ true);
+    rewriter.setInsertionPoint(ifOp.thenBlock()->getTerminator());
+    cloneAlternative(altOp, choice, rewriter);
+    rewriter.setInsertionPoint(ifOp.elseBlock()->getTerminator());
+  }
+  llvm::errs() << "Picking " << choices.back().second << ","
+               << descs[choices.back().second] << " for larger sizes\n";
+  cloneAlternative(altOp, choices.back().second, rewriter);
+  rewriter.eraseOp(altOp);
+  return success();
+}
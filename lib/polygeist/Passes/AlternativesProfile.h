@@ -0,0 +1,44 @@
+//===- AlternativesProfile.h - Use profiles of alternatives -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Helpers shared by the code that instruments polygeist.alternatives ops for
+// profiling and the code that picks their alternatives from the profile.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef POLYGEIST_PASSES_ALTERNATIVESPROFILE_H
+#define POLYGEIST_PASSES_ALTERNATIVESPROFILE_H
+
+#include "mlir/IR/PatternMatch.h"
+#include "polygeist/Ops.h"
+
+namespace mlir::polygeist {
+
+/// Returns the directory the PGO runtime writes profiles to, which is also
+/// where they are read from.
+std::string getPGODataDir();
+
+/// Returns the id the PGO runtime and the profile know \p altOp by, which is
+/// derived from its polygeist.altop.id.
+uint64_t getAlternativesKernelId(AlternativesOp altOp);
+
+/// Computes in front of \p altOp the size of the problem it solves, as an
+/// i64: the number of iterations of the first parallel loop, or the number of
+/// threads of the first kernel launch, of its first alternative. Returns null
+/// when the size is only known inside of \p altOp.
+Value createAlternativesProblemSize(AlternativesOp altOp, OpBuilder &builder);
+
+/// Replaces \p altOp by the alternative its profile shows to be the fastest,
+/// or by a dispatch on the problem size when the fastest alternative differs
+/// between problem sizes.
+LogicalResult lowerAlternativesFromProfile(AlternativesOp altOp,
+                                           PatternRewriter &rewriter);
+
+} // namespace mlir::polygeist
+
+#endif // POLYGEIST_PASSES_ALTERNATIVESPROFILE_H
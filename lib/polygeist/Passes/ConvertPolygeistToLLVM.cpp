@@ -52,11 +52,13 @@
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
 #include <fstream>
 #include <limits>
 #include <map>
 #include <numeric>
 
+#include "AlternativesProfile.h"
 #include "RuntimeWrapperUtils.h"
 
 extern llvm::cl::opt<bool> EmitROCM;
@@ -714,12 +716,11 @@ struct AsyncOpLowering : public ConvertOpToLLVMPattern<async::ExecuteOp> {
     {
       OpBuilder::InsertionGuard guard(rewriter);
       rewriter.setInsertionPointToEnd(module.getBody());
-      static int off = 0;
-      off++;
+      static std::atomic<int> off = 0;
       func = rewriter.create<LLVM::LLVMFuncOp>(
           execute.getLoc(),
           "kernelbody." + std::to_string((long long int)&execute) + "." +
-              std::to_string(off),
+              std::to_string(++off),
           funcType);
     }
 
@@ -1482,9 +1483,13 @@ struct LowerGPUAlternativesOp
   LogicalResult matchAndRewrite(polygeist::AlternativesOp gao,
                                 PatternRewriter &rewriter) const override {
 
-    if (gao->getAttrOfType<StringAttr>("alternatives.type").getValue() !=
-        "gpu_kernel")
+    // Kernels cpuify emitted once per strategy are timed and chosen the same
+    // way, but have no GPU binary to derive costs from.
+    auto type = gao->getAttrOfType<StringAttr>("alternatives.type");
+    if (!type ||
+        (type.getValue() != "gpu_kernel" && type.getValue() != "cpu_kernel"))
       return failure();
+    bool isGPUKernel = type.getValue() == "gpu_kernel";
 
     Location loc = gao->getLoc();
     std::string locStr =
@@ -1775,8 +1780,10 @@ struct LowerGPUAlternativesOp
       });
     };
 
-    bool shouldPrintInfo = getenv("POLYGEIST_GPU_ALTERNATIVES_PRINT_INFO");
-    if (shouldPrintInfo || PolygeistAlternativesMode == PAM_Static) {
+    bool shouldPrintInfo =
+        isGPUKernel && getenv("POLYGEIST_GPU_ALTERNATIVES_PRINT_INFO");
+    if (isGPUKernel &&
+        (shouldPrintInfo || PolygeistAlternativesMode == PAM_Static)) {
       if (gatherInfos().failed())
         return failure();
       LLVM_DEBUG(DBGS() << "GPU Alternatives theoretical infos unsorted:\n");
@@ -1804,19 +1811,30 @@ struct LowerGPUAlternativesOp
 
     } else if (PolygeistAlternativesMode == PAM_PGO_Profile) {
       rewriter.setInsertionPoint(gao);
-      static int num = 0;
+      static std::atomic<int> num = 0;
       // Append `\0` to follow C style string given that
       // LLVM::createGlobalString() won't handle this directly for us.
       SmallString<16> nullTermLocStr(locStr.begin(), locStr.end());
       nullTermLocStr.push_back('\0');
-      auto kernelId = LLVM::createGlobalString(
+      auto kernelName = LLVM::createGlobalString(
           loc, rewriter, std::string("kernelId.") + std::to_string(num++),
           nullTermLocStr, LLVM::Linkage::Internal, /*opaquePointers*/ true);
+      // The runtime finds kernels by this id rather than by their name, so
+      // that timing them needs no string handling. Unlike a counter, a hash
+      // of the name is unique across translation units.
+      auto kernelId = rewriter.create<LLVM::ConstantOp>(
+          loc, llvmInt64Type,
+          rewriter.getI64IntegerAttr(getAlternativesKernelId(gao)));
+      // Timings are kept apart by the size of the problem, 0 when unknown.
+      Value size = createAlternativesProblemSize(gao, rewriter);
+      if (!size)
+        size = rewriter.create<LLVM::ConstantOp>(loc, llvmInt64Type,
+                                                 rewriter.getI64IntegerAttr(0));
       auto totalAlternatives = rewriter.create<LLVM::ConstantOp>(
           loc, llvmInt32Type, gao->getNumRegions());
       auto alternative =
           rtPGOGetAlternativeCallBuilder
-              .create(loc, rewriter, {kernelId, totalAlternatives})
+              .create(loc, rewriter, {kernelId, kernelName, totalAlternatives})
               ->getResult(0);
 
       int i = 0;
@@ -1832,12 +1850,12 @@ struct LowerGPUAlternativesOp
 
         // Timing
         rewriter.setInsertionPointToStart(&ifOp.getThenRegion().front());
-        rtPGOStartCallBuilder.create(loc, rewriter,
-                                     {kernelId, totalAlternatives});
+        Value start =
+            rtPGOStartCallBuilder.create(loc, rewriter, {})->getResult(0);
         rewriter.setInsertionPoint(
             ifOp.getThenRegion().front().getTerminator());
         rtPGOEndCallBuilder.create(loc, rewriter,
-                                   {kernelId, totalAlternatives});
+                                   {kernelId, alternative, start, size});
 
         rewriter.setInsertionPointToStart(&ifOp.getElseRegion().front());
         i++;
@@ -1846,61 +1864,7 @@ struct LowerGPUAlternativesOp
       rewriter.eraseOp(gao);
       return success();
     } else if (PolygeistAlternativesMode == PAM_PGO_Opt) {
-      std::string dirname = []() {
-        if (char *d = getenv(POLYGEIST_PGO_DATA_DIR_ENV_VAR)) {
-          return std::string(d);
-        } else {
-          return std::string(POLYGEIST_PGO_DEFAULT_DATA_DIR);
-        }
-      }();
-      // TODO error handling
-      std::ifstream ifile;
-      int numAlternatives = gao->getNumRegions();
-      std::vector<std::vector<double>> timings;
-      for (int i = 0; i < numAlternatives; i++) {
-        timings.push_back({});
-      }
-      ifile.open(std::string(dirname) + "/" + locStr, std::ios::in);
-      while (ifile) {
-        int alt;
-        double time;
-        ifile >> alt >> time;
-        if (alt >= 0 && alt < numAlternatives) {
-          timings[alt].push_back(time);
-        } else {
-          llvm::errs() << "Invalid alternative data";
-          assert(0);
-        }
-      }
-      std::vector<double> avgs;
-      for (int i = 0; i < numAlternatives; i++) {
-        if (timings[i].size() == 0) {
-          llvm::errs() << "No data for alternative " << i << "," << descs[i]
-                       << " of " << locStr << "\n";
-          assert(0);
-          avgs.push_back(std::numeric_limits<double>::infinity());
-        } else {
-          // TODO might get some round off errors here, maybe use a better alg
-          // or median
-          avgs.push_back(
-              std::accumulate(timings[i].begin(), timings[i].end(), 0.0f) /
-              timings[i].size());
-          llvm::errs() << "Alternative " << i << "," << descs[i] << " is "
-                       << avgs[i] << "\n";
-        }
-      }
-
-      int bestAlt = std::distance(avgs.begin(),
-                                  std::min_element(avgs.begin(), avgs.end()));
-      llvm::errs() << "Picking " << bestAlt << "," << descs[bestAlt] << "\n";
-
-      auto block = &*gao->getRegions()[bestAlt].begin();
-
-      rewriter.eraseOp(block->getTerminator());
-      rewriter.inlineBlockBefore(block, gao);
-      rewriter.eraseOp(gao);
-
-      return success();
+      return lowerAlternativesFromProfile(gao, rewriter);
     } else {
       llvm_unreachable("Invalid enum");
     }
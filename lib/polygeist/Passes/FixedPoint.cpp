@@ -0,0 +1,125 @@
+//===- FixedPoint.cpp - Run a pipeline until nothing changes ----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that runs a list of passes in rounds until a
+// whole round leaves the operation unchanged. Changes are detected with
+// operation fingerprints, which also let a pass be skipped whenever the IR is
+// still exactly what that pass produced on its previous run. The fingerprints
+// live in one run of the pass: passes outside of the group, and the same
+// group added again later in a pipeline, start from scratch.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+
+#include "mlir/IR/OperationSupport.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Pass/PassRegistry.h"
+#include "polygeist/Passes/Passes.h"
+
+#define DEBUG_TYPE "polygeist-fixed-point"
+
+using namespace mlir;
+using namespace polygeist;
+
+namespace {
+struct FixedPointPass : public FixedPointBase<FixedPointPass> {
+  FixedPointPass() = default;
+  FixedPointPass(SmallVector<std::unique_ptr<Pass>> passes,
+                 unsigned maxIterations) {
+    this->maxIterations = maxIterations;
+    for (auto &pass : passes) {
+      stages.emplace_back();
+      stages.back().addPass(std::move(pass));
+    }
+    // Mirror the stages in the option, so that the pass prints as a textual
+    // pipeline that parses back into the same stages.
+    std::string text;
+    llvm::raw_string_ostream os(text);
+    os << '{';
+    llvm::interleaveComma(stages, os, [&](OpPassManager &stage) {
+      stage.printAsTextualPipeline(os);
+    });
+    os << '}';
+    this->pipeline = os.str();
+  }
+
+  LogicalResult initializeOptions(StringRef options) override {
+    if (failed(Pass::initializeOptions(options)))
+      return failure();
+    if (pipeline.empty())
+      return success();
+
+    // Every top-level element of the pipeline becomes its own stage, so that
+    // it can be skipped on its own.
+    stages.clear();
+    unsigned depth = 0;
+    size_t start = 0;
+    StringRef text = StringRef(pipeline).trim();
+    if (text.size() >= 2 && text.front() == '{' && text.back() == '}')
+      text = text.drop_front().drop_back();
+    for (size_t i = 0, e = text.size(); i <= e; i++) {
+      if (i < e && (text[i] == '{' || text[i] == '('))
+        depth++;
+      else if (i < e && (text[i] == '}' || text[i] == ')'))
+        depth--;
+      else if (i == e || (text[i] == ',' && depth == 0)) {
+        stages.emplace_back();
+        if (failed(parsePassPipeline(text.slice(start, i).trim(),
+                                     stages.back(), llvm::errs())))
+          return failure();
+        start = i + 1;
+      }
+    }
+    return success();
+  }
+
+  void getDependentDialects(DialectRegistry &registry) const override {
+    for (const OpPassManager &stage : stages)
+      stage.getDependentDialects(registry);
+  }
+
+  void runOnOperation() override {
+    Operation *op = getOperation();
+    OperationFingerPrint current(op);
+    // The state of the IR right after each stage last ran.
+    SmallVector<std::optional<OperationFingerPrint>> lastRun(stages.size());
+
+    for (unsigned iteration = 0; iteration < maxIterations; iteration++) {
+      bool changed = false;
+      for (auto [stage, last] : llvm::zip(stages, lastRun)) {
+        if (last && *last == current) {
+          numSkipped++;
+          continue;
+        }
+        if (failed(runPipeline(stage, op)))
+          return signalPassFailure();
+        numRun++;
+        OperationFingerPrint after(op);
+        changed |= !(after == current);
+        last = after;
+        current = after;
+      }
+      if (!changed)
+        return;
+    }
+  }
+
+  SmallVector<OpPassManager> stages;
+};
+} // namespace
+
+std::unique_ptr<Pass> mlir::polygeist::createFixedPointPass() {
+  return std::make_unique<FixedPointPass>();
+}
+
+std::unique_ptr<Pass>
+mlir::polygeist::createFixedPointPass(SmallVector<std::unique_ptr<Pass>> passes,
+                                      unsigned maxIterations) {
+  return std::make_unique<FixedPointPass>(std::move(passes), maxIterations);
+}
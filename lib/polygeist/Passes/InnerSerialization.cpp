@@ -34,6 +34,9 @@ struct ParSerialize : public OpRewritePattern<scf::ParallelOp> {
     if (!(nextParallel->getParentOfType<scf::ParallelOp>() ||
           nextParallel->getParentOfType<affine::AffineParallelOp>()))
       return failure();
+    // Reductions are left to the SCF to control flow lowering.
+    if (nextParallel.getNumResults())
+      return failure();
 
     SmallVector<Value> inds;
     scf::ForOp last = nullptr;
@@ -60,6 +63,9 @@ struct Serialize : public OpRewritePattern<scf::ParallelOp> {
 
   LogicalResult matchAndRewrite(scf::ParallelOp nextParallel,
                                 PatternRewriter &rewriter) const override {
+    // Reductions are left to the SCF to control flow lowering.
+    if (nextParallel.getNumResults())
+      return failure();
     SmallVector<Value> inds;
     scf::ForOp last = nullptr;
     for (auto tup :
@@ -1,16 +1,16 @@
 #include "PassDetails.h"
+#include "AlternativesProfile.h"
 
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/Func/Transforms/Passes.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "mlir/Transforms/RegionUtils.h"
 #include "polygeist/Passes/Passes.h"
+#include "polygeist/ProfileDB.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 #include <filesystem>
-#include <fstream>
-#include <limits>
 #include <map>
-#include <numeric>
 
 #include "polygeist/Ops.h"
 #include "polygeist/Passes/Passes.h"
@@ -38,73 +38,14 @@ struct LowerGPUAlternativesOp
   LogicalResult matchAndRewrite(polygeist::AlternativesOp gao,
                                 PatternRewriter &rewriter) const override {
 
-    if (gao->getAttrOfType<StringAttr>("alternatives.type").getValue() !=
-        "gpu_kernel")
+    auto type = gao->getAttrOfType<StringAttr>("alternatives.type");
+    if (!type ||
+        (type.getValue() != "gpu_kernel" && type.getValue() != "cpu_kernel"))
       return failure();
 
-    auto locStr = gao->getAttrOfType<StringAttr>("polygeist.altop.id").data();
-
-    auto descs = gao->getAttrOfType<ArrayAttr>("alternatives.descs");
-
-    if (PolygeistAlternativesMode == PAM_PGO_Opt) {
-      std::string dirname = []() {
-        if (char *d = getenv(POLYGEIST_PGO_DATA_DIR_ENV_VAR)) {
-          return std::string(d);
-        } else {
-          return std::string(POLYGEIST_PGO_DEFAULT_DATA_DIR);
-        }
-      }();
-      // TODO error handling
-      std::ifstream ifile;
-      int numAlternatives = gao->getNumRegions();
-      std::vector<std::vector<double>> timings;
-      for (int i = 0; i < numAlternatives; i++) {
-        timings.push_back({});
-      }
-      ifile.open(std::string(dirname) + "/" + locStr, std::ios::in);
-      while (ifile) {
-        int alt;
-        double time;
-        ifile >> alt >> time;
-        if (alt >= 0 && alt < numAlternatives) {
-          timings[alt].push_back(time);
-        } else {
-          llvm::errs() << "Invalid alternative data";
-          assert(0);
-        }
-      }
-      std::vector<double> avgs;
-      for (int i = 0; i < numAlternatives; i++) {
-        if (timings[i].size() == 0) {
-          llvm::errs() << "No data for alternative " << i << "," << descs[i]
-                       << " of " << locStr << "\n";
-          assert(0);
-          avgs.push_back(std::numeric_limits<double>::infinity());
-        } else {
-          // TODO might get some round off errors here, maybe use a better alg
-          // or median
-          avgs.push_back(
-              std::accumulate(timings[i].begin(), timings[i].end(), 0.0f) /
-              timings[i].size());
-          llvm::errs() << "Alternative " << i << "," << descs[i] << " is "
-                       << avgs[i] << "\n";
-        }
-      }
-
-      int bestAlt = std::distance(avgs.begin(),
-                                  std::min_element(avgs.begin(), avgs.end()));
-      llvm::errs() << "Picking " << bestAlt << "," << descs[bestAlt] << "\n";
-
-      auto block = &*gao->getRegions()[bestAlt].begin();
-
-      rewriter.eraseOp(block->getTerminator());
-      rewriter.inlineBlockBefore(block, gao);
-      rewriter.eraseOp(gao);
-
-      return success();
-    } else {
-      llvm_unreachable("Invalid enum");
-    }
+    if (PolygeistAlternativesMode == PAM_PGO_Opt)
+      return lowerAlternativesFromProfile(gao, rewriter);
+    llvm_unreachable("Invalid enum");
   }
 };
 } // namespace
@@ -189,3 +130,21 @@ struct LowerAlternativesPass
 std::unique_ptr<Pass> mlir::polygeist::createLowerAlternativesPass() {
   return std::make_unique<LowerAlternativesPass>();
 }
+
+void mlir::polygeist::writeAlternativesCacheKey(llvm::raw_ostream &os) {
+  if (char *e = getenv("POLYGEIST_CHOOSE_ALTERNATIVE"))
+    os << "POLYGEIST_CHOOSE_ALTERNATIVE=" << e << '\0';
+  if (PolygeistAlternativesMode == PAM_Static)
+    return;
+  os << std::filesystem::current_path().string() << '\0';
+  if (PolygeistAlternativesMode != PAM_PGO_Opt)
+    return;
+  // Only the merged profile is read. The lock file next to it changes
+  // whenever a profiled run ends and does not matter.
+  std::string path = getPGODataDir() + "/" + pgo::kProfileFileName;
+  os << path << '\0';
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText*/ false,
+                                            /*RequiresNullTerminator*/ false);
+  if (buffer)
+    os << (*buffer)->getBufferSize() << '\0' << (*buffer)->getBuffer();
+}
@@ -0,0 +1,241 @@
+//===- OpenMPFirstTouch.cpp - Initialize arrays in parallel ----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that runs the serial loops initializing freshly
+// allocated arrays in parallel, with the schedule of the omp.wsloop that later
+// uses the arrays. Operating systems place a page on the NUMA node of the
+// thread that touches it first, so a serial initialization puts every page on
+// the node of the main thread, and all other nodes read them remotely. Once
+// the same thread initializes and uses an element, each node mostly reads
+// local memory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/OpenMP/OpenMPDialect.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/IR/Dominance.h"
+#include "mlir/IR/Matchers.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+#include "polygeist/Ops.h"
+#include "polygeist/Passes/Passes.h"
+
+#define DEBUG_TYPE "openmp-first-touch"
+
+using namespace mlir;
+using namespace polygeist;
+
+/// Arrays smaller than this, in bytes, span too few pages to be worth
+/// spreading.
+static constexpr int64_t kMinArrayBytes = 1 << 16;
+
+/// Returns the memref.alloc \p val is a view of, if any.
+static memref::AllocOp getAllocation(Value val) {
+  while (Operation *def = val.getDefiningOp()) {
+    if (auto alloc = dyn_cast<memref::AllocOp>(def))
+      return alloc;
+    if (auto subindex = dyn_cast<polygeist::SubIndexOp>(def))
+      val = subindex.getSource();
+    else if (auto view = dyn_cast<ViewLikeOpInterface>(def))
+      val = view.getViewSource();
+    else
+      return nullptr;
+  }
+  return nullptr;
+}
+
+static bool isSmall(memref::AllocOp alloc) {
+  MemRefType type = alloc.getType();
+  if (!type.hasStaticShape() || !type.getElementType().isIntOrFloat())
+    return false;
+  return type.getNumElements() *
+             type.getElementType().getIntOrFloatBitWidth() / 8 <
+         kMinArrayBytes;
+}
+
+/// Collects the arrays \p loop initializes, which are all it writes to. An
+/// iteration must only write elements whose first index is the induction
+/// variable and read no element of the arrays, so that the iterations are
+/// independent.
+static bool getInitializedArrays(scf::ForOp loop,
+                                 SmallPtrSetImpl<Operation *> &arrays) {
+  Value iv = loop.getInductionVar();
+  WalkResult result = loop.getBody()->walk([&](Operation *op) {
+    if (auto store = dyn_cast<memref::StoreOp>(op)) {
+      auto alloc = store.getMemRef().getDefiningOp<memref::AllocOp>();
+      if (!alloc || store.getIndices().empty() ||
+          store.getIndices().front() != iv)
+        return WalkResult::interrupt();
+      arrays.insert(alloc);
+      return WalkResult::advance();
+    }
+    if (isa<memref::LoadOp>(op) ||
+        op->hasTrait<OpTrait::HasRecursiveMemoryEffects>() ||
+        isMemoryEffectFree(op))
+      return WalkResult::advance();
+    return WalkResult::interrupt();
+  });
+  if (result.wasInterrupted() || arrays.empty())
+    return false;
+
+  result = loop.getBody()->walk([&](memref::LoadOp load) {
+    if (memref::AllocOp alloc = getAllocation(load.getMemRef()))
+      if (arrays.contains(alloc))
+        return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return !result.wasInterrupted() &&
+         !llvm::all_of(arrays, [](Operation *alloc) {
+           return isSmall(cast<memref::AllocOp>(alloc));
+         });
+}
+
+/// Returns whether the iteration \p iv of \p loop accesses an element of one
+/// of \p arrays whose first index is \p iv.
+static bool accessesByIteration(omp::WsLoopOp loop, Value iv,
+                                const SmallPtrSetImpl<Operation *> &arrays) {
+  WalkResult result = loop.getRegion().walk([&](Operation *op) {
+    Value memref;
+    ValueRange indices;
+    if (auto load = dyn_cast<memref::LoadOp>(op)) {
+      memref = load.getMemRef();
+      indices = load.getIndices();
+    } else if (auto store = dyn_cast<memref::StoreOp>(op)) {
+      memref = store.getMemRef();
+      indices = store.getIndices();
+    } else {
+      return WalkResult::advance();
+    }
+    auto alloc = memref.getDefiningOp<memref::AllocOp>();
+    if (alloc && arrays.contains(alloc) && !indices.empty() &&
+        indices.front() == iv)
+      return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+static bool isSameValue(Value a, Value b) {
+  if (a == b)
+    return true;
+  auto aCst = getConstantIntValue(a);
+  auto bCst = getConstantIntValue(b);
+  return aCst && bCst && *aCst == *bCst;
+}
+
+/// Returns \p val for use in front of \p op, recreating it there when it is
+/// a constant computed later, or null when it is not available there.
+static Value materializeBefore(Value val, Operation *op, DominanceInfo &dom,
+                               OpBuilder &builder) {
+  if (dom.properlyDominates(val, op))
+    return val;
+  if (!matchPattern(val, m_Constant()))
+    return nullptr;
+  builder.setInsertionPoint(op);
+  return builder.clone(*val.getDefiningOp())
+      ->getResult(val.cast<OpResult>().getResultNumber());
+}
+
+namespace {
+struct OpenMPFirstTouch : public OpenMPFirstTouchBase<OpenMPFirstTouch> {
+  void runOnOperation() override {
+    SmallVector<scf::ForOp> loops;
+    getOperation()->walk([&](scf::ForOp loop) {
+      if (!loop.getNumResults() && loop.getInductionVar().getType().isIndex() &&
+          !loop->getParentOfType<omp::ParallelOp>() &&
+          !loop->getParentOfType<scf::ParallelOp>())
+        loops.push_back(loop);
+    });
+    for (scf::ForOp loop : loops)
+      parallelize(loop);
+  }
+
+  void parallelize(scf::ForOp init) {
+    SmallPtrSet<Operation *, 2> arrays;
+    if (!getInitializedArrays(init, arrays))
+      return;
+
+    // The first loop after the initialization that uses the arrays decides
+    // where their elements are needed.
+    omp::WsLoopOp user;
+    for (Operation *op = init->getNextNode(); op && !user;
+         op = op->getNextNode()) {
+      auto parallel = dyn_cast<omp::ParallelOp>(op);
+      if (!parallel)
+        continue;
+      parallel->walk([&](omp::WsLoopOp loop) {
+        if (!user && loop.getRegion().getNumArguments() == 1 &&
+            accessesByIteration(loop, loop.getRegion().getArgument(0), arrays))
+          user = loop;
+      });
+    }
+    if (!user)
+      return;
+
+    // Only a static schedule hands every thread the same iterations in both
+    // loops.
+    auto kind = user.getScheduleVal();
+    if ((kind && *kind != omp::ClauseScheduleKind::Static) ||
+        user.getScheduleModifier() || user.getSimdModifier() ||
+        !isSameValue(user.getLowerBound()[0], init.getLowerBound()) ||
+        !isSameValue(user.getUpperBound()[0], init.getUpperBound()) ||
+        !isSameValue(user.getStep()[0], init.getStep()) ||
+        user.getInclusive())
+      return;
+
+    auto userParallel = user->getParentOfType<omp::ParallelOp>();
+    if (userParallel.getIfExprVar() ||
+        user->getParentOfType<omp::WsLoopOp>())
+      return;
+
+    OpBuilder builder(init);
+    DominanceInfo dom(init->getParentOp());
+    Value numThreads, chunk;
+    if (Value var = userParallel.getNumThreadsVar())
+      if (!(numThreads = materializeBefore(var, init, dom, builder)))
+        return;
+    if (Value var = user.getScheduleChunkVar())
+      if (!(chunk = materializeBefore(var, init, dom, builder)))
+        return;
+
+    Location loc = init.getLoc();
+    builder.setInsertionPoint(init);
+    auto parallel = builder.create<omp::ParallelOp>(
+        loc, /*if_expr_var*/ Value{}, numThreads,
+        /*allocate_vars*/ ValueRange{}, /*allocators_vars*/ ValueRange{},
+        /*reduction_vars*/ ValueRange{}, /*reductions*/ ArrayAttr{},
+        userParallel.getProcBindValAttr());
+    builder.createBlock(&parallel.getRegion());
+    auto wsloop = builder.create<omp::WsLoopOp>(
+        loc, ValueRange(init.getLowerBound()), ValueRange(init.getUpperBound()),
+        ValueRange(init.getStep()));
+    builder.create<omp::TerminatorOp>(loc);
+    wsloop.setScheduleValAttr(omp::ClauseScheduleKindAttr::get(
+        &getContext(), omp::ClauseScheduleKind::Static));
+    if (chunk)
+      wsloop.getScheduleChunkVarMutable().assign(chunk);
+
+    wsloop.getRegion().takeBody(init.getRegion());
+    Operation *yield = wsloop.getRegion().front().getTerminator();
+    builder.setInsertionPoint(yield);
+    builder.create<omp::YieldOp>(yield->getLoc(), ValueRange());
+    yield->erase();
+    init->erase();
+    numParallelized++;
+  }
+};
+} // namespace
+
+std::unique_ptr<Pass> mlir::polygeist::createOpenMPFirstTouchPass() {
+  return std::make_unique<OpenMPFirstTouch>();
+}
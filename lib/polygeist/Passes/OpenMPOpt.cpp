@@ -6,12 +6,14 @@
 #include "mlir/Dialect/OpenMP/OpenMPDialect.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/Dialect/SCF/Transforms/Passes.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
 #include "mlir/IR/Dominance.h"
 #include "mlir/IR/IRMapping.h"
 #include "mlir/IR/Matchers.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "polygeist/Ops.h"
 #include "polygeist/Passes/Passes.h"
+#include "polygeist/Passes/Utils.h"
 
 using namespace mlir;
 using namespace mlir::func;
@@ -127,6 +129,129 @@ bool mayWriteTo(Operation *op, Value val, bool ignoreBarrier) {
   return true;
 }
 
+/// Returns true if all threads synchronize between the operations before \p op
+/// in its block and \p op, ignoring operations without memory effects.
+static bool hasBarrierBefore(Operation *op) {
+  for (Operation *prev = op->getPrevNode(); prev; prev = prev->getPrevNode()) {
+    if (isa<omp::BarrierOp>(prev))
+      return true;
+    // A worksharing loop ends with an implicit barrier unless it is nowait.
+    if (auto wsloop = dyn_cast<omp::WsLoopOp>(prev))
+      return !wsloop.getNowait();
+    if (!isMemoryEffectFree(prev))
+      return false;
+  }
+  return false;
+}
+
+/// Returns true if the runtime hands iteration k of \p a and of \p b to the
+/// same thread. OpenMP guarantees it for static schedules with the same chunk
+/// size over the same iteration space within one parallel region.
+static bool haveSameIterationAssignment(omp::WsLoopOp a, omp::WsLoopOp b) {
+  auto isStatic = [](omp::WsLoopOp loop) {
+    auto modifier = loop.getScheduleModifier();
+    return loop.getScheduleVal().value_or(omp::ClauseScheduleKind::Static) ==
+               omp::ClauseScheduleKind::Static &&
+           (!modifier || *modifier == omp::ScheduleModifier::none) &&
+           !loop.getSimdModifier();
+  };
+  if (!isStatic(a) || !isStatic(b))
+    return false;
+
+  Value chunkA = a.getScheduleChunkVar();
+  Value chunkB = b.getScheduleChunkVar();
+  if (chunkA != chunkB) {
+    if (!chunkA || !chunkB)
+      return false;
+    auto cstA = getConstantIntValue(chunkA);
+    auto cstB = getConstantIntValue(chunkB);
+    if (!cstA || !cstB || *cstA != *cstB)
+      return false;
+  }
+
+  return a.getInclusive() == b.getInclusive() &&
+         llvm::equal(a.getLowerBound(), b.getLowerBound()) &&
+         llvm::equal(a.getUpperBound(), b.getUpperBound()) &&
+         llvm::equal(a.getStep(), b.getStep());
+}
+
+/// Collects the reads and writes of the operations within \p loop. Returns
+/// false if some of them are unknown.
+static bool collectAccesses(
+    omp::WsLoopOp loop,
+    SmallVectorImpl<std::pair<Operation *, MemoryEffects::EffectInstance>>
+        &accesses) {
+  WalkResult result = loop.getRegion().walk([&](Operation *op) {
+    if (op->hasTrait<OpTrait::HasRecursiveMemoryEffects>())
+      return WalkResult::advance();
+    auto effectInterface = dyn_cast<MemoryEffectOpInterface>(op);
+    if (!effectInterface)
+      return WalkResult::interrupt();
+    SmallVector<MemoryEffects::EffectInstance> effects;
+    effectInterface.getEffects(effects);
+    for (auto &effect : effects)
+      if (isa<MemoryEffects::Read, MemoryEffects::Write>(effect.getEffect()))
+        accesses.emplace_back(op, effect);
+    return WalkResult::advance();
+  });
+  return !result.wasInterrupted();
+}
+
+/// Returns true if \p a, in the iteration \p ivA of its loop, and \p b, in
+/// the iteration \p ivB of its loop, access the same memref in a dimension
+/// indexed by the induction variable. Both then only touch elements that
+/// belong to the iteration, and so to the thread that runs it.
+static bool accessSameIteration(Operation *a, Value ivA, Operation *b,
+                                Value ivB) {
+  auto getAccess = [](Operation *op, Value &memref, ValueRange &indices) {
+    if (auto load = dyn_cast<memref::LoadOp>(op)) {
+      memref = load.getMemRef();
+      indices = load.getIndices();
+      return true;
+    }
+    if (auto store = dyn_cast<memref::StoreOp>(op)) {
+      memref = store.getMemRef();
+      indices = store.getIndices();
+      return true;
+    }
+    return false;
+  };
+  Value memrefA, memrefB;
+  ValueRange indicesA, indicesB;
+  if (!getAccess(a, memrefA, indicesA) || !getAccess(b, memrefB, indicesB) ||
+      memrefA != memrefB || indicesA.size() != indicesB.size())
+    return false;
+  for (auto [indexA, indexB] : llvm::zip(indicesA, indicesB))
+    if (indexA == ivA && indexB == ivB)
+      return true;
+  return false;
+}
+
+/// Returns true if no thread in \p b touches memory that another thread
+/// touches in \p a, unless both only read it. \p a and \p b must have the
+/// same iteration assignment.
+static bool touchOnlyOwnData(omp::WsLoopOp a, omp::WsLoopOp b) {
+  if (a.getLowerBound().size() != 1 || b.getLowerBound().size() != 1)
+    return false;
+  SmallVector<std::pair<Operation *, MemoryEffects::EffectInstance>> accessesA,
+      accessesB;
+  if (!collectAccesses(a, accessesA) || !collectAccesses(b, accessesB))
+    return false;
+  Value ivA = a.getRegion().front().getArgument(0);
+  Value ivB = b.getRegion().front().getArgument(0);
+  for (auto &[opA, effectA] : accessesA)
+    for (auto &[opB, effectB] : accessesB) {
+      if (!isa<MemoryEffects::Write>(effectA.getEffect()) &&
+          !isa<MemoryEffects::Write>(effectB.getEffect()))
+        continue;
+      if (!mayAlias(effectA, effectB))
+        continue;
+      if (!accessSameIteration(opA, ivA, opB, ivB))
+        return false;
+    }
+  return true;
+}
+
 struct CombineParallel : public OpRewritePattern<omp::ParallelOp> {
   using OpRewritePattern<omp::ParallelOp>::OpRewritePattern;
 
@@ -177,12 +302,14 @@ struct CombineParallel : public OpRewritePattern<omp::ParallelOp> {
       return success(changed);
     }
 
-    // TODO analyze if already has barrier at the end
-    bool preBarrier = false;
-    rewriter.setInsertionPointToEnd(&prevParallel.getRegion().front());
-    if (!preBarrier)
-      rewriter.replaceOpWithNewOp<omp::BarrierOp>(
-          prevParallel.getRegion().front().getTerminator(), TypeRange());
+    // The first region must be done before the second starts, which needs a
+    // barrier unless the first region already ends with one.
+    Operation *prevTerminator =
+        prevParallel.getRegion().front().getTerminator();
+    if (hasBarrierBefore(prevTerminator))
+      rewriter.eraseOp(prevTerminator);
+    else
+      rewriter.replaceOpWithNewOp<omp::BarrierOp>(prevTerminator, TypeRange());
     rewriter.mergeBlocks(&nextParallel.getRegion().front(),
                          &prevParallel.getRegion().front());
     rewriter.eraseOp(nextParallel);
@@ -211,11 +338,14 @@ struct ParallelForInterchange : public OpRewritePattern<omp::ParallelOp> {
         rewriter.create<scf::ForOp>(prevFor.getLoc(), prevFor.getLowerBound(),
                                     prevFor.getUpperBound(), prevFor.getStep());
     auto *yield = nextParallel.getRegion().front().getTerminator();
+    bool hasBarrier = hasBarrierBefore(yield);
     newFor.getRegion().takeBody(prevFor.getRegion());
     rewriter.inlineBlockBefore(&nextParallel.getRegion().front(),
                                newFor.getBody()->getTerminator());
-    rewriter.setInsertionPoint(newFor.getBody()->getTerminator());
-    rewriter.create<omp::BarrierOp>(nextParallel.getLoc());
+    if (!hasBarrier) {
+      rewriter.setInsertionPoint(newFor.getBody()->getTerminator());
+      rewriter.create<omp::BarrierOp>(nextParallel.getLoc());
+    }
 
     rewriter.setInsertionPointToEnd(&newParallel.getRegion().front());
     auto *newYield = rewriter.clone(*yield);
@@ -290,10 +420,376 @@ struct ParallelIfInterchange : public OpRewritePattern<scf::IfOp> {
   }
 };
 
+/// Erases barriers that directly follow another one, or directly precede the
+/// implicit barrier at the end of a parallel region.
+struct RedundantBarrier : public OpRewritePattern<omp::BarrierOp> {
+  using OpRewritePattern<omp::BarrierOp>::OpRewritePattern;
+
+  LogicalResult matchAndRewrite(omp::BarrierOp barrier,
+                                PatternRewriter &rewriter) const override {
+    if (!hasBarrierBefore(barrier)) {
+      if (!isa<omp::ParallelOp>(barrier->getParentOp()))
+        return failure();
+      Operation *next = barrier->getNextNode();
+      while (!next->hasTrait<OpTrait::IsTerminator>() &&
+             isMemoryEffectFree(next))
+        next = next->getNextNode();
+      if (!isa<omp::TerminatorOp>(next))
+        return failure();
+    }
+    rewriter.eraseOp(barrier);
+    return success();
+  }
+};
+
+/// Drops the implicit barrier at the end of a worksharing loop that is
+/// directly followed by one with the same static schedule, when each thread
+/// of the second loop only touches data that it accessed in the first one.
+///
+///    omp.wsloop for (%i) : index = (%lb) to (%ub) step (%s) {
+///      memref.store %x, %A[%i]
+///    }
+///    omp.wsloop for (%j) : index = (%lb) to (%ub) step (%s) {
+///      %y = memref.load %A[%j]
+///    }
+///
+///  makes the first loop nowait.
+///
+/// Without the barrier, the loops since the previous barrier are no longer
+/// ordered with any loop up to the next one, so all of them are compared.
+struct InferNowait : public OpRewritePattern<omp::WsLoopOp> {
+  using OpRewritePattern<omp::WsLoopOp>::OpRewritePattern;
+
+  LogicalResult matchAndRewrite(omp::WsLoopOp loop,
+                                PatternRewriter &rewriter) const override {
+    // Reductions and ordered regions rely on the barrier.
+    if (loop.getNowait() || !loop.getReductionVars().empty() ||
+        !loop.getLinearVars().empty() || loop.getOrderedValAttr())
+      return failure();
+
+    SmallVector<omp::WsLoopOp> before = {loop};
+    for (Operation *prev = loop->getPrevNode(); prev;
+         prev = prev->getPrevNode()) {
+      auto prevLoop = dyn_cast<omp::WsLoopOp>(prev);
+      if (prevLoop && prevLoop.getNowait())
+        before.push_back(prevLoop);
+      else if (prevLoop || !isMemoryEffectFree(prev))
+        break;
+    }
+
+    // The loops up to the first one that keeps its barrier, or up to an
+    // explicit barrier.
+    SmallVector<omp::WsLoopOp> after;
+    bool synchronized = false;
+    for (Operation *next = loop->getNextNode(); next && !synchronized;
+         next = next->getNextNode()) {
+      if (auto nextLoop = dyn_cast<omp::WsLoopOp>(next)) {
+        after.push_back(nextLoop);
+        synchronized = !nextLoop.getNowait();
+      } else if (isa<omp::BarrierOp>(next)) {
+        synchronized = true;
+      } else if (!isMemoryEffectFree(next) ||
+                 next->hasTrait<OpTrait::IsTerminator>()) {
+        break;
+      }
+    }
+    if (after.empty() || !synchronized)
+      return failure();
+
+    for (omp::WsLoopOp a : before)
+      for (omp::WsLoopOp b : after)
+        if (!haveSameIterationAssignment(a, b) || !touchOnlyOwnData(a, b))
+          return failure();
+
+    rewriter.updateRootInPlace(
+        loop, [&] { loop.setNowaitAttr(rewriter.getUnitAttr()); });
+    return success();
+  }
+};
+
+namespace {
+/// A parallel loop nested directly in the body of an omp.wsloop.
+struct NestedLoop {
+  /// The scf.parallel, or the omp.parallel whose only work is the loop.
+  Operation *root = nullptr;
+  /// The scf.parallel or the omp.wsloop.
+  Operation *loop = nullptr;
+  SmallVector<Value> lbs, ubs, steps;
+  Block *body = nullptr;
+  bool inclusive = false;
+};
+} // namespace
+
+/// Returns the omp.wsloop that is the only work of \p parallel, looking
+/// through memref.alloca_scope, or null when the region does anything else
+/// than computing values.
+static omp::WsLoopOp getOnlyWsLoop(omp::ParallelOp parallel) {
+  if (parallel.getIfExprVar() || !parallel.getReductionVars().empty() ||
+      !parallel.getAllocateVars().empty())
+    return nullptr;
+  Region *region = &parallel.getRegion();
+  while (true) {
+    if (!region->hasOneBlock())
+      return nullptr;
+    Operation *found = nullptr;
+    for (Operation &op : region->front()) {
+      if (op.hasTrait<OpTrait::IsTerminator>())
+        continue;
+      if (isa<omp::WsLoopOp, memref::AllocaScopeOp>(op) &&
+          !op.getNumResults()) {
+        if (found)
+          return nullptr;
+        found = &op;
+      } else if (!isMemoryEffectFree(&op)) {
+        return nullptr;
+      }
+    }
+    if (!found)
+      return nullptr;
+    if (auto loop = dyn_cast<omp::WsLoopOp>(found))
+      return loop;
+    region = &found->getRegion(0);
+  }
+}
+
+/// Finds a parallel loop in the body of \p outer that only memref.alloca_scope
+/// separates from it.
+static std::optional<NestedLoop> getNestedLoop(omp::WsLoopOp outer) {
+  Operation *root = nullptr;
+  outer.getRegion().walk<WalkOrder::PreOrder>([&](Operation *op) {
+    if (!isa<scf::ParallelOp, omp::ParallelOp>(op))
+      return WalkResult::advance();
+    for (Operation *parent = op->getParentOp(); parent != outer;
+         parent = parent->getParentOp())
+      if (!isa<memref::AllocaScopeOp>(parent) || parent->getNumResults())
+        return WalkResult::skip();
+    root = op;
+    return WalkResult::interrupt();
+  });
+  if (!root)
+    return std::nullopt;
+
+  NestedLoop nested;
+  nested.root = root;
+  if (auto par = dyn_cast<scf::ParallelOp>(root)) {
+    if (par.getNumResults() || !par.getRegion().hasOneBlock())
+      return std::nullopt;
+    nested.loop = par;
+    nested.lbs.append(par.getLowerBound().begin(), par.getLowerBound().end());
+    nested.ubs.append(par.getUpperBound().begin(), par.getUpperBound().end());
+    nested.steps.append(par.getStep().begin(), par.getStep().end());
+    nested.body = par.getBody();
+  } else {
+    auto loop = getOnlyWsLoop(cast<omp::ParallelOp>(root));
+    if (!loop || !loop.getRegion().hasOneBlock() ||
+        !loop.getReductionVars().empty() || !loop.getLinearVars().empty() ||
+        loop.getOrderedValAttr())
+      return std::nullopt;
+    nested.loop = loop;
+    nested.lbs.append(loop.getLowerBound().begin(), loop.getLowerBound().end());
+    nested.ubs.append(loop.getUpperBound().begin(), loop.getUpperBound().end());
+    nested.steps.append(loop.getStep().begin(), loop.getStep().end());
+    nested.body = &loop.getRegion().front();
+    nested.inclusive = loop.getInclusive();
+  }
+
+  // Barriers and other synchronization in the body refer to the team of the
+  // nested region, which is gone once it runs as part of the outer loop.
+  Operation *terminator = nested.body->getTerminator();
+  WalkResult result = nested.body->walk([&](Operation *op) {
+    if (op != terminator &&
+        isa_and_nonnull<omp::OpenMPDialect>(op->getDialect()))
+      return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  if (result.wasInterrupted())
+    return std::nullopt;
+  return nested;
+}
+
+/// Removes the nesting of parallel loops in the body of an omp.wsloop, which
+/// otherwise either oversubscribes the machine or, with the default of one
+/// active level, runs the inner loop serially anyway. When the inner bounds
+/// do not depend on the outer loop and nothing but pure computation happens
+/// around the inner loop, both collapse into one iteration space:
+///
+///    omp.wsloop for (%i) : index = (%c0) to (%n) step (%c1) {
+///      omp.parallel {
+///        omp.wsloop for (%j) : index = (%c0) to (%m) step (%c1) {
+///          call @f(%i, %j)
+///        }
+///      }
+///    }
+///
+///  becomes
+///
+///    omp.wsloop for (%i, %j) : index = (%c0, %c0) to (%n, %m)
+///                                      step (%c1, %c1) {
+///      call @f(%i, %j)
+///    }
+///
+/// Otherwise the inner loop becomes a nest of scf.for when the outer loop has
+/// enough iterations to keep all threads busy on its own. Outer loops with
+/// fewer iterations than threads keep their nested region.
+struct FlattenNestedParallel : public OpRewritePattern<omp::WsLoopOp> {
+  FlattenNestedParallel(MLIRContext *context, unsigned numThreads)
+      : OpRewritePattern<omp::WsLoopOp>(context), numThreads(numThreads) {}
+
+  LogicalResult matchAndRewrite(omp::WsLoopOp outer,
+                                PatternRewriter &rewriter) const override {
+    if (!outer.getRegion().hasOneBlock())
+      return failure();
+    auto nested = getNestedLoop(outer);
+    if (!nested)
+      return failure();
+
+    if (canFlatten(outer, *nested)) {
+      flatten(outer, *nested, rewriter);
+      return success();
+    }
+
+    unsigned threads = std::max<unsigned>(numThreads, 1);
+    if (auto parallel = outer->getParentOfType<omp::ParallelOp>())
+      if (Value var = parallel.getNumThreadsVar())
+        if (auto cst = getConstantIntValue(var))
+          threads = std::max<int64_t>(*cst, 1);
+    auto tripCount = getConstantTripCount(outer);
+    if (tripCount && *tripCount < threads)
+      return failure();
+    if (!llvm::all_of(nested->body->getArgumentTypes(),
+                      [](Type type) { return type.isIndex(); }))
+      return failure();
+    serialize(*nested, rewriter);
+    return success();
+  }
+
+private:
+  /// Threads assumed when the enclosing region does not set them.
+  unsigned numThreads;
+
+  static bool isInvariant(omp::WsLoopOp outer, Value val) {
+    return !outer->isAncestor(val.getParentBlock()->getParentOp()) ||
+           matchPattern(val, m_Constant());
+  }
+
+  static bool canFlatten(omp::WsLoopOp outer, const NestedLoop &nested) {
+    if (outer.getInclusive() != nested.inclusive)
+      return false;
+    Type ivType = outer.getRegion().getArgument(0).getType();
+    if (llvm::any_of(nested.body->getArgumentTypes(),
+                     [&](Type type) { return type != ivType; }))
+      return false;
+    for (ValueRange range : {ValueRange(nested.lbs), ValueRange(nested.ubs),
+                             ValueRange(nested.steps)})
+      if (llvm::any_of(range,
+                       [&](Value val) { return !isInvariant(outer, val); }))
+        return false;
+    // Everything around the inner loop runs once per inner iteration after
+    // flattening, which is only correct for computations without effects.
+    for (Operation *op = nested.root; op != outer; op = op->getParentOp())
+      for (Operation &other : *op->getBlock())
+        if (&other != op && !other.hasTrait<OpTrait::IsTerminator>() &&
+            !isMemoryEffectFree(&other))
+          return false;
+    return true;
+  }
+
+  static void flatten(omp::WsLoopOp outer, NestedLoop &nested,
+                      PatternRewriter &rewriter) {
+    // Bounds computed in the outer loop are constants, which are recreated in
+    // front of it.
+    auto hoist = [&](ValueRange range) {
+      SmallVector<Value> hoisted;
+      for (Value val : range) {
+        if (outer->isAncestor(val.getParentBlock()->getParentOp())) {
+          rewriter.setInsertionPoint(outer);
+          val = rewriter.clone(*val.getDefiningOp())
+                    ->getResult(val.cast<OpResult>().getResultNumber());
+        }
+        hoisted.push_back(val);
+      }
+      return hoisted;
+    };
+    SmallVector<Value> lbs = hoist(nested.lbs);
+    SmallVector<Value> ubs = hoist(nested.ubs);
+    SmallVector<Value> steps = hoist(nested.steps);
+
+    Block *outerBody = &outer.getRegion().front();
+    SmallVector<Value> ivs;
+    rewriter.updateRootInPlace(outer, [&] {
+      outer.getLowerBoundMutable().append(lbs);
+      outer.getUpperBoundMutable().append(ubs);
+      outer.getStepMutable().append(steps);
+      for (BlockArgument arg : nested.body->getArguments())
+        ivs.push_back(outerBody->addArgument(arg.getType(), arg.getLoc()));
+    });
+
+    // The values the omp.parallel computes around its loop are needed by the
+    // body.
+    if (isa<omp::ParallelOp>(nested.root)) {
+      Region *region = &nested.root->getRegion(0);
+      while (true) {
+        Operation *next = nullptr;
+        for (Operation &op : llvm::make_early_inc_range(region->front())) {
+          if (isa<omp::WsLoopOp, memref::AllocaScopeOp>(op))
+            next = &op;
+          else if (!op.hasTrait<OpTrait::IsTerminator>())
+            rewriter.updateRootInPlace(&op,
+                                       [&] { op.moveBefore(nested.root); });
+        }
+        if (next == nested.loop)
+          break;
+        region = &next->getRegion(0);
+      }
+    }
+
+    rewriter.inlineBlockBefore(nested.body, nested.root, ivs);
+    rewriter.eraseOp(nested.root->getPrevNode());
+    rewriter.eraseOp(nested.root);
+  }
+
+  static void serialize(NestedLoop &nested, PatternRewriter &rewriter) {
+    Location loc = nested.loop->getLoc();
+    auto parallel = dyn_cast<omp::ParallelOp>(nested.root);
+    rewriter.setInsertionPoint(nested.loop);
+    SmallVector<Value> ivs;
+    Block *body = nullptr;
+    for (auto [lb, ub, step] :
+         llvm::zip(nested.lbs, nested.ubs, nested.steps)) {
+      Value end = ub;
+      if (nested.inclusive)
+        end = rewriter.create<AddIOp>(
+            loc, ub, rewriter.create<ConstantIndexOp>(loc, 1));
+      auto forOp = rewriter.create<scf::ForOp>(loc, lb, end, step);
+      ivs.push_back(forOp.getInductionVar());
+      body = forOp.getBody();
+      rewriter.setInsertionPoint(body->getTerminator());
+    }
+    rewriter.inlineBlockBefore(nested.body, body->getTerminator(), ivs);
+    rewriter.eraseOp(body->getTerminator()->getPrevNode());
+    rewriter.eraseOp(nested.loop);
+
+    // What is left of the omp.parallel runs once, in its own scope.
+    if (parallel) {
+      rewriter.setInsertionPoint(parallel);
+      auto allocScope =
+          rewriter.create<memref::AllocaScopeOp>(loc, TypeRange());
+      Operation *terminator = parallel.getRegion().front().getTerminator();
+      rewriter.setInsertionPoint(terminator);
+      rewriter.create<memref::AllocaScopeReturnOp>(loc);
+      rewriter.eraseOp(terminator);
+      rewriter.inlineRegionBefore(parallel.getRegion(), allocScope.getRegion(),
+                                  allocScope.getRegion().begin());
+      rewriter.eraseOp(parallel);
+    }
+  }
+};
+
 void OpenMPOpt::runOnOperation() {
   mlir::RewritePatternSet rpl(getOperation()->getContext());
-  rpl.add<CombineParallel, ParallelForInterchange, ParallelIfInterchange>(
-      getOperation()->getContext());
+  rpl.add<CombineParallel, ParallelForInterchange, ParallelIfInterchange,
+          RedundantBarrier, InferNowait>(getOperation()->getContext());
+  rpl.add<FlattenNestedParallel>(getOperation()->getContext(), numThreads);
   GreedyRewriteConfig config;
   config.maxIterations = 47;
   (void)applyPatternsAndFoldGreedily(getOperation(), std::move(rpl), config);
@@ -0,0 +1,254 @@
+//===- OpenMPSchedule.cpp - Pick schedules for OpenMP loops -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that gives every omp.wsloop without a schedule
+// the one that suits its iterations:
+//
+//  - static when all iterations do the same work,
+//  - static with a small chunk when the work of an iteration grows or shrinks
+//    with the induction variable, as in triangular loop nests, so that every
+//    thread gets iterations from all parts of the range,
+//  - dynamic when the work depends on data, and guided instead when the
+//    iterations are also cheap, which needs fewer dispatches.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/Dialect/OpenMP/OpenMPDialect.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "polygeist/Passes/Passes.h"
+#include "polygeist/Passes/Utils.h"
+
+#define DEBUG_TYPE "openmp-schedule"
+
+using namespace mlir;
+using namespace polygeist;
+
+/// Trip count assumed for loops whose bounds are not constant.
+static constexpr int64_t kUnknownTripCount = 32;
+/// Cost assumed for a call, in operations.
+static constexpr int64_t kCallCost = 50;
+/// Iterations cheaper than this, in operations, are handed out by guided
+/// rather than dynamic schedules.
+static constexpr int64_t kCheapIterationCost = 200;
+
+namespace {
+/// How the work of the iterations of a loop varies.
+enum class Balance { Uniform, Triangular, Irregular };
+
+/// Classifies the work of the iterations of an omp.wsloop.
+class BalanceAnalysis {
+public:
+  BalanceAnalysis(omp::WsLoopOp loop) : loop(loop) {}
+
+  /// Returns how the iterations differ, and sets \p reason to the first
+  /// operation that makes them differ that way.
+  Balance classifyBody(Operation *&reason) {
+    Balance result = Balance::Uniform;
+    loop.getRegion().walk([&](Operation *op) {
+      Balance balance = classifyOp(op);
+      if (balance > result) {
+        result = balance;
+        reason = op;
+      }
+    });
+    return result;
+  }
+
+private:
+  /// The non-uniformity \p op introduces in the work of an iteration.
+  Balance classifyOp(Operation *op) {
+    if (isa<scf::WhileOp>(op))
+      return Balance::Irregular;
+    if (op->getNumRegions() &&
+        llvm::any_of(op->getRegions(),
+                     [](Region &region) { return !region.hasOneBlock(); }))
+      return Balance::Irregular;
+    if (auto forOp = dyn_cast<scf::ForOp>(op))
+      return std::max({classify(forOp.getLowerBound()),
+                       classify(forOp.getUpperBound()),
+                       classify(forOp.getStep())});
+    // A condition only matters when a branch does noticeable work.
+    if (auto ifOp = dyn_cast<scf::IfOp>(op)) {
+      bool hasLoop = false;
+      ifOp->walk([&](Operation *nested) {
+        hasLoop |= isa<scf::ForOp, scf::WhileOp>(nested);
+      });
+      if (hasLoop)
+        return classify(ifOp.getCondition());
+    }
+    return Balance::Uniform;
+  }
+
+  /// Classifies \p val by what it is computed from: Uniform for values
+  /// defined outside of the loop, Triangular for values computed from its
+  /// induction variables and Irregular for values read from memory.
+  Balance classify(Value val) {
+    auto found = cache.find(val);
+    if (found != cache.end())
+      return found->second;
+    // Cycles, through loop-carried values, are resolved conservatively.
+    cache[val] = Balance::Irregular;
+
+    Balance result = Balance::Uniform;
+    if (!loop->isAncestor(val.getParentBlock()->getParentOp())) {
+      result = Balance::Uniform;
+    } else if (auto arg = val.dyn_cast<BlockArgument>()) {
+      Operation *owner = arg.getOwner()->getParentOp();
+      if (owner == loop.getOperation())
+        result = Balance::Triangular;
+      else if (auto forOp = dyn_cast<scf::ForOp>(owner);
+               forOp && arg == forOp.getInductionVar())
+        result = std::max({classify(forOp.getLowerBound()),
+                           classify(forOp.getUpperBound()),
+                           classify(forOp.getStep())});
+      else
+        result = Balance::Irregular;
+    } else {
+      Operation *def = val.getDefiningOp();
+      if (!isMemoryEffectFree(def) || def->getNumRegions())
+        result = Balance::Irregular;
+      else
+        for (Value operand : def->getOperands())
+          result = std::max(result, classify(operand));
+    }
+    return cache[val] = result;
+  }
+
+  omp::WsLoopOp loop;
+  DenseMap<Value, Balance> cache;
+};
+} // namespace
+
+/// Estimates the number of operations \p block executes.
+static int64_t estimateCost(Block &block) {
+  int64_t cost = 0;
+  for (Operation &op : block) {
+    if (auto forOp = dyn_cast<scf::ForOp>(op)) {
+      cost += getConstantTripCount(forOp).value_or(kUnknownTripCount) *
+              estimateCost(*forOp.getBody());
+    } else if (auto ifOp = dyn_cast<scf::IfOp>(op)) {
+      int64_t thenCost = estimateCost(*ifOp.thenBlock());
+      int64_t elseCost = ifOp.elseBlock() ? estimateCost(*ifOp.elseBlock()) : 0;
+      cost += 1 + std::max(thenCost, elseCost);
+    } else if (isa<scf::WhileOp>(op)) {
+      int64_t body = 0;
+      for (Region &region : op.getRegions())
+        for (Block &nested : region)
+          body += estimateCost(nested);
+      cost += kUnknownTripCount * body;
+    } else if (isa<func::CallOp, LLVM::CallOp>(op)) {
+      cost += kCallCost;
+    } else {
+      cost += 1;
+      for (Region &region : op.getRegions())
+        for (Block &nested : region)
+          cost += estimateCost(nested);
+    }
+  }
+  return cost;
+}
+
+namespace {
+struct OpenMPSchedule : public OpenMPScheduleBase<OpenMPSchedule> {
+  OpenMPSchedule(bool remarks) { this->remarks = remarks; }
+
+  void runOnOperation() override {
+    getOperation()->walk([&](omp::WsLoopOp loop) {
+      if (loop.getScheduleVal())
+        return;
+
+      unsigned threads = std::max<unsigned>(numThreads, 1);
+      if (auto parallel = loop->getParentOfType<omp::ParallelOp>())
+        if (Value var = parallel.getNumThreadsVar())
+          if (auto cst = getConstantIntValue(var))
+            threads = std::max<int64_t>(*cst, 1);
+
+      std::optional<int64_t> tripCount = getConstantTripCount(loop);
+
+      Operation *reason = nullptr;
+      Balance balance = BalanceAnalysis(loop).classifyBody(reason);
+      int64_t cost = 0;
+      for (Block &block : loop.getRegion())
+        cost += estimateCost(block);
+
+      auto kind = omp::ClauseScheduleKind::Static;
+      int64_t chunk = 0;
+      std::string why;
+      llvm::raw_string_ostream os(why);
+      switch (balance) {
+      case Balance::Uniform:
+        os << "all iterations do the same work";
+        break;
+      case Balance::Triangular:
+        // Small chunks dealt round-robin even out work that changes steadily
+        // over the iteration space.
+        chunk = 1;
+        if (tripCount)
+          chunk = std::max<int64_t>(
+              1, *tripCount / ((int64_t)threads * chunksPerThread));
+        os << "the work of an inner '" << reason->getName()
+           << "' varies with the induction variable";
+        break;
+      case Balance::Irregular:
+        if (cost < kCheapIterationCost &&
+            (!tripCount || *tripCount >= (int64_t)threads * chunksPerThread))
+          kind = omp::ClauseScheduleKind::Guided;
+        else
+          kind = omp::ClauseScheduleKind::Dynamic;
+        os << "the work of an inner '" << reason->getName()
+           << "' depends on data";
+        break;
+      }
+
+      OpBuilder builder(loop);
+      loop.setScheduleValAttr(
+          omp::ClauseScheduleKindAttr::get(&getContext(), kind));
+      if (chunk)
+        loop.getScheduleChunkVarMutable().assign(
+            builder.create<arith::ConstantIntOp>(loop.getLoc(), chunk, 64));
+
+      switch (kind) {
+      case omp::ClauseScheduleKind::Static:
+        numStatic++;
+        break;
+      case omp::ClauseScheduleKind::Dynamic:
+        numDynamic++;
+        break;
+      default:
+        numGuided++;
+        break;
+      }
+
+      if (remarks) {
+        auto diag = loop.emitRemark()
+                    << "schedule(" << omp::stringifyClauseScheduleKind(kind);
+        if (chunk)
+          diag << ", " << chunk;
+        diag << "): " << os.str() << ", about " << cost
+             << " operations per iteration, ";
+        if (tripCount)
+          diag << *tripCount;
+        else
+          diag << "an unknown number of";
+        diag << " iterations for " << threads << " threads";
+      }
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<Pass> mlir::polygeist::createOpenMPSchedulePass(bool remarks) {
+  return std::make_unique<OpenMPSchedule>(remarks);
+}
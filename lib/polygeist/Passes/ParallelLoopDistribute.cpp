@@ -2701,8 +2701,9 @@ struct CPUifyPass : public SCFCPUifyBase<CPUifyPass> {
   }
   CPUifyPass() = default;
   CPUifyPass(StringRef method) { this->method.setValue(method.str()); }
-  void runOnOperation() override {
-    StringRef method(this->method);
+
+  /// Removes the barriers in \p region with the strategy \p method.
+  LogicalResult cpuify(Region &region, StringRef method) {
     if (method.startswith("distribute")) {
       {
         RewritePatternSet patterns(&getContext());
@@ -2712,26 +2713,21 @@ struct CPUifyPass : public SCFCPUifyBase<CPUifyPass> {
           addPatterns<false>(patterns, method);
         GreedyRewriteConfig config;
         config.maxIterations = 142;
-        if (failed(applyPatternsAndFoldGreedily(getOperation(),
-                                                std::move(patterns), config))) {
-          signalPassFailure();
-          return;
-        }
+        if (failed(applyPatternsAndFoldGreedily(region, std::move(patterns),
+                                                config)))
+          return failure();
       }
       {
         RewritePatternSet patterns(&getContext());
         GreedyRewriteConfig config;
         patterns.insert<LowerCacheLoad>(&getContext());
-        if (failed(applyPatternsAndFoldGreedily(getOperation(),
-                                                std::move(patterns), config))) {
-          signalPassFailure();
-          return;
-        }
+        if (failed(applyPatternsAndFoldGreedily(region, std::move(patterns),
+                                                config)))
+          return failure();
       }
     } else if (method == "omp") {
       SmallVector<polygeist::BarrierOp> toReplace;
-      getOperation()->walk(
-          [&](polygeist::BarrierOp b) { toReplace.push_back(b); });
+      region.walk([&](polygeist::BarrierOp b) { toReplace.push_back(b); });
       for (auto b : toReplace) {
         OpBuilder Builder(b);
         Builder.create<omp::BarrierOp>(b.getLoc());
@@ -2741,6 +2737,106 @@ struct CPUifyPass : public SCFCPUifyBase<CPUifyPass> {
       llvm::errs() << "unknown cpuify type: " << method << "\n";
       llvm_unreachable("unknown cpuify type");
     }
+    return success();
+  }
+
+  /// Puts every kernel, i.e. outermost parallel loop with barriers, in a
+  /// polygeist.alternatives op with one region per strategy of \p methods,
+  /// each lowered with its strategy, so that profile-guided optimization
+  /// picks the fastest strategy for every kernel.
+  LogicalResult cpuifyAlternatives(ArrayRef<StringRef> methods) {
+    SmallVector<Operation *> kernels;
+    getOperation()->walk<WalkOrder::PreOrder>([&](Operation *op) {
+      if (!isa<scf::ParallelOp, affine::AffineParallelOp>(op))
+        return WalkResult::advance();
+      if (!op->getNumResults() &&
+          op->walk([](polygeist::BarrierOp) { return WalkResult::interrupt(); })
+              .wasInterrupted())
+        kernels.push_back(op);
+      return WalkResult::skip();
+    });
+
+    for (Operation *kernel : kernels) {
+      OpBuilder builder(kernel);
+      auto alternativesOp = builder.create<polygeist::AlternativesOp>(
+          kernel->getLoc(), methods.size());
+      alternativesOp->setAttr("alternatives.type",
+                              builder.getStringAttr("cpu_kernel"));
+      SmallVector<Attribute> descs;
+      for (unsigned i = 0; i < methods.size(); i++) {
+        Block *block = &alternativesOp->getRegion(i).front();
+        builder.setInsertionPoint(block->getTerminator());
+        builder.clone(*kernel);
+        descs.push_back(
+            builder.getStringAttr("cpuify=" + methods[i].str() + ","));
+      }
+      alternativesOp->setAttr("alternatives.descs",
+                              builder.getArrayAttr(descs));
+      kernel->erase();
+
+      for (unsigned i = 0; i < methods.size(); i++)
+        if (failed(cpuify(alternativesOp->getRegion(i), methods[i])))
+          return failure();
+    }
+
+    // The code around the kernels is lowered as the first distribute strategy
+    // would lower it on its own. The omp strategy only replaces barriers.
+    auto distribute = llvm::find_if(methods, [](StringRef method) {
+      return method.startswith("distribute");
+    });
+    if (distribute == methods.end())
+      return success();
+    return cpuifyOutsideKernels(*distribute);
+  }
+
+  /// Applies the patterns of the distribute strategy \p method to everything
+  /// but the kernel alternatives. There are no barriers left there, but the
+  /// patterns still normalize parallel loops and lower cache loads.
+  LogicalResult cpuifyOutsideKernels(StringRef method) {
+    auto getOpsOutsideKernels = [&]() {
+      SmallVector<Operation *> ops;
+      getOperation()->walk<WalkOrder::PreOrder>([&](Operation *op) {
+        if (auto type = op->getAttrOfType<StringAttr>("alternatives.type"))
+          if (isa<polygeist::AlternativesOp>(op) &&
+              type.getValue() == "cpu_kernel")
+            return WalkResult::skip();
+        if (op != getOperation())
+          ops.push_back(op);
+        return WalkResult::advance();
+      });
+      return ops;
+    };
+
+    GreedyRewriteConfig config;
+    config.strictMode = GreedyRewriteStrictness::ExistingAndNewOps;
+    {
+      RewritePatternSet patterns(&getContext());
+      if (method.contains("mincut"))
+        addPatterns<true>(patterns, method);
+      else
+        addPatterns<false>(patterns, method);
+      if (failed(applyOpPatternsAndFold(getOpsOutsideKernels(),
+                                        std::move(patterns), config)))
+        return failure();
+    }
+    RewritePatternSet patterns(&getContext());
+    patterns.insert<LowerCacheLoad>(&getContext());
+    return applyOpPatternsAndFold(getOpsOutsideKernels(), std::move(patterns),
+                                  config);
+  }
+
+  void runOnOperation() override {
+    StringRef method(this->method);
+    if (method.contains('|')) {
+      SmallVector<StringRef> methods;
+      method.split(methods, '|', /*MaxSplit*/ -1, /*KeepEmpty*/ false);
+      if (failed(cpuifyAlternatives(methods)))
+        signalPassFailure();
+      return;
+    }
+    for (Region &region : getOperation()->getRegions())
+      if (failed(cpuify(region, method)))
+        return signalPassFailure();
   }
 };
 
@@ -25,7 +25,10 @@
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/IR/Dominance.h"
+#include "mlir/IR/Matchers.h"
 #include "mlir/IR/OpDefinition.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "mlir/Transforms/Passes.h"
 #include "polygeist/Ops.h"
@@ -92,6 +95,9 @@ struct ParallelLower : public ParallelLowerBase<ParallelLower> {
   PolygeistGPUStructureMode gpuKernelStructureMode;
 };
 struct ConvertCudaRTtoCPU : public ConvertCudaRTtoCPUBase<ConvertCudaRTtoCPU> {
+  ConvertCudaRTtoCPU(bool useRuntimeAllocator) {
+    this->useRuntimeAllocator = useRuntimeAllocator;
+  }
   void runOnOperation() override;
 };
 struct ConvertCudaRTtoGPU : public ConvertCudaRTtoGPUBase<ConvertCudaRTtoGPU> {
@@ -117,8 +123,8 @@ std::unique_ptr<Pass> createConvertCudaRTtoGPUPass() {
 std::unique_ptr<Pass> createConvertCudaRTtoHipRTPass() {
   return std::make_unique<ConvertCudaRTtoHipRT>();
 }
-std::unique_ptr<Pass> createConvertCudaRTtoCPUPass() {
-  return std::make_unique<ConvertCudaRTtoCPU>();
+std::unique_ptr<Pass> createConvertCudaRTtoCPUPass(bool useRuntimeAllocator) {
+  return std::make_unique<ConvertCudaRTtoCPU>(useRuntimeAllocator);
 }
 std::unique_ptr<Pass>
 createParallelLowerPass(bool wrapParallelOps,
@@ -793,6 +799,156 @@ static void replaceCallWithSuccess(Operation *call, OpBuilder &bz) {
   call->erase();
 }
 
+/// Returns the value \p op casts to another pointer or memref type, or null if
+/// it is not such a cast.
+static Value getPointerCastSource(Operation *op) {
+  if (auto cast = dyn_cast<LLVM::BitcastOp>(op))
+    return cast.getArg();
+  if (auto cast = dyn_cast<LLVM::AddrSpaceCastOp>(op))
+    return cast.getArg();
+  if (auto cast = dyn_cast<polygeist::Memref2PointerOp>(op))
+    return cast.getSource();
+  if (auto cast = dyn_cast<polygeist::Pointer2MemrefOp>(op))
+    return cast.getSource();
+  return nullptr;
+}
+
+/// Returns \p val without the pointer casts it went through.
+static Value stripPointerCasts(Value val) {
+  while (Operation *def = val.getDefiningOp()) {
+    Value source = getPointerCastSource(def);
+    if (!source)
+      break;
+    val = source;
+  }
+  return val;
+}
+
+/// Returns the memory \p addr points into, which must be a stack slot for a
+/// single pointer, or null.
+static Value getPointerSlot(Value addr) {
+  addr = stripPointerCasts(addr);
+  if (auto alloca = addr.getDefiningOp<memref::AllocaOp>()) {
+    MemRefType type = alloca.getType();
+    if (!type.hasStaticShape() || type.getNumElements() != 1)
+      return nullptr;
+    return alloca;
+  }
+  if (auto alloca = addr.getDefiningOp<LLVM::AllocaOp>())
+    if (matchPattern(alloca.getArraySize(), m_One()))
+      return alloca;
+  return nullptr;
+}
+
+/// Returns whether \p store is the only write to \p slot, and nothing else
+/// takes its address, so that the slot holds the value of the last store.
+static bool isOnlyWrite(LLVM::StoreOp store, Value slot) {
+  std::function<bool(Value)> isOnlyReadOrStored = [&](Value addr) {
+    for (OpOperand &use : addr.getUses()) {
+      Operation *user = use.getOwner();
+      if (isa<LLVM::LoadOp, memref::LoadOp, affine::AffineLoadOp>(user) ||
+          (user == store && use.get() == store.getAddr()))
+        continue;
+      if (!getPointerCastSource(user) ||
+          !isOnlyReadOrStored(user->getResult(0)))
+        return false;
+    }
+    return true;
+  };
+  return isOnlyReadOrStored(slot);
+}
+
+/// Returns whether \p val is computed in the same way in every iteration of
+/// \p loop, only by ops without side effects.
+static bool isLoopInvariant(Value val, LoopLikeOpInterface loop) {
+  if (loop.isDefinedOutsideOfLoop(val))
+    return true;
+  Operation *def = val.getDefiningOp();
+  return def && def->getNumRegions() == 0 && isMemoryEffectFree(def) &&
+         llvm::all_of(def->getOperands(), [&](Value operand) {
+           return isLoopInvariant(operand, loop);
+         });
+}
+
+/// Returns the loop-invariant \p val for use in front of \p loop, cloning
+/// the ops that compute it inside the loop.
+static Value hoistValue(Value val, LoopLikeOpInterface loop,
+                        OpBuilder &builder) {
+  if (loop.isDefinedOutsideOfLoop(val))
+    return val;
+  Operation *def = val.getDefiningOp();
+  IRMapping mapping;
+  for (Value operand : def->getOperands())
+    mapping.map(operand, hoistValue(operand, loop, builder));
+  builder.setInsertionPoint(loop);
+  return builder.clone(*def, mapping)
+      ->getResult(val.cast<OpResult>().getResultNumber());
+}
+
+/// Moves the allocation stored by \p store out of the loop it is in, when
+/// its size is the same in every iteration and one of \p frees releases it
+/// later in the same iteration. The buffer is then allocated once before the
+/// loop and freed once after it, instead of in every iteration. Returns
+/// whether the allocation was moved.
+static bool hoistAllocation(LLVM::StoreOp store,
+                            const SmallPtrSetImpl<Operation *> &frees) {
+  Operation *loopOp = store->getParentOp();
+  if (!isa<scf::ForOp, scf::WhileOp, affine::AffineForOp>(loopOp))
+    return false;
+  auto loop = cast<LoopLikeOpInterface>(loopOp);
+
+  Value buffer = store.getValue();
+  Operation *alloc = buffer.getDefiningOp();
+  Value slot = getPointerSlot(store.getAddr());
+  if (!alloc || alloc->getBlock() != store->getBlock() || !slot ||
+      !loop.isDefinedOutsideOfLoop(slot) || !isOnlyWrite(store, slot) ||
+      !isLoopInvariant(store.getAddr(), loop) ||
+      !isLoopInvariant(alloc->getOperand(0), loop))
+    return false;
+
+  // The free must release the buffer of this iteration, so it must read the
+  // slot after the store. With typed pointers, its operand is usually cast to
+  // a void pointer.
+  auto isBuffer = [&](Value val) {
+    val = stripPointerCasts(val);
+    if (val == buffer)
+      return true;
+    Operation *def = val.getDefiningOp();
+    if (!def || def->getBlock() != store->getBlock() ||
+        !store->isBeforeInBlock(def))
+      return false;
+    if (auto load = dyn_cast<LLVM::LoadOp>(def))
+      return getPointerSlot(load.getAddr()) == slot;
+    if (auto load = dyn_cast<memref::LoadOp>(def))
+      return getPointerSlot(load.getMemRef()) == slot;
+    if (auto load = dyn_cast<affine::AffineLoadOp>(def))
+      return getPointerSlot(load.getMemRef()) == slot;
+    return false;
+  };
+  Operation *free = nullptr;
+  for (Operation *op = store->getNextNode(); op && !free;
+       op = op->getNextNode())
+    if (frees.contains(op) && isBuffer(op->getOperand(0)))
+      free = op;
+  if (!free)
+    return false;
+
+  OpBuilder builder(loop);
+  alloc->setOperand(0, hoistValue(alloc->getOperand(0), loop, builder));
+  store.getAddrMutable().assign(hoistValue(store.getAddr(), loop, builder));
+  alloc->moveBefore(loop);
+  store->moveBefore(loop);
+
+  free->moveAfter(loop);
+  builder.setInsertionPoint(free);
+  Value ptr = buffer;
+  if (ptr.getType() != free->getOperand(0).getType())
+    ptr = builder.create<LLVM::BitcastOp>(free->getLoc(),
+                                          free->getOperand(0).getType(), ptr);
+  free->setOperand(0, ptr);
+  return true;
+}
+
 void ConvertCudaRTtoCPU::runOnOperation() {
   // The inliner should only be run on operations that define a symbol table,
   // as the callgraph will need to resolve references.
@@ -800,6 +956,11 @@ void ConvertCudaRTtoCPU::runOnOperation() {
   SymbolTableCollection symbolTable;
   symbolTable.getSymbolTable(getOperation());
 
+  GpuRuntimeCallBuilders builders(&getContext(), /*pointerBitwidth*/ 64);
+  // The stores of the allocations and the frees, to move them out of loops.
+  SmallVector<LLVM::StoreOp> allocations;
+  SmallPtrSet<Operation *, 8> frees;
+
   std::function<void(Operation * call, StringRef callee)> replace =
       [&](Operation *call, StringRef callee) {
         if (callee == "cudaMemcpy" || callee == "cudaMemcpyAsync") {
@@ -881,9 +1042,14 @@ void ConvertCudaRTtoCPU::runOnOperation() {
           if (arg.getType().cast<IntegerType>().getWidth() < 64)
             arg =
                 bz.create<arith::ExtUIOp>(call->getLoc(), bz.getI64Type(), arg);
-          mlir::Value alloc =
-              callMalloc(bz, getOperation(), call->getLoc(), arg);
-          bz.create<LLVM::StoreOp>(call->getLoc(), alloc, call->getOperand(0));
+          mlir::Value alloc;
+          if (useRuntimeAllocator)
+            alloc = builders.cpuMallocCallBuilder(call->getLoc(), bz, {arg})
+                        ->getResult(0);
+          else
+            alloc = callMalloc(bz, getOperation(), call->getLoc(), arg);
+          allocations.push_back(bz.create<LLVM::StoreOp>(
+              call->getLoc(), alloc, call->getOperand(0)));
           {
             auto retv = bz.create<ConstantIntOp>(
                 call->getLoc(), 0,
@@ -893,10 +1059,14 @@ void ConvertCudaRTtoCPU::runOnOperation() {
             call->erase();
           }
         } else if (callee == "cudaFree" || callee == "cudaFreeHost") {
-          auto mf = GetOrCreateFreeFunction(getOperation());
           OpBuilder bz(call);
           Value args[] = {call->getOperand(0)};
-          bz.create<mlir::LLVM::CallOp>(call->getLoc(), mf, args);
+          if (useRuntimeAllocator)
+            frees.insert(builders.cpuFreeCallBuilder(call->getLoc(), bz, args));
+          else
+            frees.insert(bz.create<mlir::LLVM::CallOp>(
+                call->getLoc(), GetOrCreateFreeFunction(getOperation()),
+                args));
           {
             auto retv = bz.create<ConstantIntOp>(
                 call->getLoc(), 0,
@@ -936,6 +1106,11 @@ void ConvertCudaRTtoCPU::runOnOperation() {
 
   getOperation().walk([&](CallOp call) { replace(call, call.getCallee()); });
 
+  // Allocations in nested loops move out one loop at a time.
+  for (LLVM::StoreOp store : allocations)
+    while (hoistAllocation(store, frees))
+      numHoisted++;
+
   // Fold the copy memtype cast
   {
     mlir::RewritePatternSet rpl(getOperation()->getContext());
@@ -215,6 +215,13 @@ struct ParallelOpRaising : public OpRewritePattern<scf::ParallelOp> {
     if (loop.getResults().size())
       return failure();
 
+    // affine.parallel has no place for the OpenMP schedule or thread
+    // affinity of the loop.
+    if (loop->hasAttr("polygeist.schedule") ||
+        loop->hasAttr("polygeist.schedule_chunk") ||
+        loop->hasAttr("polygeist.proc_bind"))
+      return failure();
+
     if (!llvm::all_of(loop.getLowerBound(), isValidIndex)) {
       return failure();
     }
@@ -205,24 +205,30 @@ public:
       "mgpurtPGOGetAlternative",
       llvmInt32Type,
       {
-          llvmPointerType, /* const char *kernelId */
+          llvmInt64Type,   /* uint64_t kernelId */
+          llvmPointerType, /* const char *kernelName */
           llvmInt32Type,   /* int totalAlternatives */
       }};
   FunctionCallBuilder rtPGOStartCallBuilder = {
-      "mgpurtPGOStart",
-      llvmVoidType,
-      {
-          llvmPointerType, /* const char *kernelId */
-          llvmInt32Type,   /* int totalAlternatives */
-      }};
+      "mgpurtPGOStart", llvmInt64Type /* uint64_t start */, {}};
   FunctionCallBuilder rtPGOEndCallBuilder = {
       "mgpurtPGOEnd",
       llvmVoidType,
       {
-          llvmPointerType, /* const char *kernelId */
-          llvmInt32Type,   /* int totalAlternatives */
+          llvmInt64Type, /* uint64_t kernelId */
+          llvmInt32Type, /* int alternative */
+          llvmInt64Type, /* uint64_t start */
+          llvmInt64Type, /* uint64_t size */
       }};
 
+  //======================= CPU runtime =======================//
+  FunctionCallBuilder cpuMallocCallBuilder = {
+      "mgpurtCpuMalloc",
+      llvmPointerType /* void * */,
+      {llvmInt64Type /* uint64_t size */}};
+  FunctionCallBuilder cpuFreeCallBuilder = {
+      "mgpurtCpuFree", llvmVoidType, {llvmPointerType /* void *ptr */}};
+
   //======================= Other =======================//
   FunctionCallBuilder abortCallBuilder = {"abort", llvmVoidType, {}};
 };
@@ -0,0 +1,112 @@
+//===- SCFToOpenMP.cpp - Convert scf.parallel to OpenMP ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file wraps -convert-scf-to-openmp so that the schedule the frontend
+// recorded on an scf.parallel as the polygeist.schedule and
+// polygeist.schedule_chunk attributes ends up on the omp.wsloop it becomes,
+// and the polygeist.proc_bind affinity on the enclosing omp.parallel. The
+// upstream conversion does not keep the attributes of the loop, so each loop
+// gets a polygeist.noop in its body that carries them through.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+
+#include "mlir/Conversion/SCFToOpenMP/SCFToOpenMP.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/OpenMP/OpenMPDialect.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
+#include "mlir/Pass/PassManager.h"
+#include "polygeist/Passes/Passes.h"
+
+#define DEBUG_TYPE "polygeist-scf-to-openmp"
+
+using namespace mlir;
+using namespace polygeist;
+
+static constexpr StringLiteral kScheduleAttr = "polygeist.schedule";
+static constexpr StringLiteral kChunkAttr = "polygeist.schedule_chunk";
+static constexpr StringLiteral kProcBindAttr = "polygeist.proc_bind";
+static constexpr StringLiteral kNoopType = "omp.schedule";
+
+/// Returns the omp.wsloop that \p marker was placed in, or null if the loop
+/// was not converted. Such a loop keeps its marker directly in its own body,
+/// so the first loop around the marker decides.
+static omp::WsLoopOp getMarkedWsLoop(polygeist::NoopOp marker) {
+  for (Operation *op = marker->getParentOp(); op; op = op->getParentOp()) {
+    if (auto wsloop = dyn_cast<omp::WsLoopOp>(op))
+      return wsloop;
+    if (isa<LoopLikeOpInterface>(op))
+      return nullptr;
+  }
+  return nullptr;
+}
+
+namespace {
+struct SCFToOpenMPPass : public SCFToOpenMPBase<SCFToOpenMPPass> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+
+    module->walk([&](scf::ParallelOp loop) {
+      if (!loop->hasAttr(kScheduleAttr) && !loop->hasAttr(kChunkAttr) &&
+          !loop->hasAttr(kProcBindAttr))
+        return;
+      OpBuilder builder = OpBuilder::atBlockBegin(loop.getBody());
+      auto noop =
+          builder.create<polygeist::NoopOp>(loop.getLoc(), ValueRange());
+      noop->setAttr("polygeist.noop_type", builder.getStringAttr(kNoopType));
+      for (StringRef name : {kScheduleAttr, kChunkAttr, kProcBindAttr})
+        if (Attribute attr = loop->getAttr(name))
+          noop->setAttr(name, attr);
+    });
+
+    OpPassManager convert(ModuleOp::getOperationName());
+    convert.addPass(createConvertSCFToOpenMPPass());
+    if (failed(runPipeline(convert, module)))
+      return signalPassFailure();
+
+    SmallVector<polygeist::NoopOp> markers;
+    module->walk([&](polygeist::NoopOp noop) {
+      auto type = noop->getAttrOfType<StringAttr>("polygeist.noop_type");
+      if (type && type.getValue() == kNoopType)
+        markers.push_back(noop);
+    });
+    for (polygeist::NoopOp noop : markers) {
+      // A loop that was not converted, e.g. because it was nested in another
+      // parallel loop, runs serially and has no schedule.
+      omp::WsLoopOp wsloop = getMarkedWsLoop(noop);
+      if (wsloop &&
+          (noop->hasAttr(kScheduleAttr) || noop->hasAttr(kChunkAttr))) {
+        auto kind =
+            noop->getAttrOfType<omp::ClauseScheduleKindAttr>(kScheduleAttr);
+        if (!kind)
+          kind = omp::ClauseScheduleKindAttr::get(
+              &getContext(), omp::ClauseScheduleKind::Static);
+        wsloop.setScheduleValAttr(kind);
+        if (auto chunk = noop->getAttrOfType<IntegerAttr>(kChunkAttr)) {
+          OpBuilder builder(wsloop);
+          wsloop.getScheduleChunkVarMutable().assign(
+              builder.create<arith::ConstantOp>(wsloop.getLoc(), chunk));
+        }
+        numScheduled++;
+      }
+      auto procBind =
+          noop->getAttrOfType<omp::ClauseProcBindKindAttr>(kProcBindAttr);
+      if (wsloop && procBind)
+        if (auto parallel = wsloop->getParentOfType<omp::ParallelOp>())
+          parallel.setProcBindValAttr(procBind);
+      noop->erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<Pass> mlir::polygeist::createSCFToOpenMPPass() {
+  return std::make_unique<SCFToOpenMPPass>();
+}
@@ -22,7 +22,7 @@ config.name = 'polygeist'
 config.test_format = lit.formats.ShTest(not llvm_config.use_lit_shell)
 
 # suffixes: A list of file extensions to treat as test files.
-config.suffixes = ['.mlir', '.c']
+config.suffixes = ['.mlir', '.c', '.test']
 
 # test_source_root: The root path where tests are located.
 config.test_source_root = os.path.dirname(__file__)
@@ -38,6 +38,7 @@ config.substitutions.append(('%llvm_shlibdir', config.llvm_lib_dir))
 config.substitutions.append(('%llvm_obj_root', config.llvm_obj_root))
 config.substitutions.append(('%polygeist_src_root', config.polygeist_src_root))
 config.substitutions.append(('%polygeist_obj_root', config.polygeist_obj_root))
+config.substitutions.append(('%clangxx', os.path.join(config.llvm_tools_dir, 'clang++')))
 
 llvm_config.with_system_environment(['HOME', 'INCLUDE', 'LIB', 'TMP', 'TEMP'])
 
@@ -58,6 +59,6 @@ config.test_exec_root = os.path.join(config.polygeist_obj_root, 'test')
 llvm_config.with_environment('PATH', config.llvm_tools_dir, append_path=True)
 
 tool_dirs = [config.polygeist_tools_dir]
-tools = ['polygeist-opt']
+tools = ['polygeist-opt', 'polygeist-pgo-merge']
 
 llvm_config.add_tool_substitutions(tools, tool_dirs)
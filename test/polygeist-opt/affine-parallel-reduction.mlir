@@ -0,0 +1,83 @@
+// RUN: polygeist-opt --detect-reduction --affine-parallel-reduction --split-input-file %s | FileCheck %s
+// RUN: polygeist-opt --detect-reduction --affine-parallel-reduction="fast-math=1" --split-input-file %s | FileCheck %s --check-prefix=FAST
+
+module {
+  func.func @dot(%x: memref<1024xi32>, %y: memref<1024xi32>, %out: memref<1xi32>) {
+    affine.for %i = 0 to 1024 {
+      %a = affine.load %x[%i] : memref<1024xi32>
+      %b = affine.load %y[%i] : memref<1024xi32>
+      %p = arith.muli %a, %b : i32
+      %s = affine.load %out[0] : memref<1xi32>
+      %t = arith.addi %s, %p : i32
+      affine.store %t, %out[0] : memref<1xi32>
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @dot(
+// CHECK:         affine.load %{{.*}}[0] : memref<1xi32>
+// CHECK:         affine.parallel (%{{.*}}) = (0) to (1024) reduce ("addi") -> (i32) {
+// CHECK:           arith.muli
+// CHECK:           affine.yield %{{.*}} : i32
+// CHECK:         %[[RES:.+]] = arith.addi %{{.*}}, %{{.*}} : i32
+// CHECK:         affine.store %[[RES]], %{{.*}}[0] : memref<1xi32>
+
+// -----
+
+module {
+  func.func @norm(%x: memref<1024xf64>, %out: memref<1xf64>) {
+    affine.for %i = 0 to 1024 {
+      %a = affine.load %x[%i] : memref<1024xf64>
+      %p = arith.mulf %a, %a : f64
+      %s = affine.load %out[0] : memref<1xf64>
+      %t = arith.addf %s, %p : f64
+      affine.store %t, %out[0] : memref<1xf64>
+    }
+    return
+  }
+}
+
+// Without fast-math, the sum stays in order.
+// CHECK-LABEL: func.func @norm(
+// CHECK:         affine.for %{{.*}} = 0 to 1024 iter_args(
+// CHECK-NOT:     affine.parallel
+
+// FAST-LABEL: func.func @norm(
+// FAST:         affine.parallel (%{{.*}}) = (0) to (1024) reduce ("addf") -> (f64) {
+
+// -----
+
+module {
+  func.func @reassoc(%x: memref<1024xf64>, %out: memref<1xf64>) {
+    affine.for %i = 0 to 1024 {
+      %a = affine.load %x[%i] : memref<1024xf64>
+      %s = affine.load %out[0] : memref<1xf64>
+      %t = arith.addf %s, %a fastmath<reassoc> : f64
+      affine.store %t, %out[0] : memref<1xf64>
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @reassoc(
+// CHECK:         affine.parallel (%{{.*}}) = (0) to (1024) reduce ("addf") -> (f64) {
+
+// -----
+
+module {
+  func.func @prefix(%x: memref<1024xi32>, %out: memref<1xi32>, %pre: memref<1024xi32>) {
+    affine.for %i = 0 to 1024 {
+      %a = affine.load %x[%i] : memref<1024xi32>
+      %s = affine.load %out[0] : memref<1xi32>
+      %t = arith.addi %s, %a : i32
+      affine.store %t, %out[0] : memref<1xi32>
+      affine.store %t, %pre[%i] : memref<1024xi32>
+    }
+    return
+  }
+}
+
+// The partial sums are used within the loop, so it is not a reduction.
+// CHECK-LABEL: func.func @prefix(
+// CHECK-NOT:     affine.parallel
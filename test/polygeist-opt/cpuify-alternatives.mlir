@@ -0,0 +1,58 @@
+// RUN: polygeist-opt --cpuify="method=distribute|omp" %s | FileCheck %s
+
+module {
+  func.func private @produce(memref<?xf32>, index)
+  func.func private @consume(memref<?xf32>, index)
+  func.func @kernel(%n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c32 = arith.constant 32 : index
+    scf.parallel (%b) = (%c0) to (%n) step (%c1) {
+      %shared = memref.alloca(%c32) : memref<?xf32>
+      scf.parallel (%t) = (%c0) to (%c32) step (%c1) {
+        func.call @produce(%shared, %t) : (memref<?xf32>, index) -> ()
+        "polygeist.barrier"(%t) : (index) -> ()
+        func.call @consume(%shared, %t) : (memref<?xf32>, index) -> ()
+        scf.yield
+      }
+      scf.yield
+    }
+    return
+  }
+  func.func @plain(%a: memref<?xf32>, %n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    scf.parallel (%i) = (%c0) to (%n) step (%c1) {
+      %v = "polygeist.cacheload"(%a, %i) : (memref<?xf32>, index) -> f32
+      memref.store %v, %a[%i] : memref<?xf32>
+      scf.yield
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @kernel(
+// CHECK:         "polygeist.alternatives"() ({
+// CHECK:           scf.parallel
+// CHECK:             scf.parallel
+// CHECK:               func.call @produce
+// CHECK:             scf.parallel
+// CHECK:               func.call @consume
+// CHECK-NOT:       polygeist.barrier
+// CHECK:           "polygeist.polygeist_yield"() : () -> ()
+// CHECK-NEXT:    }, {
+// CHECK:           scf.parallel
+// CHECK:             scf.parallel
+// CHECK:               func.call @produce
+// CHECK-NEXT:          omp.barrier
+// CHECK-NEXT:          func.call @consume
+// CHECK:           "polygeist.polygeist_yield"() : () -> ()
+// CHECK-NEXT:    }) {alternatives.descs = ["cpuify=distribute,", "cpuify=omp,"], alternatives.type = "cpu_kernel"} : () -> ()
+
+// Loops without barriers get no alternatives, but are still lowered as the
+// distribute strategy lowers them.
+// CHECK-LABEL: func.func @plain(
+// CHECK-NOT:     polygeist.alternatives
+// CHECK:         scf.parallel
+// CHECK-NEXT:      memref.load
+// CHECK-NOT:     polygeist.cacheload
@@ -0,0 +1,135 @@
+// RUN: polygeist-opt --convert-cudart-to-cpu="use-runtime-allocator=1" --split-input-file %s | FileCheck %s
+// RUN: polygeist-opt --convert-cudart-to-cpu --split-input-file %s | FileCheck %s --check-prefix=MALLOC
+
+module {
+  llvm.func @cudaMalloc(!llvm.ptr, i64) -> i32
+  llvm.func @cudaFree(!llvm.ptr) -> i32
+  llvm.func @use(!llvm.ptr)
+  func.func @scratch(%n: i64, %iters: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %slot = memref.alloca() : memref<1x!llvm.ptr>
+    %ptr = "polygeist.memref2pointer"(%slot) : (memref<1x!llvm.ptr>) -> !llvm.ptr
+    scf.for %i = %c0 to %iters step %c1 {
+      scf.for %j = %c0 to %iters step %c1 {
+        %0 = llvm.call @cudaMalloc(%ptr, %n) : (!llvm.ptr, i64) -> i32
+        %p = affine.load %slot[0] : memref<1x!llvm.ptr>
+        llvm.call @use(%p) : (!llvm.ptr) -> ()
+        %1 = llvm.call @cudaFree(%p) : (!llvm.ptr) -> i32
+      }
+    }
+    return
+  }
+}
+
+// CHECK-LABEL:   func.func @scratch(
+// CHECK-SAME:                       %[[N:.+]]: i64, %[[ITERS:.+]]: index)
+// CHECK:           %[[SLOT:.+]] = memref.alloca() : memref<1x!llvm.ptr>
+// CHECK:           %[[PTR:.+]] = "polygeist.memref2pointer"(%[[SLOT]])
+// CHECK:           %[[BUF:.+]] = llvm.call @mgpurtCpuMalloc(%[[N]]) : (i64) -> !llvm.ptr
+// CHECK-NEXT:      llvm.store %[[BUF]], %[[PTR]] : !llvm.ptr, !llvm.ptr
+// CHECK-NEXT:      scf.for
+// CHECK-NEXT:        scf.for
+// CHECK-NEXT:          %[[P:.+]] = affine.load %[[SLOT]][0] : memref<1x!llvm.ptr>
+// CHECK-NEXT:          llvm.call @use(%[[P]]) : (!llvm.ptr) -> ()
+// CHECK-NEXT:        }
+// CHECK-NEXT:      }
+// CHECK-NEXT:      llvm.call @mgpurtCpuFree(%[[BUF]]) : (!llvm.ptr) -> ()
+// CHECK-NEXT:      return
+
+// MALLOC-LABEL:  func.func @scratch(
+// MALLOC:          %[[BUF:.+]] = llvm.call @malloc(
+// MALLOC:          scf.for
+// MALLOC-NOT:      llvm.call @{{malloc|free}}
+// MALLOC:          llvm.call @free(
+// MALLOC-NEXT:     return
+
+// -----
+
+module {
+  llvm.func @cudaMalloc(!llvm.ptr, i64) -> i32
+  llvm.func @cudaFree(!llvm.ptr) -> i32
+  llvm.func @use(!llvm.ptr)
+  func.func @casts(%n: i64, %iters: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %one = arith.constant 1 : i64
+    %slot = llvm.alloca %one x !llvm.ptr : (i64) -> !llvm.ptr
+    scf.for %i = %c0 to %iters step %c1 {
+      %addr = llvm.bitcast %slot : !llvm.ptr to !llvm.ptr
+      %0 = llvm.call @cudaMalloc(%addr, %n) : (!llvm.ptr, i64) -> i32
+      %p = llvm.load %slot : !llvm.ptr -> !llvm.ptr
+      llvm.call @use(%p) : (!llvm.ptr) -> ()
+      %v = llvm.bitcast %p : !llvm.ptr to !llvm.ptr
+      %1 = llvm.call @cudaFree(%v) : (!llvm.ptr) -> i32
+    }
+    return
+  }
+}
+
+// The free matches the buffer through the casts of its operand.
+// CHECK-LABEL:   func.func @casts(
+// CHECK:           %[[BUF:.+]] = llvm.call @mgpurtCpuMalloc(
+// CHECK-NEXT:      llvm.store %[[BUF]]
+// CHECK-NEXT:      scf.for
+// CHECK-NOT:         @mgpurtCpu
+// CHECK:           }
+// CHECK-NEXT:      llvm.call @mgpurtCpuFree(%[[BUF]]) : (!llvm.ptr) -> ()
+// CHECK-NEXT:      return
+
+// -----
+
+module {
+  llvm.func @cudaMalloc(!llvm.ptr, i64) -> i32
+  llvm.func @cudaFree(!llvm.ptr) -> i32
+  func.func @growing(%iters: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %slot = memref.alloca() : memref<1x!llvm.ptr>
+    %ptr = "polygeist.memref2pointer"(%slot) : (memref<1x!llvm.ptr>) -> !llvm.ptr
+    scf.for %i = %c0 to %iters step %c1 {
+      %n = arith.index_cast %i : index to i64
+      %0 = llvm.call @cudaMalloc(%ptr, %n) : (!llvm.ptr, i64) -> i32
+      %p = affine.load %slot[0] : memref<1x!llvm.ptr>
+      %1 = llvm.call @cudaFree(%p) : (!llvm.ptr) -> i32
+    }
+    return
+  }
+}
+
+// CHECK-LABEL:   func.func @growing(
+// CHECK:           scf.for %[[I:.+]] =
+// CHECK-NEXT:        %[[N:.+]] = arith.index_cast %[[I]] : index to i64
+// CHECK-NEXT:        %[[BUF:.+]] = llvm.call @mgpurtCpuMalloc(%[[N]]) : (i64) -> !llvm.ptr
+// CHECK-NEXT:        llvm.store %[[BUF]], %{{.+}} : !llvm.ptr, !llvm.ptr
+// CHECK-NEXT:        %[[P:.+]] = affine.load
+// CHECK-NEXT:        llvm.call @mgpurtCpuFree(%[[P]]) : (!llvm.ptr) -> ()
+// CHECK-NEXT:      }
+
+// -----
+
+module {
+  llvm.func @cudaMalloc(!llvm.ptr, i64) -> i32
+  llvm.func @cudaFree(!llvm.ptr) -> i32
+  func.func @kept(%n: i64, %iters: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %slot = memref.alloca() : memref<1x!llvm.ptr>
+    %ptr = "polygeist.memref2pointer"(%slot) : (memref<1x!llvm.ptr>) -> !llvm.ptr
+    scf.for %i = %c0 to %iters step %c1 {
+      %p = affine.load %slot[0] : memref<1x!llvm.ptr>
+      %0 = llvm.call @cudaMalloc(%ptr, %n) : (!llvm.ptr, i64) -> i32
+      %1 = llvm.call @cudaFree(%p) : (!llvm.ptr) -> i32
+    }
+    return
+  }
+}
+
+// The buffer of the previous iteration is freed, so it must stay in the loop.
+// CHECK-LABEL:   func.func @kept(
+// CHECK:           scf.for
+// CHECK-NEXT:        %[[P:.+]] = affine.load
+// CHECK-NEXT:        llvm.call @mgpurtCpuMalloc
+// CHECK-NEXT:        llvm.store
+// CHECK-NEXT:        llvm.call @mgpurtCpuFree(%[[P]])
+// CHECK-NEXT:      }
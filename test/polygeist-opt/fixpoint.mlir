@@ -0,0 +1,34 @@
+// RUN: polygeist-opt --pass-pipeline="builtin.module(func.func(polygeist-fixpoint{pipeline={polygeist-mem2reg,canonicalize-polygeist,cse}}))" %s | FileCheck %s
+// RUN: polygeist-opt --pass-pipeline="builtin.module(func.func(polygeist-fixpoint{pipeline={polygeist-mem2reg,canonicalize-polygeist,cse} max-iterations=1}))" %s | FileCheck %s --check-prefix=ONCE
+// RUN: polygeist-opt --pass-pipeline="builtin.module(func.func(polygeist-fixpoint{pipeline={polygeist-mem2reg,canonicalize-polygeist,cse}}))" --dump-pass-pipeline %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=PIPELINE
+
+module {
+  func.func @twice(%arg0: i32) -> i32 {
+    %c1_i32 = arith.constant 1 : i32
+    %0 = memref.alloca() : memref<i32>
+    memref.store %arg0, %0[] : memref<i32>
+    %1 = memref.load %0[] : memref<i32>
+    %2 = arith.addi %1, %c1_i32 : i32
+    %3 = memref.load %0[] : memref<i32>
+    %4 = arith.addi %3, %c1_i32 : i32
+    %5 = arith.subi %2, %4 : i32
+    return %5 : i32
+  }
+}
+
+// The subtraction only folds once CSE has merged both additions, which takes
+// a second round over the pipeline.
+
+// CHECK:   func.func @twice(%[[arg0:.+]]: i32) -> i32 {
+// CHECK-NEXT:     %[[c0:.+]] = arith.constant 0 : i32
+// CHECK-NEXT:     return %[[c0]] : i32
+// CHECK-NEXT:   }
+
+// ONCE:   func.func @twice(%[[arg0:.+]]: i32) -> i32 {
+// ONCE-NEXT:     %[[c1:.+]] = arith.constant 1 : i32
+// ONCE-NEXT:     %[[add:.+]] = arith.addi %[[arg0]], %[[c1]] : i32
+// ONCE-NEXT:     %[[sub:.+]] = arith.subi %[[add]], %[[add]] : i32
+// ONCE-NEXT:     return %[[sub]] : i32
+// ONCE-NEXT:   }
+
+// PIPELINE: polygeist-fixpoint{{.*}}polygeist-mem2reg,canonicalize-polygeist,cse
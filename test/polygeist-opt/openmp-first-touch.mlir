@@ -0,0 +1,121 @@
+// RUN: polygeist-opt --openmp-first-touch --split-input-file %s | FileCheck %s
+
+module {
+  func.func @init(%n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c8 = arith.constant 8 : i32
+    %zero = arith.constant 0.0 : f64
+    %a = memref.alloc(%n) : memref<?xf64>
+    scf.for %i = %c0 to %n step %c1 {
+      memref.store %zero, %a[%i] : memref<?xf64>
+    }
+    omp.parallel num_threads(%c8 : i32) proc_bind(spread) {
+      %chunk = arith.constant 64 : i64
+      omp.wsloop schedule(static = %chunk : i64) for (%i) : index = (%c0) to (%n) step (%c1) {
+        %x = memref.load %a[%i] : memref<?xf64>
+        %y = arith.addf %x, %x : f64
+        memref.store %y, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @init(
+// CHECK:         %[[C8:.+]] = arith.constant 8 : i32
+// CHECK:         %[[A:.+]] = memref.alloc
+// CHECK-NEXT:    %[[CHUNK:.+]] = arith.constant 64 : i64
+// CHECK-NEXT:    omp.parallel num_threads(%[[C8]] : i32) proc_bind(spread) {
+// CHECK-NEXT:      omp.wsloop schedule(static = %[[CHUNK]] : i64) for (%[[I:.+]]) : index
+// CHECK-NEXT:        memref.store %{{.*}}, %[[A]][%[[I]]]
+// CHECK-NEXT:        omp.yield
+// CHECK-NEXT:      }
+// CHECK-NEXT:      omp.terminator
+// CHECK-NEXT:    }
+// CHECK-NEXT:    omp.parallel num_threads(%[[C8]] : i32) proc_bind(spread) {
+
+// -----
+
+module {
+  func.func @dynamic(%n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %zero = arith.constant 0.0 : f64
+    %a = memref.alloc(%n) : memref<?xf64>
+    scf.for %i = %c0 to %n step %c1 {
+      memref.store %zero, %a[%i] : memref<?xf64>
+    }
+    omp.parallel {
+      omp.wsloop schedule(dynamic) for (%i) : index = (%c0) to (%n) step (%c1) {
+        %x = memref.load %a[%i] : memref<?xf64>
+        memref.store %x, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Threads get different iterations on every run of a dynamic loop.
+// CHECK-LABEL: func.func @dynamic(
+// CHECK:         scf.for
+
+// -----
+
+module {
+  func.func @prefix(%n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %a = memref.alloc(%n) : memref<?xf64>
+    scf.for %i = %c1 to %n step %c1 {
+      %im1 = arith.subi %i, %c1 : index
+      %x = memref.load %a[%im1] : memref<?xf64>
+      memref.store %x, %a[%i] : memref<?xf64>
+    }
+    omp.parallel {
+      omp.wsloop for (%i) : index = (%c1) to (%n) step (%c1) {
+        %x = memref.load %a[%i] : memref<?xf64>
+        memref.store %x, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Every iteration reads what the previous one wrote.
+// CHECK-LABEL: func.func @prefix(
+// CHECK:         scf.for
+
+// -----
+
+module {
+  func.func @small() {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c16 = arith.constant 16 : index
+    %zero = arith.constant 0.0 : f64
+    %a = memref.alloc() : memref<16xf64>
+    scf.for %i = %c0 to %c16 step %c1 {
+      memref.store %zero, %a[%i] : memref<16xf64>
+    }
+    omp.parallel {
+      omp.wsloop for (%i) : index = (%c0) to (%c16) step (%c1) {
+        %x = memref.load %a[%i] : memref<16xf64>
+        memref.store %x, %a[%i] : memref<16xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// The array fits into a single page.
+// CHECK-LABEL: func.func @small(
+// CHECK:         scf.for
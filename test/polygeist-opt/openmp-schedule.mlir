@@ -0,0 +1,102 @@
+// RUN: polygeist-opt --openmp-schedule="num-threads=4 remarks=1" --verify-diagnostics --split-input-file %s | FileCheck %s
+
+module {
+  func.func @uniform(%a: memref<?x?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c64 = arith.constant 64 : index
+    %cst = arith.constant 0.0 : f64
+    omp.parallel {
+      // expected-remark @below {{schedule(static): all iterations do the same work, about}}
+      omp.wsloop for (%i) : index = (%c0) to (%c64) step (%c1) {
+        scf.for %j = %c0 to %c64 step %c1 {
+          memref.store %cst, %a[%i, %j] : memref<?x?xf64>
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @uniform(
+// CHECK:         omp.wsloop schedule(static) for
+
+// -----
+
+module {
+  func.func @triangular(%a: memref<?x?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c512 = arith.constant 512 : index
+    %cst = arith.constant 0.0 : f64
+    omp.parallel {
+      // expected-remark @below {{schedule(static, 16): the work of an inner 'scf.for' varies with the induction variable}}
+      omp.wsloop for (%i) : index = (%c0) to (%c512) step (%c1) {
+        %ub = arith.addi %i, %c1 : index
+        scf.for %j = %c0 to %ub step %c1 {
+          memref.store %cst, %a[%i, %j] : memref<?x?xf64>
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @triangular(
+// CHECK:         %[[CHUNK:.+]] = arith.constant 16 : i64
+// CHECK:         omp.wsloop schedule(static = %[[CHUNK]] : i64) for
+
+// -----
+
+module {
+  func.func @irregular(%n: index, %rows: memref<?xindex>, %a: memref<?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 0.0 : f64
+    omp.parallel {
+      // expected-remark @below {{schedule(guided): the work of an inner 'scf.for' depends on data}}
+      omp.wsloop for (%i) : index = (%c0) to (%n) step (%c1) {
+        %lb = memref.load %rows[%i] : memref<?xindex>
+        %next = arith.addi %i, %c1 : index
+        %ub = memref.load %rows[%next] : memref<?xindex>
+        scf.for %j = %lb to %ub step %c1 {
+          memref.store %cst, %a[%j] : memref<?xf64>
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @irregular(
+// CHECK:         omp.wsloop schedule(guided) for
+
+// -----
+
+module {
+  func.func @explicit(%n: index, %rows: memref<?xindex>, %a: memref<?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 0.0 : f64
+    omp.parallel {
+      omp.wsloop schedule(static) for (%i) : index = (%c0) to (%n) step (%c1) {
+        %lb = memref.load %rows[%i] : memref<?xindex>
+        scf.for %j = %lb to %n step %c1 {
+          memref.store %cst, %a[%j] : memref<?xf64>
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @explicit(
+// CHECK:         omp.wsloop schedule(static) for
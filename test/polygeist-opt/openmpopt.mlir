@@ -1,4 +1,5 @@
 // RUN: polygeist-opt --openmp-opt --split-input-file %s | FileCheck %s
+// RUN: polygeist-opt --openmp-opt="num-threads=2" --split-input-file %s | FileCheck %s --check-prefix=TWO
 
 module {
   func.func private @inner(index) -> ()
@@ -51,3 +52,253 @@ module {
 // CHECK-NEXT:     }
 // CHECK-NEXT:     return
 // CHECK-NEXT:   }
+
+// -----
+
+module {
+  func.func @sweep(%n: index) {
+    %a = memref.alloc(%n) : memref<?xf64>
+    %b = memref.alloc(%n) : memref<?xf64>
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 2.0 : f64
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c0) to (%n) step (%c1) {
+        %x = memref.load %a[%i] : memref<?xf64>
+        %y = arith.mulf %x, %cst : f64
+        memref.store %y, %b[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c0) to (%n) step (%c1) {
+        %x = memref.load %b[%i] : memref<?xf64>
+        memref.store %x, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.barrier
+      omp.terminator
+    }
+    return
+  }
+}
+
+// The second loop only reads what the same thread wrote in the first one.
+// CHECK-LABEL: func.func @sweep(
+// CHECK:         omp.parallel   {
+// CHECK-NEXT:      omp.wsloop   nowait for
+// CHECK:           omp.wsloop   for
+// CHECK:             omp.yield
+// CHECK-NEXT:      }
+// CHECK-NEXT:      omp.terminator
+// CHECK-NEXT:    }
+
+// -----
+
+module {
+  func.func @stencil(%n: index) {
+    %a = memref.alloc(%n) : memref<?xf64>
+    %b = memref.alloc(%n) : memref<?xf64>
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c1) to (%n) step (%c1) {
+        %im1 = arith.subi %i, %c1 : index
+        %x = memref.load %a[%im1] : memref<?xf64>
+        memref.store %x, %b[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c1) to (%n) step (%c1) {
+        %x = memref.load %b[%i] : memref<?xf64>
+        memref.store %x, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// The second loop overwrites elements that other threads read in the first.
+// CHECK-LABEL: func.func @stencil(
+// CHECK:         omp.parallel   {
+// CHECK-NEXT:      omp.wsloop   for
+// CHECK-NOT:       omp.barrier
+// CHECK:           omp.wsloop   for
+
+// -----
+
+module {
+  func.func @chain(%n: index) {
+    %a = memref.alloc(%n) : memref<?xf64>
+    %b = memref.alloc(%n) : memref<?xf64>
+    %c = memref.alloc(%n) : memref<?xf64>
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 2.0 : f64
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c1) to (%n) step (%c1) {
+        %im1 = arith.subi %i, %c1 : index
+        %x = memref.load %a[%im1] : memref<?xf64>
+        memref.store %x, %b[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.wsloop   for  (%i) : index = (%c1) to (%n) step (%c1) {
+        %x = memref.load %b[%i] : memref<?xf64>
+        memref.store %x, %c[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.wsloop   for  (%i) : index = (%c1) to (%n) step (%c1) {
+        memref.store %cst, %a[%i] : memref<?xf64>
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Only the first and the last loop conflict, so only one of the first two
+// barriers can go.
+// CHECK-LABEL: func.func @chain(
+// CHECK:         nowait
+// CHECK-NOT:     nowait
+// CHECK:         return
+
+// -----
+
+module {
+  func.func private @inner2(index, index) -> ()
+  func.func @grid(%n: index, %m: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c0) to (%n) step (%c1) {
+        omp.parallel   {
+          omp.wsloop   for  (%j) : index = (%c0) to (%m) step (%c1) {
+            func.call @inner2(%i, %j) : (index, index) -> ()
+            omp.yield
+          }
+          omp.terminator
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Independent bounds collapse into one loop.
+// CHECK-LABEL: func.func @grid(
+// CHECK-SAME:      %[[N:.+]]: index, %[[M:.+]]: index)
+// CHECK:         omp.parallel   {
+// CHECK-NEXT:      omp.wsloop   for  (%[[I:.+]], %[[J:.+]]) : index = (%{{.*}}, %{{.*}}) to (%[[N]], %[[M]]) step (%{{.*}}, %{{.*}}) {
+// CHECK-NEXT:        func.call @inner2(%[[I]], %[[J]]) : (index, index) -> ()
+// CHECK-NEXT:        omp.yield
+// CHECK-NEXT:      }
+// CHECK-NEXT:      omp.terminator
+// CHECK-NEXT:    }
+
+// -----
+
+module {
+  func.func private @use(memref<32xf32>, index, index) -> ()
+  func.func @block(%n: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    omp.parallel   {
+      omp.wsloop   for  (%i) : index = (%c0) to (%n) step (%c1) {
+        %shared = memref.alloca() : memref<32xf32>
+        scf.parallel (%j) = (%c0) to (%i) step (%c1) {
+          func.call @use(%shared, %i, %j) : (memref<32xf32>, index, index) -> ()
+          scf.yield
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// The inner loop depends on the outer one and shares memory across its
+// iterations, so it runs serially.
+// CHECK-LABEL: func.func @block(
+// CHECK:         omp.wsloop   for  (%[[I:.+]]) : index
+// CHECK-NEXT:      %[[S:.+]] = memref.alloca() : memref<32xf32>
+// CHECK-NEXT:      scf.for %[[J:.+]] = %{{.*}} to %[[I]] step %{{.*}} {
+// CHECK-NEXT:        func.call @use(%[[S]], %[[I]], %[[J]])
+// CHECK-NEXT:      }
+// CHECK-NEXT:      omp.yield
+
+// -----
+
+module {
+  func.func private @inner2(index, index) -> ()
+  func.func @few(%m: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c2 = arith.constant 2 : index
+    %c8 = arith.constant 8 : i32
+    omp.parallel num_threads(%c8 : i32) {
+      omp.wsloop   for  (%i) : index = (%c0) to (%c2) step (%c1) {
+        omp.parallel   {
+          omp.wsloop   for  (%j) : index = (%i) to (%m) step (%c1) {
+            func.call @inner2(%i, %j) : (index, index) -> ()
+            omp.yield
+          }
+          omp.terminator
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Two outer iterations cannot use eight threads, so the nesting stays.
+// CHECK-LABEL: func.func @few(
+// CHECK:         omp.wsloop
+// CHECK-NEXT:      omp.parallel
+// CHECK-NEXT:        omp.wsloop
+
+// -----
+
+module {
+  func.func private @inner2(index, index) -> ()
+  func.func @unset(%m: index) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c4 = arith.constant 4 : index
+    omp.parallel {
+      omp.wsloop   for  (%i) : index = (%c0) to (%c4) step (%c1) {
+        omp.parallel   {
+          omp.wsloop   for  (%j) : index = (%i) to (%m) step (%c1) {
+            func.call @inner2(%i, %j) : (index, index) -> ()
+            omp.yield
+          }
+          omp.terminator
+        }
+        omp.yield
+      }
+      omp.terminator
+    }
+    return
+  }
+}
+
+// Without num_threads, the pass assumes the num-threads option, 16 by
+// default, whatever machine it runs on.
+// CHECK-LABEL: func.func @unset(
+// CHECK:         omp.wsloop
+// CHECK-NEXT:      omp.parallel
+// CHECK-NEXT:        omp.wsloop
+// TWO-LABEL:   func.func @unset(
+// TWO:           omp.wsloop
+// TWO-NEXT:        scf.for
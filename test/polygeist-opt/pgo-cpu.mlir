@@ -0,0 +1,22 @@
+// RUN: polygeist-opt --lower-alternatives --convert-polygeist-to-llvm %s | FileCheck %s
+
+module {
+  func.func private @distributed()
+  func.func private @barriers()
+  func.func @f() {
+    "polygeist.alternatives"() ({
+      func.call @distributed() : () -> ()
+      "polygeist.polygeist_yield"() : () -> ()
+    }, {
+      func.call @barriers() : () -> ()
+      "polygeist.polygeist_yield"() : () -> ()
+    }) {alternatives.descs = ["cpuify=distribute,", "cpuify=omp,"], alternatives.type = "cpu_kernel"} : () -> ()
+
+    return
+  }
+}
+
+// Without a profile, the first strategy is used.
+// CHECK-LABEL:   llvm.func @f() {
+// CHECK-NEXT:      llvm.call @distributed() : () -> ()
+// CHECK-NEXT:      llvm.return
@@ -20,26 +20,28 @@ module {
 // CHECK-LABEL:   llvm.mlir.global internal constant @kernelId.0
 
 // CHECK-LABEL:   llvm.func @f() {
-// CHECK:           %[[VAL_0:.*]] = llvm.mlir.constant(2 : i32) : i32
-// CHECK:           %[[VAL_1:.*]] = llvm.mlir.constant(0 : i32) : i32
-// CHECK:           %[[VAL_2:.*]] = llvm.mlir.constant(1 : i32) : i32
-// CHECK:           %[[VAL_3:.*]] = llvm.mlir.addressof @kernelId.0 : !llvm.ptr
-// CHECK:           %[[VAL_4:.*]] = llvm.getelementptr %[[VAL_3]][0, 0] : (!llvm.ptr) -> !llvm.ptr
-// CHECK:           %[[VAL_5:.*]] = llvm.call @mgpurtPGOGetAlternative(%[[VAL_4]], %[[VAL_0]]) : (!llvm.ptr, i32) -> i32
-// CHECK:           %[[VAL_6:.*]] = llvm.icmp "eq" %[[VAL_5]], %[[VAL_1]] : i32
-// CHECK:           llvm.cond_br %[[VAL_6]], ^bb1, ^bb2
+// CHECK-DAG:       %[[TOTAL:.*]] = llvm.mlir.constant(2 : i32) : i32
+// CHECK-DAG:       %[[ZERO:.*]] = llvm.mlir.constant(0 : i32) : i32
+// CHECK-DAG:       %[[ONE:.*]] = llvm.mlir.constant(1 : i32) : i32
+// CHECK-DAG:       %[[ID:.*]] = llvm.mlir.constant({{-?[1-9][0-9]*}} : i64) : i64
+// CHECK-DAG:       %[[SIZE:.*]] = llvm.mlir.constant(0 : i64) : i64
+// CHECK:           %[[ADDR:.*]] = llvm.mlir.addressof @kernelId.0 : !llvm.ptr
+// CHECK:           %[[NAME:.*]] = llvm.getelementptr %[[ADDR]][0, 0] : (!llvm.ptr) -> !llvm.ptr
+// CHECK:           %[[ALT:.*]] = llvm.call @mgpurtPGOGetAlternative(%[[ID]], %[[NAME]], %[[TOTAL]]) : (i64, !llvm.ptr, i32) -> i32
+// CHECK:           %[[IS0:.*]] = llvm.icmp "eq" %[[ALT]], %[[ZERO]] : i32
+// CHECK:           llvm.cond_br %[[IS0]], ^bb1, ^bb2
 // CHECK:         ^bb1:
-// CHECK:           llvm.call @mgpurtPGOStart(%[[VAL_4]], %[[VAL_0]]) : (!llvm.ptr, i32) -> ()
+// CHECK:           %[[START0:.*]] = llvm.call @mgpurtPGOStart() : () -> i64
 // CHECK:           llvm.call @wow0() : () -> ()
-// CHECK:           llvm.call @mgpurtPGOEnd(%[[VAL_4]], %[[VAL_0]]) : (!llvm.ptr, i32) -> ()
+// CHECK:           llvm.call @mgpurtPGOEnd(%[[ID]], %[[ALT]], %[[START0]], %[[SIZE]]) : (i64, i32, i64, i64) -> ()
 // CHECK:           llvm.br ^bb6
 // CHECK:         ^bb2:
-// CHECK:           %[[VAL_7:.*]] = llvm.icmp "eq" %[[VAL_5]], %[[VAL_2]] : i32
-// CHECK:           llvm.cond_br %[[VAL_7]], ^bb3, ^bb4
+// CHECK:           %[[IS1:.*]] = llvm.icmp "eq" %[[ALT]], %[[ONE]] : i32
+// CHECK:           llvm.cond_br %[[IS1]], ^bb3, ^bb4
 // CHECK:         ^bb3:
-// CHECK:           llvm.call @mgpurtPGOStart(%[[VAL_4]], %[[VAL_0]]) : (!llvm.ptr, i32) -> ()
+// CHECK:           %[[START1:.*]] = llvm.call @mgpurtPGOStart() : () -> i64
 // CHECK:           llvm.call @wow1() : () -> ()
-// CHECK:           llvm.call @mgpurtPGOEnd(%[[VAL_4]], %[[VAL_0]]) : (!llvm.ptr, i32) -> ()
+// CHECK:           llvm.call @mgpurtPGOEnd(%[[ID]], %[[ALT]], %[[START1]], %[[SIZE]]) : (i64, i32, i64, i64) -> ()
 // CHECK:           llvm.br ^bb5
 // CHECK:         ^bb4:
 // CHECK:           llvm.br ^bb5
@@ -0,0 +1,59 @@
+// RUN: polygeist-opt --polygeist-scf-to-openmp --split-input-file %s | FileCheck %s
+
+module {
+  func.func @scale(%n: index, %m: index, %a: memref<?x?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 2.0 : f64
+    scf.parallel (%i, %j) = (%c0, %c0) to (%n, %m) step (%c1, %c1) {
+      memref.store %cst, %a[%i, %j] : memref<?x?xf64>
+      scf.yield
+    } {polygeist.schedule = #omp<schedulekind dynamic>, polygeist.schedule_chunk = 4 : i64}
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @scale(
+// CHECK:         omp.parallel {
+// CHECK:           %[[CHUNK:.+]] = arith.constant 4 : i64
+// CHECK:           omp.wsloop schedule(dynamic = %[[CHUNK]] : i64) for
+// CHECK-NOT:         polygeist.noop
+// CHECK:             memref.store
+
+// -----
+
+module {
+  func.func @plain(%n: index, %a: memref<?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 2.0 : f64
+    scf.parallel (%i) = (%c0) to (%n) step (%c1) {
+      memref.store %cst, %a[%i] : memref<?xf64>
+      scf.yield
+    }
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @plain(
+// CHECK:         omp.wsloop for
+
+// -----
+
+module {
+  func.func @bound(%n: index, %a: memref<?xf64>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %cst = arith.constant 2.0 : f64
+    scf.parallel (%i) = (%c0) to (%n) step (%c1) {
+      memref.store %cst, %a[%i] : memref<?xf64>
+      scf.yield
+    } {polygeist.proc_bind = #omp<procbindkind spread>}
+    return
+  }
+}
+
+// CHECK-LABEL: func.func @bound(
+// CHECK:         omp.parallel proc_bind(spread) {
+// CHECK:           omp.wsloop for
+// CHECK-NOT:         polygeist.noop
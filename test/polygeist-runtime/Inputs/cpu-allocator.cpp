@@ -0,0 +1,63 @@
+//===- cpu-allocator.cpp - Exercises the caching CPU allocator ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Prints the size classes of a few sizes, whether freed blocks are handed out
+// again for sizes of the same class, and whether blocks are aligned to cache
+// lines. The runtime is included, as the allocator is internal to it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CpuRuntimeWrappers.cpp"
+
+#include <cstdio>
+#include <initializer_list>
+
+static void printClass(uint64_t size) {
+  uint64_t classSize = 0;
+  unsigned sizeClass = CpuAllocator::getSizeClass(size, classSize);
+  if (sizeClass >= CpuAllocator::kNumClasses)
+    printf("size %llu: none\n", (unsigned long long)size);
+  else
+    printf("size %llu: class %u holds %llu\n", (unsigned long long)size,
+           sizeClass, (unsigned long long)classSize);
+}
+
+static void checkReuse(uint64_t size, uint64_t sameClassSize) {
+  void *first = mgpurtCpuMalloc(size);
+  mgpurtCpuFree(first);
+  void *second = mgpurtCpuMalloc(sameClassSize);
+  printf("reuse %llu %llu: %d\n", (unsigned long long)size,
+         (unsigned long long)sameClassSize, first == second);
+  mgpurtCpuFree(second);
+}
+
+static void checkAlignment(uint64_t size) {
+  void *ptr = mgpurtCpuMalloc(size);
+  printf("aligned %llu: %d\n", (unsigned long long)size,
+         ptr && (uintptr_t)ptr % CpuAllocator::kAlignment == 0);
+  mgpurtCpuFree(ptr);
+}
+
+int main() {
+  printf("classes %u\n", CpuAllocator::kNumClasses);
+  for (uint64_t size : {0ull, 64ull, 65ull, 80ull, 81ull, 2ull << 20,
+                        (2ull << 20) + 1, 1ull << 48, (1ull << 48) + 1})
+    printClass(size);
+
+  checkReuse(0, 64);
+  checkReuse(65, 80);
+  checkReuse(3 << 20, (3 << 20) - 1000);
+
+  checkAlignment(0);
+  checkAlignment(65);
+  checkAlignment(100);
+  checkAlignment(3 << 20);
+
+  printf("too large: %d\n", mgpurtCpuMalloc((1ull << 48) + 1) == nullptr);
+  return 0;
+}
@@ -0,0 +1,44 @@
+//===- pgo-adaptive.cpp - Drives PGOAdaptive with a fake kernel -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs a kernel with two alternatives, the second ten times faster than the
+// first, through the adaptive policy configured in the environment, and
+// prints which alternative it settled on and how often each one ran.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PGORuntime.h"
+
+#include <cstdio>
+
+extern "C" int32_t mgpurtDeviceSynchronizeErr(void) { return 0; }
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <data dir>\n", argv[0]);
+    return 1;
+  }
+  PGOAdaptive adaptive;
+  adaptive.init(argv[1]);
+  if (!adaptive.isEnabled()) {
+    fprintf(stderr, "no adaptive policy\n");
+    return 1;
+  }
+
+  const double seconds[] = {1e-3, 1e-4};
+  unsigned runs[] = {0, 0};
+  PGOAdaptive::Site *site = adaptive.createSite("kernel", 2);
+  for (int i = 0; i < 200; i++) {
+    int alternative = adaptive.choose(*site);
+    runs[alternative]++;
+    adaptive.record(*site, alternative, seconds[alternative]);
+  }
+  printf("chosen %d\n", site->chosen.load());
+  printf("runs %u %u\n", runs[0], runs[1]);
+  return 0;
+}
@@ -13,6 +13,8 @@
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "utils.h"
 #include "clang/Basic/Builtins.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 
 #define DEBUG_TYPE "CGCall"
 
@@ -276,8 +278,7 @@ ValueCategory MLIRScanner::CallHelper(
             loc, mlir::IndexType::get(builder.getContext()),
             builder.create<mlir::memref::LoadOp>(loc, val, idx));
       } else {
-        mlir::Value idx[] = {builder.create<arith::ConstantIntOp>(loc, 0, 32),
-                             builder.create<arith::ConstantIntOp>(loc, i, 32)};
+        mlir::Value idx[] = {getConstantInt(0, 32), getConstantInt(i, 32)};
         auto PT = val.getType().cast<LLVM::LLVMPointerType>();
         auto ET = PT.getElementType().cast<LLVM::LLVMStructType>().getBody()[i];
         blocks[i] = builder.create<IndexCastOp>(
@@ -312,8 +313,7 @@ ValueCategory MLIRScanner::CallHelper(
             loc, mlir::IndexType::get(builder.getContext()),
             builder.create<mlir::memref::LoadOp>(loc, val, idx));
       } else {
-        mlir::Value idx[] = {builder.create<arith::ConstantIntOp>(loc, 0, 32),
-                             builder.create<arith::ConstantIntOp>(loc, i, 32)};
+        mlir::Value idx[] = {getConstantInt(0, 32), getConstantInt(i, 32)};
         auto PT = val.getType().cast<LLVM::LLVMPointerType>();
         auto ET = PT.getElementType().cast<LLVM::LLVMStructType>().getBody()[i];
         threads[i] = builder.create<IndexCastOp>(
@@ -525,9 +525,7 @@ MLIRScanner::EmitClangBuiltinCallExpr(clang::CallExpr *expr) {
     auto resultType = getMLIRType(expr->getType());
     llvm::errs() << "warning: assuming __builtin_constant_p to be false\n";
     return make_pair(
-        ValueCategory(builder.create<arith::ConstantIntOp>(loc, 0, resultType),
-                      /*isRef*/ false),
-        true);
+        ValueCategory(getConstantInt(0, resultType), /*isRef*/ false), true);
   }
   case Builtin::BI__builtin_unreachable: {
     llvm::errs() << "warning: ignoring __builtin_unreachable\n";
@@ -538,8 +536,7 @@ MLIRScanner::EmitClangBuiltinCallExpr(clang::CallExpr *expr) {
     llvm::errs()
         << "warning: assuming __builtin_is_constant_evaluated to be false\n";
     return success(
-        ValueCategory(builder.create<arith::ConstantIntOp>(loc, 0, resultType),
-                      /*isRef*/ false));
+        ValueCategory(getConstantInt(0, resultType), /*isRef*/ false));
   }
   case Builtin::BIsqrt:
   case Builtin::BIsqrtf:
@@ -573,6 +570,467 @@ MLIRScanner::EmitClangBuiltinCallExpr(clang::CallExpr *expr) {
   return make_pair(ValueCategory(), false);
 }
 
+namespace {
+/// Calls lowered by the name of their callee rather than by a clang builtin
+/// ID, mostly libm, CUDA device and libc memory functions.
+enum class NamedCallee {
+  AtomicAdd,
+  AtomicOr,
+  AtomicAnd,
+  Pow,
+  PowF,
+  Expect,
+  Abs,
+  Mul24,
+  UMulHi,
+  Frexp,
+  Strlen,
+  IsInf,
+  IsFinite,
+  IsNan,
+  IsNormal,
+  Signbit,
+  FCmp,
+  FRem,
+  Scalbn,
+  MulF,
+  AddF,
+  SubF,
+  Log,
+  Log2,
+  Log10,
+  Log1p,
+  Exp,
+  Exp2,
+  ExpM1,
+  Ceil,
+  Sin,
+  Cos,
+  Atanh,
+  CopySign,
+  MaxNum,
+  MinNum,
+  FMA,
+  Memmove,
+  Memset,
+  Memcpy,
+  Ignore,
+};
+
+struct NamedCalleeInfo {
+  NamedCallee kind;
+  /// The CmpFPredicate of FCmp callees.
+  unsigned predicate = 0;
+};
+} // namespace
+
+/// Returns the table of callees handled by EmitBuiltinOps. New entries only
+/// need a name here and, for a new kind, a case in EmitBuiltinOps.
+static const llvm::StringMap<NamedCalleeInfo> &getNamedCallees() {
+  static const llvm::StringMap<NamedCalleeInfo> callees = [] {
+    llvm::StringMap<NamedCalleeInfo> map;
+    auto add = [&](std::initializer_list<StringRef> names, NamedCallee kind,
+                   unsigned predicate = 0) {
+      for (StringRef name : names)
+        map[name] = {kind, predicate};
+    };
+    add({"atomicAdd"}, NamedCallee::AtomicAdd);
+    add({"atomicOr"}, NamedCallee::AtomicOr);
+    add({"atomicAnd"}, NamedCallee::AtomicAnd);
+    add({"__powf", "pow", "__nv_pow", "__nv_powf", "__powi", "powi",
+         "__nv_powi", "powf"},
+        NamedCallee::Pow);
+    add({"__builtin_pow", "__builtin_powf", "__builtin_powl"},
+        NamedCallee::PowF);
+    add({"__builtin_expect"}, NamedCallee::Expect);
+    add({"__nv_fabsf", "__nv_fabs", "__nv_abs", "fabs", "fabsf",
+         "__builtin_fabs", "__builtin_fabsf"},
+        NamedCallee::Abs);
+    add({"__nv_mul24"}, NamedCallee::Mul24);
+    add({"__nv_umulhi"}, NamedCallee::UMulHi);
+    add({"__builtin_frexp", "__builtin_frexpf", "__builtin_frexpl",
+         "__builtin_frexpf128"},
+        NamedCallee::Frexp);
+    add({"__builtin_strlen", "strlen"}, NamedCallee::Strlen);
+    add({"__builtin_isinf", "__nv_isinff"}, NamedCallee::IsInf);
+    add({"__builtin_isfinite"}, NamedCallee::IsFinite);
+    add({"__builtin_isnan", "__nv_isnanf"}, NamedCallee::IsNan);
+    add({"__builtin_isnormal"}, NamedCallee::IsNormal);
+    add({"__builtin_signbit"}, NamedCallee::Signbit);
+    add({"__builtin_isgreater"}, NamedCallee::FCmp,
+        (unsigned)CmpFPredicate::OGT);
+    add({"__builtin_isgreaterequal"}, NamedCallee::FCmp,
+        (unsigned)CmpFPredicate::OGE);
+    add({"__builtin_isless"}, NamedCallee::FCmp, (unsigned)CmpFPredicate::OLT);
+    add({"__builtin_islessequal"}, NamedCallee::FCmp,
+        (unsigned)CmpFPredicate::OLE);
+    add({"__builtin_islessgreater"}, NamedCallee::FCmp,
+        (unsigned)CmpFPredicate::ONE);
+    add({"__builtin_isunordered"}, NamedCallee::FCmp,
+        (unsigned)CmpFPredicate::UNO);
+    add({"__nv_fmodf"}, NamedCallee::FRem);
+    add({"__nv_scalbn", "__nv_scalbnf", "__nv_scalbnl"}, NamedCallee::Scalbn);
+    add({"__nv_dmul_rn"}, NamedCallee::MulF);
+    add({"__nv_dadd_rn"}, NamedCallee::AddF);
+    add({"__nv_dsub_rn"}, NamedCallee::SubF);
+    add({"log"}, NamedCallee::Log);
+    add({"__log2f", "__builtin_log2", "__builtin_log2f", "__builtin_log2l",
+         "__nv_log2", "__nv_log2f", "__nv_log2l"},
+        NamedCallee::Log2);
+    add({"__builtin_log10", "__builtin_log10f", "__builtin_log10l",
+         "__nv_log10", "__nv_log10f", "__nv_log10l"},
+        NamedCallee::Log10);
+    add({"__builtin_log1p", "__builtin_log1pf", "__builtin_log1pl"},
+        NamedCallee::Log1p);
+    add({"exp", "expf"}, NamedCallee::Exp);
+    add({"__builtin_exp2", "__builtin_exp2f", "__builtin_exp2l"},
+        NamedCallee::Exp2);
+    add({"__builtin_expm1", "__builtin_expm1f", "__builtin_expm1l"},
+        NamedCallee::ExpM1);
+    add({"ceil"}, NamedCallee::Ceil);
+    add({"sin"}, NamedCallee::Sin);
+    add({"cos"}, NamedCallee::Cos);
+    add({"__builtin_atanh", "__builtin_atanhf", "__builtin_atanhl"},
+        NamedCallee::Atanh);
+    add({"__builtin_copysign", "__builtin_copysignf", "__builtin_copysignl"},
+        NamedCallee::CopySign);
+    add({"__builtin_fmax", "__builtin_fmaxf", "__builtin_fmaxl"},
+        NamedCallee::MaxNum);
+    add({"__builtin_fmin", "__builtin_fminf", "__builtin_fminl"},
+        NamedCallee::MinNum);
+    add({"__builtin_fma", "__builtin_fmaf", "__builtin_fmal"},
+        NamedCallee::FMA);
+    add({"memmove", "__builtin_memmove"}, NamedCallee::Memmove);
+    add({"memset", "__builtin_memset"}, NamedCallee::Memset);
+    add({"memcpy", "__builtin_memcpy"}, NamedCallee::Memcpy);
+    // TODO this only sets a preference so it is not needed but if possible
+    // implement it
+    add({"cudaFuncSetCacheConfig"}, NamedCallee::Ignore);
+    return map;
+  }();
+  return callees;
+}
+
+std::pair<ValueCategory, bool>
+MLIRScanner::EmitBuiltinOps(clang::CallExpr *expr) {
+  auto success = [&](auto v) { return make_pair(v, true); };
+  auto failure = [&]() { return make_pair(ValueCategory(), false); };
+
+  auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee());
+  if (!ic)
+    return failure();
+  auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr());
+  if (!sr || !sr->getDecl()->getIdentifier())
+    return failure();
+  const auto &callees = getNamedCallees();
+  auto found = callees.find(sr->getDecl()->getName());
+  if (found == callees.end())
+    return failure();
+
+  auto loc = getMLIRLocation(expr->getExprLoc());
+  // Declares the external function \p name with the argument types of \p args
+  // and the result type of the call, and calls it.
+  auto callExternal = [&](StringRef name, ArrayRef<mlir::Value> args) {
+    if (Glob.functions.find(name.str()) == Glob.functions.end()) {
+      std::vector<mlir::Type> types;
+      for (auto arg : args)
+        types.push_back(arg.getType());
+      std::vector<mlir::Type> rettypes{getMLIRType(expr->getType())};
+      mlir::OpBuilder mbuilder(Glob.module->getContext());
+      auto funcType = mbuilder.getFunctionType(types, rettypes);
+      auto function = mlir::func::FuncOp::create(builder.getUnknownLoc(),
+                                                 name, funcType);
+      SymbolTable::setSymbolVisibility(function,
+                                       SymbolTable::Visibility::Private);
+      Glob.functions[name.str()] = function;
+      Glob.module->push_back(function);
+    }
+    return builder.create<CallOp>(loc, Glob.functions[name.str()], args)
+        .getResult(0);
+  };
+  auto extendToResult = [&](mlir::Value V) {
+    auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
+    mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
+    return ValueCategory(res, /*isRef*/ false);
+  };
+
+  switch (found->second.kind) {
+  case NamedCallee::AtomicAdd:
+  case NamedCallee::AtomicOr:
+  case NamedCallee::AtomicAnd: {
+    std::vector<ValueCategory> args;
+    for (auto *a : expr->arguments()) {
+      args.push_back(Visit(a));
+    }
+    auto a0 = args[0].getValue(loc, builder);
+    auto a1 = args[1].getValue(loc, builder);
+    AtomicRMWKind op;
+    LLVM::AtomicBinOp lop;
+    if (found->second.kind == NamedCallee::AtomicAdd) {
+      if (a1.getType().isa<mlir::IntegerType>()) {
+        op = AtomicRMWKind::addi;
+        lop = LLVM::AtomicBinOp::add;
+      } else {
+        op = AtomicRMWKind::addf;
+        lop = LLVM::AtomicBinOp::fadd;
+      }
+    } else if (found->second.kind == NamedCallee::AtomicOr) {
+      op = AtomicRMWKind::ori;
+      lop = LLVM::AtomicBinOp::_or;
+    } else {
+      op = AtomicRMWKind::andi;
+      lop = LLVM::AtomicBinOp::_and;
+    }
+
+    if (a0.getType().isa<MemRefType>())
+      return success(ValueCategory(
+          builder.create<memref::AtomicRMWOp>(
+              loc, a1.getType(), op, a1, a0,
+              std::vector<mlir::Value>({getConstantIndex(0)})),
+          /*isReference*/ false));
+    return success(
+        ValueCategory(builder.create<LLVM::AtomicRMWOp>(
+                          loc, lop, a0, a1, LLVM::AtomicOrdering::acq_rel),
+                      /*isReference*/ false));
+  }
+  case NamedCallee::Pow: {
+    auto mlirType = getMLIRType(expr->getType());
+    std::vector<mlir::Value> args;
+    for (auto *a : expr->arguments()) {
+      args.push_back(Visit(a).getValue(loc, builder));
+    }
+    if (args[1].getType().isa<mlir::IntegerType>())
+      return success(ValueCategory(
+          builder.create<LLVM::PowIOp>(loc, mlirType, args[0], args[1]),
+          /*isReference*/ false));
+    return success(ValueCategory(
+        builder.create<math::PowFOp>(loc, mlirType, args[0], args[1]),
+        /*isReference*/ false));
+  }
+  case NamedCallee::Expect:
+    llvm::errs() << "warning: ignoring __builtin_expect\n";
+    return success(Visit(expr->getArg(0)));
+  case NamedCallee::Abs: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value Fabs;
+    if (V.getType().isa<mlir::FloatType>())
+      Fabs = builder.create<math::AbsFOp>(loc, V);
+    else {
+      auto zero =
+          getConstantInt(0, V.getType().cast<mlir::IntegerType>().getWidth());
+      Fabs = builder.create<SelectOp>(
+          loc, builder.create<arith::CmpIOp>(loc, CmpIPredicate::sge, V, zero),
+          V, builder.create<arith::SubIOp>(loc, zero, V));
+    }
+    return success(ValueCategory(Fabs, /*isRef*/ false));
+  }
+  case NamedCallee::Mul24: {
+    mlir::Value V0 = getLLVM(expr->getArg(0));
+    mlir::Value V1 = getLLVM(expr->getArg(1));
+    auto c8 = getConstantInt(8, 32);
+    V0 = builder.create<arith::ShLIOp>(loc, V0, c8);
+    V0 = builder.create<arith::ShRUIOp>(loc, V0, c8);
+    V1 = builder.create<arith::ShLIOp>(loc, V1, c8);
+    V1 = builder.create<arith::ShRUIOp>(loc, V1, c8);
+    return success(ValueCategory(builder.create<MulIOp>(loc, V0, V1), false));
+  }
+  case NamedCallee::UMulHi: {
+    mlir::Value V0 = getLLVM(expr->getArg(0));
+    mlir::Value V1 = getLLVM(expr->getArg(1));
+    auto I64 = builder.getIntegerType(64);
+    auto I32 = builder.getIntegerType(32);
+    V0 = builder.create<ExtUIOp>(loc, I64, V0);
+    V1 = builder.create<ExtUIOp>(loc, I64, V1);
+    mlir::Value R = builder.create<arith::MulIOp>(loc, V0, V1);
+    auto c32 = getConstantInt(32, 64);
+    R = builder.create<arith::ShRUIOp>(loc, R, c32);
+    R = builder.create<TruncIOp>(loc, I32, R);
+    return success(ValueCategory(R, false));
+  }
+  case NamedCallee::Frexp: {
+    mlir::Value vals[] = {getLLVM(expr->getArg(0)), getLLVM(expr->getArg(1))};
+    auto name = sr->getDecl()->getName().substr(
+        std::string("__builtin_").length());
+    return success(ValueCategory(callExternal(name, vals), false));
+  }
+  case NamedCallee::Strlen: {
+    mlir::Value vals[] = {getLLVM(expr->getArg(0))};
+    return success(ValueCategory(callExternal("strlen", vals), false));
+  }
+  case NamedCallee::IsInf:
+  case NamedCallee::IsFinite: {
+    // isinf(x)    --> fabs(x) == infinity
+    // isfinite(x) --> fabs(x) != infinity
+    // x != NaN via the ordered compare in either case.
+    mlir::Value V = getLLVM(expr->getArg(0));
+    auto Ty = V.getType().cast<mlir::FloatType>();
+    mlir::Value Fabs = builder.create<math::AbsFOp>(loc, V);
+    auto Infinity =
+        getConstantFloat(APFloat::getInf(Ty.getFloatSemantics()), Ty);
+    auto Pred = found->second.kind == NamedCallee::IsInf ? CmpFPredicate::OEQ
+                                                         : CmpFPredicate::ONE;
+    mlir::Value FCmp = builder.create<CmpFOp>(loc, Pred, Fabs, Infinity);
+    return success(extendToResult(FCmp));
+  }
+  case NamedCallee::IsNan: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value Eq = builder.create<CmpFOp>(loc, CmpFPredicate::UNO, V, V);
+    return success(extendToResult(Eq));
+  }
+  case NamedCallee::IsNormal: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    auto Ty = V.getType().cast<mlir::FloatType>();
+    mlir::Value Eq = builder.create<CmpFOp>(loc, CmpFPredicate::OEQ, V, V);
+
+    mlir::Value Abs = builder.create<math::AbsFOp>(loc, V);
+    auto Infinity =
+        getConstantFloat(APFloat::getInf(Ty.getFloatSemantics()), Ty);
+    mlir::Value IsLessThanInf =
+        builder.create<CmpFOp>(loc, CmpFPredicate::ULT, Abs, Infinity);
+    APFloat Smallest = APFloat::getSmallestNormalized(Ty.getFloatSemantics());
+    auto SmallestV = getConstantFloat(Smallest, Ty);
+    mlir::Value IsNormal =
+        builder.create<CmpFOp>(loc, CmpFPredicate::UGE, Abs, SmallestV);
+    V = builder.create<AndIOp>(loc, Eq, IsLessThanInf);
+    V = builder.create<AndIOp>(loc, V, IsNormal);
+    return success(extendToResult(V));
+  }
+  case NamedCallee::Signbit: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    auto Ty = V.getType().cast<mlir::FloatType>();
+    auto ITy = builder.getIntegerType(Ty.getWidth());
+    mlir::Value BC = builder.create<BitcastOp>(loc, ITy, V);
+    auto ZeroV = getConstantInt(0, ITy);
+    V = builder.create<CmpIOp>(loc, CmpIPredicate::slt, BC, ZeroV);
+    return success(extendToResult(V));
+  }
+  case NamedCallee::FCmp: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value V2 = getLLVM(expr->getArg(1));
+    V = builder.create<CmpFOp>(
+        loc, (CmpFPredicate)found->second.predicate, V, V2);
+    return success(extendToResult(V));
+  }
+  case NamedCallee::PowF: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value V2 = getLLVM(expr->getArg(1));
+    V = builder.create<math::PowFOp>(loc, V, V2);
+    return success(ValueCategory(V, /*isRef*/ false));
+  }
+  case NamedCallee::FRem: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value V2 = getLLVM(expr->getArg(1));
+    V = builder.create<mlir::LLVM::FRemOp>(loc, V.getType(), V, V2);
+    return success(ValueCategory(V, /*isRef*/ false));
+  }
+  case NamedCallee::Scalbn: {
+    mlir::Value vals[] = {getLLVM(expr->getArg(0)), getLLVM(expr->getArg(1))};
+    auto name = sr->getDecl()->getName().substr(5);
+    return success(ValueCategory(callExternal(name, vals), /*isRef*/ false));
+  }
+  case NamedCallee::MulF:
+  case NamedCallee::AddF:
+  case NamedCallee::SubF: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value V2 = getLLVM(expr->getArg(1));
+    if (found->second.kind == NamedCallee::MulF)
+      V = builder.create<MulFOp>(loc, V, V2);
+    else if (found->second.kind == NamedCallee::AddF)
+      V = builder.create<AddFOp>(loc, V, V2);
+    else
+      V = builder.create<SubFOp>(loc, V, V2);
+    return success(ValueCategory(V, /*isRef*/ false));
+  }
+  case NamedCallee::Log:
+    return success(ValueCategory(
+        builder.create<math::LogOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Log2:
+    return success(ValueCategory(
+        builder.create<math::Log2Op>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Log10:
+    return success(ValueCategory(
+        builder.create<math::Log10Op>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Log1p:
+    return success(ValueCategory(
+        builder.create<math::Log1pOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Exp:
+    return success(ValueCategory(
+        builder.create<math::ExpOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Exp2:
+    return success(ValueCategory(
+        builder.create<math::Exp2Op>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::ExpM1:
+    return success(ValueCategory(
+        builder.create<math::ExpM1Op>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Ceil:
+    return success(ValueCategory(
+        builder.create<math::CeilOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Sin:
+    return success(ValueCategory(
+        builder.create<math::SinOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Cos:
+    return success(ValueCategory(
+        builder.create<math::CosOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::Atanh:
+    return success(ValueCategory(
+        builder.create<math::AtanOp>(loc, getLLVM(expr->getArg(0))),
+        /*isRef*/ false));
+  case NamedCallee::CopySign:
+    return success(ValueCategory(
+        builder.create<LLVM::CopySignOp>(loc, getLLVM(expr->getArg(0)),
+                                         getLLVM(expr->getArg(1))),
+        /*isRef*/ false));
+  case NamedCallee::MaxNum:
+    return success(ValueCategory(
+        builder.create<LLVM::MaxNumOp>(loc, getLLVM(expr->getArg(0)),
+                                       getLLVM(expr->getArg(1))),
+        /*isRef*/ false));
+  case NamedCallee::MinNum:
+    return success(ValueCategory(
+        builder.create<LLVM::MinNumOp>(loc, getLLVM(expr->getArg(0)),
+                                       getLLVM(expr->getArg(1))),
+        /*isRef*/ false));
+  case NamedCallee::FMA: {
+    mlir::Value V = getLLVM(expr->getArg(0));
+    mlir::Value V2 = getLLVM(expr->getArg(1));
+    mlir::Value V3 = getLLVM(expr->getArg(2));
+    V = builder.create<LLVM::FMAOp>(loc, V, V2, V3);
+    return success(ValueCategory(V, /*isRef*/ false));
+  }
+  case NamedCallee::Memmove:
+  case NamedCallee::Memset:
+  case NamedCallee::Memcpy: {
+    std::vector<mlir::Value> args = {getLLVM(expr->getArg(0)),
+                                     getLLVM(expr->getArg(1)),
+                                     getLLVM(expr->getArg(2))};
+    if (found->second.kind == NamedCallee::Memmove) {
+      builder.create<LLVM::MemmoveOp>(loc, args[0], args[1], args[2],
+                                      /*isVolatile*/ false);
+    } else if (found->second.kind == NamedCallee::Memset) {
+      args[1] = builder.create<TruncIOp>(loc, builder.getI8Type(), args[1]);
+      builder.create<LLVM::MemsetOp>(loc, args[0], args[1], args[2],
+                                     /*isVolatile*/ false);
+    } else {
+      builder.create<LLVM::MemcpyOp>(loc, args[0], args[1], args[2], false);
+    }
+    return success(ValueCategory(args[0], /*isReference*/ false));
+  }
+  case NamedCallee::Ignore:
+    return success(ValueCategory());
+  }
+  llvm_unreachable("unhandled named callee");
+}
+
 ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
 
   auto loc = getMLIRLocation(expr->getExprLoc());
@@ -617,9 +1075,7 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
           llvm::Constant *LC = Glob.CGM.GetAddrOfRTTIDescriptor(LT);
           llvm::Constant *RC = Glob.CGM.GetAddrOfRTTIDescriptor(RT);
           auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-          return ValueCategory(
-              builder.create<arith::ConstantIntOp>(loc, LC == RC, postTy),
-              false);
+          return ValueCategory(getConstantInt(LC == RC, postTy), false);
         }
       }
     }
@@ -650,481 +1106,6 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
     return Visit(ps);
   }
 
-  if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
-    if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "atomicAdd" ||
-           sr->getDecl()->getName() == "atomicOr" ||
-           sr->getDecl()->getName() == "atomicAnd")) {
-        std::vector<ValueCategory> args;
-        for (auto *a : expr->arguments()) {
-          args.push_back(Visit(a));
-        }
-        auto a0 = args[0].getValue(loc, builder);
-        auto a1 = args[1].getValue(loc, builder);
-        AtomicRMWKind op;
-        LLVM::AtomicBinOp lop;
-        if (sr->getDecl()->getName() == "atomicAdd") {
-          if (a1.getType().isa<mlir::IntegerType>()) {
-            op = AtomicRMWKind::addi;
-            lop = LLVM::AtomicBinOp::add;
-          } else {
-            op = AtomicRMWKind::addf;
-            lop = LLVM::AtomicBinOp::fadd;
-          }
-        } else if (sr->getDecl()->getName() == "atomicOr") {
-          op = AtomicRMWKind::ori;
-          lop = LLVM::AtomicBinOp::_or;
-        } else if (sr->getDecl()->getName() == "atomicAnd") {
-          op = AtomicRMWKind::andi;
-          lop = LLVM::AtomicBinOp::_and;
-        } else
-          assert(0);
-
-        if (a0.getType().isa<MemRefType>())
-          return ValueCategory(
-              builder.create<memref::AtomicRMWOp>(
-                  loc, a1.getType(), op, a1, a0,
-                  std::vector<mlir::Value>({getConstantIndex(0)})),
-              /*isReference*/ false);
-        else
-          return ValueCategory(
-              builder.create<LLVM::AtomicRMWOp>(loc, lop, a0, a1,
-                                                LLVM::AtomicOrdering::acq_rel),
-              /*isReference*/ false);
-      }
-    }
-
-  if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
-    if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__powf" ||
-           sr->getDecl()->getName() == "pow" ||
-           sr->getDecl()->getName() == "__nv_pow" ||
-           sr->getDecl()->getName() == "__nv_powf" ||
-           sr->getDecl()->getName() == "__powi" ||
-           sr->getDecl()->getName() == "powi" ||
-           sr->getDecl()->getName() == "__nv_powi" ||
-           sr->getDecl()->getName() == "__nv_powi" ||
-           sr->getDecl()->getName() == "powf")) {
-        auto mlirType = getMLIRType(expr->getType());
-        std::vector<mlir::Value> args;
-        for (auto *a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        if (args[1].getType().isa<mlir::IntegerType>())
-          return ValueCategory(
-              builder.create<LLVM::PowIOp>(loc, mlirType, args[0], args[1]),
-              /*isReference*/ false);
-        else
-          return ValueCategory(
-              builder.create<math::PowFOp>(loc, mlirType, args[0], args[1]),
-              /*isReference*/ false);
-      }
-    }
-  if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
-    if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_expect") {
-        llvm::errs() << "warning: ignoring __builtin_expect\n";
-        return Visit(expr->getArg(0));
-      }
-    }
-  if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
-    if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_fabsf" ||
-           sr->getDecl()->getName() == "__nv_fabs" ||
-           sr->getDecl()->getName() == "__nv_abs" ||
-           sr->getDecl()->getName() == "fabs" ||
-           sr->getDecl()->getName() == "fabsf" ||
-           sr->getDecl()->getName() == "__builtin_fabs" ||
-           sr->getDecl()->getName() == "__builtin_fabsf")) {
-        // isinf(x)    --> fabs(x) == infinity
-        // isfinite(x) --> fabs(x) != infinity
-        // x != NaN via the ordered compare in either case.
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value Fabs;
-        if (V.getType().isa<mlir::FloatType>())
-          Fabs = builder.create<math::AbsFOp>(loc, V);
-        else {
-          auto zero = builder.create<arith::ConstantIntOp>(
-              loc, 0, V.getType().cast<mlir::IntegerType>().getWidth());
-          Fabs = builder.create<SelectOp>(
-              loc,
-              builder.create<arith::CmpIOp>(loc, CmpIPredicate::sge, V, zero),
-              V, builder.create<arith::SubIOp>(loc, zero, V));
-        }
-        return ValueCategory(Fabs, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__nv_mul24") {
-        mlir::Value V0 = getLLVM(expr->getArg(0));
-        mlir::Value V1 = getLLVM(expr->getArg(1));
-        auto c8 = builder.create<arith::ConstantIntOp>(loc, 8, 32);
-        V0 = builder.create<arith::ShLIOp>(loc, V0, c8);
-        V0 = builder.create<arith::ShRUIOp>(loc, V0, c8);
-        V1 = builder.create<arith::ShLIOp>(loc, V1, c8);
-        V1 = builder.create<arith::ShRUIOp>(loc, V1, c8);
-        return ValueCategory(builder.create<MulIOp>(loc, V0, V1), false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__nv_umulhi") {
-        mlir::Value V0 = getLLVM(expr->getArg(0));
-        mlir::Value V1 = getLLVM(expr->getArg(1));
-        auto I64 = builder.getIntegerType(64);
-        auto I32 = builder.getIntegerType(32);
-        V0 = builder.create<ExtUIOp>(loc, I64, V0);
-        V1 = builder.create<ExtUIOp>(loc, I64, V1);
-        mlir::Value R = builder.create<arith::MulIOp>(loc, V0, V1);
-        auto c32 = builder.create<arith::ConstantIntOp>(loc, 32, 64);
-        R = builder.create<arith::ShRUIOp>(loc, R, c32);
-        R = builder.create<TruncIOp>(loc, I32, R);
-        return ValueCategory(R, false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_frexp" ||
-           sr->getDecl()->getName() == "__builtin_frexpf" ||
-           sr->getDecl()->getName() == "__builtin_frexpl" ||
-           sr->getDecl()->getName() == "__builtin_frexpf128")) {
-        mlir::Value V0 = getLLVM(expr->getArg(0));
-        mlir::Value V1 = getLLVM(expr->getArg(1));
-
-        auto name = sr->getDecl()
-                        ->getName()
-                        .substr(std::string("__builtin_").length())
-                        .str();
-
-        if (Glob.functions.find(name) == Glob.functions.end()) {
-          std::vector<mlir::Type> types{V0.getType(), V1.getType()};
-
-          auto RT = getMLIRType(expr->getType());
-          std::vector<mlir::Type> rettypes{RT};
-          mlir::OpBuilder mbuilder(Glob.module->getContext());
-          auto funcType = mbuilder.getFunctionType(types, rettypes);
-          Glob.functions[name] = mlir::func::FuncOp(mlir::func::FuncOp::create(
-              builder.getUnknownLoc(), name, funcType));
-          SymbolTable::setSymbolVisibility(Glob.functions[name],
-                                           SymbolTable::Visibility::Private);
-          Glob.module->push_back(Glob.functions[name]);
-        }
-
-        mlir::Value vals[] = {V0, V1};
-        return ValueCategory(
-            builder.create<CallOp>(loc, Glob.functions[name], vals)
-                .getResult(0),
-            false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_strlen" ||
-           sr->getDecl()->getName() == "strlen")) {
-        mlir::Value V0 = getLLVM(expr->getArg(0));
-
-        const auto *name = "strlen";
-
-        if (Glob.functions.find(name) == Glob.functions.end()) {
-          std::vector<mlir::Type> types{V0.getType()};
-
-          auto RT = getMLIRType(expr->getType());
-          std::vector<mlir::Type> rettypes{RT};
-          mlir::OpBuilder mbuilder(Glob.module->getContext());
-          auto funcType = mbuilder.getFunctionType(types, rettypes);
-          Glob.functions[name] = mlir::func::FuncOp(mlir::func::FuncOp::create(
-              builder.getUnknownLoc(), name, funcType));
-          SymbolTable::setSymbolVisibility(Glob.functions[name],
-                                           SymbolTable::Visibility::Private);
-          Glob.module->push_back(Glob.functions[name]);
-        }
-
-        mlir::Value vals[] = {V0};
-        return ValueCategory(
-            builder.create<CallOp>(loc, Glob.functions[name], vals)
-                .getResult(0),
-            false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_isfinite" ||
-           sr->getDecl()->getName() == "__builtin_isinf" ||
-           sr->getDecl()->getName() == "__nv_isinff")) {
-        // isinf(x)    --> fabs(x) == infinity
-        // isfinite(x) --> fabs(x) != infinity
-        // x != NaN via the ordered compare in either case.
-        mlir::Value V = getLLVM(expr->getArg(0));
-        auto Ty = V.getType().cast<mlir::FloatType>();
-        mlir::Value Fabs = builder.create<math::AbsFOp>(loc, V);
-        auto Infinity = builder.create<ConstantFloatOp>(
-            loc, APFloat::getInf(Ty.getFloatSemantics()), Ty);
-        auto Pred = (sr->getDecl()->getName() == "__builtin_isinf" ||
-                     sr->getDecl()->getName() == "__nv_isinff")
-                        ? CmpFPredicate::OEQ
-                        : CmpFPredicate::ONE;
-        mlir::Value FCmp = builder.create<CmpFOp>(loc, Pred, Fabs, Infinity);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, FCmp);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_isnan" ||
-           sr->getDecl()->getName() == "__nv_isnanf")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value Eq = builder.create<CmpFOp>(loc, CmpFPredicate::UNO, V, V);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, Eq);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_isnormal")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        auto Ty = V.getType().cast<mlir::FloatType>();
-        mlir::Value Eq = builder.create<CmpFOp>(loc, CmpFPredicate::OEQ, V, V);
-
-        mlir::Value Abs = builder.create<math::AbsFOp>(loc, V);
-        auto Infinity = builder.create<ConstantFloatOp>(
-            loc, APFloat::getInf(Ty.getFloatSemantics()), Ty);
-        mlir::Value IsLessThanInf =
-            builder.create<CmpFOp>(loc, CmpFPredicate::ULT, Abs, Infinity);
-        APFloat Smallest =
-            APFloat::getSmallestNormalized(Ty.getFloatSemantics());
-        auto SmallestV = builder.create<ConstantFloatOp>(loc, Smallest, Ty);
-        mlir::Value IsNormal =
-            builder.create<CmpFOp>(loc, CmpFPredicate::UGE, Abs, SmallestV);
-        V = builder.create<AndIOp>(loc, Eq, IsLessThanInf);
-        V = builder.create<AndIOp>(loc, V, IsNormal);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_signbit") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        auto Ty = V.getType().cast<mlir::FloatType>();
-        auto ITy = builder.getIntegerType(Ty.getWidth());
-        mlir::Value BC = builder.create<BitcastOp>(loc, ITy, V);
-        auto ZeroV = builder.create<ConstantIntOp>(loc, 0, ITy);
-        V = builder.create<CmpIOp>(loc, CmpIPredicate::slt, BC, ZeroV);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_isgreater") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::OGT, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_isgreaterequal") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::OGE, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_isless") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::OLT, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_islessequal") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::OLE, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_islessgreater") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::ONE, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__builtin_isunordered") {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<CmpFOp>(loc, CmpFPredicate::UNO, V, V2);
-        auto postTy = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-        mlir::Value res = builder.create<ExtUIOp>(loc, postTy, V);
-        return ValueCategory(res, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_pow" ||
-           sr->getDecl()->getName() == "__builtin_powf" ||
-           sr->getDecl()->getName() == "__builtin_powl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<math::PowFOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_fmodf")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<mlir::LLVM::FRemOp>(loc, V.getType(), V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_atanh" ||
-           sr->getDecl()->getName() == "__builtin_atanhf" ||
-           sr->getDecl()->getName() == "__builtin_atanhl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::AtanOp>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_scalbn" ||
-           sr->getDecl()->getName() == "__nv_scalbnf" ||
-           sr->getDecl()->getName() == "__nv_scalbnl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        auto name = sr->getDecl()->getName().substr(5).str();
-        std::vector<mlir::Type> types{V.getType(), V2.getType()};
-        auto RT = getMLIRType(expr->getType());
-
-        std::vector<mlir::Type> rettypes{RT};
-
-        mlir::OpBuilder mbuilder(Glob.module->getContext());
-        auto funcType = mbuilder.getFunctionType(types, rettypes);
-        mlir::func::FuncOp function =
-            mlir::func::FuncOp(mlir::func::FuncOp::create(
-                builder.getUnknownLoc(), name, funcType));
-        SymbolTable::setSymbolVisibility(function,
-                                         SymbolTable::Visibility::Private);
-
-        Glob.functions[name] = function;
-        Glob.module->push_back(function);
-        mlir::Value vals[] = {V, V2};
-        V = builder.create<CallOp>(loc, function, vals).getResult(0);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_dmul_rn")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<MulFOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_dadd_rn")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<AddFOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__nv_dsub_rn")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<SubFOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_log2" ||
-           sr->getDecl()->getName() == "__builtin_log2f" ||
-           sr->getDecl()->getName() == "__builtin_log2l" ||
-           sr->getDecl()->getName() == "__nv_log2" ||
-           sr->getDecl()->getName() == "__nv_log2f" ||
-           sr->getDecl()->getName() == "__nv_log2l")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::Log2Op>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_log10" ||
-           sr->getDecl()->getName() == "__builtin_log10f" ||
-           sr->getDecl()->getName() == "__builtin_log10l" ||
-           sr->getDecl()->getName() == "__nv_log10" ||
-           sr->getDecl()->getName() == "__nv_log10f" ||
-           sr->getDecl()->getName() == "__nv_log10l")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::Log10Op>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_log1p" ||
-           sr->getDecl()->getName() == "__builtin_log1pf" ||
-           sr->getDecl()->getName() == "__builtin_log1pl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::Log1pOp>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_exp2" ||
-           sr->getDecl()->getName() == "__builtin_exp2f" ||
-           sr->getDecl()->getName() == "__builtin_exp2l")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::Exp2Op>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_expm1" ||
-           sr->getDecl()->getName() == "__builtin_expm1f" ||
-           sr->getDecl()->getName() == "__builtin_expm1l")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        V = builder.create<math::ExpM1Op>(loc, V);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_copysign" ||
-           sr->getDecl()->getName() == "__builtin_copysignf" ||
-           sr->getDecl()->getName() == "__builtin_copysignl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<LLVM::CopySignOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_copysign" ||
-           sr->getDecl()->getName() == "__builtin_copysignf" ||
-           sr->getDecl()->getName() == "__builtin_copysignl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<LLVM::CopySignOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_fmax" ||
-           sr->getDecl()->getName() == "__builtin_fmaxf" ||
-           sr->getDecl()->getName() == "__builtin_fmaxl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<LLVM::MaxNumOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_fmin" ||
-           sr->getDecl()->getName() == "__builtin_fminf" ||
-           sr->getDecl()->getName() == "__builtin_fminl")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        V = builder.create<LLVM::MinNumOp>(loc, V, V2);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "__builtin_fma" ||
-           sr->getDecl()->getName() == "__builtin_fmaf" ||
-           sr->getDecl()->getName() == "__builtin_fmal")) {
-        mlir::Value V = getLLVM(expr->getArg(0));
-        mlir::Value V2 = getLLVM(expr->getArg(1));
-        mlir::Value V3 = getLLVM(expr->getArg(2));
-        V = builder.create<LLVM::FMAOp>(loc, V, V2, V3);
-        return ValueCategory(V, /*isRef*/ false);
-      }
-    }
-
   if (!CStyleMemRef) {
     if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
       if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
@@ -1167,43 +1148,6 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
 
   if (auto *ic = dyn_cast<ImplicitCastExpr>(expr->getCallee()))
     if (auto *sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "memmove" ||
-           sr->getDecl()->getName() == "__builtin_memmove")) {
-        std::vector<mlir::Value> args = {getLLVM(expr->getArg(0)),
-                                         getLLVM(expr->getArg(1)),
-                                         getLLVM(expr->getArg(2))};
-        builder.create<LLVM::MemmoveOp>(loc, args[0], args[1], args[2],
-                                        /*isVolatile*/ false);
-        return ValueCategory(args[0], /*isReference*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "memset" ||
-           sr->getDecl()->getName() == "__builtin_memset")) {
-        std::vector<mlir::Value> args = {getLLVM(expr->getArg(0)),
-                                         getLLVM(expr->getArg(1)),
-                                         getLLVM(expr->getArg(2))};
-
-        args[1] = builder.create<TruncIOp>(loc, builder.getI8Type(), args[1]);
-        builder.create<LLVM::MemsetOp>(loc, args[0], args[1], args[2],
-                                       /*isVolatile*/ false);
-        return ValueCategory(args[0], /*isReference*/ false);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "memcpy" ||
-           sr->getDecl()->getName() == "__builtin_memcpy")) {
-        std::vector<mlir::Value> args = {getLLVM(expr->getArg(0)),
-                                         getLLVM(expr->getArg(1)),
-                                         getLLVM(expr->getArg(2))};
-        builder.create<LLVM::MemcpyOp>(loc, args[0], args[1], args[2], false);
-        return ValueCategory(args[0], /*isReference*/ false);
-      }
-      // TODO this only sets a preference so it is not needed but if possible
-      // implement it
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "cudaFuncSetCacheConfig")) {
-        return ValueCategory();
-      }
       if (sr->getDecl()->getIdentifier() &&
           (sr->getDecl()->getName() == "cudaMemcpy" ||
            sr->getDecl()->getName() == "cudaMemcpyAsync" ||
@@ -1277,16 +1221,15 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
               mlir::Value size = builder.create<IndexCastOp>(
                   loc, Visit(expr->getArg(2)).getValue(loc, builder),
                   mlir::IndexType::get(builder.getContext()));
-              size = builder.create<DivUIOp>(
-                  loc, size, builder.create<ConstantIndexOp>(loc, elemSize));
+              size = builder.create<DivUIOp>(loc, size,
+                                             getConstantIndex(elemSize));
 
               if (sr->getDecl()->getName() == "cudaMemcpyToSymbol") {
                 mlir::Value offset = Visit(expr->getArg(3)).getValue(loc, builder);
                 offset = builder.create<IndexCastOp>(
                     loc, offset, mlir::IndexType::get(builder.getContext()));
-                offset = builder.create<DivUIOp>(
-                    loc, offset,
-                    builder.create<ConstantIndexOp>(loc, elemSize));
+                offset = builder.create<DivUIOp>(loc, offset,
+                                                 getConstantIndex(elemSize));
                 // assert(!dstArray);
                 if (auto mt = dyn_cast<MemRefType>(dst.getType())) {
                   auto shape = std::vector<int64_t>(mt.getShape());
@@ -1417,9 +1360,8 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
                   expr->dump();
                   llvm::errs() << " retTy: " << retTy << "\n";
                 }
-                return ValueCategory(
-                    builder.create<ConstantIntOp>(loc, 0, retTy),
-                    /*isReference*/ false);
+                return ValueCategory(getConstantInt(0, retTy),
+                                     /*isReference*/ false);
               }
             }
           }
@@ -1466,19 +1408,19 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
               auto melem = Glob.getMLIRType(elem, &dstArray);
               mlir::Value toStore;
               if (melem.isa<mlir::IntegerType>())
-                toStore = builder.create<ConstantIntOp>(loc, 0, melem);
+                toStore = getConstantInt(0, melem);
               else {
                 auto ft = melem.cast<FloatType>();
-                toStore = builder.create<ConstantFloatOp>(
-                    loc, APFloat(ft.getFloatSemantics(), "0"), ft);
+                toStore =
+                    getConstantFloat(APFloat(ft.getFloatSemantics(), "0"), ft);
               }
 
               auto elemSize = getTypeSize(elem);
               mlir::Value size = builder.create<IndexCastOp>(
                   loc, Visit(expr->getArg(2)).getValue(loc, builder),
                   mlir::IndexType::get(builder.getContext()));
-              size = builder.create<DivUIOp>(
-                  loc, size, builder.create<ConstantIndexOp>(loc, elemSize));
+              size = builder.create<DivUIOp>(loc, size,
+                                             getConstantIndex(elemSize));
 
               auto affineOp = builder.create<scf::ForOp>(
                   loc, getConstantIndex(0), size, getConstantIndex(1));
@@ -1511,7 +1453,7 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
               builder.setInsertionPoint(oldblock, oldpoint);
 
               auto retTy = getMLIRType(expr->getType());
-              return ValueCategory(builder.create<ConstantIntOp>(loc, 0, retTy),
+              return ValueCategory(getConstantInt(0, retTy),
                                    /*isReference*/ false);
             }
           }
@@ -1559,7 +1501,8 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
 
   const auto *callee = EmitCallee(expr->getCallee());
 
-  std::set<std::string> funcs = {
+  // Built once; this is consulted for every call that reaches this point.
+  static const llvm::StringSet<> funcs = {
       "fread",
       "read",
       "strcmp",
@@ -1622,7 +1565,7 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
               cast<FunctionDecl>(sr->getDecl()), KernelReferenceKind::Kernel));
         else
           name = Glob.CGM.getMangledName(sr->getDecl());
-        if (funcs.count(name.str()) || name.startswith("mkl_") ||
+        if (funcs.count(name) || name.startswith("mkl_") ||
             name.startswith("MKL_") || name.startswith("cublas") ||
             name.startswith("cblas_")) {
 
@@ -1825,9 +1768,7 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
                 loc, mlir::IndexType::get(builder.getContext()),
                 builder.create<mlir::memref::LoadOp>(loc, val, idx));
           } else {
-            mlir::Value idx[] = {
-                builder.create<arith::ConstantIntOp>(loc, 0, 32),
-                builder.create<arith::ConstantIntOp>(loc, i, 32)};
+            mlir::Value idx[] = {getConstantInt(0, 32), getConstantInt(i, 32)};
             auto PT = val.getType().cast<LLVM::LLVMPointerType>();
             auto ET =
                 PT.getElementType().cast<LLVM::LLVMStructType>().getBody()[i];
@@ -1864,9 +1805,7 @@ ValueCategory MLIRScanner::VisitCallExpr(clang::CallExpr *expr) {
                 loc, mlir::IndexType::get(builder.getContext()),
                 builder.create<mlir::memref::LoadOp>(loc, val, idx));
           } else {
-            mlir::Value idx[] = {
-                builder.create<arith::ConstantIntOp>(loc, 0, 32),
-                builder.create<arith::ConstantIntOp>(loc, i, 32)};
+            mlir::Value idx[] = {getConstantInt(0, 32), getConstantInt(i, 32)};
             auto PT = val.getType().cast<LLVM::LLVMPointerType>();
             auto ET =
                 PT.getElementType().cast<LLVM::LLVMStructType>().getBody()[i];
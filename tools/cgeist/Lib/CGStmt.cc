@@ -13,16 +13,192 @@
 #include "mlir/Dialect/OpenMP/OpenMPDialect.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/IR/Diagnostics.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 
 #define DEBUG_TYPE "CGStmt"
 
 using namespace mlir;
 using namespace mlir::arith;
 
+extern llvm::cl::opt<bool> StructuredFor;
+extern llvm::cl::opt<bool> RaiseToAffine;
+
 static bool isTerminator(Operation *op) {
   return op->mightHaveTrait<OpTrait::IsTerminator>();
 }
 
+namespace {
+/// Classifies how the variables referenced by a statement are used, and
+/// whether the statement contains control flow that would leave an enclosing
+/// loop other than by finishing an iteration.
+class StmtUses : public RecursiveASTVisitor<StmtUses> {
+public:
+  using Base = RecursiveASTVisitor<StmtUses>;
+
+  /// Variables that are assigned, incremented or decremented.
+  llvm::SmallPtrSet<const ValueDecl *, 8> written;
+  /// Variables that are used other than by reading or writing their value,
+  /// e.g. by taking their address or binding a reference or capture to them.
+  llvm::SmallPtrSet<const ValueDecl *, 8> escaping;
+  /// Whether there is a return, goto or label, or a break or continue that
+  /// is not nested in a loop of the statement.
+  bool unstructured = false;
+
+  bool VisitImplicitCastExpr(ImplicitCastExpr *expr) {
+    if (expr->getCastKind() == CK_LValueToRValue)
+      if (auto *ref = dyn_cast<DeclRefExpr>(expr->getSubExpr()->IgnoreParens()))
+        accesses.insert(ref);
+    return true;
+  }
+  bool VisitBinaryOperator(clang::BinaryOperator *expr) {
+    if (expr->isAssignmentOp())
+      markWritten(expr->getLHS());
+    return true;
+  }
+  bool VisitUnaryOperator(clang::UnaryOperator *expr) {
+    if (expr->isIncrementDecrementOp())
+      markWritten(expr->getSubExpr());
+    return true;
+  }
+  bool VisitDeclRefExpr(DeclRefExpr *expr) {
+    if (expr->refersToEnclosingVariableOrCapture() || !accesses.count(expr))
+      escaping.insert(expr->getDecl());
+    return true;
+  }
+
+  bool VisitBreakStmt(BreakStmt *) { return markLoopExit(); }
+  bool VisitContinueStmt(ContinueStmt *) { return markLoopExit(); }
+  bool VisitReturnStmt(ReturnStmt *) { return markUnstructured(); }
+  bool VisitGotoStmt(GotoStmt *) { return markUnstructured(); }
+  bool VisitIndirectGotoStmt(IndirectGotoStmt *) {
+    return markUnstructured();
+  }
+  bool VisitLabelStmt(LabelStmt *) { return markUnstructured(); }
+
+  bool TraverseForStmt(ForStmt *stmt) {
+    return traverseLoop([&] { return Base::TraverseForStmt(stmt); });
+  }
+  bool TraverseWhileStmt(WhileStmt *stmt) {
+    return traverseLoop([&] { return Base::TraverseWhileStmt(stmt); });
+  }
+  bool TraverseDoStmt(DoStmt *stmt) {
+    return traverseLoop([&] { return Base::TraverseDoStmt(stmt); });
+  }
+  bool TraverseCXXForRangeStmt(CXXForRangeStmt *stmt) {
+    return traverseLoop([&] { return Base::TraverseCXXForRangeStmt(stmt); });
+  }
+
+private:
+  void markWritten(Expr *expr) {
+    if (auto *ref = dyn_cast<DeclRefExpr>(expr->IgnoreParens())) {
+      accesses.insert(ref);
+      written.insert(ref->getDecl());
+    }
+  }
+  bool markLoopExit() {
+    unstructured |= loopDepth == 0;
+    return true;
+  }
+  bool markUnstructured() {
+    unstructured = true;
+    return true;
+  }
+  template <typename F> bool traverseLoop(F traverse) {
+    loopDepth++;
+    bool result = traverse();
+    loopDepth--;
+    return result;
+  }
+
+  /// References that only read or write the value of their variable.
+  llvm::SmallPtrSet<const DeclRefExpr *, 16> accesses;
+  unsigned loopDepth = 0;
+};
+} // namespace
+
+/// Returns the value of \p expr if it is a positive integer constant that
+/// fits a loop step.
+static std::optional<int> getPositiveStep(const Expr *expr,
+                                          const ASTContext &ctx) {
+  std::optional<llvm::APSInt> val = expr->getIntegerConstantExpr(ctx);
+  if (!val || !val->isStrictlyPositive() || val->getActiveBits() > 30)
+    return std::nullopt;
+  return (int)val->getExtValue();
+}
+
+/// Returns true if \p expr is a side-effect free integer expression over
+/// constants and local scalars, which are appended to \p vars. Such a bound
+/// may be evaluated once before the loop as long as the loop does not modify
+/// these scalars.
+static bool isInvariantBound(const Expr *expr, const ASTContext &ctx,
+                             SmallVectorImpl<const VarDecl *> &vars) {
+  expr = expr->IgnoreParens();
+  if (expr->isIntegerConstantExpr(ctx))
+    return true;
+  if (const auto *cast = dyn_cast<CastExpr>(expr)) {
+    switch (cast->getCastKind()) {
+    case CK_LValueToRValue:
+    case CK_IntegralCast:
+    case CK_NoOp:
+      return isInvariantBound(cast->getSubExpr(), ctx, vars);
+    default:
+      return false;
+    }
+  }
+  if (const auto *ref = dyn_cast<DeclRefExpr>(expr)) {
+    const auto *var = dyn_cast<VarDecl>(ref->getDecl());
+    if (!var || !var->hasLocalStorage() || !var->getType()->isIntegerType() ||
+        var->getType().isVolatileQualified())
+      return false;
+    vars.push_back(var);
+    return true;
+  }
+  if (const auto *unaryOp = dyn_cast<clang::UnaryOperator>(expr)) {
+    switch (unaryOp->getOpcode()) {
+    case UO_Plus:
+    case UO_Minus:
+    case UO_Not:
+      return isInvariantBound(unaryOp->getSubExpr(), ctx, vars);
+    default:
+      return false;
+    }
+  }
+  if (const auto *binaryOp = dyn_cast<clang::BinaryOperator>(expr)) {
+    switch (binaryOp->getOpcode()) {
+    case BO_Add:
+    case BO_Sub:
+    case BO_Mul:
+    case BO_Div:
+    case BO_Rem:
+    case BO_Shl:
+    case BO_Shr:
+    case BO_And:
+    case BO_Or:
+    case BO_Xor:
+      return isInvariantBound(binaryOp->getLHS(), ctx, vars) &&
+             isInvariantBound(binaryOp->getRHS(), ctx, vars);
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
+/// Returns true if every value of the loop bound \p bound can be reached by
+/// an induction variable of type \p indVarType, so that the induction
+/// variable does not overflow before the loop exits.
+static bool boundFitsIndVar(const Expr *bound, QualType indVarType,
+                            const ASTContext &ctx) {
+  bound = bound->IgnoreParenImpCasts();
+  uint64_t width = ctx.getTypeSize(indVarType);
+  if (std::optional<llvm::APSInt> val = bound->getIntegerConstantExpr(ctx))
+    return (val->isSigned() ? val->getSignificantBits()
+                            : val->getActiveBits() + 1) <= width;
+  return ctx.getTypeSize(bound->getType()) < width ||
+         (ctx.getTypeSize(bound->getType()) == width &&
+          bound->getType()->isSignedIntegerType());
+}
+
 bool MLIRScanner::getLowerBound(clang::ForStmt *fors,
                                 mlirclang::AffineLoopDescriptor &descr) {
   auto *init = fors->getInit();
@@ -36,6 +212,7 @@ bool MLIRScanner::getLowerBound(clang::ForStmt *fors,
           descr.setName(varDecl);
           descr.setType(val.getType());
           LLVM_DEBUG(descr.getType().print(llvm::dbgs()));
+          val = castToIndex(loc, val);
 
           if (descr.getForwardMode())
             descr.setLowerBound(val);
@@ -56,8 +233,7 @@ bool MLIRScanner::getLowerBound(clang::ForStmt *fors,
       if (auto *declRefStmt = dyn_cast<DeclRefExpr>(binOp->getLHS())) {
         auto loc = getMLIRLocation(binOp->getExprLoc());
         mlir::Value val = Visit(binOp->getRHS()).getValue(loc, builder);
-        val = builder.create<IndexCastOp>(
-            loc, mlir::IndexType::get(builder.getContext()), val);
+        val = castToIndex(loc, val);
         descr.setName(cast<VarDecl>(declRefStmt->getDecl()));
         descr.setType(getMLIRType(declRefStmt->getDecl()->getType()));
         if (descr.getForwardMode())
@@ -101,8 +277,7 @@ bool MLIRScanner::getUpperBound(clang::ForStmt *fors,
 
       auto *rhs = binaryOp->getRHS();
       mlir::Value val = Visit(rhs).getValue(loc, builder);
-      val = builder.create<IndexCastOp>(
-          loc, mlir::IndexType::get(val.getContext()), val);
+      val = castToIndex(loc, val);
       if (binaryOp->getOpcode() == clang::BinaryOperator::Opcode::BO_LE)
         val = builder.create<AddIOp>(loc, val, getConstantIndex(1));
       descr.setUpperBound(val);
@@ -114,8 +289,7 @@ bool MLIRScanner::getUpperBound(clang::ForStmt *fors,
 
       auto *rhs = binaryOp->getRHS();
       mlir::Value val = Visit(rhs).getValue(loc, builder);
-      val = builder.create<IndexCastOp>(
-          loc, mlir::IndexType::get(val.getContext()), val);
+      val = castToIndex(loc, val);
       if (binaryOp->getOpcode() == clang::BinaryOperator::Opcode::BO_GT)
         val = builder.create<AddIOp>(loc, val, getConstantIndex(1));
       descr.setLowerBound(val);
@@ -137,9 +311,100 @@ bool MLIRScanner::getConstantStep(clang::ForStmt *fors,
       descr.setForwardMode(forwardLoop);
       return true;
     }
+  if (auto *assignOp = dyn_cast<clang::CompoundAssignOperator>(inc))
+    if (assignOp->getOpcode() == clang::BinaryOperator::Opcode::BO_AddAssign)
+      if (auto step =
+              getPositiveStep(assignOp->getRHS(), Glob.CGM.getContext())) {
+        descr.setStep(*step);
+        descr.setForwardMode(true);
+        return true;
+      }
   return false;
 }
 
+/// Returns true if \p fors is a counted loop that can be emitted as an affine
+/// or scf loop without changing its meaning: the induction variable is a
+/// signed integer declared by the loop, it is stepped by a positive constant
+/// (or decremented by one) and compared against a side-effect free bound, and
+/// the body neither leaves the loop early nor modifies the induction
+/// variable or the variables of the bound. Only the AST is inspected, so a
+/// loop for which this holds is accepted by isTrivialAffineLoop without
+/// emitting anything that would have to be discarded.
+bool MLIRScanner::isStructuredForLoop(clang::ForStmt *fors) {
+  if (!StructuredFor || !EmittingFunctionDecl ||
+      !EmittingFunctionDecl->hasBody())
+    return false;
+  const ASTContext &ctx = Glob.CGM.getContext();
+
+  auto *declStmt = dyn_cast_or_null<DeclStmt>(fors->getInit());
+  if (!declStmt || !declStmt->isSingleDecl())
+    return false;
+  auto *indVar = dyn_cast<VarDecl>(declStmt->getSingleDecl());
+  if (!indVar || !indVar->hasInit() || !indVar->hasLocalStorage())
+    return false;
+  // Narrower induction variables are promoted in the condition and wrap
+  // around in the increment, where an index loop would keep counting.
+  QualType indVarType = indVar->getType();
+  if (!indVarType->isSignedIntegerType() || indVarType->isEnumeralType() ||
+      indVarType.isVolatileQualified() ||
+      ctx.getTypeSize(indVarType) < ctx.getTypeSize(ctx.IntTy))
+    return false;
+
+  bool forward;
+  Stmt *inc = fors->getInc();
+  if (auto *unaryOp = dyn_cast_or_null<clang::UnaryOperator>(inc)) {
+    if (!unaryOp->isIncrementDecrementOp() ||
+        !matchIndvar(unaryOp->getSubExpr(), indVar))
+      return false;
+    forward = unaryOp->isIncrementOp();
+  } else if (auto *assignOp = dyn_cast_or_null<CompoundAssignOperator>(inc)) {
+    if (assignOp->getOpcode() != clang::BinaryOperator::Opcode::BO_AddAssign ||
+        !matchIndvar(assignOp->getLHS(), indVar) ||
+        !getPositiveStep(assignOp->getRHS(), ctx))
+      return false;
+    forward = true;
+  } else {
+    return false;
+  }
+
+  auto *cond = dyn_cast_or_null<clang::BinaryOperator>(fors->getCond());
+  if (!cond || !matchIndvar(cond->getLHS(), indVar) ||
+      !cond->getLHS()->getType()->isSignedIntegerType())
+    return false;
+  auto opcode = cond->getOpcode();
+  if (forward ? opcode != clang::BinaryOperator::Opcode::BO_LT &&
+                    opcode != clang::BinaryOperator::Opcode::BO_LE
+              : opcode != clang::BinaryOperator::Opcode::BO_GT &&
+                    opcode != clang::BinaryOperator::Opcode::BO_GE)
+    return false;
+  SmallVector<const VarDecl *> boundVars;
+  if (!isInvariantBound(cond->getRHS(), ctx, boundVars) ||
+      llvm::is_contained(boundVars, indVar) ||
+      !boundFitsIndVar(cond->getRHS(), indVarType, ctx))
+    return false;
+
+  StmtUses body;
+  body.TraverseStmt(fors->getBody());
+  if (body.unstructured)
+    return false;
+  boundVars.push_back(indVar);
+  for (const VarDecl *var : boundVars)
+    if (body.written.count(var) || body.escaping.count(var))
+      return false;
+
+  // A bound variable whose address is taken anywhere in the function may be
+  // written through a pointer inside the loop.
+  if (!escapingVars) {
+    StmtUses function;
+    function.TraverseStmt(EmittingFunctionDecl->getBody());
+    escapingVars = std::move(function.escaping);
+  }
+  for (const VarDecl *var : boundVars)
+    if (var != indVar && escapingVars->count(var))
+      return false;
+  return true;
+}
+
 bool MLIRScanner::isTrivialAffineLoop(clang::ForStmt *fors,
                                       mlirclang::AffineLoopDescriptor &descr) {
   if (!getConstantStep(fors, descr)) {
@@ -160,22 +425,29 @@ bool MLIRScanner::isTrivialAffineLoop(clang::ForStmt *fors,
 
 void MLIRScanner::buildAffineLoopImpl(
     clang::ForStmt *fors, mlir::Location loc, mlir::Value lb, mlir::Value ub,
-    const mlirclang::AffineLoopDescriptor &descr) {
-  auto affineOp = builder.create<affine::AffineForOp>(
-      loc, lb, builder.getSymbolIdentityMap(), ub,
-      builder.getSymbolIdentityMap(), descr.getStep(),
-      /*iterArgs=*/std::nullopt);
-
-  auto &reg = affineOp.getRegion();
-
-  auto val = (mlir::Value)affineOp.getInductionVar();
+    const mlirclang::AffineLoopDescriptor &descr, bool isAffine) {
+  Block *body;
+  mlir::Value val;
+  if (isAffine) {
+    auto affineOp = builder.create<affine::AffineForOp>(
+        loc, lb, builder.getSymbolIdentityMap(), ub,
+        builder.getSymbolIdentityMap(), descr.getStep(),
+        /*iterArgs=*/std::nullopt);
+    body = affineOp.getBody();
+    val = affineOp.getInductionVar();
+  } else {
+    auto forOp = builder.create<scf::ForOp>(
+        loc, lb, ub, getConstantIndex(descr.getStep()));
+    body = forOp.getBody();
+    val = forOp.getInductionVar();
+  }
 
-  reg.front().clear();
+  body->clear();
 
   auto oldpoint = builder.getInsertionPoint();
   auto *oldblock = builder.getInsertionBlock();
 
-  builder.setInsertionPointToEnd(&reg.front());
+  builder.setInsertionPointToEnd(body);
 
   auto er = builder.create<scf::ExecuteRegionOp>(loc, ArrayRef<mlir::Type>());
   er.getRegion().push_back(new Block());
@@ -195,20 +467,23 @@ void MLIRScanner::buildAffineLoopImpl(
   // TODO: set loop context.
   Visit(fors->getBody());
 
-  builder.setInsertionPointToEnd(&reg.front());
-  builder.create<affine::AffineYieldOp>(loc);
+  builder.setInsertionPointToEnd(body);
+  if (isAffine)
+    builder.create<affine::AffineYieldOp>(loc);
+  else
+    builder.create<scf::YieldOp>(loc);
 
   // TODO: set the value of the iteration value to the final bound at the
   // end of the loop.
   builder.setInsertionPoint(oldblock, oldpoint);
 }
 
-void MLIRScanner::buildAffineLoop(
-    clang::ForStmt *fors, mlir::Location loc,
-    const mlirclang::AffineLoopDescriptor &descr) {
+void MLIRScanner::buildAffineLoop(clang::ForStmt *fors, mlir::Location loc,
+                                  const mlirclang::AffineLoopDescriptor &descr,
+                                  bool isAffine) {
   mlir::Value lb = descr.getLowerBound();
   mlir::Value ub = descr.getUpperBound();
-  buildAffineLoopImpl(fors, loc, lb, ub, descr);
+  buildAffineLoopImpl(fors, loc, lb, ub, descr, isAffine);
 }
 
 ValueCategory MLIRScanner::VisitForStmt(clang::ForStmt *fors) {
@@ -216,10 +491,20 @@ ValueCategory MLIRScanner::VisitForStmt(clang::ForStmt *fors) {
 
   auto loc = getMLIRLocation(fors->getForLoc());
 
+  // Loops in a scop are trusted to be affine. Other loops are only emitted
+  // as structured loops when the AST proves it safe. They become affine.for
+  // only when the pipeline raises to affine anyway and their bounds are valid
+  // affine symbols at this point, and scf.for otherwise.
   mlirclang::AffineLoopDescriptor affineLoopDescr;
-  if (Glob.scopLocList.isInScop(fors->getForLoc()) &&
+  bool inScop = Glob.scopLocList.isInScop(fors->getForLoc());
+  if ((inScop || isStructuredForLoop(fors)) &&
       isTrivialAffineLoop(fors, affineLoopDescr)) {
-    buildAffineLoop(fors, loc, affineLoopDescr);
+    bool isAffine =
+        inScop ||
+        (RaiseToAffine &&
+         affine::isValidSymbol(affineLoopDescr.getLowerBound()) &&
+         affine::isValidSymbol(affineLoopDescr.getUpperBound()));
+    buildAffineLoop(fors, loc, affineLoopDescr, isAffine);
   } else {
 
     if (auto *s = fors->getInit()) {
@@ -228,7 +513,7 @@ ValueCategory MLIRScanner::VisitForStmt(clang::ForStmt *fors) {
 
     auto i1Ty = builder.getIntegerType(1);
     auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-    auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+    auto truev = getConstantInt(true, 1);
 
     LoopContext lctx{builder.create<mlir::memref::AllocaOp>(loc, type),
                      builder.create<mlir::memref::AllocaOp>(loc, type)};
@@ -263,9 +548,8 @@ ValueCategory MLIRScanner::VisitForStmt(clang::ForStmt *fors) {
       }
       auto ty = cond.getType().cast<mlir::IntegerType>();
       if (ty.getWidth() != 1) {
-        cond = builder.create<arith::CmpIOp>(
-            loc, CmpIPredicate::ne, cond,
-            builder.create<ConstantIntOp>(loc, 0, ty));
+        cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                             getConstantInt(0, ty));
       }
       auto nb = builder.create<mlir::memref::LoadOp>(
           loc, lctx.noBreak, std::vector<mlir::Value>());
@@ -321,7 +605,7 @@ ValueCategory MLIRScanner::VisitCXXForRangeStmt(clang::CXXForRangeStmt *fors) {
 
   auto i1Ty = builder.getIntegerType(1);
   auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-  auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+  auto truev = getConstantInt(true, 1);
 
   LoopContext lctx{builder.create<mlir::memref::AllocaOp>(loc, type),
                    builder.create<mlir::memref::AllocaOp>(loc, type)};
@@ -349,9 +633,8 @@ ValueCategory MLIRScanner::VisitCXXForRangeStmt(clang::CXXForRangeStmt *fors) {
     }
     auto ty = cond.getType().cast<mlir::IntegerType>();
     if (ty.getWidth() != 1) {
-      cond = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, cond,
-          builder.create<ConstantIntOp>(loc, 0, ty));
+      cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                           getConstantInt(0, ty));
     }
     auto nb = builder.create<mlir::memref::LoadOp>(loc, lctx.noBreak,
                                                    std::vector<mlir::Value>());
@@ -393,6 +676,340 @@ ValueCategory MLIRScanner::VisitCXXForRangeStmt(clang::CXXForRangeStmt *fors) {
   return nullptr;
 }
 
+/// Returns the operator of a reduction clause on a scalar variable, or
+/// std::nullopt for user-defined reductions.
+static std::optional<MLIRScanner::OMPReduction::Kind>
+getOMPReductionKind(const OMPReductionClause *clause) {
+  using Kind = MLIRScanner::OMPReduction::Kind;
+  DeclarationName name = clause->getNameInfo().getName();
+  if (name.isIdentifier()) {
+    if (name.getAsIdentifierInfo()->isStr("min"))
+      return Kind::Min;
+    if (name.getAsIdentifierInfo()->isStr("max"))
+      return Kind::Max;
+    return std::nullopt;
+  }
+  switch (name.getCXXOverloadedOperator()) {
+  // '-' combines the partial results by adding them, like '+'.
+  case OO_Plus:
+  case OO_Minus:
+    return Kind::Add;
+  case OO_Star:
+    return Kind::Mul;
+  case OO_Amp:
+    return Kind::And;
+  case OO_Pipe:
+    return Kind::Or;
+  case OO_Caret:
+    return Kind::Xor;
+  case OO_AmpAmp:
+    return Kind::LogicalAnd;
+  case OO_PipePipe:
+    return Kind::LogicalOr;
+  default:
+    return std::nullopt;
+  }
+}
+
+void MLIRScanner::getOMPReductions(
+    clang::OMPExecutableDirective *dir,
+    llvm::SmallVectorImpl<OMPReduction> &reductions) {
+  for (auto *clause : dir->getClausesOfKind<OMPReductionClause>()) {
+    auto kind = getOMPReductionKind(clause);
+    if (clause->getModifier() != OMPC_REDUCTION_unknown &&
+        clause->getModifier() != OMPC_REDUCTION_default)
+      kind = std::nullopt;
+    for (auto *expr : clause->varlists()) {
+      auto *ref = dyn_cast<DeclRefExpr>(expr->IgnoreParenImpCasts());
+      auto *var = ref ? dyn_cast<VarDecl>(ref->getDecl()) : nullptr;
+      QualType type = expr->getType();
+      mlir::Type mlirType = var ? getMLIRType(type) : mlir::Type();
+      if (!kind || !var || !mlirType.isIntOrFloat() ||
+          (mlirType.isa<FloatType>() &&
+           (*kind == OMPReduction::And || *kind == OMPReduction::Or ||
+            *kind == OMPReduction::Xor))) {
+        llvm::errs() << "may not handle omp reduction of ";
+        expr->printPretty(llvm::errs(), nullptr,
+                          Glob.CGM.getContext().getPrintingPolicy());
+        llvm::errs() << ", it stays shared\n";
+        continue;
+      }
+      OMPReduction red;
+      red.var = var;
+      red.kind = *kind;
+      red.type = mlirType;
+      red.isSigned = type->isSignedIntegerOrEnumerationType();
+      red.shared = Visit(ref);
+      assert(red.shared.isReference);
+      reductions.push_back(red);
+    }
+  }
+}
+
+/// Returns the value that leaves the other operand of \p kind unchanged.
+static mlir::Value
+getOMPReductionIdentity(MLIRScanner &scanner,
+                        const MLIRScanner::OMPReduction &red) {
+  using Kind = MLIRScanner::OMPReduction::Kind;
+  if (auto ft = red.type.dyn_cast<FloatType>()) {
+    const llvm::fltSemantics &sem = ft.getFloatSemantics();
+    switch (red.kind) {
+    case Kind::Mul:
+    case Kind::LogicalAnd:
+      return scanner.getConstantFloat(APFloat(sem, 1), ft);
+    case Kind::Min:
+      return scanner.getConstantFloat(APFloat::getInf(sem), ft);
+    case Kind::Max:
+      return scanner.getConstantFloat(APFloat::getInf(sem, /*Negative*/ true),
+                                      ft);
+    default:
+      return scanner.getConstantFloat(APFloat::getZero(sem), ft);
+    }
+  }
+  unsigned width = red.type.getIntOrFloatBitWidth();
+  APInt value(width, 0);
+  switch (red.kind) {
+  case Kind::Mul:
+  case Kind::LogicalAnd:
+    value = APInt(width, 1);
+    break;
+  case Kind::And:
+    value = APInt::getAllOnes(width);
+    break;
+  case Kind::Min:
+    value = red.isSigned ? APInt::getSignedMaxValue(width)
+                         : APInt::getMaxValue(width);
+    break;
+  case Kind::Max:
+    value = red.isSigned ? APInt::getSignedMinValue(width)
+                         : APInt::getMinValue(width);
+    break;
+  default:
+    break;
+  }
+  return scanner.getConstant(IntegerAttr::get(red.type, value));
+}
+
+/// Combines two partial results of \p red. Only operations that
+/// -convert-scf-to-openmp recognizes in scf.reduce are used. The operands of
+/// the logical reductions are truth values, which makes them And and Or on
+/// integers, and a product and a maximum on floats.
+static mlir::Value combineOMPReduction(OpBuilder &builder, mlir::Location loc,
+                                       const MLIRScanner::OMPReduction &red,
+                                       mlir::Value lhs, mlir::Value rhs) {
+  using Kind = MLIRScanner::OMPReduction::Kind;
+  bool isFloat = red.type.isa<FloatType>();
+  switch (red.kind) {
+  case Kind::Add:
+    return isFloat ? (mlir::Value)builder.create<AddFOp>(loc, lhs, rhs)
+                   : builder.create<AddIOp>(loc, lhs, rhs);
+  case Kind::Mul:
+    return isFloat ? (mlir::Value)builder.create<MulFOp>(loc, lhs, rhs)
+                   : builder.create<MulIOp>(loc, lhs, rhs);
+  case Kind::And:
+    return builder.create<AndIOp>(loc, lhs, rhs);
+  case Kind::Or:
+    return builder.create<OrIOp>(loc, lhs, rhs);
+  case Kind::Xor:
+    return builder.create<XOrIOp>(loc, lhs, rhs);
+  case Kind::LogicalAnd:
+    return isFloat ? (mlir::Value)builder.create<MulFOp>(loc, lhs, rhs)
+                   : builder.create<AndIOp>(loc, lhs, rhs);
+  case Kind::LogicalOr:
+    if (!isFloat)
+      return builder.create<OrIOp>(loc, lhs, rhs);
+    [[fallthrough]];
+  case Kind::Min:
+  case Kind::Max: {
+    bool less = red.kind == Kind::Min;
+    mlir::Value cond;
+    if (isFloat)
+      cond = builder.create<CmpFOp>(
+          loc, less ? CmpFPredicate::OLT : CmpFPredicate::OGT, lhs, rhs);
+    else if (red.isSigned)
+      cond = builder.create<CmpIOp>(
+          loc, less ? CmpIPredicate::slt : CmpIPredicate::sgt, lhs, rhs);
+    else
+      cond = builder.create<CmpIOp>(
+          loc, less ? CmpIPredicate::ult : CmpIPredicate::ugt, lhs, rhs);
+    return builder.create<SelectOp>(loc, cond, lhs, rhs);
+  }
+  }
+  llvm_unreachable("unknown omp reduction");
+}
+
+void MLIRScanner::privatizeOMPReductions(
+    mlir::Location loc, llvm::MutableArrayRef<OMPReduction> reductions,
+    std::map<clang::VarDecl *, ValueCategory> &prev) {
+  for (auto &red : reductions) {
+    // Globals and statics have no binding, which is recorded as a null one so
+    // that the private copy is unbound again afterwards.
+    auto found = params.find(red.var);
+    if (found != params.end()) {
+      prev[red.var] = found->second;
+      params.erase(found);
+    } else {
+      prev[red.var] = ValueCategory();
+    }
+    bool LLVMABI = Glob.getMLIRType(
+                           Glob.CGM.getContext().getLValueReferenceType(
+                               red.var->getType()))
+                       .isa<mlir::LLVM::LLVMPointerType>();
+    auto allocop = createAllocOp(red.type, red.var, /*memtype*/ 0,
+                                 /*isArray*/ false, LLVMABI);
+    red.priv = ValueCategory(allocop, /*isReference*/ true);
+    red.priv.store(loc, builder, getOMPReductionIdentity(*this, red));
+    params[red.var] = red.priv;
+  }
+}
+
+void MLIRScanner::restoreOMPBindings(
+    const std::map<clang::VarDecl *, ValueCategory> &prev) {
+  for (const auto &[var, binding] : prev) {
+    if (binding.val)
+      params[var] = binding;
+    else
+      params.erase(var);
+  }
+}
+
+mlir::Value MLIRScanner::getOMPReductionOperand(mlir::Location loc,
+                                                const OMPReduction &red,
+                                                mlir::Value val) {
+  if (red.kind != OMPReduction::LogicalAnd &&
+      red.kind != OMPReduction::LogicalOr)
+    return val;
+  if (auto ft = red.type.dyn_cast<FloatType>()) {
+    auto isTrue = builder.create<CmpFOp>(
+        loc, CmpFPredicate::UNE, val,
+        getConstantFloat(APFloat::getZero(ft.getFloatSemantics()), ft));
+    return builder.create<UIToFPOp>(loc, ft, isTrue);
+  }
+  mlir::Value isTrue = builder.create<CmpIOp>(loc, CmpIPredicate::ne, val,
+                                              getConstantInt(0, red.type));
+  if (red.type.getIntOrFloatBitWidth() == 1)
+    return isTrue;
+  return builder.create<ExtUIOp>(loc, red.type, isTrue);
+}
+
+void MLIRScanner::emitOMPCriticalReduction(
+    mlir::Location loc, llvm::ArrayRef<OMPReduction> reductions,
+    bool barrier) {
+  if (reductions.empty())
+    return;
+  auto critical =
+      builder.create<omp::CriticalOp>(loc, /*name*/ FlatSymbolRefAttr{});
+  critical.getRegion().push_back(new Block());
+  builder.setInsertionPointToStart(&critical.getRegion().front());
+  for (const auto &red : reductions) {
+    auto lhs =
+        getOMPReductionOperand(loc, red, red.shared.getValue(loc, builder));
+    auto rhs =
+        getOMPReductionOperand(loc, red, red.priv.getValue(loc, builder));
+    red.shared.store(loc, builder,
+                     combineOMPReduction(builder, loc, red, lhs, rhs));
+  }
+  builder.create<omp::TerminatorOp>(loc);
+  builder.setInsertionPointAfter(critical);
+  if (barrier)
+    builder.create<omp::BarrierOp>(loc);
+}
+
+/// Returns the number of loops of \p dir that become dimensions of the
+/// parallel loop. These are the loops of the collapse nest up to the first one
+/// whose bounds depend on an enclosing counter, which runs serially within
+/// each parallel iteration instead.
+static unsigned getNumParallelLoops(clang::OMPLoopDirective *dir) {
+  unsigned numLoops = dir->getLoopsNumber();
+  for (unsigned i = 0; i < numLoops; i++)
+    if (dir->dependent_counters()[i])
+      return i;
+  return numLoops;
+}
+
+/// Returns the statement that each iteration of the first \p numLoops loops
+/// of \p dir runs.
+static clang::Stmt *getOMPLoopBody(clang::OMPLoopDirective *dir,
+                                   unsigned numLoops) {
+  if (numLoops == dir->getLoopsNumber())
+    return dir->getBody();
+  clang::Stmt *body = nullptr;
+  OMPLoopBasedDirective::doForAllLoops(
+      dir->getInnermostCapturedStmt()->getCapturedStmt(),
+      /*TryImperfectlyNestedLoops*/ true, numLoops + 1,
+      [&](unsigned depth, clang::Stmt *loop) {
+        if (depth == numLoops)
+          body = loop;
+        return false;
+      });
+  assert(body && "collapsed loop nest is too shallow");
+  return body;
+}
+
+static std::optional<omp::ClauseScheduleKind>
+getOMPScheduleKind(OpenMPScheduleClauseKind kind) {
+  switch (kind) {
+  case OMPC_SCHEDULE_static:
+    return omp::ClauseScheduleKind::Static;
+  case OMPC_SCHEDULE_dynamic:
+    return omp::ClauseScheduleKind::Dynamic;
+  case OMPC_SCHEDULE_guided:
+    return omp::ClauseScheduleKind::Guided;
+  case OMPC_SCHEDULE_auto:
+    return omp::ClauseScheduleKind::Auto;
+  case OMPC_SCHEDULE_runtime:
+    return omp::ClauseScheduleKind::Runtime;
+  default:
+    return std::nullopt;
+  }
+}
+
+/// Returns the schedule clause of \p dir, if any, and sets \p kind to the
+/// schedule it asks for.
+static clang::OMPScheduleClause *
+getOMPScheduleClause(clang::OMPLoopDirective *dir,
+                     std::optional<omp::ClauseScheduleKind> &kind) {
+  clang::OMPScheduleClause *clause = nullptr;
+  for (auto *f : dir->clauses())
+    if (auto *schedule = dyn_cast<OMPScheduleClause>(f))
+      clause = schedule;
+  if (!clause)
+    return nullptr;
+  kind = getOMPScheduleKind(clause->getScheduleKind());
+  if (clause->getFirstScheduleModifier() != OMPC_SCHEDULE_MODIFIER_unknown ||
+      clause->getSecondScheduleModifier() != OMPC_SCHEDULE_MODIFIER_unknown)
+    llvm::errs() << "may not handle omp schedule modifier\n";
+  return clause;
+}
+
+/// Returns the thread affinity the proc_bind clause of \p dir asks for, or
+/// null when it has none.
+static omp::ClauseProcBindKindAttr
+getOMPProcBind(clang::OMPExecutableDirective *dir, MLIRContext *ctx) {
+  for (auto *f : dir->clauses()) {
+    auto *clause = dyn_cast<OMPProcBindClause>(f);
+    if (!clause)
+      continue;
+    switch (clause->getProcBindKind()) {
+    case llvm::omp::OMP_PROC_BIND_primary:
+      return omp::ClauseProcBindKindAttr::get(ctx,
+                                              omp::ClauseProcBindKind::Primary);
+    case llvm::omp::OMP_PROC_BIND_master:
+      return omp::ClauseProcBindKindAttr::get(ctx,
+                                              omp::ClauseProcBindKind::Master);
+    case llvm::omp::OMP_PROC_BIND_close:
+      return omp::ClauseProcBindKindAttr::get(ctx,
+                                              omp::ClauseProcBindKind::Close);
+    case llvm::omp::OMP_PROC_BIND_spread:
+      return omp::ClauseProcBindKindAttr::get(ctx,
+                                              omp::ClauseProcBindKind::Spread);
+    default:
+      break;
+    }
+  }
+  return {};
+}
+
 ValueCategory
 MLIRScanner::VisitOMPSingleDirective(clang::OMPSingleDirective *par) {
   auto loc = getMLIRLocation(par->getBeginLoc());
@@ -435,23 +1052,23 @@ ValueCategory MLIRScanner::VisitOMPForDirective(clang::OMPForDirective *fors) {
     Visit(fors->getPreInits());
   }
 
+  unsigned numLoops = getNumParallelLoops(fors);
+
   SmallVector<mlir::Value> inits;
-  for (auto *f : fors->inits()) {
+  for (auto *f : fors->inits().take_front(numLoops)) {
     assert(f);
     f = cast<clang::BinaryOperator>(f)->getRHS();
-    inits.push_back(builder.create<IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    inits.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
   }
 
   SmallVector<mlir::Value> finals;
-  for (auto *f : fors->finals()) {
+  for (auto *f : fors->finals().take_front(numLoops)) {
     f = cast<clang::BinaryOperator>(f)->getRHS();
-    finals.push_back(builder.create<IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    finals.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
   }
 
   SmallVector<mlir::Value> incs;
-  for (auto *f : fors->updates()) {
+  for (auto *f : fors->updates().take_front(numLoops)) {
     f = cast<clang::BinaryOperator>(f)->getRHS();
     while (auto *ce = dyn_cast<clang::CastExpr>(f))
       f = ce->getSubExpr();
@@ -463,11 +1080,32 @@ ValueCategory MLIRScanner::VisitOMPForDirective(clang::OMPForDirective *fors) {
     bo = cast<clang::BinaryOperator>(f);
     assert(bo->getOpcode() == clang::BinaryOperator::Opcode::BO_Mul);
     f = bo->getRHS();
-    incs.push_back(builder.create<IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    incs.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
+  }
+
+  // Every thread accumulates into a copy of its own, which it combines into
+  // the shared variable once it ran out of iterations.
+  std::map<VarDecl *, ValueCategory> prevInduction;
+  SmallVector<OMPReduction> reductions;
+  getOMPReductions(fors, reductions);
+  privatizeOMPReductions(loc, reductions, prevInduction);
+
+  std::optional<omp::ClauseScheduleKind> schedule;
+  mlir::Value chunk;
+  if (auto *clause = getOMPScheduleClause(fors, schedule)) {
+    if (auto *pre = clause->getPreInitStmt())
+      Visit(pre);
+    if (auto *size = clause->getChunkSize())
+      chunk = Visit(size).getValue(loc, builder);
   }
 
   auto affineOp = builder.create<omp::WsLoopOp>(loc, inits, finals, incs);
+  if (schedule) {
+    affineOp.setScheduleValAttr(
+        omp::ClauseScheduleKindAttr::get(builder.getContext(), *schedule));
+    if (chunk)
+      affineOp.getScheduleChunkVarMutable().assign(chunk);
+  }
   affineOp.getRegion().push_back(new Block());
   for (auto init : inits)
     affineOp.getRegion().front().addArgument(init.getType(), init.getLoc());
@@ -487,13 +1125,14 @@ ValueCategory MLIRScanner::VisitOMPForDirective(clang::OMPForDirective *fors) {
   auto *oldScope = allocationScope;
   allocationScope = &executeRegion.getRegion().back();
 
-  std::map<VarDecl *, ValueCategory> prevInduction;
-  for (auto zp : zip(inds, fors->counters())) {
-    auto idx = builder.create<IndexCastOp>(
-        loc, getMLIRType(fors->getIterationVariable()->getType()),
-        std::get<0>(zp));
-    VarDecl *name =
-        cast<VarDecl>(cast<DeclRefExpr>(std::get<1>(zp))->getDecl());
+  // The counters of the loops that stay serial are private as well, and are
+  // set by the loops themselves.
+  auto counters = fors->counters();
+  for (unsigned i = 0, e = counters.size(); i < e; i++) {
+    mlir::Type type = getMLIRType(fors->getIterationVariable()->getType());
+    VarDecl *name = cast<VarDecl>(cast<DeclRefExpr>(counters[i])->getDecl());
+    if (i >= numLoops)
+      type = getMLIRType(name->getType());
 
     if (params.find(name) != params.end()) {
       prevInduction[name] = params[name];
@@ -509,14 +1148,16 @@ ValueCategory MLIRScanner::VisitOMPForDirective(clang::OMPForDirective *fors) {
     else
       Glob.getMLIRType(name->getType(), &isArray);
 
-    auto allocop = createAllocOp(idx.getType(), name, /*memtype*/ 0,
+    auto allocop = createAllocOp(type, name, /*memtype*/ 0,
                                  /*isArray*/ isArray, /*LLVMABI*/ LLVMABI);
     params[name] = ValueCategory(allocop, true);
-    params[name].store(loc, builder, idx);
+    if (i < numLoops)
+      params[name].store(loc, builder,
+                         builder.create<IndexCastOp>(loc, type, inds[i]));
   }
 
   // TODO: set loop context.
-  Visit(fors->getBody());
+  Visit(getOMPLoopBody(fors, numLoops));
 
   builder.create<scf::YieldOp>(loc, ValueRange());
 
@@ -525,9 +1166,9 @@ ValueCategory MLIRScanner::VisitOMPForDirective(clang::OMPForDirective *fors) {
   // TODO: set the value of the iteration value to the final bound at the
   // end of the loop.
   builder.setInsertionPoint(oldblock, oldpoint);
+  emitOMPCriticalReduction(loc, reductions, /*barrier*/ true);
 
-  for (auto pair : prevInduction)
-    params[pair.first] = pair.second;
+  restoreOMPBindings(prevInduction);
 
   return nullptr;
 }
@@ -573,16 +1214,22 @@ MLIRScanner::VisitOMPParallelDirective(clang::OMPParallelDirective *par) {
           Visit(numThreadsClause->getNumThreads()).getValue(loc, builder);
       break;
     }
+    case llvm::omp::OMPC_reduction:
+    case llvm::omp::OMPC_proc_bind:
+      break;
     default:
       llvm::errs() << "may not handle omp clause " << (int)f->getClauseKind()
                    << "\n";
     }
   }
+  SmallVector<OMPReduction> reductions;
+  getOMPReductions(par, reductions);
+
   auto affineOp = builder.create<omp::ParallelOp>(
       loc, /*if_expr_var*/ Value{}, numThreads, /*allocate_vars*/ ValueRange{},
       /*allocators_vars*/ ValueRange{}, /*reduction_vars*/ ValueRange{},
       /*reductions*/ ArrayAttr{},
-      /*proc_bind_val*/ omp::ClauseProcBindKindAttr{});
+      /*proc_bind_val*/ getOMPProcBind(par, builder.getContext()));
 
   auto oldpoint = builder.getInsertionPoint();
   auto *oldblock = builder.getInsertionBlock();
@@ -598,17 +1245,18 @@ MLIRScanner::VisitOMPParallelDirective(clang::OMPParallelDirective *par) {
 
   auto *oldScope = allocationScope;
   allocationScope = &executeRegion.getRegion().back();
+  privatizeOMPReductions(loc, reductions, prevInduction);
 
   Visit(cast<CapturedStmt>(par->getAssociatedStmt())
             ->getCapturedDecl()
             ->getBody());
 
+  emitOMPCriticalReduction(loc, reductions, /*barrier*/ false);
   builder.create<scf::YieldOp>(loc);
   allocationScope = oldScope;
   builder.setInsertionPoint(oldblock, oldpoint);
 
-  for (auto pair : prevInduction)
-    params[pair.first] = pair.second;
+  restoreOMPBindings(prevInduction);
   return nullptr;
 }
 
@@ -621,23 +1269,23 @@ ValueCategory MLIRScanner::VisitOMPParallelForDirective(
     Visit(fors->getPreInits());
   }
 
+  unsigned numLoops = getNumParallelLoops(fors);
+
   SmallVector<mlir::Value> inits;
-  for (auto *f : fors->inits()) {
+  for (auto *f : fors->inits().take_front(numLoops)) {
     assert(f);
     f = cast<clang::BinaryOperator>(f)->getRHS();
-    inits.push_back(builder.create<IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    inits.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
   }
 
   SmallVector<mlir::Value> finals;
-  for (auto *f : fors->finals()) {
+  for (auto *f : fors->finals().take_front(numLoops)) {
     f = cast<clang::BinaryOperator>(f)->getRHS();
-    finals.push_back(builder.create<arith::IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    finals.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
   }
 
   SmallVector<mlir::Value> incs;
-  for (auto *f : fors->updates()) {
+  for (auto *f : fors->updates().take_front(numLoops)) {
     f = cast<clang::BinaryOperator>(f)->getRHS();
     while (auto *ce = dyn_cast<clang::CastExpr>(f))
       f = ce->getSubExpr();
@@ -649,11 +1297,44 @@ ValueCategory MLIRScanner::VisitOMPParallelForDirective(
     bo = cast<clang::BinaryOperator>(f);
     assert(bo->getOpcode() == clang::BinaryOperator::Opcode::BO_Mul);
     f = bo->getRHS();
-    incs.push_back(builder.create<IndexCastOp>(
-        loc, builder.getIndexType(), Visit(f).getValue(loc, builder)));
+    incs.push_back(castToIndex(loc, Visit(f).getValue(loc, builder)));
   }
 
-  auto affineOp = builder.create<scf::ParallelOp>(loc, inits, finals, incs);
+  // Every iteration accumulates into a copy of its own, and scf.reduce
+  // combines the copies with the value the variable had before the loop.
+  SmallVector<OMPReduction> reductions;
+  getOMPReductions(fors, reductions);
+  SmallVector<mlir::Value> reductionInits;
+  SmallVector<mlir::Type> reductionTypes;
+  for (const auto &red : reductions) {
+    reductionInits.push_back(
+        getOMPReductionOperand(loc, red, red.shared.getValue(loc, builder)));
+    reductionTypes.push_back(red.type);
+  }
+
+  auto affineOp = builder.create<scf::ParallelOp>(loc, inits, finals, incs,
+                                                  reductionInits);
+
+  // The schedule and the thread affinity are carried as attributes until
+  // -polygeist-scf-to-openmp moves them onto the omp.wsloop and omp.parallel
+  // this loop becomes.
+  std::optional<omp::ClauseScheduleKind> schedule;
+  if (auto *clause = getOMPScheduleClause(fors, schedule)) {
+    if (schedule)
+      affineOp->setAttr(
+          "polygeist.schedule",
+          omp::ClauseScheduleKindAttr::get(builder.getContext(), *schedule));
+    if (auto *size = clause->getChunkSize()) {
+      if (auto cst = size->getIntegerConstantExpr(Glob.CGM.getContext()))
+        affineOp->setAttr("polygeist.schedule_chunk",
+                          builder.getI64IntegerAttr(cst->getExtValue()));
+      else
+        llvm::errs() << "may not handle omp schedule chunk that is not a "
+                        "constant, the default is used\n";
+    }
+  }
+  if (auto procBind = getOMPProcBind(fors, builder.getContext()))
+    affineOp->setAttr("polygeist.proc_bind", procBind);
 
   auto inds = affineOp.getInductionVars();
 
@@ -663,7 +1344,7 @@ ValueCategory MLIRScanner::VisitOMPParallelForDirective(
   builder.setInsertionPointToStart(&affineOp.getRegion().front());
 
   auto executeRegion =
-      builder.create<scf::ExecuteRegionOp>(loc, ArrayRef<mlir::Type>());
+      builder.create<scf::ExecuteRegionOp>(loc, reductionTypes);
   executeRegion.getRegion().push_back(new Block());
   builder.setInsertionPointToStart(&executeRegion.getRegion().back());
 
@@ -671,12 +1352,15 @@ ValueCategory MLIRScanner::VisitOMPParallelForDirective(
   allocationScope = &executeRegion.getRegion().back();
 
   std::map<VarDecl *, ValueCategory> prevInduction;
-  for (auto zp : zip(inds, fors->counters())) {
-    auto idx = builder.create<IndexCastOp>(
-        loc, getMLIRType(fors->getIterationVariable()->getType()),
-        std::get<0>(zp));
-    VarDecl *name =
-        cast<VarDecl>(cast<DeclRefExpr>(std::get<1>(zp))->getDecl());
+  privatizeOMPReductions(loc, reductions, prevInduction);
+  // The counters of the loops that stay serial are private as well, and are
+  // set by the loops themselves.
+  auto counters = fors->counters();
+  for (unsigned i = 0, e = counters.size(); i < e; i++) {
+    mlir::Type type = getMLIRType(fors->getIterationVariable()->getType());
+    VarDecl *name = cast<VarDecl>(cast<DeclRefExpr>(counters[i])->getDecl());
+    if (i >= numLoops)
+      type = getMLIRType(name->getType());
 
     if (params.find(name) != params.end()) {
       prevInduction[name] = params[name];
@@ -692,25 +1376,42 @@ ValueCategory MLIRScanner::VisitOMPParallelForDirective(
     else
       Glob.getMLIRType(name->getType(), &isArray);
 
-    auto allocop = createAllocOp(idx.getType(), name, /*memtype*/ 0,
+    auto allocop = createAllocOp(type, name, /*memtype*/ 0,
                                  /*isArray*/ isArray, /*LLVMABI*/ LLVMABI);
     params[name] = ValueCategory(allocop, true);
-    params[name].store(loc, builder, idx);
+    if (i < numLoops)
+      params[name].store(loc, builder,
+                         builder.create<IndexCastOp>(loc, type, inds[i]));
   }
 
   // TODO: set loop context.
-  Visit(fors->getBody());
-
-  builder.create<scf::YieldOp>(loc);
+  Visit(getOMPLoopBody(fors, numLoops));
+
+  SmallVector<mlir::Value> partials;
+  for (const auto &red : reductions)
+    partials.push_back(
+        getOMPReductionOperand(loc, red, red.priv.getValue(loc, builder)));
+  builder.create<scf::YieldOp>(loc, partials);
+
+  builder.setInsertionPoint(affineOp.getBody()->getTerminator());
+  for (size_t i = 0; i < reductions.size(); i++)
+    builder.create<scf::ReduceOp>(
+        loc, executeRegion.getResult(i),
+        [&](OpBuilder &b, mlir::Location loc, mlir::Value lhs,
+            mlir::Value rhs) {
+          b.create<scf::ReduceReturnOp>(
+              loc, combineOMPReduction(b, loc, reductions[i], lhs, rhs));
+        });
 
   allocationScope = oldScope;
 
   // TODO: set the value of the iteration value to the final bound at the
   // end of the loop.
   builder.setInsertionPoint(oldblock, oldpoint);
+  for (auto [red, result] : llvm::zip(reductions, affineOp.getResults()))
+    red.shared.store(loc, builder, result);
 
-  for (auto pair : prevInduction)
-    params[pair.first] = pair.second;
+  restoreOMPBindings(prevInduction);
 
   return nullptr;
 }
@@ -722,7 +1423,7 @@ ValueCategory MLIRScanner::VisitDoStmt(clang::DoStmt *fors) {
 
   auto i1Ty = builder.getIntegerType(1);
   auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-  auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+  auto truev = getConstantInt(true, 1);
   loops.push_back({builder.create<mlir::memref::AllocaOp>(loc, type),
                    builder.create<mlir::memref::AllocaOp>(loc, type)});
   builder.create<mlir::memref::StoreOp>(loc, truev, loops.back().noBreak);
@@ -749,9 +1450,8 @@ ValueCategory MLIRScanner::VisitDoStmt(clang::DoStmt *fors) {
     }
     auto ty = cond.getType().cast<mlir::IntegerType>();
     if (ty.getWidth() != 1) {
-      cond = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, cond,
-          builder.create<ConstantIntOp>(loc, 0, ty));
+      cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                           getConstantInt(0, ty));
     }
     auto nb = builder.create<mlir::memref::LoadOp>(loc, loops.back().noBreak,
                                                    std::vector<mlir::Value>());
@@ -783,7 +1483,7 @@ ValueCategory MLIRScanner::VisitWhileStmt(clang::WhileStmt *stmt) {
 
   auto i1Ty = builder.getIntegerType(1);
   auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-  auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+  auto truev = getConstantInt(true, 1);
   loops.push_back({builder.create<mlir::memref::AllocaOp>(loc, type),
                    builder.create<mlir::memref::AllocaOp>(loc, type)});
   builder.create<mlir::memref::StoreOp>(loc, truev, loops.back().noBreak);
@@ -812,9 +1512,8 @@ ValueCategory MLIRScanner::VisitWhileStmt(clang::WhileStmt *stmt) {
     }
     auto ty = cond.getType().cast<mlir::IntegerType>();
     if (ty.getWidth() != 1) {
-      cond = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, cond,
-          builder.create<ConstantIntOp>(loc, 0, ty));
+      cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                           getConstantInt(0, ty));
     }
     auto nb = builder.create<mlir::memref::LoadOp>(loc, loops.back().noBreak,
                                                    std::vector<mlir::Value>());
@@ -864,9 +1563,8 @@ ValueCategory MLIRScanner::VisitIfStmt(clang::IfStmt *stmt) {
   }
   auto prevTy = cond.getType().cast<mlir::IntegerType>();
   if (!prevTy.isInteger(1)) {
-    cond = builder.create<arith::CmpIOp>(
-        loc, CmpIPredicate::ne, cond,
-        builder.create<ConstantIntOp>(loc, 0, prevTy));
+    cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                         getConstantInt(0, prevTy));
   }
   bool hasElseRegion = stmt->getElse();
   auto ifOp = builder.create<mlir::scf::IfOp>(loc, cond, hasElseRegion);
@@ -941,7 +1639,7 @@ ValueCategory MLIRScanner::VisitSwitchStmt(clang::SwitchStmt *stmt) {
 
       auto i1Ty = builder.getIntegerType(1);
       auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-      auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+      auto truev = getConstantInt(true, 1);
       loops.push_back({builder.create<mlir::memref::AllocaOp>(loc, type),
                        builder.create<mlir::memref::AllocaOp>(loc, type)});
       builder.create<mlir::memref::StoreOp>(loc, truev, loops.back().noBreak);
@@ -965,7 +1663,7 @@ ValueCategory MLIRScanner::VisitSwitchStmt(clang::SwitchStmt *stmt) {
 
       auto i1Ty = builder.getIntegerType(1);
       auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-      auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+      auto truev = getConstantInt(true, 1);
       loops.push_back({builder.create<mlir::memref::AllocaOp>(loc, type),
                        builder.create<mlir::memref::AllocaOp>(loc, type)});
       builder.create<mlir::memref::StoreOp>(loc, truev, loops.back().noBreak);
@@ -980,6 +1678,7 @@ ValueCategory MLIRScanner::VisitSwitchStmt(clang::SwitchStmt *stmt) {
 
   if (caseVals.size() == 0) {
     delete &exitB;
+    forgetIndexCasts(er.getRegion());
     er.erase();
     builder.setInsertionPoint(oldblock2, oldpoint2);
     return nullptr;
@@ -1061,8 +1760,7 @@ ValueCategory MLIRScanner::VisitBreakStmt(clang::BreakStmt *stmt) {
   assert(loops.size() && "must be non-empty");
   assert(loops.back().keepRunning && "keep running false");
   assert(loops.back().noBreak && "no break false");
-  auto vfalse =
-      builder.create<ConstantIntOp>(builder.getUnknownLoc(), false, 1);
+  auto vfalse = getConstantInt(false, 1);
   builder.create<mlir::memref::StoreOp>(loc, vfalse, loops.back().keepRunning);
   builder.create<mlir::memref::StoreOp>(loc, vfalse, loops.back().noBreak);
 
@@ -1074,8 +1772,7 @@ ValueCategory MLIRScanner::VisitContinueStmt(clang::ContinueStmt *stmt) {
   auto loc = getMLIRLocation(stmt->getContinueLoc());
   assert(loops.size() && "must be non-empty");
   assert(loops.back().keepRunning && "keep running false");
-  auto vfalse =
-      builder.create<ConstantIntOp>(builder.getUnknownLoc(), false, 1);
+  auto vfalse = getConstantInt(false, 1);
   builder.create<mlir::memref::StoreOp>(loc, vfalse, loops.back().keepRunning);
   return nullptr;
 }
@@ -1190,8 +1887,7 @@ ValueCategory MLIRScanner::VisitReturnStmt(clang::ReturnStmt *stmt) {
   }
 
   assert(loops.size() && "must be non-empty");
-  auto vfalse =
-      builder.create<ConstantIntOp>(builder.getUnknownLoc(), false, 1);
+  auto vfalse = getConstantInt(false, 1);
   for (auto l : loops) {
     builder.create<mlir::memref::StoreOp>(loc, vfalse, l.keepRunning);
     builder.create<mlir::memref::StoreOp>(loc, vfalse, l.noBreak);
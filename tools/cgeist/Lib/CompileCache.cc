@@ -0,0 +1,100 @@
+//===- CompileCache.cc - Content-addressed output cache --------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompileCache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace mlirclang;
+
+CompileCache::CompileCache(StringRef dir, uint64_t maxSizeBytes)
+    : dir(dir.str()), maxSizeBytes(maxSizeBytes) {}
+
+std::string CompileCache::getEntryPath() {
+  if (entryPath.empty()) {
+    // pruneCache only considers files carrying the llvmcache- prefix.
+    SmallString<128> path(dir);
+    sys::path::append(path, "llvmcache-" + toHex(hasher.sha1(),
+                                                 /*LowerCase*/ true));
+    entryPath = std::string(path);
+  }
+  return entryPath;
+}
+
+std::unique_ptr<MemoryBuffer> CompileCache::lookup() {
+  if (!isEnabled())
+    return nullptr;
+  int FD;
+  if (sys::fs::openFileForRead(getEntryPath(), FD))
+    return nullptr;
+  auto buffer = MemoryBuffer::getOpenFile(
+      sys::fs::convertFDToNativeFile(FD), getEntryPath(), /*FileSize*/ -1,
+      /*RequiresNullTerminator*/ false);
+  // Pruning evicts by access time, which relatime mounts do not keep
+  // current.
+  sys::fs::setLastAccessAndModificationTime(FD,
+                                            std::chrono::system_clock::now());
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  if (!buffer)
+    return nullptr;
+  return std::move(*buffer);
+}
+
+void CompileCache::store(StringRef contents) {
+  if (!isEnabled())
+    return;
+  if (std::error_code EC = sys::fs::create_directories(dir)) {
+    errs() << "warning: cannot create cache directory " << dir << ": "
+           << EC.message() << "\n";
+    return;
+  }
+
+  // Writers race on the same key only with identical contents, so the last
+  // rename wins without readers ever seeing a partial entry.
+  SmallString<128> model(dir);
+  sys::path::append(model, "tmp-%%%%%%%%");
+  auto tmpFile = sys::fs::TempFile::create(model);
+  if (!tmpFile) {
+    errs() << "warning: cannot create cache entry: "
+           << toString(tmpFile.takeError()) << "\n";
+    return;
+  }
+  {
+    raw_fd_ostream out(tmpFile->FD, /*shouldClose*/ false);
+    out << contents;
+  }
+  if (Error err = tmpFile->keep(getEntryPath())) {
+    errs() << "warning: cannot store cache entry: " << toString(std::move(err))
+           << "\n";
+    consumeError(tmpFile->discard());
+    return;
+  }
+
+  CachePruningPolicy policy;
+  policy.Interval = std::chrono::seconds(0);
+  policy.Expiration = std::chrono::seconds(0);
+  policy.MaxSizeBytes = maxSizeBytes;
+  pruneCache(dir, policy);
+}
+
+void CompileCache::storeFile(StringRef path) {
+  if (!isEnabled())
+    return;
+  auto buffer = MemoryBuffer::getFile(path, /*IsText*/ false,
+                                      /*RequiresNullTerminator*/ false);
+  if (!buffer)
+    return;
+  store((*buffer)->getBuffer());
+}
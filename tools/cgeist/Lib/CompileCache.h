@@ -0,0 +1,59 @@
+//===- CompileCache.h - Content-addressed output cache ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_TOOLS_MLIRCLANG_COMPILECACHE_H
+#define MLIR_TOOLS_MLIRCLANG_COMPILECACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_sha1_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class MemoryBuffer;
+} // namespace llvm
+
+namespace mlirclang {
+
+/// An on-disk cache of cgeist outputs addressed by a hash of everything that
+/// determines them. Entries are published with an atomic rename, so parallel
+/// builds sharing a directory never observe partial files, and the directory
+/// is pruned in least recently used order to stay below a size limit. All
+/// methods are no-ops on a cache without a directory.
+class CompileCache {
+public:
+  CompileCache(llvm::StringRef dir, uint64_t maxSizeBytes);
+
+  bool isEnabled() const { return !dir.empty(); }
+
+  /// Stream that the key material is written to before lookup() or store().
+  llvm::raw_ostream &key() { return hasher; }
+
+  /// Returns the cached output for the current key, or null on a miss.
+  std::unique_ptr<llvm::MemoryBuffer> lookup();
+
+  /// Stores \p contents under the current key and prunes the cache.
+  void store(llvm::StringRef contents);
+
+  /// Stores the contents of the file at \p path under the current key.
+  void storeFile(llvm::StringRef path);
+
+private:
+  std::string getEntryPath();
+
+  std::string dir;
+  uint64_t maxSizeBytes;
+  llvm::raw_sha1_ostream hasher;
+  std::string entryPath;
+};
+
+} // namespace mlirclang
+
+#endif
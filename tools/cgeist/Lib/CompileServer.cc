@@ -0,0 +1,320 @@
+//===- CompileServer.cc - Compile requests over a Unix socket --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A request is a message carrying the client's stdin, stdout and stderr as
+// SCM_RIGHTS descriptors, followed by the protocol version, the command line,
+// the working directory and the environment. Strings are sent as a 32-bit
+// length followed by their bytes and lists as a 32-bit count followed by their
+// strings. The reply is the 32-bit exit code of the compile.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompileServer.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using namespace llvm;
+using namespace mlirclang;
+
+static constexpr uint32_t ProtocolVersion = 1;
+
+/// stdin, stdout and stderr.
+static constexpr int NumStreams = 3;
+
+static bool writeAll(int fd, const void *data, size_t size) {
+  const char *ptr = static_cast<const char *>(data);
+  while (size) {
+    ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *data, size_t size) {
+  char *ptr = static_cast<char *>(data);
+  while (size) {
+    ssize_t n = ::read(fd, ptr, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool writeString(int fd, StringRef str) {
+  uint32_t size = str.size();
+  return writeAll(fd, &size, sizeof(size)) && writeAll(fd, str.data(), size);
+}
+
+static bool readString(int fd, std::string &str) {
+  uint32_t size;
+  if (!readAll(fd, &size, sizeof(size)))
+    return false;
+  str.resize(size);
+  return readAll(fd, str.data(), size);
+}
+
+static bool writeStrings(int fd, ArrayRef<const char *> strs) {
+  uint32_t count = strs.size();
+  if (!writeAll(fd, &count, sizeof(count)))
+    return false;
+  for (const char *str : strs)
+    if (!writeString(fd, str))
+      return false;
+  return true;
+}
+
+static bool readStrings(int fd, std::vector<std::string> &strs) {
+  uint32_t count;
+  if (!readAll(fd, &count, sizeof(count)))
+    return false;
+  strs.resize(count);
+  for (std::string &str : strs)
+    if (!readString(fd, str))
+      return false;
+  return true;
+}
+
+static bool sendStreams(int sock) {
+  int fds[NumStreams] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  return ::sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+static bool receiveStreams(int sock, int (&fds)[NumStreams]) {
+  char byte;
+  struct iovec iov = {&byte, 1};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+    return false;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    return false;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  return true;
+}
+
+static bool getSocketAddress(StringRef path, struct sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    return false;
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+/// Returns a socket connected to \p path, or -1.
+static int connectTo(StringRef path) {
+  struct sockaddr_un addr;
+  if (!getSocketAddress(path, addr))
+    return -1;
+  int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return -1;
+  if (::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    ::close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/// Serves the request on \p conn from a process forked for it. Returns the
+/// exit code of the compile.
+static int handleRequest(int conn,
+                         function_ref<int(int argc, char **argv)> compile) {
+  int fds[NumStreams];
+  if (!receiveStreams(conn, fds))
+    return 1;
+  for (int i = 0; i < NumStreams; i++) {
+    ::dup2(fds[i], i);
+    ::close(fds[i]);
+  }
+
+  uint32_t version;
+  if (!readAll(conn, &version, sizeof(version)))
+    return 1;
+  int32_t code = 1;
+  if (version != ProtocolVersion) {
+    errs() << "error: the compile server speaks protocol version "
+           << ProtocolVersion << ", the client " << version << "\n";
+    writeAll(conn, &code, sizeof(code));
+    return code;
+  }
+
+  // The environment strings must stay alive for putenv.
+  std::vector<std::string> args, env;
+  std::string cwd;
+  if (!readStrings(conn, args) || !readString(conn, cwd) ||
+      !readStrings(conn, env))
+    return 1;
+  if (::chdir(cwd.c_str()) != 0) {
+    errs() << "error: cannot change to " << cwd << ": " << strerror(errno)
+           << "\n";
+    writeAll(conn, &code, sizeof(code));
+    return code;
+  }
+  ::clearenv();
+  for (std::string &var : env)
+    ::putenv(var.data());
+
+  // The compile runs in a process of its own so that the client also gets
+  // an exit code when it calls exit() or crashes.
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+      argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    int result = compile(args.size(), argv.data());
+    outs().flush();
+    ::_exit(result);
+  }
+  int status;
+  if (pid < 0) {
+    errs() << "error: cannot fork: " << strerror(errno) << "\n";
+  } else {
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+    if (WIFEXITED(status))
+      code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+      code = 128 + WTERMSIG(status);
+  }
+  writeAll(conn, &code, sizeof(code));
+  return code;
+}
+
+int mlirclang::serve(StringRef path,
+                     function_ref<int(int argc, char **argv)> compile) {
+  struct sockaddr_un addr;
+  if (!getSocketAddress(path, addr)) {
+    errs() << "error: invalid socket path " << path << "\n";
+    return 1;
+  }
+  if (int sock = connectTo(path); sock >= 0) {
+    ::close(sock);
+    errs() << "error: a compile server is already listening on " << path
+           << "\n";
+    return 1;
+  }
+  // A socket file left behind by a server that is gone.
+  ::unlink(addr.sun_path);
+
+  int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  // Only the user running the server may submit compiles to it.
+  mode_t oldMask = ::umask(0077);
+  bool bound = listener >= 0 &&
+               ::bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  ::umask(oldMask);
+  if (!bound || ::listen(listener, SOMAXCONN) != 0) {
+    errs() << "error: cannot listen on " << path << ": " << strerror(errno)
+           << "\n";
+    return 1;
+  }
+
+  // Children reply to their client themselves and need not be waited for.
+  ::signal(SIGCHLD, SIG_IGN);
+  outs().flush();
+  while (true) {
+    int conn = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errs() << "error: cannot accept on " << path << ": " << strerror(errno)
+             << "\n";
+      return 1;
+    }
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::close(listener);
+      ::signal(SIGCHLD, SIG_DFL);
+      // Skip the destructors of the state shared with the server.
+      ::_exit(handleRequest(conn, compile));
+    }
+    if (pid < 0)
+      errs() << "warning: cannot fork for a compile request: "
+             << strerror(errno) << "\n";
+    ::close(conn);
+  }
+}
+
+std::optional<int> mlirclang::forwardToServer(StringRef path, int argc,
+                                              char **argv) {
+  int sock = connectTo(path);
+  if (sock < 0)
+    return std::nullopt;
+
+  SmallString<256> cwd;
+  if (sys::fs::current_path(cwd)) {
+    ::close(sock);
+    return std::nullopt;
+  }
+  SmallVector<const char *> args(argv, argv + argc);
+  SmallVector<const char *> env;
+  for (char **var = environ; *var; var++)
+    env.push_back(*var);
+
+  int32_t code;
+  bool done = sendStreams(sock) &&
+              writeAll(sock, &ProtocolVersion, sizeof(ProtocolVersion)) &&
+              writeStrings(sock, args) && writeString(sock, cwd) &&
+              writeStrings(sock, env) && readAll(sock, &code, sizeof(code));
+  ::close(sock);
+  if (!done) {
+    errs() << "error: lost the connection to the compile server at " << path
+           << "\n";
+    return 1;
+  }
+  return code;
+}
@@ -0,0 +1,35 @@
+//===- CompileServer.h - Compile requests over a Unix socket ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_TOOLS_MLIRCLANG_COMPILESERVER_H
+#define MLIR_TOOLS_MLIRCLANG_COMPILESERVER_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <optional>
+
+namespace mlirclang {
+
+/// Accepts compile requests on the Unix socket at \p path and runs \p compile
+/// for each of them in a process forked from the caller, so that everything
+/// set up before the call is shared, already initialized, by all compiles.
+/// A request carries the command line, working directory, environment and
+/// standard streams of a client, and the client receives the exit code of
+/// \p compile. Only returns on error.
+int serve(llvm::StringRef path,
+          llvm::function_ref<int(int argc, char **argv)> compile);
+
+/// Runs the command line \p argv on the server listening at \p path and
+/// returns its exit code, or std::nullopt if no server is listening there.
+std::optional<int> forwardToServer(llvm::StringRef path, int argc,
+                                   char **argv);
+
+} // namespace mlirclang
+
+#endif
@@ -0,0 +1,253 @@
+//===- TimeReport.cc - Per-stage compile statistics ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "TimeReport.h"
+
+#include "mlir/IR/Operation.h"
+#include "mlir/Pass/PassInstrumentation.h"
+#include "mlir/Pass/PassManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+#include <time.h>
+
+using namespace mlir;
+using namespace mlirclang;
+
+static double getCPUSeconds(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+/// Child processes are only accounted once they have been waited for, which
+/// the driver does before a stage ends.
+static double getProcessCPUSeconds() {
+  return getCPUSeconds(RUSAGE_SELF) + getCPUSeconds(RUSAGE_CHILDREN);
+}
+
+/// Passes nested under a func.func pipeline may run on several threads at
+/// once, so they are charged the CPU time of the thread that ran them.
+static double getThreadCPUSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t getPeakRSSBytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes on Linux.
+  return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+static int64_t countOperations(Operation *op) {
+  int64_t count = 0;
+  op->walk([&](Operation *) { count++; });
+  return count;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+TimeReport::Scope::Scope(TimeReport *report, llvm::StringRef name,
+                         Operation *op)
+    : report(report->isEnabled() ? report : nullptr), op(op) {
+  if (!this->report)
+    return;
+  sample.name = name.str();
+  sample.invocations = 1;
+  if (op) {
+    sample.opsBefore = countOperations(op);
+    fingerprint.emplace(op);
+  }
+  wallStart = std::chrono::steady_clock::now();
+  cpuStart = getProcessCPUSeconds();
+  peakRSSStart = getPeakRSSBytes();
+}
+
+TimeReport::Scope::~Scope() {
+  if (!report)
+    return;
+  sample.wallSeconds = secondsSince(wallStart);
+  sample.cpuSeconds = getProcessCPUSeconds() - cpuStart;
+  sample.peakRSSGrowthBytes = getPeakRSSBytes() - peakRSSStart;
+  if (op) {
+    sample.opsAfter = countOperations(op);
+    sample.changed = !(*fingerprint == OperationFingerPrint(op));
+  }
+  std::lock_guard<std::mutex> lock(report->mutex);
+  report->stages.push_back(std::move(sample));
+}
+
+namespace mlirclang {
+/// Accumulates one sample per pass instance. Nested pipelines are cloned for
+/// every thread, so an instance is identified by its stage, the name of the
+/// operation it runs on and how many passes of the same name ran on that
+/// operation before it.
+class TimeReportInstrumentation : public PassInstrumentation {
+public:
+  TimeReportInstrumentation(TimeReport &report, llvm::StringRef stage)
+      : report(report), stage(stage.str()) {}
+
+  void runBeforePass(Pass *pass, Operation *op) override {
+    if (isAdaptor(pass))
+      return;
+    InFlight state;
+    state.opsBefore = countOperations(op);
+    state.fingerprint.emplace(op);
+    state.cpuStart = getThreadCPUSeconds();
+    state.wallStart = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(report.mutex);
+    inFlight.insert_or_assign({pass, op}, std::move(state));
+  }
+
+  void runAfterPass(Pass *pass, Operation *op) override { finish(pass, op); }
+
+  void runAfterPassFailed(Pass *pass, Operation *op) override {
+    finish(pass, op);
+  }
+
+private:
+  struct InFlight {
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart = 0;
+    int64_t opsBefore = 0;
+    std::optional<OperationFingerPrint> fingerprint;
+  };
+
+  /// Pipeline adaptors only forward to the nested passes, which are recorded
+  /// on their own.
+  static bool isAdaptor(Pass *pass) {
+    return pass->getName().contains("OpToOpPassAdaptor");
+  }
+
+  void finish(Pass *pass, Operation *op) {
+    if (isAdaptor(pass))
+      return;
+    double wall, cpu = getThreadCPUSeconds();
+    int64_t opsAfter = countOperations(op);
+    std::unique_lock<std::mutex> lock(report.mutex);
+    auto found = inFlight.find({pass, op});
+    if (found == inFlight.end())
+      return;
+    InFlight state = std::move(found->second);
+    inFlight.erase(found);
+    wall = secondsSince(state.wallStart);
+    cpu -= state.cpuStart;
+    llvm::StringRef passName =
+        pass->getArgument().empty() ? pass->getName() : pass->getArgument();
+    unsigned instance = occurrences[op][passName]++;
+    lock.unlock();
+
+    bool changed = !(*state.fingerprint == OperationFingerPrint(op));
+    std::string anchor = op->getName().getStringRef().str();
+    std::string name = (passName + "#" + llvm::Twine(instance)).str();
+
+    lock.lock();
+    auto inserted =
+        indices.try_emplace(anchor + "/" + name, report.passes.size());
+    if (inserted.second) {
+      TimeReport::Sample sample;
+      sample.name = name;
+      sample.stage = stage;
+      sample.anchor = anchor;
+      sample.opsBefore = 0;
+      sample.opsAfter = 0;
+      report.passes.push_back(std::move(sample));
+    }
+    TimeReport::Sample &sample = report.passes[inserted.first->second];
+    sample.invocations++;
+    sample.wallSeconds += wall;
+    sample.cpuSeconds += cpu;
+    sample.opsBefore += state.opsBefore;
+    sample.opsAfter += opsAfter;
+    sample.changed |= changed;
+  }
+
+  TimeReport &report;
+  std::string stage;
+  // All of the state below is guarded by the report mutex.
+  llvm::DenseMap<std::pair<Pass *, Operation *>, InFlight> inFlight;
+  llvm::DenseMap<Operation *, llvm::StringMap<unsigned>> occurrences;
+  llvm::StringMap<size_t> indices;
+};
+} // namespace mlirclang
+
+void TimeReport::instrument(PassManager &pm, llvm::StringRef stage) {
+  if (!enabled)
+    return;
+  pm.addInstrumentation(
+      std::make_unique<TimeReportInstrumentation>(*this, stage));
+}
+
+void TimeReport::counter(llvm::StringRef name, int64_t value) {
+  if (!enabled)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  counters.emplace_back(name.str(), value);
+}
+
+bool TimeReport::write(llvm::StringRef path) const {
+  if (!enabled)
+    return true;
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC);
+  if (EC) {
+    llvm::errs() << "Failed to open " << path << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  auto writeSample = [](llvm::json::OStream &J, const Sample &sample) {
+    J.object([&] {
+      J.attribute("name", sample.name);
+      if (!sample.stage.empty())
+        J.attribute("stage", sample.stage);
+      if (!sample.anchor.empty())
+        J.attribute("op", sample.anchor);
+      J.attribute("invocations", (int64_t)sample.invocations);
+      J.attribute("wall_seconds", sample.wallSeconds);
+      J.attribute("cpu_seconds", sample.cpuSeconds);
+      if (sample.stage.empty())
+        J.attribute("peak_rss_growth_bytes",
+                    (int64_t)sample.peakRSSGrowthBytes);
+      if (sample.opsBefore >= 0) {
+        J.attribute("ops_before", sample.opsBefore);
+        J.attribute("ops_after", sample.opsAfter);
+        J.attribute("noop", !sample.changed);
+      }
+    });
+  };
+
+  std::lock_guard<std::mutex> lock(mutex);
+  llvm::json::OStream J(os, /*IndentSize*/ 2);
+  J.object([&] {
+    J.attribute("peak_rss_bytes", (int64_t)getPeakRSSBytes());
+    J.attributeArray("stages", [&] {
+      for (const Sample &sample : stages)
+        writeSample(J, sample);
+    });
+    J.attributeArray("passes", [&] {
+      for (const Sample &sample : passes)
+        writeSample(J, sample);
+    });
+    J.attributeObject("counters", [&] {
+      for (const auto &counter : counters)
+        J.attribute(counter.first, counter.second);
+    });
+  });
+  os << "\n";
+  return true;
+}
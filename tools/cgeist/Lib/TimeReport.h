@@ -0,0 +1,105 @@
+//===- TimeReport.h - Per-stage compile statistics -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_TOOLS_MLIRCLANG_TIMEREPORT_H
+#define MLIR_TOOLS_MLIRCLANG_TIMEREPORT_H
+
+#include "mlir/IR/OperationSupport.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mlir {
+class PassManager;
+} // namespace mlir
+
+namespace mlirclang {
+
+/// Collects wall time, CPU time and IR size for the stages of a cgeist run
+/// and for every pass instance they execute, and writes them as JSON for
+/// -time-report. Stages also record how much they raised the peak RSS of the
+/// process. All methods are no-ops on a disabled report.
+class TimeReport {
+public:
+  struct Sample {
+    std::string name;
+    /// Stage the sample belongs to, empty for stages themselves.
+    std::string stage;
+    /// Name of the operation a pass ran on, empty for stages.
+    std::string anchor;
+    unsigned invocations = 0;
+    double wallSeconds = 0;
+    /// For stages, this includes child processes that finished during the
+    /// stage, such as the clang driver run by the backend.
+    double cpuSeconds = 0;
+    /// Growth of the process peak RSS during a stage. The peak only ever
+    /// grows, so passes running concurrently cannot be told apart and do not
+    /// record it.
+    uint64_t peakRSSGrowthBytes = 0;
+    /// Number of nested operations, -1 if the stage is not measured on IR.
+    int64_t opsBefore = -1;
+    int64_t opsAfter = -1;
+    bool changed = false;
+  };
+
+  /// Measures one driver stage from construction to destruction.
+  class Scope {
+  public:
+    Scope(TimeReport *report, llvm::StringRef name, mlir::Operation *op);
+    Scope(const Scope &) = delete;
+    ~Scope();
+
+  private:
+    TimeReport *report;
+    mlir::Operation *op;
+    Sample sample;
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart = 0;
+    uint64_t peakRSSStart = 0;
+    std::optional<mlir::OperationFingerPrint> fingerprint;
+  };
+
+  explicit TimeReport(bool enabled) : enabled(enabled) {}
+
+  bool isEnabled() const { return enabled; }
+
+  /// Starts measuring the stage \p name. When \p op is given, its operation
+  /// count and fingerprint are compared before and after the stage.
+  Scope stage(llvm::StringRef name, mlir::Operation *op = nullptr) {
+    return Scope(this, name, op);
+  }
+
+  /// Records every pass instance run by \p pm as part of stage \p stage.
+  void instrument(mlir::PassManager &pm, llvm::StringRef stage);
+
+  /// Records a count that is not tied to a stage, such as the number of
+  /// operations the frontend avoided emitting.
+  void counter(llvm::StringRef name, int64_t value);
+
+  /// Writes the report to \p path as JSON. Returns false on error.
+  bool write(llvm::StringRef path) const;
+
+private:
+  friend class TimeReportInstrumentation;
+
+  bool enabled;
+  mutable std::mutex mutex;
+  std::vector<Sample> stages;
+  std::vector<Sample> passes;
+  std::vector<std::pair<std::string, int64_t>> counters;
+};
+
+} // namespace mlirclang
+
+#endif
@@ -12,6 +12,7 @@
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/DLTI/DLTI.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/IR/Threading.h"
 #include "mlir/Target/LLVMIR/Import.h"
 #include "utils.h"
 #include "clang/AST/Attr.h"
@@ -29,6 +30,7 @@
 #include "clang/Driver/Tool.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendOptions.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/Utils.h"
@@ -36,6 +38,7 @@
 #include "clang/Parse/Parser.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -67,6 +70,12 @@ static cl::opt<bool>
     CombinedStructABI("struct-abi", cl::init(true),
                       cl::desc("Use literal LLVM ABI for structs"));
 
+cl::opt<bool> StructuredFor(
+    "structured-for", cl::init(true),
+    cl::desc("Emit canonical for loops directly as affine or scf loops"));
+
+mlirclang::FrontendStatistics mlirclang::frontendStatistics;
+
 ValueCategory MLIRScanner::createComplexFloat(mlir::Location loc,
                                               mlir::Value real,
                                               mlir::Value imag,
@@ -144,8 +153,7 @@ ValueCategory MLIRScanner::getComplexPartRef(mlir::Location loc,
                .cast<mlir::LLVM::LLVMArrayType>()
                .getElementType();
     }
-    mlir::Value vec[2] = {builder.create<ConstantIntOp>(loc, 0, 32),
-                          builder.create<ConstantIntOp>(loc, fnum, 32)};
+    mlir::Value vec[2] = {getConstantInt(0, 32), getConstantInt(fnum, 32)};
     return ValueCategory(
         builder.create<mlir::LLVM::GEPOp>(
             loc, mlir::LLVM::LLVMPointerType::get(ET, PT.getAddressSpace()),
@@ -163,8 +171,7 @@ mlir::Value MLIRScanner::getComplexPart(mlir::Location loc, mlir::Value complex,
     if (fnum == 0)
       return complex;
     else
-      return builder.create<ConstantFloatOp>(
-          loc, APFloat::getZero(ft.getFloatSemantics()), ft);
+      return getConstantFloat(APFloat::getZero(ft.getFloatSemantics()), ft);
   } else if (auto ST =
                  dyn_cast<mlir::LLVM::LLVMStructType>(complex.getType())) {
     return builder.create<LLVM::ExtractValueOp>(loc, complex, fnum);
@@ -392,7 +399,7 @@ void MLIRScanner::init(mlir::func::FuncOp function, const FunctionDecl *fd) {
 
   auto i1Ty = builder.getIntegerType(1);
   auto type = mlir::MemRefType::get({}, i1Ty, {}, 0);
-  auto truev = builder.create<ConstantIntOp>(loc, true, 1);
+  auto truev = getConstantInt(true, 1);
   loops.push_back({builder.create<mlir::memref::AllocaOp>(loc, type),
                    builder.create<mlir::memref::AllocaOp>(loc, type)});
   builder.create<mlir::memref::StoreOp>(loc, truev, loops.back().noBreak);
@@ -604,8 +611,8 @@ MLIRScanner::VisitExtVectorElementExpr(clang::ExtVectorElementExpr *expr) {
   const auto exprLoc = getMLIRLocation(expr->getExprLoc());
   const auto accLoc = getMLIRLocation(expr->getAccessorLoc());
   const mlir::Value idxs[2] = {
-      builder.create<ConstantIntOp>(exprLoc, 0, 32),
-      builder.create<ConstantIntOp>(exprLoc, indices[0], 32),
+      getConstantInt(0, 32),
+      getConstantInt(indices[0], 32),
   };
 
   if (const auto pt = dyn_cast<LLVM::LLVMPointerType>(et)) {
@@ -644,10 +651,9 @@ ValueCategory MLIRScanner::VisitConstantExpr(clang::ConstantExpr *expr) {
   auto sv = Visit(expr->getSubExpr());
   if (auto ty = dyn_cast<mlir::IntegerType>(getMLIRType(expr->getType()))) {
     if (expr->hasAPValueResult()) {
-      return ValueCategory(builder.create<arith::ConstantIntOp>(
-                               getMLIRLocation(expr->getExprLoc()),
-                               expr->getResultAsAPSInt().getExtValue(), ty),
-                           /*isReference*/ false);
+      return ValueCategory(
+          getConstantInt(expr->getResultAsAPSInt().getExtValue(), ty),
+          /*isReference*/ false);
     }
   }
   assert(sv.val);
@@ -656,42 +662,32 @@ ValueCategory MLIRScanner::VisitConstantExpr(clang::ConstantExpr *expr) {
 
 ValueCategory MLIRScanner::VisitTypeTraitExpr(clang::TypeTraitExpr *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(
-      builder.create<arith::ConstantIntOp>(getMLIRLocation(expr->getExprLoc()),
-                                           expr->getValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantInt(expr->getValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitGNUNullExpr(clang::GNUNullExpr *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(builder.create<arith::ConstantIntOp>(
-                           getMLIRLocation(expr->getExprLoc()), 0, ty),
-                       /*isReference*/ false);
+  return ValueCategory(getConstantInt(0, ty), /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitIntegerLiteral(clang::IntegerLiteral *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(
-      builder.create<arith::ConstantIntOp>(getMLIRLocation(expr->getExprLoc()),
-                                           expr->getValue().getSExtValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantInt(expr->getValue().getSExtValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory
 MLIRScanner::VisitCharacterLiteral(clang::CharacterLiteral *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(
-      builder.create<arith::ConstantIntOp>(getMLIRLocation(expr->getExprLoc()),
-                                           expr->getValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantInt(expr->getValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitFloatingLiteral(clang::FloatingLiteral *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::FloatType>();
-  return ValueCategory(
-      builder.create<ConstantFloatOp>(getMLIRLocation(expr->getExprLoc()),
-                                      expr->getValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantFloat(expr->getValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory
@@ -712,8 +708,7 @@ MLIRScanner::VisitImaginaryLiteral(clang::ImaginaryLiteral *expr) {
     assert(0 && "unexpected complex type\n");
   }
 
-  auto zero = builder.create<ConstantFloatOp>(
-      loc, APFloat(fty.getFloatSemantics(), "0"), fty);
+  auto zero = getConstantFloat(APFloat(fty.getFloatSemantics(), "0"), fty);
   auto imag = Visit(expr->getSubExpr()).getValue(loc, builder);
   return createComplexFloat(loc, zero, imag, expr->getType());
 }
@@ -721,10 +716,8 @@ MLIRScanner::VisitImaginaryLiteral(clang::ImaginaryLiteral *expr) {
 ValueCategory
 MLIRScanner::VisitCXXBoolLiteralExpr(clang::CXXBoolLiteralExpr *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(
-      builder.create<ConstantIntOp>(getMLIRLocation(expr->getExprLoc()),
-                                    expr->getValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantInt(expr->getValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitStringLiteral(clang::StringLiteral *expr) {
@@ -744,12 +737,11 @@ MLIRScanner::VisitImplicitValueInitExpr(clang::ImplicitValueInitExpr *decl) {
   auto loc = getMLIRLocation(decl->getExprLoc());
 
   if (auto FT = dyn_cast<mlir::FloatType>(Mty))
-    return ValueCategory(builder.create<ConstantFloatOp>(
-                             loc, APFloat(FT.getFloatSemantics(), "0"), FT),
-                         /*isReference*/ false);
+    return ValueCategory(
+        getConstantFloat(APFloat(FT.getFloatSemantics(), "0"), FT),
+        /*isReference*/ false);
   if (auto IT = dyn_cast<mlir::IntegerType>(Mty))
-    return ValueCategory(builder.create<ConstantIntOp>(loc, 0, IT),
-                         /*isReference*/ false);
+    return ValueCategory(getConstantInt(0, IT), /*isReference*/ false);
   if (auto MT = dyn_cast<mlir::MemRefType>(Mty))
     return ValueCategory(
         builder.create<polygeist::Pointer2MemrefOp>(
@@ -874,8 +866,8 @@ mlir::Attribute MLIRScanner::InitializeValueByInitListExpr(mlir::Value toInit,
             assert(0 && "unknown inner type");
 
           mlir::Value idxs[] = {
-              builder.create<ConstantIntOp>(loc, 0, 32),
-              builder.create<ConstantIntOp>(loc, i, 32),
+              getConstantInt(0, 32),
+              getConstantInt(i, 32),
           };
           next = builder.create<LLVM::GEPOp>(
               loc, LLVM::LLVMPointerType::get(nextType, PT.getAddressSpace()),
@@ -1057,7 +1049,7 @@ ValueCategory MLIRScanner::VisitVarDecl(clang::VarDecl *decl) {
       iter = builder.getInsertionPoint();
       builder.setInsertionPointToStart(&ifOp.getThenRegion().back());
       builder.create<memref::StoreOp>(
-          varLoc, builder.create<ConstantIntOp>(varLoc, false, 1), boolop,
+          varLoc, getConstantInt(false, 1), boolop,
           std::vector<mlir::Value>({getConstantIndex(0)}));
     }
   } else
@@ -1141,8 +1133,7 @@ ValueCategory MLIRScanner::VisitCXXStdInitializerListExpr(
   auto iTy = getMLIRType(Field->getType()).cast<mlir::IntegerType>();
   res = builder.create<LLVM::InsertValueOp>(
       loc, res.getType(), res,
-      builder.create<arith::ConstantIntOp>(
-          loc, ArrayType->getSize().getZExtValue(), iTy.getWidth()),
+      getConstantInt(ArrayType->getSize().getZExtValue(), iTy.getWidth()),
       builder.getDenseI64ArrayAttr(1));
   return ValueCategory(res, /*isRef*/ false);
 }
@@ -1494,9 +1485,49 @@ mlir::Value MLIRScanner::castToIndex(mlir::Location loc, mlir::Value val) {
 
   if (auto op = val.getDefiningOp<ConstantIntOp>())
     return getConstantIndex(op.value());
+  if (val.getType().isa<mlir::IndexType>())
+    return val;
+
+  return createIndexCast(loc, mlir::IndexType::get(val.getContext()), val);
+}
 
-  return builder.create<arith::IndexCastOp>(
-      loc, mlir::IndexType::get(val.getContext()), val);
+/// Reuses an existing cast of \p val to \p type when one dominates the
+/// insertion point, which is common for loop bounds and subscripts that read
+/// the same value repeatedly.
+mlir::Value MLIRScanner::createIndexCast(mlir::Location loc, mlir::Type type,
+                                         mlir::Value val) {
+  // Walk out from the insertion point; the scanner only emits regions that
+  // see values from above, so a cast earlier in any enclosing block
+  // dominates.
+  mlir::Block *block = builder.getInsertionBlock();
+  mlir::Block::iterator point = builder.getInsertionPoint();
+  while (true) {
+    auto found = indexCasts.find(std::make_tuple(block, val, type));
+    if (found != indexCasts.end())
+      for (mlir::Operation *cast : found->second)
+        if (point == block->end() || cast->isBeforeInBlock(&*point)) {
+          mlirclang::frontendStatistics.indexCastsReused++;
+          return cast->getResult(0);
+        }
+    mlir::Operation *parent = block->getParentOp();
+    if (!parent || parent == function.getOperation() || !parent->getBlock())
+      break;
+    block = parent->getBlock();
+    point = parent->getIterator();
+  }
+  mlirclang::frontendStatistics.indexCastsEmitted++;
+  auto cast = builder.create<arith::IndexCastOp>(loc, type, val);
+  indexCasts[std::make_tuple(cast->getBlock(), val, type)].push_back(cast);
+  return cast;
+}
+
+void MLIRScanner::forgetIndexCasts(mlir::Region &region) {
+  region.walk([&](mlir::Block *block) {
+    for (mlir::Operation &op : *block)
+      if (auto cast = dyn_cast<arith::IndexCastOp>(op))
+        indexCasts.erase(
+            std::make_tuple(block, cast.getIn(), cast.getType()));
+  });
 }
 
 ValueCategory
@@ -1508,7 +1539,7 @@ MLIRScanner::VisitCXXScalarValueInitExpr(clang::CXXScalarValueInitExpr *expr) {
   assert(!isArray);
 
   if (melem.isa<mlir::IntegerType>())
-    return ValueCategory(builder.create<ConstantIntOp>(loc, 0, melem), false);
+    return ValueCategory(getConstantInt(0, melem), false);
   else if (auto MT = dyn_cast<mlir::MemRefType>(melem))
     return ValueCategory(
         builder.create<polygeist::Pointer2MemrefOp>(
@@ -1522,9 +1553,8 @@ MLIRScanner::VisitCXXScalarValueInitExpr(clang::CXXScalarValueInitExpr *expr) {
     if (!melem.isa<FloatType>())
       expr->dump();
     auto ft = melem.cast<FloatType>();
-    return ValueCategory(builder.create<ConstantFloatOp>(
-                             loc, APFloat(ft.getFloatSemantics(), "0"), ft),
-                         false);
+    return ValueCategory(
+        getConstantFloat(APFloat(ft.getFloatSemantics(), "0"), ft), false);
   }
 }
 
@@ -1577,11 +1607,11 @@ ValueCategory MLIRScanner::VisitConstructCommon(clang::CXXConstructExpr *cons,
     }
     mlir::Value size = getTypeSize(loc, cons->getType());
 
-    auto i8_0 = builder.create<ConstantIntOp>(loc, 0, 8);
+    auto i8_0 = getConstantInt(0, 8);
     auto sizev =
         builder.create<arith::IndexCastOp>(loc, builder.getI64Type(), size);
 
-    auto falsev = builder.create<ConstantIntOp>(loc, false, 1);
+    auto falsev = getConstantInt(false, 1);
     builder.create<LLVM::MemsetOp>(loc, val, i8_0, sizev, falsev);
   }
 
@@ -1638,8 +1668,7 @@ ValueCategory MLIRScanner::CommonArrayToPointer(mlir::Location loc,
   if (auto PT = dyn_cast<mlir::LLVM::LLVMPointerType>(scalar.val.getType())) {
     if (PT.getElementType().isa<mlir::LLVM::LLVMPointerType>())
       return ValueCategory(scalar.val, /*isRef*/ false);
-    mlir::Value vec[2] = {builder.create<ConstantIntOp>(loc, 0, 32),
-                          builder.create<ConstantIntOp>(loc, 0, 32)};
+    mlir::Value vec[2] = {getConstantInt(0, 32), getConstantInt(0, 32)};
     if (!PT.getElementType().isa<mlir::LLVM::LLVMArrayType>()) {
       EmittingFunctionDecl->dump();
       function.dump();
@@ -1787,82 +1816,6 @@ const clang::FunctionDecl *MLIRScanner::EmitCallee(const Expr *E) {
   return nullptr;
 }
 
-std::pair<ValueCategory, bool>
-MLIRScanner::EmitBuiltinOps(clang::CallExpr *expr) {
-  auto loc = getMLIRLocation(expr->getExprLoc());
-  if (auto ic = dyn_cast<ImplicitCastExpr>(expr->getCallee())) {
-    if (auto sr = dyn_cast<DeclRefExpr>(ic->getSubExpr())) {
-      if (sr->getDecl()->getIdentifier() &&
-          sr->getDecl()->getName() == "__log2f") {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<mlir::math::Log2Op>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-      if (sr->getDecl()->getIdentifier() && sr->getDecl()->getName() == "log") {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<mlir::math::LogOp>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "ceil")) {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<math::CeilOp>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-      if (sr->getDecl()->getIdentifier() &&
-          (sr->getDecl()->getName() == "expf" ||
-           sr->getDecl()->getName() == "exp")) {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<mlir::math::ExpOp>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-      if (sr->getDecl()->getIdentifier() && sr->getDecl()->getName() == "sin") {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<mlir::math::SinOp>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-
-      if (sr->getDecl()->getIdentifier() && sr->getDecl()->getName() == "cos") {
-        std::vector<mlir::Value> args;
-        for (auto a : expr->arguments()) {
-          args.push_back(Visit(a).getValue(loc, builder));
-        }
-        return make_pair(
-            ValueCategory(builder.create<mlir::math::CosOp>(loc, args[0]),
-                          /*isReference*/ false),
-            true);
-      }
-    }
-  }
-
-  return make_pair(ValueCategory(), false);
-}
-
 std::pair<ValueCategory, bool>
 MLIRScanner::EmitGPUCallExpr(clang::CallExpr *expr) {
   auto loc = getMLIRLocation(expr->getExprLoc());
@@ -1904,7 +1857,7 @@ MLIRScanner::EmitGPUCallExpr(clang::CallExpr *expr) {
         if (sr->getDecl()->getName() == "cudaFree" ||
             sr->getDecl()->getName() == "cudaFreeHost") {
           auto ty = getMLIRType(expr->getType());
-          auto op = builder.create<ConstantIntOp>(loc, 0, ty);
+          auto op = getConstantInt(0, ty);
           return make_pair(ValueCategory(op, /*isReference*/ false), true);
         }
         // TODO remove me when the free is removed.
@@ -1963,7 +1916,7 @@ MLIRScanner::EmitGPUCallExpr(clang::CallExpr *expr) {
                   .store(loc, builder, allocv);
               auto retTy = getMLIRType(expr->getType());
               return make_pair(
-                  ValueCategory(builder.create<ConstantIntOp>(loc, 0, retTy),
+                  ValueCategory(getConstantInt(0, retTy),
                                 /*isReference*/ false),
                   true);
             }
@@ -2100,14 +2053,41 @@ MLIRScanner::EmitGPUCallExpr(clang::CallExpr *expr) {
   return make_pair(ValueCategory(), false);
 }
 
-mlir::Value MLIRScanner::getConstantIndex(int x) {
-  if (constants.find(x) != constants.end()) {
-    return constants[x];
+mlir::Value MLIRScanner::getConstant(mlir::TypedAttr value) {
+  auto found = constants.find(value);
+  if (found != constants.end()) {
+    mlirclang::frontendStatistics.constantsReused++;
+    return found->second;
   }
+  // The entry block dominates everything the function emits, so one constant
+  // serves every use and later passes have no duplicates to clean up.
+  mlirclang::frontendStatistics.constantsEmitted++;
   mlir::OpBuilder subbuilder(builder.getContext());
-  subbuilder.setInsertionPointToStart(entryBlock);
-  return constants[x] =
-             subbuilder.create<ConstantIndexOp>(subbuilder.getUnknownLoc(), x);
+  if (lastConstant)
+    subbuilder.setInsertionPointAfter(lastConstant);
+  else
+    subbuilder.setInsertionPointToStart(entryBlock);
+  auto constant =
+      subbuilder.create<arith::ConstantOp>(subbuilder.getUnknownLoc(), value);
+  lastConstant = constant;
+  return constants[value] = constant;
+}
+
+mlir::Value MLIRScanner::getConstantIndex(int64_t x) {
+  return getConstant(builder.getIndexAttr(x));
+}
+
+mlir::Value MLIRScanner::getConstantInt(int64_t x, mlir::Type type) {
+  return getConstant(builder.getIntegerAttr(type, x));
+}
+
+mlir::Value MLIRScanner::getConstantInt(int64_t x, unsigned width) {
+  return getConstantInt(x, builder.getIntegerType(width));
+}
+
+mlir::Value MLIRScanner::getConstantFloat(const llvm::APFloat &x,
+                                          mlir::FloatType type) {
+  return getConstant(builder.getFloatAttr(type, x));
 }
 
 ValueCategory MLIRScanner::VisitMSPropertyRefExpr(MSPropertyRefExpr *expr) {
@@ -2157,11 +2137,10 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
     }
     auto ty = val.getType().cast<mlir::IntegerType>();
     if (ty.getWidth() != 1) {
-      val = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, val,
-          builder.create<ConstantIntOp>(loc, 0, ty));
+      val = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, val,
+                                          getConstantInt(0, ty));
     }
-    auto c1 = builder.create<ConstantIntOp>(loc, 1, val.getType());
+    auto c1 = getConstantInt(1, val.getType());
     mlir::Value res = builder.create<XOrIOp>(loc, val, c1);
 
     if (postTy.getWidth() > 1)
@@ -2177,8 +2156,8 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
       val.dump();
     }
     auto ty = val.getType().cast<mlir::IntegerType>();
-    auto c1 = builder.create<ConstantIntOp>(
-        loc, APInt::getAllOnes(ty.getWidth()).getSExtValue(), ty);
+    auto c1 =
+        getConstantInt(APInt::getAllOnes(ty.getWidth()).getSExtValue(), ty);
     return ValueCategory(builder.create<XOrIOp>(loc, val, c1),
                          /*isReference*/ false);
   }
@@ -2228,10 +2207,8 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
                              /*isReference*/ false);
       }
       return ValueCategory(
-          builder.create<SubIOp>(loc,
-                                 builder.create<ConstantIntOp>(
-                                     loc, 0, ty.cast<mlir::IntegerType>()),
-                                 val),
+          builder.create<SubIOp>(
+              loc, getConstantInt(0, ty.cast<mlir::IntegerType>()), val),
           /*isReference*/ false);
     }
   }
@@ -2250,8 +2227,7 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
       assert(prev.getType() == ty);
       next = builder.create<AddFOp>(
           loc, prev,
-          builder.create<ConstantFloatOp>(
-              loc, APFloat(ft.getFloatSemantics(), "1"), ft));
+          getConstantFloat(APFloat(ft.getFloatSemantics(), "1"), ft));
     } else if (auto mt = dyn_cast<MemRefType>(ty)) {
       auto shape = std::vector<int64_t>(mt.getShape());
       shape[0] = ShapedType::kDynamic;
@@ -2263,9 +2239,7 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
     } else if (auto pt = dyn_cast<mlir::LLVM::LLVMPointerType>(ty)) {
       auto ity = mlir::IntegerType::get(builder.getContext(), 64);
       next = builder.create<LLVM::GEPOp>(
-          loc, pt, prev,
-          std::vector<mlir::Value>(
-              {builder.create<ConstantIntOp>(loc, 1, ity)}));
+          loc, pt, prev, std::vector<mlir::Value>({getConstantInt(1, ity)}));
     } else {
       if (!ty.isa<mlir::IntegerType>()) {
         llvm::errs() << ty << " - " << prev << "\n";
@@ -2277,8 +2251,7 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
       }
       assert(prev.getType() == ty);
       next = builder.create<AddIOp>(
-          loc, prev,
-          builder.create<ConstantIntOp>(loc, 1, ty.cast<mlir::IntegerType>()));
+          loc, prev, getConstantInt(1, ty.cast<mlir::IntegerType>()));
     }
     sub.store(loc, builder, next);
 
@@ -2297,14 +2270,13 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
     if (auto ft = dyn_cast<mlir::FloatType>(ty)) {
       next = builder.create<SubFOp>(
           loc, prev,
-          builder.create<ConstantFloatOp>(
-              loc, APFloat(ft.getFloatSemantics(), "1"), ft));
+          getConstantFloat(APFloat(ft.getFloatSemantics(), "1"), ft));
     } else if (auto pt = dyn_cast<mlir::LLVM::LLVMPointerType>(ty)) {
       auto ity = mlir::IntegerType::get(builder.getContext(), 64);
       next = builder.create<LLVM::GEPOp>(
           loc, pt, prev,
           std::vector<mlir::Value>(
-              {builder.create<ConstantIntOp>(loc, ShapedType::kDynamic, ity)}));
+              {getConstantInt(ShapedType::kDynamic, ity)}));
     } else if (auto mt = dyn_cast<MemRefType>(ty)) {
       auto shape = std::vector<int64_t>(mt.getShape());
       shape[0] = ShapedType::kDynamic;
@@ -2319,8 +2291,7 @@ ValueCategory MLIRScanner::VisitUnaryOperator(clang::UnaryOperator *U) {
         U->dump();
       }
       next = builder.create<SubIOp>(
-          loc, prev,
-          builder.create<ConstantIntOp>(loc, 1, ty.cast<mlir::IntegerType>()));
+          loc, prev, getConstantInt(1, ty.cast<mlir::IntegerType>()));
     }
     sub.store(loc, builder, next);
     return ValueCategory(
@@ -2499,12 +2470,12 @@ ValueCategory MLIRScanner::VisitAtomicExpr(clang::AtomicExpr *BO) {
     if (ty.isa<mlir::IntegerType>()) {
       op = AtomicRMWKind::addi;
       lop = LLVM::AtomicBinOp::add;
-      a1 = builder.create<ConstantIntOp>(loc, 0, ty);
+      a1 = getConstantInt(0, ty);
     } else {
       op = AtomicRMWKind::addf;
       lop = LLVM::AtomicBinOp::fadd;
-      a1 = builder.create<ConstantFloatOp>(
-          loc, APFloat(ty.cast<mlir::FloatType>().getFloatSemantics(), "0"),
+      a1 = getConstantFloat(
+          APFloat(ty.cast<mlir::FloatType>().getFloatSemantics(), "0"),
           ty.cast<mlir::FloatType>());
     }
     // TODO add atomic ordering
@@ -2612,9 +2583,8 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
     }
     auto prevTy = cond.getType().cast<mlir::IntegerType>();
     if (!prevTy.isInteger(1)) {
-      cond = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, cond,
-          builder.create<ConstantIntOp>(loc, 0, prevTy));
+      cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                           getConstantInt(0, prevTy));
     }
     auto ifOp = builder.create<mlir::scf::IfOp>(loc, types, cond,
                                                 /*hasElseRegion*/ true);
@@ -2631,16 +2601,14 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
           loc, mlir::LLVM::ICmpPredicate::ne, rhs, nullptr_llvm);
     }
     if (!rhs.getType().cast<mlir::IntegerType>().isInteger(1)) {
-      rhs = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, rhs,
-          builder.create<ConstantIntOp>(loc, 0, rhs.getType()));
+      rhs = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, rhs,
+                                          getConstantInt(0, rhs.getType()));
     }
     mlir::Value truearray[] = {rhs};
     builder.create<mlir::scf::YieldOp>(loc, truearray);
 
     builder.setInsertionPointToStart(&ifOp.getElseRegion().back());
-    mlir::Value falsearray[] = {
-        builder.create<ConstantIntOp>(loc, 0, types[0])};
+    mlir::Value falsearray[] = {getConstantInt(0, types[0])};
     builder.create<mlir::scf::YieldOp>(loc, falsearray);
 
     builder.setInsertionPoint(oldblock, oldpoint);
@@ -2651,9 +2619,8 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
     auto cond = lhs.getValue(loc, builder);
     auto prevTy = cond.getType().cast<mlir::IntegerType>();
     if (!prevTy.isInteger(1)) {
-      cond = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, cond,
-          builder.create<ConstantIntOp>(loc, 0, prevTy));
+      cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                           getConstantInt(0, prevTy));
     }
     auto ifOp = builder.create<mlir::scf::IfOp>(loc, types, cond,
                                                 /*hasElseRegion*/ true);
@@ -2662,15 +2629,14 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
     auto oldblock = builder.getInsertionBlock();
     builder.setInsertionPointToStart(&ifOp.getThenRegion().back());
 
-    mlir::Value truearray[] = {builder.create<ConstantIntOp>(loc, 1, types[0])};
+    mlir::Value truearray[] = {getConstantInt(1, types[0])};
     builder.create<mlir::scf::YieldOp>(loc, truearray);
 
     builder.setInsertionPointToStart(&ifOp.getElseRegion().back());
     auto rhs = Visit(BO->getRHS()).getValue(loc, builder);
     if (!rhs.getType().cast<mlir::IntegerType>().isInteger(1)) {
-      rhs = builder.create<arith::CmpIOp>(
-          loc, CmpIPredicate::ne, rhs,
-          builder.create<ConstantIntOp>(loc, 0, rhs.getType()));
+      rhs = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, rhs,
+                                          getConstantInt(0, rhs.getType()));
     }
     assert(rhs != nullptr);
     mlir::Value falsearray[] = {rhs};
@@ -2922,8 +2888,7 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
       if (auto lhs_c = lhs_v.getDefiningOp<ConstantIntOp>()) {
         if (auto rhs_c = rhs_v.getDefiningOp<ConstantIntOp>()) {
           return ValueCategory(
-              builder.create<arith::ConstantIntOp>(
-                  loc, lhs_c.value() + rhs_c.value(), lhs_c.getType()),
+              getConstantInt(lhs_c.value() + rhs_c.value(), lhs_c.getType()),
               false);
         }
       }
@@ -2961,7 +2926,7 @@ ValueCategory MLIRScanner::VisitBinaryOperator(clang::BinaryOperator *BO) {
                    dyn_cast<mlir::LLVM::LLVMPointerType>(lhs_v.getType())) {
       if (auto IT = dyn_cast<mlir::IntegerType>(rhs_v.getType())) {
         mlir::Value vals[1] = {builder.create<SubIOp>(
-            loc, builder.create<ConstantIntOp>(loc, 0, IT.getWidth()), rhs_v)};
+            loc, getConstantInt(0, IT.getWidth()), rhs_v)};
         return ValueCategory(
             builder.create<LLVM::GEPOp>(loc, lhs_v.getType(), lhs_v,
                                         ArrayRef<mlir::Value>(vals)),
@@ -3330,8 +3295,7 @@ ValueCategory MLIRScanner::CommonFieldLookup(mlir::Location loc,
   }
 
   auto PT = val.getType().cast<mlir::LLVM::LLVMPointerType>();
-  mlir::Value vec[] = {builder.create<ConstantIntOp>(loc, 0, 32),
-                       builder.create<ConstantIntOp>(loc, fnum, 32)};
+  mlir::Value vec[] = {getConstantInt(0, 32), getConstantInt(fnum, 32)};
   if (!PT.getElementType()
            .isa<mlir::LLVM::LLVMStructType, mlir::LLVM::LLVMArrayType>()) {
     llvm::errs() << "function: " << function << "\n";
@@ -3428,9 +3392,8 @@ ValueCategory MLIRScanner::VisitDeclRefExpr(DeclRefExpr *E) {
   }
   if (auto ED = dyn_cast<EnumConstantDecl>(E->getDecl())) {
     auto ty = getMLIRType(E->getType()).cast<mlir::IntegerType>();
-    return ValueCategory(
-        builder.create<ConstantIntOp>(loc, ED->getInitVal().getExtValue(), ty),
-        /*isReference*/ false);
+    return ValueCategory(getConstantInt(ED->getInitVal().getExtValue(), ty),
+                         /*isReference*/ false);
 
     if (!ED->getInitExpr())
       ED->dump();
@@ -3520,10 +3483,8 @@ MLIRScanner::VisitCXXDefaultInitExpr(clang::CXXDefaultInitExpr *expr) {
 
 ValueCategory MLIRScanner::VisitCXXNoexceptExpr(CXXNoexceptExpr *expr) {
   auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(
-      builder.create<ConstantIntOp>(getMLIRLocation(expr->getExprLoc()),
-                                    expr->getValue(), ty),
-      /*isReference*/ false);
+  return ValueCategory(getConstantInt(expr->getValue(), ty),
+                       /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitMemberExpr(MemberExpr *ME) {
@@ -3603,10 +3564,10 @@ mlir::Value MLIRScanner::GetAddressOfDerivedClass(
 
     mlir::Value Offset = nullptr;
     if (isLLVMStructABI(RD, /*ST*/ nullptr)) {
-      Offset = builder.create<arith::ConstantIntOp>(
-          loc, -(ssize_t)Layout.getBaseClassOffset(BaseDecl).getQuantity(), 32);
+      Offset = getConstantInt(
+          -(ssize_t)Layout.getBaseClassOffset(BaseDecl).getQuantity(), 32);
     } else {
-      Offset = builder.create<arith::ConstantIntOp>(loc, 0, 32);
+      Offset = getConstantInt(0, 32);
       bool found = false;
       for (auto f : RD->bases()) {
         if (f.getType().getTypePtr()->getUnqualifiedDesugaredType() ==
@@ -3725,8 +3686,8 @@ mlir::Value MLIRScanner::GetAddressOfBaseClass(
       }
       if (!done) {
         mlir::Value idx[] = {
-            builder.create<arith::ConstantIntOp>(loc, 0, 32),
-            builder.create<arith::ConstantIntOp>(loc, fnum, 32)};
+            getConstantInt(0, 32),
+            getConstantInt(fnum, 32)};
         auto PT = value.getType().cast<LLVM::LLVMPointerType>();
         mlir::Type ET;
         if (auto ST =
@@ -3996,11 +3957,10 @@ ValueCategory MLIRScanner::VisitCastExpr(CastExpr *E) {
                               .getAddressSpace()),
                       val);
                 }
-                auto i8_0 = builder.create<arith::ConstantIntOp>(loc, 0, 8);
+                auto i8_0 = getConstantInt(0, 8);
                 auto sizev = builder.create<arith::IndexCastOp>(
                     loc, builder.getI64Type(), allocSize);
-                auto falsev =
-                    builder.create<arith::ConstantIntOp>(loc, false, 1);
+                auto falsev = getConstantInt(false, 1);
                 builder.create<LLVM::MemsetOp>(loc, val, i8_0, sizev, falsev);
               }
               return ValueCategory(alloc, /*isReference*/ false);
@@ -4359,9 +4319,8 @@ ValueCategory MLIRScanner::VisitCastExpr(CastExpr *E) {
   case clang::CastKind::CK_IntegralToBoolean: {
     auto res = Visit(E->getSubExpr()).getValue(loc, builder);
     auto prevTy = res.getType().cast<mlir::IntegerType>();
-    res = builder.create<arith::CmpIOp>(
-        loc, CmpIPredicate::ne, res,
-        builder.create<ConstantIntOp>(loc, 0, prevTy));
+    res = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, res,
+                                        getConstantInt(0, prevTy));
     auto postTy = getMLIRType(E->getType()).cast<mlir::IntegerType>();
     bool signedType = true;
     if (auto bit = dyn_cast<clang::BuiltinType>(&*E->getType())) {
@@ -4390,8 +4349,8 @@ ValueCategory MLIRScanner::VisitCastExpr(CastExpr *E) {
       if (bit->isSignedInteger())
         signedType = true;
     }
-    auto Zero = builder.create<ConstantFloatOp>(
-        loc, APFloat::getZero(prevTy.getFloatSemantics()), prevTy);
+    auto Zero =
+        getConstantFloat(APFloat::getZero(prevTy.getFloatSemantics()), prevTy);
     res = builder.create<arith::CmpFOp>(loc, CmpFPredicate::UNE, res, Zero);
     if (1 < postTy.getWidth()) {
       if (signedType) {
@@ -4438,8 +4397,7 @@ ValueCategory MLIRScanner::VisitCastExpr(CastExpr *E) {
     } else {
       assert(0 && "unexpected complex type");
     }
-    auto zero = builder.create<ConstantFloatOp>(
-        loc, APFloat(fty.getFloatSemantics(), "0"), fty);
+    auto zero = getConstantFloat(APFloat(fty.getFloatSemantics(), "0"), fty);
     return createComplexFloat(loc, real, zero, E->getType());
   }
 
@@ -4470,9 +4428,8 @@ MLIRScanner::VisitConditionalOperator(clang::ConditionalOperator *E) {
   }
   auto prevTy = cond.getType().cast<mlir::IntegerType>();
   if (!prevTy.isInteger(1)) {
-    cond = builder.create<arith::CmpIOp>(
-        loc, CmpIPredicate::ne, cond,
-        builder.create<ConstantIntOp>(loc, 0, prevTy));
+    cond = builder.create<arith::CmpIOp>(loc, CmpIPredicate::ne, cond,
+                                         getConstantInt(0, prevTy));
   }
   std::vector<mlir::Type> types;
   if (!E->getType()->isVoidType())
@@ -4554,8 +4511,7 @@ ValueCategory MLIRScanner::VisitSizeOfPackExpr(SizeOfPackExpr *expr) {
   const auto loc = getMLIRLocation(expr->getExprLoc());
   const auto val = expr->getPackLength();
   const auto ty = getMLIRType(expr->getType()).cast<mlir::IntegerType>();
-  return ValueCategory(builder.create<arith::ConstantIntOp>(loc, val, ty),
-                       /*isReference*/ false);
+  return ValueCategory(getConstantInt(val, ty), /*isReference*/ false);
 }
 
 ValueCategory MLIRScanner::VisitStmtExpr(clang::StmtExpr *stmt) {
@@ -5897,7 +5853,7 @@ mlir::Value MLIRScanner::getTypeSize(mlir::Location loc, clang::QualType t) {
         builder.create<polygeist::TypeSizeOp>(
             loc, builder.getIndexType(),
             mlir::TypeAttr::get(MT.getElementType())),
-        builder.create<arith::ConstantIndexOp>(loc, num));
+        getConstantIndex(num));
   }
   assert(!isArray);
   return builder.create<polygeist::TypeSizeOp>(
@@ -5918,13 +5874,194 @@ mlir::Value MLIRScanner::getTypeAlign(mlir::Location loc, clang::QualType t) {
 
 #include "clang/Frontend/TextDiagnosticBuffer.h"
 
-static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
-                      std::string fn, std::vector<std::string> includeDirs,
-                      std::vector<std::string> defines,
-                      mlir::OwningOpRef<mlir::ModuleOp> &module,
-                      llvm::Triple &triple, llvm::DataLayout &DL,
-                      llvm::Triple &gpuTriple, llvm::DataLayout &gpuDL) {
+/// Returns the LLVM linkage of a top-level symbol emitted by the frontend.
+static std::optional<LLVM::Linkage> getSymbolLinkage(Operation *op) {
+  if (auto fn = dyn_cast<LLVM::LLVMFuncOp>(op))
+    return fn.getLinkage();
+  if (auto glob = dyn_cast<LLVM::GlobalOp>(op))
+    return glob.getLinkage();
+  if (auto lnk = op->getAttrOfType<LLVM::LinkageAttr>("llvm.linkage"))
+    return lnk.getLinkage();
+  if (auto glob = dyn_cast<memref::GlobalOp>(op))
+    return glob.isPrivate() ? LLVM::Linkage::Internal
+                            : LLVM::Linkage::External;
+  return std::nullopt;
+}
+
+static bool isSymbolDeclaration(Operation *op) {
+  if (auto fn = dyn_cast<FunctionOpInterface>(op))
+    return fn.isExternal();
+  if (auto glob = dyn_cast<LLVM::GlobalOp>(op))
+    return !glob.getValueOrNull() && !glob.getInitializerBlock();
+  if (auto glob = dyn_cast<memref::GlobalOp>(op))
+    return glob.isExternal();
+  return false;
+}
 
+static bool isPrivateSymbol(Operation *op) {
+  auto sym = dyn_cast<SymbolOpInterface>(op);
+  return sym && sym.isPrivate();
+}
+
+/// Symbols without a linkage attribute, such as the helpers the frontend
+/// emits as func.func, are local when their visibility is private.
+static bool hasLocalLinkage(Operation *op) {
+  if (isSymbolDeclaration(op))
+    return false;
+  if (auto lnk = getSymbolLinkage(op))
+    return *lnk == LLVM::Linkage::Internal || *lnk == LLVM::Linkage::Private;
+  return isPrivateSymbol(op);
+}
+
+/// Nested symbol tables of the same kind, such as a gpu.module emitted by
+/// every CUDA unit, are merged instead of being linked as one symbol.
+static bool isMergeableSymbolTable(Operation *op, Operation *other) {
+  return op->getName() == other->getName() &&
+         op->hasTrait<OpTrait::SymbolTable>() && op->getNumRegions() == 1 &&
+         op->getRegion(0).hasOneBlock();
+}
+
+/// Definitions that the linker is allowed to deduplicate.
+static bool isDiscardableDefinition(Operation *op) {
+  auto lnk = getSymbolLinkage(op);
+  if (!lnk)
+    return false;
+  switch (*lnk) {
+  case LLVM::Linkage::Linkonce:
+  case LLVM::Linkage::LinkonceODR:
+  case LLVM::Linkage::Weak:
+  case LLVM::Linkage::WeakODR:
+  case LLVM::Linkage::Common:
+  case LLVM::Linkage::AvailableExternally:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Whether the definition \p op is renamed apart from the definition
+/// \p other. Besides local symbols this covers private definitions that keep
+/// a non-local linkage, which is how CUDA device functions are emitted: every
+/// unit has its own device code, so they may be defined in several units.
+static bool isLocalTo(Operation *op, Operation *other) {
+  if (hasLocalLinkage(op))
+    return true;
+  return !isSymbolDeclaration(op) && !isSymbolDeclaration(other) &&
+         isPrivateSymbol(op) && !isDiscardableDefinition(op);
+}
+
+/// Moves the operations of the symbol table \p from into \p into, following
+/// the rules the LLVM linker applies to the emitted IR: a definition replaces
+/// a declaration, duplicate linkonce/weak definitions are dropped and
+/// colliding local symbols are renamed apart. Nested symbol tables are merged
+/// with the same rules. Symbol uses are updated within \p intoScope and
+/// \p fromScope, the modules of the two translation units.
+static LogicalResult linkSymbolTable(Operation *into, Operation *from,
+                                     Operation *intoScope,
+                                     Operation *fromScope) {
+  Block &intoBody = into->getRegion(0).front();
+  Block &fromBody = from->getRegion(0).front();
+  auto symbolName = [](Operation &op) {
+    return op.getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+  };
+  llvm::StringMap<Operation *> intoSymbols;
+  for (Operation &op : intoBody)
+    if (auto name = symbolName(op))
+      intoSymbols[name] = &op;
+  llvm::StringSet<> fromSymbols;
+  for (Operation &op : fromBody)
+    if (auto name = symbolName(op))
+      fromSymbols.insert(name);
+
+  unsigned suffix = 0;
+  auto uniqueName = [&](StringRef base) {
+    std::string candidate;
+    do {
+      candidate = (base + "." + Twine(suffix++)).str();
+    } while (intoSymbols.count(candidate) || fromSymbols.count(candidate));
+    return StringAttr::get(into->getContext(), candidate);
+  };
+  auto rename = [](Operation *op, StringAttr newName, Operation *scope) {
+    if (failed(SymbolTable::replaceAllSymbolUses(op, newName, scope)))
+      return failure();
+    SymbolTable::setSymbolName(op, newName);
+    return success();
+  };
+
+  // Rename local symbols and merge nested symbol tables first, all uses have
+  // to be updated before any operation changes modules.
+  for (Operation &op : fromBody) {
+    auto name = symbolName(op);
+    if (!name)
+      continue;
+    Operation *existing = intoSymbols.lookup(name);
+    if (!existing)
+      continue;
+    if (isMergeableSymbolTable(&op, existing)) {
+      if (failed(linkSymbolTable(existing, &op, intoScope, fromScope)))
+        return failure();
+    } else if (isLocalTo(&op, existing)) {
+      auto newName = uniqueName(name);
+      if (failed(rename(&op, newName, fromScope)))
+        return failure();
+      fromSymbols.insert(newName);
+    } else if (isLocalTo(existing, &op)) {
+      auto newName = uniqueName(name);
+      if (failed(rename(existing, newName, intoScope)))
+        return failure();
+      intoSymbols.erase(name);
+      intoSymbols[newName] = existing;
+    }
+  }
+
+  // gpu.module bodies end with a terminator that has to stay last.
+  auto insertPt = intoBody.end();
+  if (!intoBody.empty() && intoBody.back().hasTrait<OpTrait::IsTerminator>())
+    insertPt = Block::iterator(&intoBody.back());
+  for (Operation &op : llvm::make_early_inc_range(fromBody)) {
+    if (op.hasTrait<OpTrait::IsTerminator>())
+      continue;
+    auto name = symbolName(op);
+    Operation *existing = name ? intoSymbols.lookup(name) : nullptr;
+    if (existing) {
+      if (isMergeableSymbolTable(&op, existing) ||
+          isSymbolDeclaration(&op) ||
+          (!isSymbolDeclaration(existing) && isDiscardableDefinition(&op))) {
+        op.erase();
+        continue;
+      }
+      if (!isSymbolDeclaration(existing) &&
+          !isDiscardableDefinition(existing)) {
+        op.emitError("redefinition of symbol '")
+            << name.getValue() << "' across translation units";
+        return failure();
+      }
+      existing->erase();
+    }
+    op.moveBefore(&intoBody, insertPt);
+    if (name)
+      intoSymbols[name] = &op;
+  }
+  return success();
+}
+
+/// Links the module of a translation unit into the combined module.
+static LogicalResult linkTranslationUnit(ModuleOp into, ModuleOp from) {
+  return linkSymbolTable(into, from, into, from);
+}
+
+/// Runs the clang driver on \p filenames with the language options given to
+/// cgeist and calls \p callback with a compiler instance set up for every
+/// resulting cc1 job. The jobs build an AST unless \p pchOutput is set, in
+/// which case the inputs are precompiled as headers into it. Returns false if
+/// the driver or a callback fails.
+static bool
+forEachCompilerInstance(const char *Argv0,
+                        const std::vector<std::string> &filenames,
+                        const std::vector<std::string> &includeDirs,
+                        const std::vector<std::string> &defines,
+                        llvm::function_ref<bool(CompilerInstance &)> callback,
+                        llvm::StringRef pchOutput = "") {
   IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
   // Buffer diagnostics from argument parsing so that we can output them using a
   // well formed diagnostic object.
@@ -5943,13 +6080,18 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
   // some cases as is with this one - it has to be before the input file
   if (Lang != "") {
     Argv.push_back("-x");
-    Argv.emplace_back(Lang);
+    if (pchOutput != "" && (Lang == "c" || Lang == "c++"))
+      Argv.emplace_back(Lang, "-header");
+    else
+      Argv.emplace_back(Lang);
   }
   for (const auto &filename : filenames) {
     Argv.emplace_back(filename);
   }
   if (FOpenMP)
     Argv.push_back("-fopenmp");
+  if (FFastMath)
+    Argv.push_back("-ffast-math");
   if (TargetTripleOpt != "") {
     Argv.push_back("-target");
     Argv.emplace_back(TargetTripleOpt);
@@ -5997,8 +6139,18 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
     Argv.push_back("-include");
     Argv.emplace_back(Include);
   }
-
-  Argv.push_back("-emit-ast");
+  if (pchOutput != "") {
+    // A header input makes the driver schedule a precompile job that writes
+    // the PCH to the output file.
+    Argv.push_back("-o");
+    Argv.emplace_back(pchOutput);
+  } else {
+    if (IncludePCH != "") {
+      Argv.push_back("-include-pch");
+      Argv.emplace_back(IncludePCH);
+    }
+    Argv.push_back("-emit-ast");
+  }
 
   const unique_ptr<Compilation> compilation(
       driver->BuildCompilation(Argv.getArguments()));
@@ -6006,8 +6158,6 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
   if (Jobs.size() < 1)
     return false;
 
-  MLIRAction Act(fn, module);
-
   for (auto &job : Jobs) {
     std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
 
@@ -6064,19 +6214,95 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
     // FIXME: We shouldn't need to do this, the target should be immutable once
     // created. This complexity should be lifted elsewhere.
     Clang->getTarget().adjust(Clang->getDiagnostics(), Clang->getLangOpts());
+    if (!callback(*Clang))
+      return false;
+  }
+  return true;
+}
 
-    llvm::Triple jobTriple = Clang->getTarget().getTriple();
+static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
+                      std::string fn, std::vector<std::string> includeDirs,
+                      std::vector<std::string> defines,
+                      mlir::OwningOpRef<mlir::ModuleOp> &module,
+                      llvm::Triple &triple, llvm::DataLayout &DL,
+                      llvm::Triple &gpuTriple, llvm::DataLayout &gpuDL) {
+
+  // When the context has a thread pool, every translation unit is lowered
+  // into its own module concurrently and the results are linked in input
+  // order, which keeps the output independent of the scheduling.
+  mlir::MLIRContext *ctx = module->getContext();
+  if (filenames.size() > 1 && ctx->isMultithreadingEnabled()) {
+    struct TranslationUnit {
+      mlir::OwningOpRef<mlir::ModuleOp> module;
+      llvm::Triple triple, gpuTriple;
+      llvm::DataLayout DL{""}, gpuDL{""};
+    };
+    std::vector<TranslationUnit> TUs(filenames.size());
+    for (auto &TU : TUs)
+      TU.module = mlir::ModuleOp::create(module->getLoc());
+
+    if (failed(mlir::failableParallelForEachN(
+            ctx, 0, TUs.size(), [&](size_t i) {
+              auto &TU = TUs[i];
+              return success(parseMLIR(Argv0, {filenames[i]}, fn, includeDirs,
+                                       defines, TU.module, TU.triple, TU.DL,
+                                       TU.gpuTriple, TU.gpuDL));
+            })))
+      return false;
+
+    // Units built for different targets cannot be combined into one module.
+    std::string dlSpecName =
+        ("dlti." + DataLayoutSpecAttr::kAttrKeyword).str();
+    StringRef targetAttrNames[] = {
+        LLVM::LLVMDialect::getTargetTripleAttrName(),
+        LLVM::LLVMDialect::getDataLayoutAttrName(), dlSpecName};
+
+    triple = TUs.front().triple;
+    DL = TUs.front().DL;
+    for (size_t i = 0; i < TUs.size(); i++) {
+      auto &TU = TUs[i];
+      if (gpuTriple.str() == "" && TU.gpuTriple.str() != "") {
+        gpuTriple = TU.gpuTriple;
+        gpuDL = TU.gpuDL;
+      }
+      for (StringRef name : targetAttrNames) {
+        Attribute first = TUs.front().module.get()->getAttr(name);
+        Attribute attr = TU.module.get()->getAttr(name);
+        if (first == attr)
+          continue;
+        llvm::errs() << "error: " << filenames[i] << " and " << filenames[0]
+                     << " have a different " << name;
+        auto str = dyn_cast_or_null<StringAttr>(attr);
+        auto firstStr = dyn_cast_or_null<StringAttr>(first);
+        if (str && firstStr)
+          llvm::errs() << " (" << str.getValue() << " and "
+                       << firstStr.getValue() << ")";
+        llvm::errs() << "\n";
+        return false;
+      }
+      for (auto attr : TU.module.get()->getAttrs())
+        if (!module.get()->hasAttr(attr.getName()))
+          module.get()->setAttr(attr.getName(), attr.getValue());
+      if (failed(linkTranslationUnit(module.get(), TU.module.get())))
+        return false;
+    }
+    return true;
+  }
+
+  MLIRAction Act(fn, module);
+  auto lowerJob = [&](CompilerInstance &Clang) {
+    llvm::Triple jobTriple = Clang.getTarget().getTriple();
     if (triple.str() == "" || !jobTriple.isNVPTX()) {
       triple = jobTriple;
       module.get()->setAttr(
           LLVM::LLVMDialect::getTargetTripleAttrName(),
           StringAttr::get(module->getContext(),
-                          Clang->getTarget().getTriple().getTriple()));
-      DL = llvm::DataLayout(Clang->getTarget().getDataLayoutString());
+                          Clang.getTarget().getTriple().getTriple()));
+      DL = llvm::DataLayout(Clang.getTarget().getDataLayoutString());
       module.get()->setAttr(
           LLVM::LLVMDialect::getDataLayoutAttrName(),
           StringAttr::get(module->getContext(),
-                          Clang->getTarget().getDataLayoutString()));
+                          Clang.getTarget().getDataLayoutString()));
 
       module.get()->setAttr(("dlti." + DataLayoutSpecAttr::kAttrKeyword).str(),
                             translateDataLayout(DL, module->getContext()));
@@ -6084,10 +6310,10 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
       // Add target-cpu and target-features attributes to functions. If
       // we have a decl for the function and it has a target attribute then
       // parse that and add it to the feature set.
-      StringRef TargetCPU = Clang->getTarget().getTargetOpts().CPU;
-      StringRef TuneCPU = Clang->getTarget().getTargetOpts().TuneCPU;
+      StringRef TargetCPU = Clang.getTarget().getTargetOpts().CPU;
+      StringRef TuneCPU = Clang.getTarget().getTargetOpts().TuneCPU;
       std::vector<std::string> Features =
-          Clang->getTarget().getTargetOpts().Features;
+          Clang.getTarget().getTargetOpts().Features;
 
       if (!TargetCPU.empty()) {
         module.get()->setAttr("polygeist.target-cpu",
@@ -6103,6 +6329,11 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
             "polygeist.target-features",
             StringAttr::get(module->getContext(), llvm::join(Features, ",")));
       }
+      StringRef FloatABI = Clang.getCodeGenOpts().FloatABI;
+      if (!FloatABI.empty()) {
+        module.get()->setAttr("polygeist.float-abi",
+                              StringAttr::get(module->getContext(), FloatABI));
+      }
     }
 
     // TODO investigate what AMDGCN and AMDGPU are, do we need them both?
@@ -6112,36 +6343,112 @@ static bool parseMLIR(const char *Argv0, std::vector<std::string> filenames,
           StringRef("polygeist.gpu_module." +
                     LLVM::LLVMDialect::getTargetTripleAttrName().str()),
           StringAttr::get(module->getContext(),
-                          Clang->getTarget().getTriple().getTriple()));
-      gpuDL = llvm::DataLayout(Clang->getTarget().getDataLayoutString());
+                          Clang.getTarget().getTriple().getTriple()));
+      gpuDL = llvm::DataLayout(Clang.getTarget().getDataLayoutString());
       module.get()->setAttr(
           StringRef("polygeist.gpu_module." +
                     LLVM::LLVMDialect::getDataLayoutAttrName().str()),
           StringAttr::get(module->getContext(),
-                          Clang->getTarget().getDataLayoutString()));
+                          Clang.getTarget().getDataLayoutString()));
     }
 
-    for (const auto &FIF : Clang->getFrontendOpts().Inputs) {
+    for (const auto &FIF : Clang.getFrontendOpts().Inputs) {
       // Reset the ID tables if we are reusing the SourceManager and parsing
       // regular files.
-      if (Clang->hasSourceManager() && !Act.isModelParsingAction())
-        Clang->getSourceManager().clearIDTables();
-      if (Act.BeginSourceFile(*Clang, FIF)) {
+      if (Clang.hasSourceManager() && !Act.isModelParsingAction())
+        Clang.getSourceManager().clearIDTables();
+      if (Act.BeginSourceFile(Clang, FIF)) {
 
         llvm::Error err = Act.Execute();
         if (err) {
           llvm::errs() << "saw error: " << err << "\n";
           return false;
         }
-        assert(Clang->hasSourceManager());
+        assert(Clang.hasSourceManager());
 
         Act.EndSourceFile();
       }
     }
 
-    if (Clang->getDiagnostics().hasErrorOccurred()) {
-      return false;
-    }
+    return !Clang.getDiagnostics().hasErrorOccurred();
+  };
+  return forEachCompilerInstance(Argv0, filenames, includeDirs, defines,
+                                 lowerJob);
+}
+
+namespace {
+/// Prints the preprocessed input, including any pragmas, to a stream.
+class PreprocessToStreamAction : public clang::PreprocessorFrontendAction {
+public:
+  explicit PreprocessToStreamAction(llvm::raw_ostream &OS) : OS(OS) {}
+
+protected:
+  void ExecuteAction() override {
+    CompilerInstance &CI = getCompilerInstance();
+    DoPrintPreprocessedInput(CI.getPreprocessor(), &OS,
+                             CI.getPreprocessorOutputOpts());
   }
-  return true;
+
+private:
+  llvm::raw_ostream &OS;
+};
+} // namespace
+
+/// Writes the preprocessed form of \p filenames, as seen by every cc1 job
+/// parseMLIR would run, to \p OS.
+static bool preprocessMLIRInputs(const char *Argv0,
+                                 const std::vector<std::string> &filenames,
+                                 const std::vector<std::string> &includeDirs,
+                                 const std::vector<std::string> &defines,
+                                 llvm::raw_ostream &OS) {
+  return forEachCompilerInstance(
+      Argv0, filenames, includeDirs, defines, [&](CompilerInstance &Clang) {
+        for (const auto &FIF : Clang.getFrontendOpts().Inputs) {
+          PreprocessToStreamAction Act(OS);
+          if (!Act.BeginSourceFile(Clang, FIF))
+            return false;
+          if (llvm::Error err = Act.Execute()) {
+            llvm::errs() << "saw error: " << err << "\n";
+            return false;
+          }
+          Act.EndSourceFile();
+        }
+        return !Clang.getDiagnostics().hasErrorOccurred();
+      });
+}
+
+/// Writes a precompiled header for \p filenames to \p outputFile. Later runs
+/// load it with -include-pch and deserialize only the declarations they
+/// reference instead of parsing the headers again.
+static bool emitPCH(const char *Argv0,
+                    const std::vector<std::string> &filenames,
+                    const std::vector<std::string> &includeDirs,
+                    const std::vector<std::string> &defines,
+                    llvm::StringRef outputFile) {
+  unsigned jobs = 0;
+  return forEachCompilerInstance(
+      Argv0, filenames, includeDirs, defines,
+      [&](CompilerInstance &Clang) {
+        // Every job of an offloading compilation would need its own header.
+        if (jobs++) {
+          llvm::errs() << "error: -emit-pch requires a single compile job\n";
+          return false;
+        }
+        if (Clang.getFrontendOpts().ProgramAction != frontend::GeneratePCH) {
+          llvm::errs() << "error: -emit-pch requires header inputs\n";
+          return false;
+        }
+        for (const auto &FIF : Clang.getFrontendOpts().Inputs) {
+          GeneratePCHAction Act;
+          if (!Act.BeginSourceFile(Clang, FIF))
+            return false;
+          if (llvm::Error err = Act.Execute()) {
+            llvm::errs() << "saw error: " << err << "\n";
+            return false;
+          }
+          Act.EndSourceFile();
+        }
+        return !Clang.getDiagnostics().hasErrorOccurred();
+      },
+      outputFile);
 }
@@ -32,6 +32,8 @@
 #include "clang/Lex/HeaderSearchOptions.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/Support/CommandLine.h"
 
@@ -39,11 +41,26 @@
 #include "clang/../../lib/CodeGen/CodeGenModule.h"
 #include "clang/AST/Mangle.h"
 
+#include <atomic>
+#include <optional>
+
 using namespace clang;
 using namespace mlir;
 
 extern llvm::cl::opt<std::string> PrefixABI;
 
+namespace mlirclang {
+/// Counts the constants and index casts the frontend emitted and the ones it
+/// reused instead, summed over all translation units for -time-report.
+struct FrontendStatistics {
+  std::atomic<uint64_t> constantsEmitted{0};
+  std::atomic<uint64_t> constantsReused{0};
+  std::atomic<uint64_t> indexCastsEmitted{0};
+  std::atomic<uint64_t> indexCastsReused{0};
+};
+extern FrontendStatistics frontendStatistics;
+} // namespace mlirclang
+
 struct LoopContext {
   mlir::Value keepRunning;
   mlir::Value noBreak;
@@ -191,12 +208,34 @@ private:
 
   mlir::func::FuncOp EmitDirectCallee(const FunctionDecl *FD);
 
-  std::map<int, mlir::Value> constants;
+  /// Constants of the function, materialized at the start of the entry block
+  /// in the order they are first requested.
+  llvm::DenseMap<mlir::Attribute, mlir::Value> constants;
+  mlir::Operation *lastConstant = nullptr;
+
+  /// Index casts emitted so far, keyed on the block they are in, the cast
+  /// value and the result type.
+  llvm::DenseMap<std::tuple<mlir::Block *, mlir::Value, mlir::Type>,
+                 llvm::SmallVector<mlir::Operation *, 1>>
+      indexCasts;
+
+  /// Drops the index casts of the blocks in \p region, which is about to be
+  /// erased.
+  void forgetIndexCasts(mlir::Region &region);
 
   mlir::Value castToIndex(mlir::Location loc, mlir::Value val);
 
+  mlir::Value createIndexCast(mlir::Location loc, mlir::Type type,
+                              mlir::Value val);
+
   mlir::Value getLLVM(Expr *E, bool isRef = false);
 
+  /// Local variables of the function whose address escapes, computed for the
+  /// first loop that is checked by isStructuredForLoop.
+  std::optional<llvm::SmallPtrSet<const clang::ValueDecl *, 8>> escapingVars;
+
+  bool isStructuredForLoop(clang::ForStmt *fors);
+
   bool isTrivialAffineLoop(clang::ForStmt *fors,
                            mlirclang::AffineLoopDescriptor &descr);
 
@@ -210,11 +249,52 @@ private:
                        mlirclang::AffineLoopDescriptor &descr);
 
   void buildAffineLoop(clang::ForStmt *fors, mlir::Location loc,
-                       const mlirclang::AffineLoopDescriptor &descr);
+                       const mlirclang::AffineLoopDescriptor &descr,
+                       bool isAffine);
 
   void buildAffineLoopImpl(clang::ForStmt *fors, mlir::Location loc,
                            mlir::Value lb, mlir::Value ub,
-                           const mlirclang::AffineLoopDescriptor &descr);
+                           const mlirclang::AffineLoopDescriptor &descr,
+                           bool isAffine);
+
+  /// A scalar variable of an OpenMP reduction clause.
+  struct OMPReduction {
+    enum Kind { Add, Mul, Min, Max, And, Or, Xor, LogicalAnd, LogicalOr };
+    clang::VarDecl *var;
+    Kind kind;
+    mlir::Type type;
+    bool isSigned;
+    /// The variable outside of the construct.
+    ValueCategory shared;
+    /// The copy of the variable the construct accumulates into.
+    ValueCategory priv;
+  };
+
+  /// Collects the variables of the reduction clauses of \p dir that can be
+  /// lowered. The others are reported and stay shared.
+  void getOMPReductions(clang::OMPExecutableDirective *dir,
+                        llvm::SmallVectorImpl<OMPReduction> &reductions);
+
+  /// Binds each reduction variable to a private copy that holds the identity
+  /// of its reduction. The previous bindings are saved in \p prev.
+  void privatizeOMPReductions(mlir::Location loc,
+                              llvm::MutableArrayRef<OMPReduction> reductions,
+                              std::map<clang::VarDecl *, ValueCategory> &prev);
+
+  /// Restores the bindings saved in \p prev, removing those that were null
+  /// because the variable is global.
+  void restoreOMPBindings(
+      const std::map<clang::VarDecl *, ValueCategory> &prev);
+
+  /// Returns \p val as an operand of the combiner of \p red.
+  mlir::Value getOMPReductionOperand(mlir::Location loc,
+                                     const OMPReduction &red, mlir::Value val);
+
+  /// Combines the private copies into the shared variables one thread at a
+  /// time, followed by a barrier if \p barrier is set.
+  void emitOMPCriticalReduction(mlir::Location loc,
+                                llvm::ArrayRef<OMPReduction> reductions,
+                                bool barrier);
 
 public:
   const FunctionDecl *EmittingFunctionDecl;
@@ -234,12 +314,20 @@ public:
 
   void setEntryAndAllocBlock(mlir::Block *B) {
     allocationScope = entryBlock = B;
+    constants.clear();
+    lastConstant = nullptr;
+    indexCasts.clear();
     builder.setInsertionPointToStart(B);
   }
 
   mlir::OpBuilder &getBuilder();
 
-  mlir::Value getConstantIndex(int x);
+  /// Returns the constant \p value, emitted at most once per function.
+  mlir::Value getConstant(mlir::TypedAttr value);
+  mlir::Value getConstantIndex(int64_t x);
+  mlir::Value getConstantInt(int64_t x, mlir::Type type);
+  mlir::Value getConstantInt(int64_t x, unsigned width);
+  mlir::Value getConstantFloat(const llvm::APFloat &x, mlir::FloatType type);
 
   ValueCategory createComplexFloat(mlir::Location loc, mlir::Value real,
                                    mlir::Value imag, clang::QualType cty);
@@ -0,0 +1,8 @@
+#include "cuda.h"
+#include "__clang_cuda_builtin_vars.h"
+
+__device__ void bar(double *w) { w[threadIdx.x] = 3.0; }
+
+__global__ void fill2(double *w) { bar(w); }
+
+void start2(double *w) { fill2<<<1, 20>>>(w); }
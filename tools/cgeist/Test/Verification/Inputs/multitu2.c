@@ -0,0 +1,3 @@
+static int helper(int x) { return x * 2; }
+
+int other(int x) { return helper(x); }
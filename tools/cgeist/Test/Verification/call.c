@@ -1,5 +1,6 @@
 // RUN: cgeist %s --function=* -S | FileCheck %s
 // RUN: cgeist %s --function=* -S -memref-fullrank | FileCheck %s --check-prefix=FULLRANK
+// RUN: cgeist %s --function=* -S -j=4 | FileCheck %s
 
 void sub0(int a[2]);
 void sub(int a[2]) { a[2]++; }
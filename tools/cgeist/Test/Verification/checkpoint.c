@@ -0,0 +1,28 @@
+// RUN: cgeist %s --function=* -S -stop-after=raise -o %t.mlirbc
+// RUN: cgeist -resume-from=%t.mlirbc --function=* -S | FileCheck %s
+// RUN: cgeist %s --function=* -S | FileCheck %s
+// RUN: cgeist %s --function=* -S -emit-llvm -stop-after=omp -o %t.omp.mlirbc
+// RUN: cgeist -resume-from=%t.omp.mlirbc --function=* -S -emit-llvm | FileCheck %s --check-prefix=LLVM
+// RUN: not cgeist %s --function=* -S -stop-after=parse -o %t.bad 2>&1 | FileCheck %s --check-prefix=ERR
+// RUN: not cgeist %s --function=* -S -stop-after=omp -o %t.bad 2>&1 | FileCheck %s --check-prefix=SKIP
+// RUN: not cgeist -resume-from=%t.mlirbc --function=* -S -stop-after=raise -o %t.bad 2>&1 | FileCheck %s --check-prefix=DONE
+
+int sum(int n, int *a) {
+  int s = 0;
+  for (int i = 0; i < n; i++)
+    s += a[i];
+  return s;
+}
+
+// CHECK-NOT:   polygeist.completed_stages
+// CHECK-LABEL: func @sum(
+// CHECK:         scf.for
+
+// LLVM-LABEL: define i32 @sum(
+
+// ERR: error: unknown stage 'parse' for -stop-after
+
+// SKIP: error: stage 'omp' does not run with the given options
+// SKIP-NOT: func @sum
+
+// DONE: error: stage 'raise' already ran in
@@ -24,11 +24,11 @@ int solver(	float** y,
 } 
 
 // CHECK:   func @solver(%[[arg0:.+]]: memref<?xmemref<?xf32>>, %[[arg1:.+]]: i32, %[[arg2:.+]]: f32, %[[arg3:.+]]: f32) -> i32 
-// CHECK-NEXT:     %[[false:.+]] = arith.constant false
-// CHECK-NEXT:     %[[cst:.+]] = arith.constant 0.000000e+00 : f32
-// CHECK-NEXT:     %[[c1_i32:.+]] = arith.constant 1 : i32
-// CHECK-NEXT:     %[[c0_i32:.+]] = arith.constant 0 : i32
-// CHECK-NEXT:     %[[true:.+]] = arith.constant true
+// CHECK-DAG:      %[[false:.+]] = arith.constant false
+// CHECK-DAG:      %[[cst:.+]] = arith.constant 0.000000e+00 : f32
+// CHECK-DAG:      %[[c1_i32:.+]] = arith.constant 1 : i32
+// CHECK-DAG:      %[[c0_i32:.+]] = arith.constant 0 : i32
+// CHECK-DAG:      %[[true:.+]] = arith.constant true
 // CHECK-NEXT:     %[[V0:.+]] = llvm.mlir.undef : f32
 // CHECK-NEXT:     %[[V1]]:2 = scf.while (%[[arg4:.+]] = %[[V0]], %[[arg5:.+]] = %[[c0_i32]], %[[arg6:.+]] = %[[true]]) : (f32, i32, i1) -> (f32, i32) {
 // CHECK-NEXT:       %[[V2:.+]] = arith.cmpi slt, %[[arg5]], %[[c1_i32]] : i32
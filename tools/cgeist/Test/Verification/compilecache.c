@@ -0,0 +1,31 @@
+// RUN: rm -rf %t.cache
+// RUN: cgeist %s --function=* -S -cache-dir=%t.cache -o %t.mlir
+// RUN: cgeist %s --function=* -S -cache-dir=%t.cache -time-report=%t.json | FileCheck %s
+// RUN: FileCheck %s --check-prefix=REPORT < %t.json
+// RUN: cgeist %s --function=* -S -cache-dir=%t.cache -DSCALE=3 | FileCheck %s --check-prefix=SCALE
+// RUN: rm -rf %t.pgo && mkdir -p %t.pgo
+// RUN: env POLYGEIST_PGO_DATA_DIR=%t.pgo cgeist %s --function=* -S -polygeist-alternatives-mode=pgo_opt -cache-dir=%t.cache -o %t.pgo.mlir
+// RUN: echo changed > %t.pgo/profile.db.lock
+// RUN: env POLYGEIST_PGO_DATA_DIR=%t.pgo cgeist %s --function=* -S -polygeist-alternatives-mode=pgo_opt -cache-dir=%t.cache -time-report=%t.lock.json -o %t.pgo.mlir
+// RUN: FileCheck %s --check-prefix=REPORT < %t.lock.json
+// RUN: echo changed > %t.pgo/profile.db
+// RUN: env POLYGEIST_PGO_DATA_DIR=%t.pgo cgeist %s --function=* -S -polygeist-alternatives-mode=pgo_opt -cache-dir=%t.cache -time-report=%t.pgo.json -o %t.pgo.mlir
+// RUN: FileCheck %s --check-prefix=PROFILE < %t.pgo.json
+
+#ifndef SCALE
+#define SCALE 2
+#endif
+
+int scale(int x) { return x * SCALE; }
+
+// CHECK: func.func @scale(
+// CHECK: arith.constant 2 : i32
+
+// REPORT: "name": "cache-lookup",
+// REPORT-NOT: "name": "frontend",
+
+// SCALE: arith.constant 3 : i32
+
+// A changed profile is a miss.
+// PROFILE: "name": "cache-lookup",
+// PROFILE: "name": "frontend",
@@ -19,9 +19,9 @@ int checkCmdLineFlag(const int argc) {
 
 // CHECK-LABEL:   func.func @checkCmdLineFlag(
 // CHECK-SAME:                                %[[VAL_0:[A-Za-z0-9_]*]]: i32) -> i32
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1 : index
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 1 : i32
-// CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 0 : i32
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1 : index
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 1 : i32
+// CHECK-DAG:       %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 0 : i32
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = arith.index_cast %[[VAL_0]] : i32 to index
 // CHECK:           %[[VAL_5:[A-Za-z0-9_]*]] = scf.for %[[VAL_6:[A-Za-z0-9_]*]] = %[[VAL_1]] to %[[VAL_4]] step %[[VAL_1]] iter_args(%[[VAL_7:[A-Za-z0-9_]*]] = %[[VAL_3]]) -> (i32) {
 // CHECK:             %[[VAL_8:[A-Za-z0-9_]*]] = func.call @get() : () -> i32
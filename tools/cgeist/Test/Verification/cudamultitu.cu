@@ -0,0 +1,16 @@
+// RUN: cgeist %s %S/Inputs/cudamultitu2.cu --cuda-gpu-arch=sm_60 -nocudalib -nocudainc %resourcedir --function=* -S -j=2 | FileCheck %s
+
+#include "Inputs/cuda.h"
+#include "__clang_cuda_builtin_vars.h"
+
+__device__ void bar(double *w) { w[threadIdx.x] = 2.0; }
+
+__global__ void fill(double *w) { bar(w); }
+
+void start(double *w) { fill<<<1, 20>>>(w); }
+
+// Both units define their own device function bar.
+// CHECK-DAG: func.func private @_Z3barPd(%{{.*}}: memref<?xf64>)
+// CHECK-DAG: func.func private @_Z3barPd.0(%{{.*}}: memref<?xf64>)
+// CHECK-DAG: call @_Z3barPd(
+// CHECK-DAG: call @_Z3barPd.0(
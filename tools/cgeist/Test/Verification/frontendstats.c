@@ -0,0 +1,15 @@
+// RUN: cgeist %s --function=* -S -time-report=%t.json -o /dev/null
+// RUN: FileCheck %s < %t.json
+
+void scale(int n, int *a) {
+  for (int i = 0; i < n; i++)
+    a[i] = a[i] * 2 + 2;
+  for (int i = 0; i < n; i++)
+    a[i] = a[i] * 2 + 2;
+}
+
+// CHECK: "counters": {
+// CHECK-DAG: "frontend.constants_emitted": {{[1-9]}}
+// CHECK-DAG: "frontend.constants_reused": {{[1-9]}}
+// CHECK-DAG: "frontend.index_casts_emitted": {{[1-9]}}
+// CHECK-DAG: "frontend.index_casts_reused": {{[0-9]}}
@@ -20,10 +20,10 @@ int* alloc() {
 }
 
 // CHECK-LABEL:   func.func @alloc() -> memref<?xi32>
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 0 : index
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1 : index
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 4 : i64
-// CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 4 : index
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 0 : index
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1 : index
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 4 : i64
+// CHECK-DAG:       %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 4 : index
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = llvm.mlir.undef : i32
 // CHECK:           %[[VAL_5:[A-Za-z0-9_]*]] = memref.alloca() : memref<1xi32>
 // CHECK:           affine.store %[[VAL_4]], %[[VAL_5]][0] : memref<1xi32>
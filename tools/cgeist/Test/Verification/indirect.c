@@ -21,8 +21,8 @@ int main() {
 // LLCHECK: }
 
 // CHECK-LABEL:   func.func @main() -> i32  
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 0 : i32
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 0 : i32
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
 // CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = llvm.mlir.addressof @str0 : !llvm.ptr
 // CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = llvm.getelementptr %[[VAL_2]][0, 0] : (!llvm.ptr) -> !llvm.ptr, !llvm.array<11 x i8>
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = "polygeist.get_func"() <{name = @square}> : () -> !llvm.ptr
@@ -0,0 +1,26 @@
+// RUN: cgeist %s %stdinclude -O2 -o %t.driver && %t.driver > %t.out1
+// RUN: cgeist %s %stdinclude -O2 -in-process-backend -o %t.inproc && %t.inproc > %t.out2
+// RUN: diff %t.out1 %t.out2
+// RUN: cgeist %s %stdinclude -O2 -in-process-backend -codegen-partitions=2 -o %t.parts && %t.parts > %t.out3
+// RUN: diff %t.out1 %t.out3
+// RUN: cgeist %s %stdinclude -O2 -c -in-process-backend -codegen-partitions=2 -o %t.o 2>&1 | FileCheck %s --check-prefix=OBJ
+// RUN: cgeist %s %stdinclude -O2 -codegen-partitions=2 -o %t.driver2 2>&1 | FileCheck %s --check-prefix=DRIVER
+
+#include <stdio.h>
+
+int weights[8] = {3, 1, 4, 1, 5, 9, 2, 6};
+
+static double mean(int n) {
+  double sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += weights[i];
+  return sum / n;
+}
+
+int main() {
+  printf("%d %f\n", weights[5] * weights[2], mean(8));
+  return 0;
+}
+
+// OBJ: warning: -codegen-partitions is ignored with -c
+// DRIVER: warning: -codegen-partitions requires -in-process-backend and is ignored
@@ -12,9 +12,9 @@ void copy(struct N* dst, void* src) {
 // CHECK-LABEL:   func.func @copy(
 // CHECK-SAME:                    %[[VAL_0:[A-Za-z0-9_]*]]: memref<?x2xi32>,
 // CHECK-SAME:                    %[[VAL_1:[A-Za-z0-9_]*]]: memref<?xi8>)
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 8 : index
-// CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1 : index
-// CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = arith.constant 0 : index
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 8 : index
+// CHECK-DAG:       %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1 : index
+// CHECK-DAG:       %[[VAL_4:[A-Za-z0-9_]*]] = arith.constant 0 : index
 // CHECK:           %[[VAL_5:[A-Za-z0-9_]*]] = "polygeist.memref2pointer"(%[[VAL_0]]) : (memref<?x2xi32>) -> !llvm.ptr
 // CHECK:           scf.for %[[VAL_6:[A-Za-z0-9_]*]] = %[[VAL_4]] to %[[VAL_2]] step %[[VAL_3]] {
 // CHECK:             %[[VAL_7:[A-Za-z0-9_]*]] = memref.load %[[VAL_1]]{{\[}}%[[VAL_6]]] : memref<?xi8>
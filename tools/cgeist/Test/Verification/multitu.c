@@ -0,0 +1,12 @@
+// RUN: cgeist %s %S/Inputs/multitu2.c --function=* -S -O0 -j=2 | FileCheck %s
+
+static int helper(int x) { return x + 1; }
+
+int other(int x);
+
+int first(int x) { return helper(x) + other(x); }
+
+// CHECK-LABEL: func @first(
+// CHECK:         call @helper(
+// CHECK-LABEL: func @other(
+// CHECK:         call @helper.0(
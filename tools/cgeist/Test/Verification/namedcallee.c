@@ -0,0 +1,26 @@
+// RUN: cgeist %s --function=* -S | FileCheck %s
+
+#include <string.h>
+
+double clamp(double x, double lo, double hi) {
+  return __builtin_fmin(__builtin_fmax(x, lo), hi);
+}
+
+int ordered(double a, double b) { return __builtin_isgreater(a, b); }
+
+unsigned long lengths(const char *a, const char *b) {
+  return strlen(a) + __builtin_strlen(b);
+}
+
+// CHECK-LABEL: func.func @clamp(
+// CHECK: llvm.intr.maxnum
+// CHECK: llvm.intr.minnum
+
+// CHECK-LABEL: func.func @ordered(
+// CHECK: arith.cmpf ogt
+
+// CHECK-LABEL: func.func @lengths(
+// CHECK: call @strlen(
+// CHECK: call @strlen(
+// CHECK: func.func private @strlen(
+// CHECK-NOT: func.func private @strlen(
@@ -55,9 +55,9 @@ int foo() {
 // CHECK-LABEL:   func.func @main(
 // CHECK-SAME:                    %[[VAL_0:[A-Za-z0-9_]*]]: i32,
 // CHECK-SAME:                    %[[VAL_1:[A-Za-z0-9_]*]]: memref<?xmemref<?xi8>>) -> i32
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 2.000000e+00 : f64
-// CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1.000000e+00 : f64
-// CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = arith.constant 0 : i32
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 2.000000e+00 : f64
+// CHECK-DAG:       %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1.000000e+00 : f64
+// CHECK-DAG:       %[[VAL_4:[A-Za-z0-9_]*]] = arith.constant 0 : i32
 // CHECK:           %[[VAL_5:[A-Za-z0-9_]*]] = llvm.mlir.addressof @str0 : !llvm.ptr
 // CHECK:           %[[VAL_6:[A-Za-z0-9_]*]] = llvm.getelementptr %[[VAL_5]][0, 0] : (!llvm.ptr) -> !llvm.ptr, !llvm.array<20 x i8>
 // CHECK:           %[[VAL_7:[A-Za-z0-9_]*]] = llvm.call @printf(%[[VAL_6]], %[[VAL_3]], %[[VAL_2]]) vararg(!llvm.func<i32 (ptr, ...)>) : (!llvm.ptr, f64, f64) -> i32
@@ -91,9 +91,9 @@ int foo() {
 // CHECK:         }
 
 // CHECK-LABEL:   func.func @_Z3bafv() -> memref<?xi32>
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3 : i32
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 2 : i32
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 1 : i32
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3 : i32
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 2 : i32
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 1 : i32
 // CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = memref.alloc() : memref<3xi32>
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = memref.cast %[[VAL_3]] : memref<3xi32> to memref<?xi32>
 // CHECK:           affine.store %[[VAL_2]], %[[VAL_3]][0] : memref<3xi32>
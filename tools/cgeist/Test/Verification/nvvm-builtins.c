@@ -0,0 +1,14 @@
+// RUN: cgeist %s --function=* -S | FileCheck %s
+
+// The CUDA builtins are recognized by name, so they lower to NVVM in C too.
+void __syncthreads(void);
+extern int warpSize;
+
+int lanes(void) {
+  __syncthreads();
+  return warpSize;
+}
+
+// CHECK-LABEL: func @lanes(
+// CHECK:         nvvm.barrier0
+// CHECK:         nvvm.read.ptx.sreg.warpsize
@@ -0,0 +1,18 @@
+// RUN: cgeist %s --function=* -fopenmp --detect-reduction -S -emit-openmpir | FileCheck %s
+
+// The accumulation in memory becomes a reduction of an affine.parallel, which
+// reaches OpenMP as a reduction clause of the worksharing loop.
+void dot(int *x, int *y, int *out) {
+#pragma scop
+  for (int i = 0; i < 1024; i++)
+    out[0] += x[i] * y[i];
+#pragma endscop
+}
+
+// CHECK:       omp.reduction.declare @[[RED:[^ ]+]] : i32
+// CHECK:         arith.addi
+// CHECK-LABEL: func @dot(
+// CHECK:         omp.parallel
+// CHECK:           omp.wsloop {{.*}}reduction(@[[RED]] -> %{{.*}} : !llvm.ptr{{.*}}) for
+// CHECK:             arith.muli
+// CHECK:             omp.reduction
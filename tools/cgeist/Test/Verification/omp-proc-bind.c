@@ -0,0 +1,23 @@
+// RUN: cgeist %s --function=* -fopenmp -S | FileCheck %s
+
+void spread(int n, double *a) {
+#pragma omp parallel proc_bind(spread)
+  {
+#pragma omp for
+    for (int i = 0; i < n; i++)
+      a[i] = 0;
+  }
+}
+
+void close(int n, double *a) {
+#pragma omp parallel for proc_bind(close)
+  for (int i = 0; i < n; i++)
+    a[i] = 0;
+}
+
+// CHECK-LABEL: func @spread(
+// CHECK:         omp.parallel proc_bind(spread) {
+
+// CHECK-LABEL: func @close(
+// CHECK:         scf.parallel (%{{.*}}) = (%{{.*}}) to (%{{.*}}) step (%{{.*}}) {
+// CHECK:         } {polygeist.proc_bind = #omp<procbindkind close>}
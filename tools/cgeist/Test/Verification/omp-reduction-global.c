@@ -0,0 +1,40 @@
+// RUN: cgeist %s --function=* -fopenmp -S | FileCheck %s
+
+int total;
+
+int sum(int n, int *x) {
+#pragma omp parallel for reduction(+ : total)
+  for (int i = 0; i < n; i++)
+    total += x[i];
+  return total * 2;
+}
+
+int count(int n, int *x) {
+  static int c;
+#pragma omp parallel reduction(+ : c)
+  {
+#pragma omp for
+    for (int i = 0; i < n; i++)
+      c += x[i] != 0;
+  }
+  return c + 1;
+}
+
+// After the constructs, the variables are read from their globals again,
+// not from the private copies inside the constructs.
+
+// CHECK-LABEL: func @sum(
+// CHECK:         %[[G:.+]] = memref.get_global @total : memref<1xi32>
+// CHECK:         %[[R:.+]] = scf.parallel
+// CHECK:         {{(affine|memref)}}.store %[[R]], %[[G]][
+// CHECK:         %[[V:.+]] = arith.muli %{{.*}}, %{{.*}} : i32
+// CHECK-NEXT:    return %[[V]] : i32
+
+// CHECK-LABEL: func @count(
+// CHECK:         %[[G:.+]] = memref.get_global @{{.*}}c : memref<1xi32>
+// CHECK:         omp.parallel
+// CHECK:           omp.critical {
+// CHECK:             {{(affine|memref)}}.store %{{.*}}, %[[G]][
+// CHECK:         %[[V:.+]] = {{(affine|memref)}}.load %[[G]][
+// CHECK:         %[[S:.+]] = arith.addi %[[V]], %{{.*}} : i32
+// CHECK-NEXT:    return %[[S]] : i32
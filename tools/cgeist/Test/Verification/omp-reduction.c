@@ -0,0 +1,62 @@
+// RUN: cgeist %s --function=* -fopenmp -S | FileCheck %s
+
+double sum(int n, double *x) {
+  double s = 0;
+#pragma omp parallel for reduction(+ : s)
+  for (int i = 0; i < n; i++)
+    s += x[i];
+  return s;
+}
+
+int smallest(int n, int *x) {
+  int m = 1000;
+#pragma omp parallel for reduction(min : m)
+  for (int i = 0; i < n; i++)
+    m = x[i] < m ? x[i] : m;
+  return m;
+}
+
+int all(int n, int *x) {
+  int ok = 1;
+#pragma omp parallel for reduction(&& : ok)
+  for (int i = 0; i < n; i++)
+    ok = ok && x[i];
+  return ok;
+}
+
+int count(int n, int *x) {
+  int c = 0;
+#pragma omp parallel reduction(+ : c)
+  {
+#pragma omp for
+    for (int i = 0; i < n; i++)
+      c += x[i] != 0;
+  }
+  return c;
+}
+
+// CHECK-LABEL: func @sum(
+// CHECK:         %[[R:.+]] = scf.parallel (%{{.*}}) = (%{{.*}}) to (%{{.*}}) step (%{{.*}}) init (%{{.*}}) -> f64 {
+// CHECK:           scf.reduce(%{{.*}})  : f64 {
+// CHECK:           ^bb0(%[[L:.+]]: f64, %[[RR:.+]]: f64):
+// CHECK:             %[[S:.+]] = arith.addf %[[L]], %[[RR]] : f64
+// CHECK:             scf.reduce.return %[[S]] : f64
+// CHECK:         return %[[R]] : f64
+
+// CHECK-LABEL: func @smallest(
+// CHECK:         scf.parallel {{.*}} init (%{{.*}}) -> i32 {
+// CHECK:           scf.reduce(%{{.*}})  : i32 {
+// CHECK:             arith.cmpi slt
+// CHECK:             arith.select
+
+// CHECK-LABEL: func @all(
+// CHECK:         scf.parallel {{.*}} init (%{{.*}}) -> i32 {
+// CHECK:           scf.reduce(%{{.*}})  : i32 {
+// CHECK:             arith.andi
+
+// CHECK-LABEL: func @count(
+// CHECK:         omp.parallel
+// CHECK:           omp.wsloop
+// CHECK:           omp.critical {
+// CHECK:             arith.addi
+// CHECK:             omp.terminator
@@ -0,0 +1,44 @@
+// RUN: cgeist %s --function=* -fopenmp -S | FileCheck %s
+// RUN: cgeist %s --function=scale -fopenmp -S -emit-openmpir | FileCheck %s --check-prefix=WSLOOP
+
+void scale(int n, int m, double *a) {
+#pragma omp parallel for collapse(2) schedule(dynamic, 4)
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < m; j++)
+      a[i * m + j] *= 2;
+}
+
+void lower(int n, double *a) {
+#pragma omp parallel for collapse(2) schedule(guided)
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < i; j++)
+      a[i * n + j] = 0;
+}
+
+void clear(int n, int c, double *a) {
+#pragma omp parallel
+  {
+#pragma omp for schedule(static, c)
+    for (int i = 0; i < n; i++)
+      a[i] = 0;
+  }
+}
+
+// CHECK-LABEL: func @scale(
+// CHECK:         scf.parallel (%{{.*}}, %{{.*}}) = (%{{.*}}, %{{.*}}) to (%{{.*}}, %{{.*}}) step (%{{.*}}, %{{.*}}) {
+// CHECK:         } {polygeist.schedule = #omp<schedulekind dynamic>, polygeist.schedule_chunk = 4 : i64}
+
+// The bounds of the inner loop depend on the outer counter, so only the
+// outer loop is parallel.
+// CHECK-LABEL: func @lower(
+// CHECK:         scf.parallel (%{{.*}}) = (%{{.*}}) to (%{{.*}}) step (%{{.*}}) {
+// CHECK:           scf.for
+// CHECK:         } {polygeist.schedule = #omp<schedulekind guided>}
+
+// CHECK-LABEL: func @clear(
+// CHECK:         omp.parallel
+// CHECK:           omp.wsloop schedule(static = %{{.*}} : i32)
+
+// WSLOOP-LABEL: func @scale(
+// WSLOOP:         omp.parallel
+// WSLOOP:           omp.wsloop schedule(dynamic = %{{.*}} : i64) for (%{{[^,]*}}, %{{[^)]*}}) : index =
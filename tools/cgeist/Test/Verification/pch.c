@@ -0,0 +1,12 @@
+// RUN: cgeist %S/Inputs/pch.h -emit-pch -o %t.pch
+// RUN: cgeist %s --function=* -S -O0 -include-pch %t.pch | FileCheck %s
+// RUN: not cgeist %s -emit-pch -o %t.src.pch 2>&1 | FileCheck %s --check-prefix=SOURCE
+
+int apply(int x) { return twice(x) + 1; }
+
+// CHECK-LABEL: func @apply(
+// CHECK:         call @twice(
+// CHECK-LABEL: func private @twice(
+// CHECK-NOT:   @unused
+
+// SOURCE: error: -emit-pch requires header inputs
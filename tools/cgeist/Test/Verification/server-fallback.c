@@ -0,0 +1,7 @@
+// RUN: cgeist %s --function=* -S -server=%t.missing.sock | FileCheck %s
+// RUN: env CGEIST_SERVER=%t.missing.sock cgeist %s --function=* -S | FileCheck %s
+
+int add(int a, int b) { return a + b; }
+
+// CHECK-LABEL: func @add(
+// CHECK:         arith.addi
@@ -0,0 +1,21 @@
+// The server is started, used and stopped in one shell, whose trap stops it
+// even when the served compile fails. Socket paths are limited to about a
+// hundred bytes, so the socket does not live next to %t.
+// RUN: sh -c 'path=$(mktemp -u /tmp/cgeist-server.XXXXXX); \
+// RUN:   cgeist -serve="$path" < /dev/null > /dev/null 2>&1 & \
+// RUN:   trap "kill $!; rm -f $path" EXIT; \
+// RUN:   for i in $(seq 100); do test -S "$path" && break; sleep 0.1; done; \
+// RUN:   test -S "$path" && \
+// RUN:   cgeist %s --function=* -S -o %t.served.mlir -server="$path"'
+// RUN: cgeist %s --function=* -S -o %t.direct.mlir
+// RUN: diff %t.direct.mlir %t.served.mlir
+// RUN: FileCheck %s < %t.served.mlir
+
+// An option value that looks like -serve does not start a server.
+// RUN: rm -rf %t.dir && mkdir %t.dir && cd %t.dir && cgeist -o -serve %s --function=* -S
+// RUN: FileCheck %s < %t.dir/-serve
+
+int add(int a, int b) { return a + b; }
+
+// CHECK-LABEL: func @add(
+// CHECK:         arith.addi
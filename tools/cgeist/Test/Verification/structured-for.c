@@ -0,0 +1,56 @@
+// RUN: cgeist %s --function=* -S --immediate | FileCheck %s
+
+void fill(int n, double *a) {
+  for (int i = 0; i < n; i += 2)
+    a[i] = 0;
+}
+
+void nest(int n, double *a) {
+  for (int i = n - 1; i >= 0; i--)
+    for (int j = 0; j <= i; j++)
+      a[i * n + j] = 0;
+}
+
+void early(int n, double *a) {
+  for (int i = 0; i < n; i++) {
+    if (a[i] < 0)
+      break;
+    a[i] = 1;
+  }
+}
+
+void bump(int n, double *a) {
+  for (int i = 0; i < n; i++) {
+    a[i] = 1;
+    n--;
+  }
+}
+
+void narrow(double *a) {
+  for (signed char i = 0; i < 300; i++)
+    a[i] = 1;
+}
+
+void wide(long n, double *a) {
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+}
+
+// CHECK-LABEL: func @fill
+// CHECK-NOT: affine.for
+// CHECK: scf.for %{{.*}} = %{{.*}} to %{{.*}} step %{{.*}} {
+// CHECK-LABEL: func @nest
+// CHECK: scf.for
+// CHECK: scf.for
+// CHECK-LABEL: func @early
+// CHECK-NOT: scf.for
+// CHECK: cf.cond_br
+// CHECK-LABEL: func @bump
+// CHECK-NOT: scf.for
+// CHECK: cf.cond_br
+// CHECK-LABEL: func @narrow
+// CHECK-NOT: scf.for
+// CHECK: cf.cond_br
+// CHECK-LABEL: func @wide
+// CHECK-NOT: scf.for
+// CHECK: cf.cond_br
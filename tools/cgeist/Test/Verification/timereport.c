@@ -0,0 +1,19 @@
+// RUN: cgeist %s --function=* -S -time-report=%t.json -o /dev/null
+// RUN: FileCheck %s < %t.json
+
+int square(int x) { return x * x; }
+
+// CHECK: "peak_rss_bytes":
+// CHECK: "stages": [
+// CHECK: "name": "startup",
+// CHECK: "peak_rss_growth_bytes":
+// CHECK: "name": "frontend",
+// CHECK: "ops_before":
+// CHECK: "name": "canonicalize",
+// CHECK: "noop":
+// CHECK: "passes": [
+// CHECK: "stage": "canonicalize",
+// CHECK: "op": "func.func",
+// CHECK-NOT: "peak_rss
+// CHECK: "counters": {
+// CHECK: "startup.dialects_loaded":
@@ -20,8 +20,8 @@ void meta() {
 }
 
 // CHECK-LABEL:   func.func @_Z4metav()
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3.000000e+00 : f64
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1.000000e+00 : f64
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3.000000e+00 : f64
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 1.000000e+00 : f64
 // CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = memref.alloca() : memref<1x!llvm.struct<(struct<(f64)>)>>
 // CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = memref.cast %[[VAL_2]] : memref<1x!llvm.struct<(struct<(f64)>)>> to memref<?x!llvm.struct<(struct<(f64)>)>>
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = memref.alloca() : memref<1x!llvm.struct<(struct<(f64)>)>>
@@ -31,8 +31,8 @@ void make() {
 }
 
 // CHECK-LABEL:   func.func @_Z4makev()
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3.140000e+00 : f64
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 3.140000e+00 : f64
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
 // CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = memref.alloca() : memref<1x!llvm.struct<(struct<(i32)>, struct<(f32)>, f64)>>
 // CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = memref.cast %[[VAL_2]] : memref<1x!llvm.struct<(struct<(i32)>, struct<(f32)>, f64)>> to memref<?x!llvm.struct<(struct<(i32)>, struct<(f32)>, f64)>>
 // CHECK:           call @_ZN3SubC1Eid(%[[VAL_3]], %[[VAL_1]], %[[VAL_0]]) : (memref<?x!llvm.struct<(struct<(i32)>, struct<(f32)>, f64)>>, i32, f64) -> ()
@@ -11,10 +11,10 @@ void testArrayInitExpr()
 }
 
 // CHECK-LABEL:   func.func @_Z17testArrayInitExprv()  
-// CHECK:           %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 4 : i32
-// CHECK:           %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
-// CHECK:           %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 2 : i32
-// CHECK:           %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1 : i32
+// CHECK-DAG:       %[[VAL_0:[A-Za-z0-9_]*]] = arith.constant 4 : i32
+// CHECK-DAG:       %[[VAL_1:[A-Za-z0-9_]*]] = arith.constant 3 : i32
+// CHECK-DAG:       %[[VAL_2:[A-Za-z0-9_]*]] = arith.constant 2 : i32
+// CHECK-DAG:       %[[VAL_3:[A-Za-z0-9_]*]] = arith.constant 1 : i32
 // CHECK:           %[[VAL_4:[A-Za-z0-9_]*]] = memref.alloca() : memref<1x!llvm.struct<(array<4 x i32>)>>
 // CHECK:           %[[VAL_5:[A-Za-z0-9_]*]] = "polygeist.memref2pointer"(%[[VAL_4]]) : (memref<1x!llvm.struct<(array<4 x i32>)>>) -> !llvm.ptr
 // CHECK:           llvm.store %[[VAL_3]], %[[VAL_5]] : i32, !llvm.ptr
@@ -22,6 +22,7 @@
 #include <clang/Frontend/TextDiagnosticPrinter.h>
 #include <clang/Frontend/Utils.h>
 
+#include "mlir/Bytecode/BytecodeWriter.h"
 #include "mlir/Conversion/AffineToStandard/AffineToStandard.h"
 #include "mlir/Conversion/GPUCommon/GPUCommonPass.h"
 #include "mlir/Conversion/GPUToNVVM/GPUToNVVMPass.h"
@@ -30,16 +31,13 @@
 #include "mlir/Conversion/MathToLLVM/MathToLLVM.h"
 #include "mlir/Conversion/OpenMPToLLVM/ConvertOpenMPToLLVM.h"
 #include "mlir/Conversion/SCFToControlFlow/SCFToControlFlow.h"
-#include "mlir/Conversion/SCFToOpenMP/SCFToOpenMP.h"
 #include "mlir/Dialect/Affine/Passes.h"
-#include "mlir/Dialect/Async/IR/Async.h"
 #include "mlir/Dialect/DLTI/DLTI.h"
 #include "mlir/Dialect/Func/Extensions/InlinerExtension.h"
 #include "mlir/Dialect/GPU/IR/GPUDialect.h"
 #include "mlir/Dialect/GPU/Transforms/Passes.h"
 #include "mlir/Dialect/LLVMIR/ROCDLDialect.h"
 #include "mlir/Dialect/LLVMIR/Transforms/RequestCWrappers.h"
-#include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/OpenMP/OpenMPDialect.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/Dialect/SCF/Transforms/Passes.h"
@@ -50,7 +48,7 @@
 #include "mlir/InitAllDialects.h"
 #include "mlir/InitAllExtensions.h"
 #include "mlir/InitAllPasses.h"
-#include "mlir/InitAllTranslations.h"
+#include "mlir/Parser/Parser.h"
 #include "mlir/Pass/PassManager.h"
 #include "mlir/Target/LLVMIR/Dialect/All.h"
 #include "mlir/Target/LLVMIR/Dialect/Builtin/BuiltinToLLVMIRTranslation.h"
@@ -59,15 +57,29 @@
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "mlir/Transforms/Passes.h"
 
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/LLVMDriver.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
 #include "llvm/TargetParser/Host.h"
 #include "llvm/Transforms/IPO/Internalize.h"
 #include <fstream>
@@ -78,6 +90,9 @@
 #include <fstream>
 
 #include "ArgumentList.h"
+#include "Lib/CompileCache.h"
+#include "Lib/CompileServer.h"
+#include "Lib/TimeReport.h"
 
 using namespace llvm;
 
@@ -147,6 +162,18 @@ static cl::opt<bool> SCFOpenMP("scf-openmp", cl::init(true),
 static cl::opt<bool> OpenMPOpt("openmp-opt", cl::init(true),
                                cl::desc("Turn on openmp opt"));
 
+static cl::opt<bool> OpenMPSchedule(
+    "openmp-schedule", cl::init(true),
+    cl::desc("Pick a schedule for OpenMP loops that have none"));
+
+static cl::opt<bool> OpenMPScheduleRemarks(
+    "openmp-schedule-remarks", cl::init(false),
+    cl::desc("Explain the schedules picked for OpenMP loops"));
+
+static cl::opt<bool> OpenMPFirstTouch(
+    "openmp-first-touch", cl::init(true),
+    cl::desc("Initialize arrays in parallel like the OpenMP loops using them"));
+
 static cl::opt<bool> ParallelLICM("parallel-licm", cl::init(true),
                                   cl::desc("Turn on parallel licm"));
 
@@ -162,8 +189,8 @@ static cl::opt<bool> ShowAST("show-ast", cl::init(false), cl::desc("Show AST"));
 static cl::opt<bool> ImmediateMLIR("immediate", cl::init(false),
                                    cl::desc("Emit immediate mlir"));
 
-static cl::opt<bool> RaiseToAffine("raise-scf-to-affine", cl::init(false),
-                                   cl::desc("Raise SCF to Affine"));
+cl::opt<bool> RaiseToAffine("raise-scf-to-affine", cl::init(false),
+                            cl::desc("Raise SCF to Affine"));
 
 static cl::opt<bool> ScalarReplacement("scal-rep", cl::init(true),
                                        cl::desc("Raise SCF to Affine"));
@@ -205,6 +232,10 @@ static cl::opt<std::string> cfunction("function",
 static cl::opt<bool> FOpenMP("fopenmp", cl::init(false),
                              cl::desc("Enable OpenMP"));
 
+static cl::opt<bool> FFastMath("ffast-math", cl::init(false),
+                               cl::desc("Allow reassociating floating-point "
+                                        "arithmetic"));
+
 static cl::opt<std::string> ToCPU("cpuify", cl::init(""),
                                   cl::desc("Convert to cpu"));
 
@@ -234,6 +265,18 @@ static cl::list<std::string> defines("D", cl::desc("defines"),
 static cl::list<std::string> Includes("include", cl::desc("includes"),
                                       cl::cat(toolOptions));
 
+static cl::opt<std::string>
+    IncludePCH("include-pch", cl::init(""),
+               cl::desc("Load the declarations of the included headers from "
+                        "a precompiled header written by -emit-pch"),
+               cl::cat(toolOptions));
+
+static cl::opt<bool>
+    EmitPCH("emit-pch", cl::init(false),
+            cl::desc("Write a precompiled header of the input to the output "
+                     "file instead of compiling it"),
+            cl::cat(toolOptions));
+
 static cl::opt<std::string> TargetTripleOpt("target", cl::init(""),
                                             cl::desc("Target triple"),
                                             cl::cat(toolOptions));
@@ -253,6 +296,63 @@ static cl::opt<bool> PMEnablePrinting(
     "pm-enable-printing", cl::init(false),
     cl::desc("Enable printing of IR before and after all passes"));
 
+static cl::opt<unsigned> NumThreads(
+    "j", cl::init(1),
+    cl::desc("Number of threads used to lower translation units and to run "
+             "function-level pass pipelines (0 uses all hardware threads)"));
+
+static cl::alias NumThreadsAlias("threads", cl::desc("Alias for -j"),
+                                 cl::aliasopt(NumThreads));
+
+static cl::opt<bool> InProcessBackend(
+    "in-process-backend", cl::init(false),
+    cl::desc("Optimize and codegen the LLVM module in-process instead of "
+             "handing textual IR to the clang driver"));
+
+static cl::opt<unsigned> CodegenPartitions(
+    "codegen-partitions", cl::init(1),
+    cl::desc("Number of module partitions to codegen in parallel with "
+             "-in-process-backend"));
+
+static cl::opt<std::string> TimeReportFile(
+    "time-report", cl::init(""),
+    cl::desc("Write wall time, CPU time, peak RSS growth and IR size of "
+             "every driver stage and pass instance as JSON to the given file"));
+
+static cl::opt<std::string> CacheDir(
+    "cache-dir", cl::init(""),
+    cl::desc("Reuse the output of an identical earlier compilation stored in "
+             "this directory (-S and -c only)"));
+
+static cl::opt<unsigned>
+    CacheSizeMB("cache-size-mb", cl::init(1024),
+                cl::desc("Size limit of -cache-dir in megabytes"));
+
+static cl::opt<std::string>
+    ServeSocket("serve", cl::init(""),
+                cl::desc("Run as a compile server on the given Unix socket, "
+                         "keeping a warm context for all compiles"));
+
+static cl::opt<std::string> ServerSocket(
+    "server", cl::init(""),
+    cl::desc("Compile on the server listening on the given Unix socket, or "
+             "locally if there is none. Defaults to $CGEIST_SERVER"));
+
+/// Stages of the driver pipeline that can be checkpointed, in the order they
+/// run when lowering to LLVM.
+static const char *const CheckpointStages[] = {"frontend", "raise", "cpuify",
+                                               "gpu",      "omp",   "llvm"};
+
+static cl::opt<std::string> StopAfter(
+    "stop-after", cl::init(""),
+    cl::desc("Write the module as MLIR bytecode to the output file after the "
+             "given stage: frontend, raise, cpuify, gpu, omp or llvm"));
+
+static cl::opt<std::string> ResumeFrom(
+    "resume-from", cl::init(""),
+    cl::desc("Continue from a checkpoint written by -stop-after instead of "
+             "parsing input files. Options must match the checkpointed run"));
+
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 
 class PolygeistCudaDetectorArgList : public llvm::opt::ArgList {
@@ -447,17 +547,228 @@ int emitBinary(char *Argv0, const char *filename,
   return Res;
 }
 
+/// Returns the codegen options clang would use for the same command line:
+/// the float ABI recorded by the frontend and the floating-point relaxations
+/// of -ffast-math.
+static llvm::TargetOptions getTargetOptions(StringRef FloatABI) {
+  llvm::TargetOptions Options;
+  Options.FloatABIType =
+      llvm::StringSwitch<llvm::FloatABI::ABIType>(FloatABI)
+          .Case("soft", llvm::FloatABI::Soft)
+          .Case("softfp", llvm::FloatABI::Soft)
+          .Case("hard", llvm::FloatABI::Hard)
+          .Default(llvm::FloatABI::Default);
+  if (FFastMath) {
+    Options.UnsafeFPMath = true;
+    Options.NoInfsFPMath = true;
+    Options.NoNaNsFPMath = true;
+    Options.NoSignedZerosFPMath = true;
+    Options.ApproxFuncFPMath = true;
+    Options.AllowFPOpFusion = llvm::FPOpFusion::Fast;
+  }
+  return Options;
+}
+
+/// Runs the LLVM optimization pipeline for \p optLevel and codegen on \p M
+/// in-process. One object file is written per stream in \p OSs; with more
+/// than one stream the module is split and the partitions are compiled in
+/// parallel.
+static int emitObjectFiles(llvm::Module &M, int optLevel, StringRef CPU,
+                           StringRef Features,
+                           const llvm::TargetOptions &Options,
+                           ArrayRef<llvm::raw_pwrite_stream *> OSs) {
+  llvm::InitializeAllTargetInfos();
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+
+  std::string Error;
+  const llvm::Target *T =
+      llvm::TargetRegistry::lookupTarget(M.getTargetTriple(), Error);
+  if (!T) {
+    llvm::errs() << "error: " << Error << "\n";
+    return 1;
+  }
+
+  llvm::CodeGenOpt::Level CGOptLevel = llvm::CodeGenOpt::Default;
+  llvm::OptimizationLevel Level = llvm::OptimizationLevel::O2;
+  switch (optLevel) {
+  case 0:
+    CGOptLevel = llvm::CodeGenOpt::None;
+    Level = llvm::OptimizationLevel::O0;
+    break;
+  case 1:
+    CGOptLevel = llvm::CodeGenOpt::Less;
+    Level = llvm::OptimizationLevel::O1;
+    break;
+  case 3:
+    CGOptLevel = llvm::CodeGenOpt::Aggressive;
+    Level = llvm::OptimizationLevel::O3;
+    break;
+  }
+  // PIC objects link into both PIE and non-PIE executables, whichever the
+  // toolchain defaults to.
+  auto createTargetMachine = [&]() {
+    return std::unique_ptr<llvm::TargetMachine>(T->createTargetMachine(
+        M.getTargetTriple(), CPU, Features, Options,
+        llvm::Reloc::PIC_, std::nullopt, CGOptLevel));
+  };
+  std::unique_ptr<llvm::TargetMachine> TM = createTargetMachine();
+
+  {
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+    llvm::PassBuilder PB(TM.get());
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    llvm::ModulePassManager MPM =
+        optLevel == 0 ? PB.buildO0DefaultPipeline(Level)
+                      : PB.buildPerModuleDefaultPipeline(Level);
+    MPM.run(M, MAM);
+  }
+
+  if (OSs.size() > 1) {
+    llvm::splitCodeGen(M, OSs, {}, createTargetMachine,
+                       llvm::CGFT_ObjectFile);
+    return 0;
+  }
+  llvm::legacy::PassManager CodeGenPasses;
+  if (TM->addPassesToEmitFile(CodeGenPasses, *OSs.front(), nullptr,
+                              llvm::CGFT_ObjectFile)) {
+    llvm::errs() << "error: target does not support object file emission\n";
+    return 1;
+  }
+  CodeGenPasses.run(M);
+  return 0;
+}
+
 #include "Lib/clang-mlir.cc"
-int main(int argc, char **argv) {
 
-  if (argc >= 1) {
-    if (std::string(argv[1]) == "-cc1") {
-      SmallVector<const char *> Argv;
-      for (int i = 0; i < argc; i++)
-        Argv.push_back(argv[i]);
-      return ExecuteCC1Tool(Argv, {});
+/// Returns whether the compile of \p files may emit or lower GPU code, which
+/// is the only use cgeist has for the GPU dialect.
+static bool needsGPU(ArrayRef<std::string> files) {
+  return CudaLower || EmitCUDA || EmitROCM || Lang == "cuda" ||
+         llvm::any_of(files, [](StringRef file) {
+           return llvm::sys::path::extension(file) == ".cu";
+         });
+}
+
+/// Returns a context with the dialects of the frontend loaded. The GPU dialect
+/// is only loaded with \p gpu, ROCDL with \p rocm and OpenMP with \p openmp.
+/// NVVM is always loaded, since __syncthreads and warpSize lower to it in any
+/// language and the frontend may run on several threads, where dialects can
+/// no longer be loaded. All dialects are registered, which is cheap, so that
+/// passes and the checkpoint parser can load any other one they need.
+static std::unique_ptr<mlir::MLIRContext>
+createContext(bool gpu, bool rocm, bool openmp) {
+  using namespace mlir;
+  // The passes a polygeist-fixpoint pipeline can name when it is parsed from
+  // its textual form.
+  mlir::registerpolygeistPasses();
+  mlir::registerCSEPass();
+  mlir::registerCanonicalizerPass();
+  mlir::registerInlinerPass();
+  mlir::registerSymbolDCEPass();
+  mlir::registerLoopInvariantCodeMotionPass();
+  mlir::registerConvertAffineToStandardPass();
+  mlir::affine::registerAffinePasses();
+
+  mlir::DialectRegistry registry;
+  mlir::registerOpenMPDialectTranslation(registry);
+  mlir::registerLLVMDialectTranslation(registry);
+  mlir::func::registerInlinerExtension(registry);
+  // Registering these passes initializes the backends they compile device
+  // code with.
+  if (gpu)
+    polygeist::registerGpuSerializeToCubinPass();
+  if (rocm)
+    polygeist::registerGpuSerializeToHsacoPass();
+  mlir::registerAllDialects(registry);
+  mlir::registerAllExtensions(registry);
+  mlir::registerBuiltinDialectTranslation(registry);
+
+  auto context = std::make_unique<MLIRContext>(
+      registry, MLIRContext::Threading::DISABLED);
+  context->getOrLoadDialect<affine::AffineDialect>();
+  context->getOrLoadDialect<func::FuncDialect>();
+  context->getOrLoadDialect<DLTIDialect>();
+  context->getOrLoadDialect<mlir::scf::SCFDialect>();
+  context->getOrLoadDialect<mlir::LLVM::LLVMDialect>();
+  context->getOrLoadDialect<mlir::math::MathDialect>();
+  context->getOrLoadDialect<mlir::memref::MemRefDialect>();
+  context->getOrLoadDialect<mlir::polygeist::PolygeistDialect>();
+  context->getOrLoadDialect<mlir::cf::ControlFlowDialect>();
+  context->getOrLoadDialect<mlir::NVVM::NVVMDialect>();
+  if (gpu)
+    context->getOrLoadDialect<mlir::gpu::GPUDialect>();
+  if (rocm)
+    context->getOrLoadDialect<mlir::ROCDL::ROCDLDialect>();
+  if (openmp)
+    context->getOrLoadDialect<mlir::omp::OpenMPDialect>();
+
+  LLVM::LLVMFunctionType::attachInterface<MemRefInsider>(*context);
+  LLVM::LLVMPointerType::attachInterface<MemRefInsider>(*context);
+  LLVM::LLVMArrayType::attachInterface<MemRefInsider>(*context);
+  LLVM::LLVMStructType::attachInterface<MemRefInsider>(*context);
+  MemRefType::attachInterface<PtrElementModel<MemRefType>>(*context);
+  IndexType::attachInterface<PtrElementModel<IndexType>>(*context);
+  LLVM::LLVMStructType::attachInterface<PtrElementModel<LLVM::LLVMStructType>>(
+      *context);
+  LLVM::LLVMPointerType::attachInterface<
+      PtrElementModel<LLVM::LLVMPointerType>>(*context);
+  LLVM::LLVMArrayType::attachInterface<PtrElementModel<LLVM::LLVMArrayType>>(
+      *context);
+  return context;
+}
+
+/// Context set up by a compile server before it forks a compile, or null,
+/// and the gpu, rocm and openmp arguments it was created with.
+static std::unique_ptr<mlir::MLIRContext> warmContext;
+static std::tuple<bool, bool, bool> warmContextDialects;
+
+/// Returns the value of option \p name if it is given on the command line as
+/// -name=value or -name value, with one or two dashes. Other registered
+/// options that take a value in the next argument consume it the way the
+/// option parser does, so `-o -serve` names an output file. This runs before
+/// the command line is parsed, which happens once per compile.
+static std::optional<StringRef> findOption(int argc, char **argv,
+                                           StringRef name) {
+  StringMap<cl::Option *> &options = cl::getRegisteredOptions();
+  for (int i = 1; i < argc; i++) {
+    StringRef arg = StringRef(argv[i]);
+    if (arg == "--")
+      break;
+    // -L and -l are split off for the linker before parsing.
+    if (arg == "-L" || arg == "-l") {
+      i++;
+      continue;
+    }
+    if (!arg.consume_front("-"))
+      continue;
+    arg.consume_front("-");
+    auto [argName, value] = arg.split('=');
+    bool hasValue = argName.size() != arg.size();
+    if (argName == name) {
+      if (hasValue)
+        return value;
+      if (i + 1 < argc)
+        return StringRef(argv[i + 1]);
+      return std::nullopt;
     }
+    auto option = options.find(argName);
+    if (!hasValue && option != options.end() &&
+        option->second->getValueExpectedFlag() == cl::ValueRequired)
+      i++;
   }
+  return std::nullopt;
+}
+
+static int compile(int argc, char **argv) {
   SmallVector<const char *> LinkageArgs;
   SmallVector<const char *> MLIRArgs;
   {
@@ -505,11 +816,14 @@ int main(int argc, char **argv) {
   InitLLVM y(size, data);
   std::vector<std::string> files;
   {
-    cl::list<std::string> inputFileName(cl::Positional, cl::OneOrMore,
+    cl::list<std::string> inputFileName(cl::Positional, cl::ZeroOrMore,
                                         cl::desc("<Specify input file>"),
                                         cl::cat(toolOptions));
     cl::ParseCommandLineOptions(size, data);
-    assert(inputFileName.size());
+    if (inputFileName.empty() && ResumeFrom.empty()) {
+      llvm::errs() << "error: no input files\n";
+      return 1;
+    }
     for (auto inp : inputFileName) {
       std::ifstream inputFile(inp);
       if (!inputFile.good()) {
@@ -520,49 +834,134 @@ int main(int argc, char **argv) {
     }
   }
 
-  mlir::registerAllPasses();
-  mlir::registerAllTranslations();
-  mlir::DialectRegistry registry;
-  mlir::registerOpenMPDialectTranslation(registry);
-  mlir::registerLLVMDialectTranslation(registry);
-  mlir::func::registerInlinerExtension(registry);
-  polygeist::registerGpuSerializeToCubinPass();
-  polygeist::registerGpuSerializeToHsacoPass();
-  mlir::registerAllDialects(registry);
-  mlir::registerAllExtensions(registry);
-  mlir::registerAllFromLLVMIRTranslations(registry);
-  mlir::registerBuiltinDialectTranslation(registry);
-  MLIRContext context(registry);
-
-  context.disableMultithreading();
-  context.getOrLoadDialect<affine::AffineDialect>();
-  context.getOrLoadDialect<func::FuncDialect>();
-  context.getOrLoadDialect<DLTIDialect>();
-  context.getOrLoadDialect<mlir::scf::SCFDialect>();
-  context.getOrLoadDialect<mlir::async::AsyncDialect>();
-  context.getOrLoadDialect<mlir::LLVM::LLVMDialect>();
-  context.getOrLoadDialect<mlir::NVVM::NVVMDialect>();
-  context.getOrLoadDialect<mlir::ROCDL::ROCDLDialect>();
-  context.getOrLoadDialect<mlir::gpu::GPUDialect>();
-  context.getOrLoadDialect<mlir::omp::OpenMPDialect>();
-  context.getOrLoadDialect<mlir::math::MathDialect>();
-  context.getOrLoadDialect<mlir::memref::MemRefDialect>();
-  context.getOrLoadDialect<mlir::linalg::LinalgDialect>();
-  context.getOrLoadDialect<mlir::polygeist::PolygeistDialect>();
-  context.getOrLoadDialect<mlir::cf::ControlFlowDialect>();
-
-  LLVM::LLVMFunctionType::attachInterface<MemRefInsider>(context);
-  LLVM::LLVMPointerType::attachInterface<MemRefInsider>(context);
-  LLVM::LLVMArrayType::attachInterface<MemRefInsider>(context);
-  LLVM::LLVMStructType::attachInterface<MemRefInsider>(context);
-  MemRefType::attachInterface<PtrElementModel<MemRefType>>(context);
-  IndexType::attachInterface<PtrElementModel<IndexType>>(context);
-  LLVM::LLVMStructType::attachInterface<PtrElementModel<LLVM::LLVMStructType>>(
-      context);
-  LLVM::LLVMPointerType::attachInterface<
-      PtrElementModel<LLVM::LLVMPointerType>>(context);
-  LLVM::LLVMArrayType::attachInterface<PtrElementModel<LLVM::LLVMArrayType>>(
-      context);
+  if (!StopAfter.empty() &&
+      !llvm::is_contained(CheckpointStages, StringRef(StopAfter))) {
+    llvm::errs() << "error: unknown stage '" << StopAfter
+                 << "' for -stop-after\n";
+    return 1;
+  }
+  // Rejects stages skipped by the output options before doing any work. The
+  // conditions mirror the ones guarding the pipelines below.
+  {
+    bool LowersToOpenMP =
+        EmitLLVM || !EmitAssembly || EmitOpenMPIR || EmitLLVMDialect;
+    StringRef stage = StopAfter;
+    bool runs = ImmediateMLIR ? stage == "frontend"
+                : stage == "omp"  ? LowersToOpenMP
+                : stage == "llvm" ? LowersToOpenMP && !EmitOpenMPIR
+                                  : true;
+    if (!stage.empty() && !runs) {
+      llvm::errs() << "error: stage '" << stage
+                   << "' does not run with the given options\n";
+      return 1;
+    }
+  }
+
+  // Stages still running on an early return are recorded before the report
+  // is written.
+  mlirclang::TimeReport timeReport(!TimeReportFile.empty());
+  auto writeTimeReport =
+      llvm::make_scope_exit([&] { timeReport.write(TimeReportFile); });
+
+  if (EmitPCH) {
+    if (Output == "-") {
+      llvm::errs() << "error: -emit-pch requires an output file\n";
+      return 1;
+    }
+    auto stage = timeReport.stage("emit-pch");
+    return emitPCH(argv[0], files, includeDirs, defines, Output) ? 0 : 1;
+  }
+
+  // A hit reproduces the output of an identical earlier compilation without
+  // running the frontend or any pipeline. The key covers the tool version,
+  // the arguments, the PGO profile and the preprocessed inputs.
+  bool CompileOnly = llvm::is_contained(LinkageArgs, StringRef("-c"));
+  bool Cacheable = !OutputIntermediateGPU && StopAfter.empty() &&
+                   ResumeFrom.empty() &&
+                   (EmitAssembly || (CompileOnly && Output != "-"));
+  mlirclang::CompileCache compileCache(Cacheable ? CacheDir : "",
+                                       (uint64_t)CacheSizeMB << 20);
+  if (compileCache.isEnabled()) {
+    auto stage = timeReport.stage("cache-lookup");
+    llvm::raw_ostream &key = compileCache.key();
+    key << clang::getClangFullVersion() << '\0';
+    std::string exe = GetExecutablePath(argv[0], /*CanonicalPrefixes*/ true);
+    llvm::sys::fs::file_status status;
+    if (!llvm::sys::fs::status(exe, status))
+      key << exe << '\0' << status.getSize() << '\0'
+          << status.getLastModificationTime().time_since_epoch().count()
+          << '\0';
+    for (size_t i = 1; i < MLIRArgs.size(); i++) {
+      // Options that do not change the contents of the output.
+      StringRef name = StringRef(MLIRArgs[i]).ltrim('-');
+      if (name == "o") {
+        i++;
+        continue;
+      }
+      if (!name.startswith("o=") && !name.startswith("cache-") &&
+          !name.startswith("time-report"))
+        key << MLIRArgs[i] << '\0';
+    }
+    for (const char *arg : LinkageArgs)
+      key << arg << '\0';
+    // The headers in a precompiled header do not appear in the preprocessed
+    // inputs, so the contents of the header file stand in for them.
+    if (IncludePCH != "") {
+      auto pch = llvm::MemoryBuffer::getFile(IncludePCH, /*IsText*/ false,
+                                             /*RequiresNullTerminator*/ false);
+      if (pch)
+        key << (*pch)->getBufferSize() << '\0' << (*pch)->getBuffer();
+    }
+    polygeist::writeAlternativesCacheKey(key);
+    if (!preprocessMLIRInputs(argv[0], files, includeDirs, defines, key))
+      return 1;
+
+    if (auto cached = compileCache.lookup()) {
+      if (Output == "-") {
+        llvm::outs() << cached->getBuffer();
+        return 0;
+      }
+      std::error_code EC;
+      llvm::raw_fd_ostream out(Output, EC, llvm::sys::fs::OF_None);
+      if (EC) {
+        llvm::errs() << "Failed to open " << Output << ": " << EC.message()
+                     << "\n";
+        return -1;
+      }
+      out << cached->getBuffer();
+      return 0;
+    }
+  }
+
+  // Translation units and the nested func::FuncOp pipelines are processed in
+  // parallel on this pool. It has to outlive the context. IR printing at
+  // module scope is not supported by MLIR with multithreading enabled.
+  std::unique_ptr<llvm::ThreadPool> threadPool;
+  std::unique_ptr<MLIRContext> contextOwner;
+  {
+    auto stage = timeReport.stage("startup");
+    // A served compile only takes the warm context when it would have
+    // created the same one, so that it loads the same dialects as a direct
+    // compile.
+    auto dialects = std::make_tuple(needsGPU(files), (bool)EmitROCM,
+                                    (bool)FOpenMP);
+    if (warmContext && warmContextDialects == dialects)
+      contextOwner = std::move(warmContext);
+    else
+      contextOwner = std::apply(createContext, dialects);
+  }
+  MLIRContext &context = *contextOwner;
+  timeReport.counter("startup.dialects_loaded",
+                     context.getLoadedDialects().size());
+  if (NumThreads != 1) {
+    if (PMEnablePrinting) {
+      llvm::errs() << "warning: -pm-enable-printing forces -j=1\n";
+    } else {
+      threadPool = std::make_unique<llvm::ThreadPool>(
+          llvm::hardware_concurrency(NumThreads));
+      context.setThreadPool(*threadPool);
+    }
+  }
 
   mlir::OwningOpRef<mlir::ModuleOp> module(
       mlir::ModuleOp::create(mlir::OpBuilder(&context).getUnknownLoc()));
@@ -571,9 +970,84 @@ int main(int argc, char **argv) {
   llvm::DataLayout DL("");
   llvm::Triple gpuTriple;
   llvm::DataLayout gpuDL("");
-  if (!parseMLIR(argv[0], files, cfunction, includeDirs, defines, module,
-                 triple, DL, gpuTriple, gpuDL)) {
-    return 1;
+
+  // Stages recorded in a resumed checkpoint are skipped. Stages are only
+  // ever added to completedStages, which is written with the checkpoint.
+  // Whether the OpenMP runtime must be linked is found once the omp stage
+  // has run, so it is recorded in the checkpoint as well.
+  constexpr StringLiteral completedStagesAttrName =
+      "polygeist.completed_stages";
+  constexpr StringLiteral linkOMPAttrName = "polygeist.link_omp";
+  bool LinkOMP = FOpenMP;
+  llvm::StringSet<> resumedStages;
+  llvm::SmallSetVector<StringRef, 8> completedStages;
+  auto finishStage = [&](StringRef stage) -> std::optional<int> {
+    if (!completedStages.insert(stage) || StopAfter != stage)
+      return std::nullopt;
+    auto timer = timeReport.stage("checkpoint");
+    SmallVector<Attribute> names;
+    for (StringRef name : completedStages)
+      names.push_back(StringAttr::get(&context, name));
+    module.get()->setAttr(completedStagesAttrName,
+                          ArrayAttr::get(&context, names));
+    if (LinkOMP)
+      module.get()->setAttr(linkOMPAttrName, UnitAttr::get(&context));
+    std::error_code EC;
+    llvm::raw_fd_ostream out(Output, EC, llvm::sys::fs::OF_None);
+    if (EC) {
+      llvm::errs() << "Failed to open " << Output << ": " << EC.message()
+                   << "\n";
+      return -1;
+    }
+    if (failed(mlir::writeBytecodeToFile(module.get(), out))) {
+      llvm::errs() << "Failed to write checkpoint to " << Output << "\n";
+      return -1;
+    }
+    return 0;
+  };
+
+  if (!ResumeFrom.empty()) {
+    auto stage = timeReport.stage("resume");
+    module = mlir::parseSourceFile<mlir::ModuleOp>(ResumeFrom, &context);
+    if (!module) {
+      llvm::errs() << "Failed to read checkpoint " << ResumeFrom << "\n";
+      return 1;
+    }
+    if (auto stages =
+            module.get()->getAttrOfType<ArrayAttr>(completedStagesAttrName))
+      for (StringRef name : stages.getAsValueRange<StringAttr>()) {
+        resumedStages.insert(name);
+        completedStages.insert(name);
+      }
+    module.get()->removeAttr(completedStagesAttrName);
+    if (module.get()->removeAttr(linkOMPAttrName))
+      LinkOMP = true;
+    if (resumedStages.contains(StopAfter)) {
+      llvm::errs() << "error: stage '" << StopAfter << "' already ran in "
+                   << ResumeFrom << "\n";
+      return 1;
+    }
+    if (auto attr = module.get()->getAttrOfType<StringAttr>(
+            LLVM::LLVMDialect::getTargetTripleAttrName()))
+      triple = llvm::Triple(attr.getValue());
+    if (auto attr = module.get()->getAttrOfType<StringAttr>(
+            LLVM::LLVMDialect::getDataLayoutAttrName()))
+      DL = llvm::DataLayout(attr.getValue());
+  } else {
+    auto stage = timeReport.stage("frontend", module.get());
+    if (!parseMLIR(argv[0], files, cfunction, includeDirs, defines, module,
+                   triple, DL, gpuTriple, gpuDL)) {
+      return 1;
+    }
+  }
+  if (auto res = finishStage("frontend"))
+    return *res;
+  {
+    auto &stats = mlirclang::frontendStatistics;
+    timeReport.counter("frontend.constants_emitted", stats.constantsEmitted);
+    timeReport.counter("frontend.constants_reused", stats.constantsReused);
+    timeReport.counter("frontend.index_casts_emitted", stats.indexCastsEmitted);
+    timeReport.counter("frontend.index_casts_reused", stats.indexCastsReused);
   }
 
   auto convertGepInBounds = [](llvm::Module &llvmModule) {
@@ -596,6 +1070,14 @@ int main(int argc, char **argv) {
     if (PMEnablePrinting)
       pm.enableIRPrinting();
   };
+  auto runPipeline = [&](mlir::PassManager &pm, StringRef name,
+                         StringRef stage) {
+    if (resumedStages.contains(stage))
+      return success();
+    timeReport.instrument(pm, name);
+    auto timer = timeReport.stage(name, module.get());
+    return pm.run(module.get());
+  };
 
   mlir::PassManager pm(&context);
   enablePrinting(pm);
@@ -638,7 +1120,6 @@ int main(int argc, char **argv) {
   bool EmitGPU = EmitROCM || EmitCUDA;
 
   int unrollSize = 32;
-  bool LinkOMP = FOpenMP;
   pm.enableVerifier(EarlyVerifier);
 
   pm.addPass(polygeist::createConvertToOpaquePtrPass());
@@ -646,17 +1127,19 @@ int main(int argc, char **argv) {
   mlir::OpPassManager &optPM = pm.nest<mlir::func::FuncOp>();
   GreedyRewriteConfig canonicalizerConfig;
   canonicalizerConfig.maxIterations = CanonicalizeIterations;
+  // Reruns a group of cleanup passes until they stop changing a function,
+  // skipping the ones that would see IR they already processed in the same
+  // group. Cleanup passes added on their own below always run.
+  auto addFixedPoint = [](auto &pm, auto... passes) {
+    SmallVector<std::unique_ptr<mlir::Pass>> group;
+    (group.push_back(std::move(passes)), ...);
+    pm.addPass(polygeist::createFixedPointPass(std::move(group)));
+  };
   if (true) {
-    optPM.addPass(mlir::createCSEPass());
-    optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-        canonicalizerConfig, {}, {}));
-    optPM.addPass(polygeist::createPolygeistMem2RegPass());
-    optPM.addPass(mlir::createCSEPass());
-    optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-        canonicalizerConfig, {}, {}));
-    optPM.addPass(polygeist::createPolygeistMem2RegPass());
-    optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-        canonicalizerConfig, {}, {}));
+    addFixedPoint(optPM, mlir::createCSEPass(),
+                  mlir::polygeist::createPolygeistCanonicalizePass(
+                      canonicalizerConfig, {}, {}),
+                  polygeist::createPolygeistMem2RegPass());
     optPM.addPass(polygeist::createRemoveTrivialUsePass());
     optPM.addPass(polygeist::createPolygeistMem2RegPass());
     optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
@@ -672,20 +1155,17 @@ int main(int argc, char **argv) {
     addLICM(optPM);
     optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
         canonicalizerConfig, {}, {}));
-    optPM.addPass(polygeist::createCanonicalizeForPass());
-    optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-        canonicalizerConfig, {}, {}));
+    addFixedPoint(optPM, polygeist::createCanonicalizeForPass(),
+                  mlir::polygeist::createPolygeistCanonicalizePass(
+                      canonicalizerConfig, {}, {}));
     if (RaiseToAffine) {
-      optPM.addPass(polygeist::createCanonicalizeForPass());
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
       addLICM(optPM);
       optPM.addPass(polygeist::createRaiseSCFToAffinePass());
       optPM.addPass(polygeist::replaceAffineCFGPass());
       if (ScalarReplacement)
         optPM.addPass(mlir::affine::createAffineScalarReplacementPass());
     }
-    if (mlir::failed(pm.run(module.get()))) {
+    if (mlir::failed(runPipeline(pm, "canonicalize", "raise"))) {
       module->dump();
       return 4;
     }
@@ -701,8 +1181,12 @@ int main(int argc, char **argv) {
       enablePrinting(pm);
       mlir::OpPassManager &optPM = pm.nest<mlir::func::FuncOp>();
 
-      if (DetectReduction)
+      if (DetectReduction) {
         optPM.addPass(polygeist::detectReductionPass());
+        if (FOpenMP)
+          optPM.addPass(
+              polygeist::createAffineParallelReductionPass(FFastMath));
+      }
 
       // Disable inlining for -O0
       if (!Opt0) {
@@ -716,13 +1200,11 @@ int main(int argc, char **argv) {
             canonicalizerConfig, {}, {}));
         pm.addPass(mlir::createInlinerPass());
         mlir::OpPassManager &optPM2 = pm.nest<mlir::func::FuncOp>();
-        optPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-            canonicalizerConfig, {}, {}));
-        optPM2.addPass(mlir::createCSEPass());
-        optPM2.addPass(polygeist::createPolygeistMem2RegPass());
-        optPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-            canonicalizerConfig, {}, {}));
-        optPM2.addPass(mlir::createCSEPass());
+        addFixedPoint(optPM2,
+                      mlir::polygeist::createPolygeistCanonicalizePass(
+                          canonicalizerConfig, {}, {}),
+                      mlir::createCSEPass(),
+                      polygeist::createPolygeistMem2RegPass());
         optPM2.addPass(polygeist::createCanonicalizeForPass());
         if (RaiseToAffine) {
           optPM2.addPass(polygeist::createRaiseSCFToAffinePass());
@@ -735,7 +1217,7 @@ int main(int argc, char **argv) {
         optPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
             canonicalizerConfig, {}, {}));
       }
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "inline", "raise"))) {
         module->dump();
         return 6;
       }
@@ -754,25 +1236,30 @@ int main(int argc, char **argv) {
       }
       pm.addPass(polygeist::createConvertCudaRTtoGPUPass());
       if (ToCPU.size() > 0) {
-        pm.addPass(polygeist::createConvertCudaRTtoCPUPass());
+        // The CPU runtime, which is linked in when no GPU code is emitted,
+        // pools the allocations.
+        bool useRuntimeAllocator = false;
+#if POLYGEIST_ENABLE_CPU_RUNTIME
+        useRuntimeAllocator = !EmitCUDA && !EmitROCM;
+#endif
+        pm.addPass(
+            polygeist::createConvertCudaRTtoCPUPass(useRuntimeAllocator));
       } else if (EmitROCM) {
         pm.addPass(polygeist::createConvertCudaRTtoHipRTPass());
       }
       pm.addPass(mlir::createSymbolDCEPass());
       mlir::OpPassManager &noptPM = pm.nest<mlir::func::FuncOp>();
-      noptPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      noptPM.addPass(polygeist::createPolygeistMem2RegPass());
-      noptPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
+      addFixedPoint(noptPM,
+                    mlir::polygeist::createPolygeistCanonicalizePass(
+                        canonicalizerConfig, {}, {}),
+                    polygeist::createPolygeistMem2RegPass());
       pm.addPass(mlir::createInlinerPass());
       mlir::OpPassManager &noptPM2 = pm.nest<mlir::func::FuncOp>();
-      noptPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      noptPM2.addPass(polygeist::createPolygeistMem2RegPass());
-      noptPM2.addPass(polygeist::createCanonicalizeForPass());
-      noptPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
+      addFixedPoint(noptPM2,
+                    mlir::polygeist::createPolygeistCanonicalizePass(
+                        canonicalizerConfig, {}, {}),
+                    polygeist::createPolygeistMem2RegPass(),
+                    polygeist::createCanonicalizeForPass());
       noptPM2.addPass(mlir::createCSEPass());
       addLICM(noptPM2);
       noptPM2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
@@ -807,33 +1294,28 @@ int main(int argc, char **argv) {
         if (ScalarReplacement)
           noptPM2.addPass(mlir::affine::createAffineScalarReplacementPass());
       }
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "parallel-lower", "raise"))) {
         module->dump();
         return 7;
       }
     }
+    if (auto res = finishStage("raise"))
+      return *res;
 
     mlir::PassManager pm(&context);
     enablePrinting(pm);
     mlir::OpPassManager &optPM = pm.nest<mlir::func::FuncOp>();
     if (CudaLower) {
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      optPM.addPass(mlir::createCSEPass());
-      optPM.addPass(polygeist::createPolygeistMem2RegPass());
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      optPM.addPass(mlir::createCSEPass());
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      optPM.addPass(polygeist::createCanonicalizeForPass());
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
+      addFixedPoint(optPM,
+                    mlir::polygeist::createPolygeistCanonicalizePass(
+                        canonicalizerConfig, {}, {}),
+                    mlir::createCSEPass(),
+                    polygeist::createPolygeistMem2RegPass());
+      addFixedPoint(optPM, polygeist::createCanonicalizeForPass(),
+                    mlir::polygeist::createPolygeistCanonicalizePass(
+                        canonicalizerConfig, {}, {}));
 
       if (RaiseToAffine) {
-        optPM.addPass(polygeist::createCanonicalizeForPass());
-        optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-            canonicalizerConfig, {}, {}));
         addLICM(optPM);
         optPM.addPass(polygeist::createRaiseSCFToAffinePass());
         optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
@@ -850,13 +1332,11 @@ int main(int argc, char **argv) {
       } else if (ToCPU.size() != 0) {
         optPM.addPass(polygeist::createCPUifyPass(ToCPU));
       }
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      optPM.addPass(mlir::createCSEPass());
-      optPM.addPass(polygeist::createPolygeistMem2RegPass());
-      optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
-          canonicalizerConfig, {}, {}));
-      optPM.addPass(mlir::createCSEPass());
+      addFixedPoint(optPM,
+                    mlir::polygeist::createPolygeistCanonicalizePass(
+                        canonicalizerConfig, {}, {}),
+                    mlir::createCSEPass(),
+                    polygeist::createPolygeistMem2RegPass());
       if (RaiseToAffine) {
         optPM.addPass(polygeist::createCanonicalizeForPass());
         optPM.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
@@ -902,10 +1382,12 @@ int main(int argc, char **argv) {
         pm.addPass(polygeist::createInnerSerializationPass());
       addLICM(pm);
 
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "cpuify", "cpuify"))) {
         module->dump();
         return 8;
       }
+      if (auto res = finishStage("cpuify"))
+        return *res;
     }
 
 #if POLYGEIST_ENABLE_GPU
@@ -938,7 +1420,7 @@ int main(int argc, char **argv) {
       pm.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
           canonicalizerConfig, {}, {}));
 
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "gpu-outline", "gpu"))) {
         module->dump();
         return 12;
       }
@@ -954,39 +1436,47 @@ int main(int argc, char **argv) {
           canonicalizerConfig, {}, {}));
       pm.addPass(polygeist::createLowerAlternativesPass());
       pm.addPass(polygeist::createCollectKernelStatisticsPass());
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "lower-alternatives", "gpu"))) {
         module->dump();
         return 12;
       }
     }
 
     // Prune unused gpu module funcs
-    module.get()->walk([&](gpu::GPUModuleOp gpum) {
-      bool changed;
-      do {
-        changed = false;
-        std::vector<Operation *> unused;
-        gpum->walk([&](Operation *op) {
-          if (isa<gpu::GPUFuncOp>(op) || isa<func::FuncOp>(op) ||
-              isa<LLVM::LLVMFuncOp>(op)) {
-            auto symbolUses = SymbolTable::getSymbolUses(op, module.get());
-            if (symbolUses && symbolUses->empty()) {
-              unused.push_back(op);
+    if (!resumedStages.contains("gpu"))
+      module.get()->walk([&](gpu::GPUModuleOp gpum) {
+        bool changed;
+        do {
+          changed = false;
+          std::vector<Operation *> unused;
+          gpum->walk([&](Operation *op) {
+            if (isa<gpu::GPUFuncOp>(op) || isa<func::FuncOp>(op) ||
+                isa<LLVM::LLVMFuncOp>(op)) {
+              auto symbolUses = SymbolTable::getSymbolUses(op, module.get());
+              if (symbolUses && symbolUses->empty()) {
+                unused.push_back(op);
+              }
             }
+          });
+          for (auto op : unused) {
+            changed = true;
+            op->erase();
           }
-        });
-        for (auto op : unused) {
-          changed = true;
-          op->erase();
-        }
-      } while (changed);
-    });
+        } while (changed);
+      });
+    if (auto res = finishStage("gpu"))
+      return *res;
 
     if (EmitLLVM || !EmitAssembly || EmitOpenMPIR || EmitLLVMDialect) {
       mlir::PassManager pm2(&context);
       enablePrinting(pm2);
       if (SCFOpenMP) {
-        pm2.addPass(createConvertSCFToOpenMPPass());
+        pm2.addPass(polygeist::createSCFToOpenMPPass());
+        if (OpenMPSchedule)
+          pm2.addPass(
+              polygeist::createOpenMPSchedulePass(OpenMPScheduleRemarks));
+        if (OpenMPFirstTouch)
+          pm2.addPass(polygeist::createOpenMPFirstTouchPass());
       } else
         pm2.addPass(polygeist::createSerializationPass());
       pm2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
@@ -1001,12 +1491,15 @@ int main(int argc, char **argv) {
       pm2.addPass(mlir::createCSEPass());
       pm2.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
           canonicalizerConfig, {}, {}));
-      if (mlir::failed(pm2.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm2, "openmp", "omp"))) {
         module->dump();
         return 9;
       }
-      if (!EmitOpenMPIR) {
+      if (!EmitOpenMPIR && !resumedStages.contains("omp"))
         module->walk([&](mlir::omp::ParallelOp) { LinkOMP = true; });
+      if (auto res = finishStage("omp"))
+        return *res;
+      if (!EmitOpenMPIR) {
         mlir::PassManager pm3(&context);
         enablePrinting(pm3);
         LowerToLLVMOptions options(&context);
@@ -1105,18 +1598,22 @@ int main(int argc, char **argv) {
         pm3.addPass(mlir::polygeist::createPolygeistCanonicalizePass(
             canonicalizerConfig, {}, {}));
 
-        if (mlir::failed(pm3.run(module.get()))) {
+        if (mlir::failed(runPipeline(pm3, "lower-to-llvm", "llvm"))) {
           module->dump();
           return 10;
         }
+        if (auto res = finishStage("llvm"))
+          return *res;
       }
 
     } else {
 
-      if (mlir::failed(pm.run(module.get()))) {
+      if (mlir::failed(runPipeline(pm, "cpuify", "cpuify"))) {
         module->dump();
         return 11;
       }
+      if (auto res = finishStage("cpuify"))
+        return *res;
     }
     if (mlir::failed(mlir::verify(module.get()))) {
       module->dump();
@@ -1124,9 +1621,30 @@ int main(int argc, char **argv) {
     }
   }
 
+  assert(StopAfter.empty() && "-stop-after stage is validated up front");
+
+  // Writes the textual output and keeps a copy of it in the compile cache.
+  auto writeOutput = [&](llvm::function_ref<void(llvm::raw_ostream &)> print) {
+    std::string text;
+    llvm::raw_string_ostream os(text);
+    print(os);
+    compileCache.store(os.str());
+    if (Output == "-") {
+      llvm::outs() << text;
+      return;
+    }
+    std::error_code EC;
+    llvm::raw_fd_ostream out(Output, EC);
+    out << text;
+  };
+
   if (EmitLLVM || !EmitAssembly) {
     llvm::LLVMContext llvmContext;
-    auto llvmModule = mlir::translateModuleToLLVMIR(module.get(), llvmContext);
+    std::unique_ptr<llvm::Module> llvmModule;
+    {
+      auto stage = timeReport.stage("llvm-translation");
+      llvmModule = mlir::translateModuleToLLVMIR(module.get(), llvmContext);
+    }
     if (!llvmModule) {
       module->dump();
       llvm::errs() << "Failed to emit LLVM IR\n";
@@ -1183,6 +1701,54 @@ int main(int argc, char **argv) {
       llvm::Linker::linkModules(*llvmModule, std::move(rocmWrapper),
                                 llvm::Linker::Flags::LinkOnlyNeeded);
     }
+#endif
+#if POLYGEIST_ENABLE_CPU_RUNTIME
+    // The profiling hooks of kernel alternatives need the C++ standard
+    // library, so only programs that call them link it.
+    StringRef pgoHooks[] = {"mgpurtPGOGetAlternative", "mgpurtPGOStart",
+                            "mgpurtPGOEnd"};
+    if (!EmitCUDA && !EmitROCM && llvm::any_of(pgoHooks, [&](StringRef name) {
+          return llvmModule->getFunction(name);
+        })) {
+// This header defines:
+// unsigned char CpuPGORuntimeWrappers_cpp_bc[]
+// unsigned int CpuPGORuntimeWrappers_cpp_bc_len
+#include "../lib/polygeist/ExecutionEngine/CpuPGORuntimeWrappers.cpp.bin.h"
+      StringRef blobStrRef((const char *)CpuPGORuntimeWrappers_cpp_bc,
+                           CpuPGORuntimeWrappers_cpp_bc_len);
+      MemoryBufferRef blobMemoryBufferRef(blobStrRef, "Binary include");
+      llvm::SMDiagnostic err;
+      std::unique_ptr<llvm::Module> pgoWrapper =
+          llvm::parseIR(blobMemoryBufferRef, err, llvmContext);
+      if (!pgoWrapper || llvm::verifyModule(*pgoWrapper, &llvm::errs())) {
+        llvm::errs() << "Failed to load CPU PGO wrapper bitcode module\n";
+        return -1;
+      }
+      llvm::Linker::linkModules(*llvmModule, std::move(pgoWrapper),
+                                llvm::Linker::Flags::LinkOnlyNeeded);
+      if (!CompileOnly)
+        LinkageArgs.push_back("-lstdc++");
+    }
+    if (!EmitCUDA && !EmitROCM) {
+// This header defines:
+// unsigned char CpuRuntimeWrappers_cpp_bc[]
+// unsigned int CpuRuntimeWrappers_cpp_bc_len
+#include "../lib/polygeist/ExecutionEngine/CpuRuntimeWrappers.cpp.bin.h"
+      StringRef blobStrRef((const char *)CpuRuntimeWrappers_cpp_bc,
+                           CpuRuntimeWrappers_cpp_bc_len);
+      MemoryBufferRef blobMemoryBufferRef(blobStrRef, "Binary include");
+      llvm::SMDiagnostic err;
+      std::unique_ptr<llvm::Module> cpuWrapper =
+          llvm::parseIR(blobMemoryBufferRef, err, llvmContext);
+      if (!cpuWrapper || llvm::verifyModule(*cpuWrapper, &llvm::errs())) {
+        llvm::errs() << "Failed to load CPU wrapper bitcode module\n";
+        return -1;
+      }
+      // Only the allocator and the device synchronization of the profiling
+      // hooks are needed, if any.
+      llvm::Linker::linkModules(*llvmModule, std::move(cpuWrapper),
+                                llvm::Linker::Flags::LinkOnlyNeeded);
+    }
 #endif
     if (InBoundsGEP) {
       convertGepInBounds(*llvmModule);
@@ -1225,7 +1791,79 @@ int main(int argc, char **argv) {
     }
     llvmModule->setDataLayout(DL);
     llvmModule->setTargetTriple(triple.getTriple());
-    if (!EmitAssembly) {
+    if (!EmitAssembly && InProcessBackend) {
+      auto stage = timeReport.stage("backend");
+      StringRef CPU, Features, FloatABI;
+      if (auto V = module.get()->getAttrOfType<mlir::StringAttr>(
+              "polygeist.target-cpu"))
+        CPU = V.getValue();
+      if (auto V = module.get()->getAttrOfType<mlir::StringAttr>(
+              "polygeist.target-features"))
+        Features = V.getValue();
+      if (auto V = module.get()->getAttrOfType<mlir::StringAttr>(
+              "polygeist.float-abi"))
+        FloatABI = V.getValue();
+      llvm::TargetOptions Options = getTargetOptions(FloatABI);
+
+      // With -c the object is the final output, there is nothing to link.
+      if (llvm::is_contained(LinkageArgs, StringRef("-c"))) {
+        if (CodegenPartitions > 1)
+          llvm::errs() << "warning: -codegen-partitions is ignored with -c, "
+                          "the object is written as a single partition\n";
+        std::error_code EC;
+        llvm::raw_fd_ostream out(Output, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+          llvm::errs() << "Failed to open " << Output << ": " << EC.message()
+                       << "\n";
+          return -1;
+        }
+        int res = emitObjectFiles(*llvmModule, optLevel, CPU, Features,
+                                  Options, {&out});
+        out.close();
+        if (res == 0)
+          compileCache.storeFile(Output);
+        return res;
+      }
+
+      std::vector<llvm::sys::fs::TempFile> objFiles;
+      std::vector<std::unique_ptr<llvm::raw_fd_ostream>> objStreams;
+      SmallVector<llvm::raw_pwrite_stream *> OSs;
+      for (unsigned i = 0; i < std::max(1u, (unsigned)CodegenPartitions);
+           i++) {
+        auto tmpFile =
+            llvm::sys::fs::TempFile::create("/tmp/intermediate%%%%%%%.o");
+        if (!tmpFile) {
+          llvm::errs() << "Failed to create temp file\n";
+          return -1;
+        }
+        objFiles.push_back(std::move(*tmpFile));
+        objStreams.push_back(std::make_unique<llvm::raw_fd_ostream>(
+            objFiles.back().FD, /*shouldClose*/ false));
+        OSs.push_back(objStreams.back().get());
+      }
+      int res =
+          emitObjectFiles(*llvmModule, optLevel, CPU, Features, Options, OSs);
+      objStreams.clear();
+      if (res == 0) {
+        // Only the final link goes through the clang driver.
+        SmallVector<const char *> linkArgs(LinkageArgs);
+        for (auto &objFile : llvm::drop_begin(objFiles))
+          linkArgs.push_back(objFile.TmpName.c_str());
+        res = emitBinary(argv[0], objFiles.front().TmpName.c_str(), linkArgs,
+                         LinkOMP);
+      }
+      for (auto &objFile : objFiles) {
+        if (objFile.discard()) {
+          llvm::errs() << "Failed to erase temp file\n";
+          return -1;
+        }
+      }
+      return res;
+    } else if (!EmitAssembly) {
+      auto stage = timeReport.stage("backend");
+      if (CodegenPartitions > 1)
+        llvm::errs() << "warning: -codegen-partitions requires "
+                        "-in-process-backend and is ignored\n";
       auto tmpFile =
           llvm::sys::fs::TempFile::create("/tmp/intermediate%%%%%%%.ll");
       if (!tmpFile) {
@@ -1240,27 +1878,53 @@ int main(int argc, char **argv) {
       }
       int res =
           emitBinary(argv[0], tmpFile->TmpName.c_str(), LinkageArgs, LinkOMP);
+      if (res == 0)
+        compileCache.storeFile(Output);
       if (tmpFile->discard()) {
         llvm::errs() << "Failed to erase temp file\n";
         return -1;
       }
       return res;
-    } else if (Output == "-") {
-      llvm::outs() << *llvmModule << "\n";
     } else {
-      std::error_code EC;
-      llvm::raw_fd_ostream out(Output, EC);
-      out << *llvmModule << "\n";
+      writeOutput([&](llvm::raw_ostream &os) { os << *llvmModule << "\n"; });
     }
 
   } else {
-    if (Output == "-") {
-      module->print(outs(), flags);
-    } else {
-      std::error_code EC;
-      llvm::raw_fd_ostream out(Output, EC);
-      module->print(out, flags);
-    }
+    writeOutput([&](llvm::raw_ostream &os) { module->print(os, flags); });
   }
   return 0;
 }
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    if (std::string(argv[1]) == "-cc1") {
+      SmallVector<const char *> Argv;
+      for (int i = 0; i < argc; i++)
+        Argv.push_back(argv[i]);
+      return ExecuteCC1Tool(Argv, {});
+    }
+  }
+
+  // A server pays for registration and target initialization once, and
+  // every compile forked from it starts from that state. The warm context is
+  // the one of plain host code. Compiles that need GPU, ROCm or OpenMP
+  // dialects create their own in the forked process.
+  if (auto path = findOption(argc, argv, "serve")) {
+    warmContextDialects = {/*gpu*/ false, /*rocm*/ false, /*openmp*/ false};
+    warmContext = std::apply(createContext, warmContextDialects);
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+    return mlirclang::serve(*path, compile);
+  }
+  std::optional<StringRef> server = findOption(argc, argv, "server");
+  if (!server)
+    if (const char *env = getenv("CGEIST_SERVER"))
+      server = StringRef(env);
+  if (server && !server->empty())
+    if (std::optional<int> res =
+            mlirclang::forwardToServer(*server, argc, argv))
+      return *res;
+  return compile(argc, argv);
+}
@@ -0,0 +1,178 @@
+//===- polygeist-pgo-merge.cpp - Merge profiles of alternatives -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the 'polygeist-pgo-merge' tool, which combines the
+// profiles of the alternatives of kernels that several runs or machines
+// recorded into one, and prints the statistics of a profile together with
+// the alternatives -polygeist-alternatives-mode=pgo_opt would pick from it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "polygeist/ProfileDB.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace mlir::polygeist;
+
+static cl::list<std::string> inputFilenames(cl::Positional, cl::OneOrMore,
+                                            cl::desc("<profiles>"));
+
+static cl::opt<std::string> outputFilename("o", cl::desc("Output profile"),
+                                           cl::value_desc("filename"));
+
+static cl::opt<bool>
+    dump("dump", cl::init(false),
+         cl::desc("Print the statistics of the merged profile"));
+
+static cl::opt<bool> text(
+    "text", cl::init(false),
+    cl::desc("Read timings from text files with lines of the form "
+             "'<kernel> <problem size> <alternative> <seconds>'"));
+
+static cl::opt<double>
+    confidence("polygeist-pgo-confidence", cl::init(0.95),
+               cl::desc("Confidence the profile must give that an "
+                        "alternative is faster before it is picked over an "
+                        "earlier one"));
+
+static cl::opt<unsigned>
+    minSamples("polygeist-pgo-min-samples", cl::init(5),
+               cl::desc("Timings an alternative needs in the profile before "
+                        "it is compared with the others"));
+
+static bool readText(StringRef filename, const MemoryBuffer &buffer,
+                     pgo::ProfileDB &db) {
+  for (line_iterator line(buffer, /*SkipBlanks*/ true, '#'); !line.is_at_end();
+       ++line) {
+    SmallVector<StringRef, 4> fields;
+    line->split(fields, ' ', -1, /*KeepEmpty*/ false);
+    uint64_t size;
+    unsigned alternative;
+    double seconds;
+    if (fields.size() != 4 || fields[1].getAsInteger(10, size) ||
+        fields[2].getAsInteger(10, alternative) ||
+        fields[3].getAsDouble(seconds)) {
+      WithColor::error() << filename << ":" << line.line_number()
+                         << ": expected '<kernel> <problem size> "
+                            "<alternative> <seconds>'\n";
+      return false;
+    }
+    uint64_t kernel = pgo::getKernelId(xxHash64(fields[0]));
+    db.setName(kernel, fields[0].str());
+    db.addSample(kernel, pgo::getSizeClass(size), alternative, seconds);
+  }
+  return true;
+}
+
+/// Prints the records of every kernel in \p view, and the alternative picked
+/// for every size class and over all sizes.
+static void printStatistics(const pgo::ProfileView &view, raw_ostream &os) {
+  std::map<uint64_t, std::string> names = view.getNames();
+  for (const pgo::ProfileRecord *it = view.begin(); it != view.end();) {
+    uint64_t kernel = it->kernel;
+    auto name = names.find(kernel);
+    os << "kernel ";
+    if (name != names.end())
+      os << name->second;
+    else
+      os << format_hex(kernel, 18);
+    os << "\n";
+
+    std::vector<pgo::ProfileRecord> overall;
+    auto range = view.lookup(kernel);
+    for (; it != range.second;) {
+      uint32_t sizeClass = it->sizeClass;
+      std::vector<pgo::ProfileRecord> records;
+      for (; it != range.second && it->sizeClass == sizeClass; ++it) {
+        while (records.size() <= it->alternative)
+          records.push_back(
+              pgo::createRecord(kernel, sizeClass, records.size()));
+        records[it->alternative] = *it;
+        while (overall.size() <= it->alternative)
+          overall.push_back(pgo::createRecord(kernel, 0, overall.size()));
+        pgo::mergeRecords(overall[it->alternative], *it);
+      }
+
+      os << "  sizes ";
+      if (sizeClass)
+        os << "below " << (sizeClass < 64 ? (1ull << sizeClass) : ~0ull);
+      else
+        os << "unknown";
+      os << ": picks "
+         << pgo::selectAlternative(records, confidence, minSamples) << "\n";
+      for (const pgo::ProfileRecord &record : records) {
+        if (!record.count)
+          continue;
+        os << "    alternative " << record.alternative << ": count "
+           << record.count << ", median "
+           << format("%.3g", pgo::getMedian(record)) << ", mean "
+           << format("%.3g", record.mean) << ", stddev "
+           << format("%.3g", std::sqrt(pgo::getVariance(record))) << ", min "
+           << format("%.3g", record.min) << ", max "
+           << format("%.3g", record.max) << "\n";
+      }
+    }
+    os << "  all sizes: picks "
+       << pgo::selectAlternative(overall, confidence, minSamples) << "\n";
+  }
+}
+
+int main(int argc, char **argv) {
+  InitLLVM y(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Polygeist profile merger for alternatives\n");
+
+  pgo::ProfileDB db;
+  for (const std::string &filename : inputFilenames) {
+    auto buffer = MemoryBuffer::getFile(filename, /*IsText*/ text,
+                                        /*RequiresNullTerminator*/ text);
+    if (std::error_code error = buffer.getError()) {
+      WithColor::error() << filename << ": " << error.message() << "\n";
+      return 1;
+    }
+    if (text) {
+      if (!readText(filename, **buffer, db))
+        return 1;
+      continue;
+    }
+    pgo::ProfileView view;
+    if (!view.init((*buffer)->getBufferStart(), (*buffer)->getBufferSize())) {
+      WithColor::error() << filename << ": not a valid profile\n";
+      return 1;
+    }
+    db.merge(view);
+  }
+
+  std::string contents = db.serialize();
+  if (!outputFilename.empty()) {
+    std::error_code error;
+    ToolOutputFile output(outputFilename, error, sys::fs::OF_None);
+    if (error) {
+      WithColor::error() << outputFilename << ": " << error.message() << "\n";
+      return 1;
+    }
+    output.os() << contents;
+    output.keep();
+  }
+
+  if (dump) {
+    pgo::ProfileView view;
+    view.init(contents.data(), contents.size());
+    printStatistics(view, outs());
+  }
+  return 0;
+}